@@ -37,6 +37,9 @@
 // ----------------------------------------------------------------------
 // Definitions, type & enum declaration
 
+// Write clock of display bus, the same what freq_write of LGFX_ST7789V2_S3 is
+#define IMG_DRAW_SPI_WRITE_HZ (80000000ULL)
+
 // ----------------------------------------------------------------------
 // FreeRTOS Variables
 
@@ -68,12 +71,26 @@ StaticTimer_t xOsdUpdateTimerControlBlock;
 // Temporal storage for OSD text when converting to string
 static char gui_text_buf[128];
 
+// Stripe what is being pushed by DMA, it's released when the next transfer is started
+static JpgStripe_t* pxStripeInFlight = NULL;
+// Display bus is kept by img_chunk_draw task while stripes are coming one by one
+static bool bStripesWriteStarted = false;
+// When the top row of the frame was drawn
+static int64_t llFrameDrawStart = 0;
+// When display bus was taken for stripes
+static int64_t llBusHeldStart = 0;
+// Statistics of the frame being drawn, see @ref ''CONFIG_IMG_FRAME_DRAW_TIME_DBG_PRINTOUT''
+static uint32_t ulFrameBusHeldUs = 0;
+static uint32_t ulFrameDrawCpuUs = 0;
+static uint32_t ulFrameDrawBytes = 0;
+
 // Bunch of flags which reduce CPU cycles usage if there is nothing updated
 bool sRedrawDataRate = false;
 bool sRedrawChannelNumber = true;
 bool sRedrawRTT = false;
 bool sRedrawTxPower = true;
 bool sRedrawRSSi = false;
+bool sRedrawImgScale = false;
 
 // ----------------------------
 // Each class for each screen
@@ -124,11 +141,16 @@ static uint32_t ulOsdSyncDraw(TickType_t xTicksToSync);
 static void draw_osd_screen(void);
 
 /**
- * @brief Draw decoded chunk of from @ref image_decoder
+ * @brief Push decoded MCU row from @ref image_decoder to display by DMA
  * 
- * @param pxJpgMagicChunk Pointer to image data.
+ * @param pxStripe Pointer to image data, it's released back to decoder after transfer.
+ */
+static void draw_img_stripe(JpgStripe_t* pxStripe);
+
+/**
+ * @brief Push part of the stripe bitmap, by DMA or by CPU see @ref ''CONFIG_IMG_DRAW_STRIPES_DMA''
  */
-static void draw_img_chunk(JpgMagicChunk_t* pxJpgMagicChunk);
+static void push_img_stripe(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* pusBitmap);
 
 /**
  * @brief Draw text placeholders
@@ -205,6 +227,11 @@ vOsdUpdateCallback(memory_model_types_t xDataId)
 		break;
 	}
 
+	case MEMORY_MODEL_IMG_SCALE: {
+		sRedrawImgScale = true;
+		break;
+	}
+
 	default:
 		break;
 	}
@@ -282,6 +309,22 @@ draw_osd_screen(void)
 	sprintf(&gui_text_buf[0], "%02u", ulAvgFPS);
 	tft_oled.drawString(&gui_text_buf[0], TEXT_POS_X_FOR_FPS, TEXT_POS_Y_FOR_FPS);
 
+	if(sRedrawImgScale)
+	{
+		sRedrawImgScale = false;
+
+		uint32_t ulScale = ulMemoryModelGet(MEMORY_MODEL_IMG_SCALE);
+		if(ulScale)
+		{
+			sprintf(&gui_text_buf[0], "x%u", 1UL << ulScale);
+		}
+		else
+		{
+			sprintf(&gui_text_buf[0], "  ");
+		}
+		tft_oled.drawString(&gui_text_buf[0], TEXT_POS_X_FOR_IMG_SCALE, TEXT_POS_Y_FOR_IMG_SCALE);
+	}
+
 	sprintf(&gui_text_buf[0], "%03u", ulAvgFrameTime);
 	tft_oled.drawString(&gui_text_buf[0], TEXT_POS_X_FOR_FRAME_TIME, TEXT_POS_Y_FOR_FRAME_TIME);
 
@@ -289,23 +332,114 @@ draw_osd_screen(void)
 }
 
 static void IRAM_ATTR
-draw_img_chunk(JpgMagicChunk_t* pxJpgMagicChunk)
+push_img_stripe(int32_t x, int32_t y, int32_t w, int32_t h, const uint16_t* pusBitmap)
+{
+#if(CONFIG_IMG_DRAW_STRIPES_DMA == 1)
+	tft.pushImageDMA(x, y, w, h, pusBitmap);
+#else
+	tft.pushImage(x, y, w, h, pusBitmap);
+#endif
+}
+
+static void IRAM_ATTR
+draw_img_stripe(JpgStripe_t* pxStripe)
 {
 	PROFILE_POINT(CONFIG_IMG_CHUNK_DRAW_DBG_PROFILER, profile_point_start);
 
-	// tft.startWrite();
+	int64_t llStart = esp_timer_get_time();
+	// Stripe could be reused by decoder once it's released
+	bool bLastRow = pxStripe->usLastRow;
+
+	if(!bStripesWriteStarted)
+	{
+		tft.startWrite();
+		bStripesWriteStarted = true;
+		llBusHeldStart = llStart;
+	}
 
-	// tft.setAddrWindow(pxJpgMagicChunk->usPosX, pxJpgMagicChunk->usPosY, pxJpgMagicChunk->usW, pxJpgMagicChunk->usH);
-	// tft.pushPixelsDMA((uint16_t*)&pxJpgMagicChunk->usBitmapBuf[0], pxJpgMagicChunk->usPixels);
+	if(pxStripe->usPosY == IMG_CHUNK_POS_Y_OFS)
+	{
+		llFrameDrawStart = llStart;
+		llBusHeldStart = llStart;
+		ulFrameBusHeldUs = 0;
+		ulFrameDrawCpuUs = 0;
+		ulFrameDrawBytes = 0;
+	}
 
-	tft.setWindow(pxJpgMagicChunk->usPosX,
-	              pxJpgMagicChunk->usPosY,
-	              pxJpgMagicChunk->usPosX + pxJpgMagicChunk->usW - 1,
-	              pxJpgMagicChunk->usPosY + pxJpgMagicChunk->usH - 1);
+	ulFrameDrawBytes += pxStripe->usFilledW * pxStripe->usH * sizeof(uint16_t);
 
-	tft.writePixels((uint16_t*)&pxJpgMagicChunk->usBitmapBuf[0], pxJpgMagicChunk->usPixels);
+	if(pxStripe->usFilledW == pxStripe->usW)
+	{
+		push_img_stripe(pxStripe->usPosX,
+		                pxStripe->usPosY,
+		                pxStripe->usW,
+		                pxStripe->usH,
+		                (uint16_t*)&pxStripe->usBitmapBuf[0]);
+	}
+	else if(pxStripe->usFilledW)
+	{
+		// Broken row, only decoded part is pushed line by line as stride of the bitmap is wider
+		for(uint32_t y = 0; y < pxStripe->usH; y++)
+		{
+			push_img_stripe(pxStripe->usPosX,
+			                pxStripe->usPosY + y,
+			                pxStripe->usFilledW,
+			                1,
+			                (uint16_t*)&pxStripe->usBitmapBuf[y * pxStripe->usW]);
+		}
+	}
 
-	// tft.endWrite();
+	// DMA does one transfer at a time, so previous stripe is already sent
+	if(pxStripeInFlight)
+	{
+		vImageDecoderReleaseStripe(pxStripeInFlight);
+	}
+	pxStripeInFlight = pxStripe;
+
+	// Release display bus and the last stripe, when there is nothing to push right now
+	if(bLastRow || !xImageDecoderStripesAvailable())
+	{
+		tft.waitDMA();
+		tft.endWrite();
+		bStripesWriteStarted = false;
+
+		vImageDecoderReleaseStripe(pxStripeInFlight);
+		pxStripeInFlight = NULL;
+
+		ulFrameBusHeldUs += (uint32_t)(esp_timer_get_time() - llBusHeldStart);
+	}
+
+	int64_t llEnd = esp_timer_get_time();
+	ulFrameDrawCpuUs += (uint32_t)(llEnd - llStart);
+
+	if(bLastRow)
+	{
+		// Draw task was busy for CPU time, display bus was kept for bus held time,
+		// utilisation is time of pixel data on the wire at write clock of frame draw time.
+		ASYNC_PRINTF(CONFIG_IMG_FRAME_DRAW_TIME_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Frame draw: %uus\n",
+		             (uint32_t)(llEnd - llFrameDrawStart));
+		ASYNC_PRINTF(CONFIG_IMG_FRAME_DRAW_TIME_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Frame draw CPU: %uus\n",
+		             ulFrameDrawCpuUs);
+		ASYNC_PRINTF(CONFIG_IMG_FRAME_DRAW_TIME_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Frame draw bus held: %uus\n",
+		             ulFrameBusHeldUs);
+		ASYNC_PRINTF(CONFIG_IMG_FRAME_DRAW_TIME_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Frame draw bytes: %u\n",
+		             ulFrameDrawBytes);
+		ASYNC_PRINTF(CONFIG_IMG_FRAME_DRAW_TIME_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Frame draw SPI utilisation: %u%%\n",
+		             (llEnd > llFrameDrawStart)
+		                 ? (uint32_t)((ulFrameDrawBytes * 8ULL * 100000000ULL)
+		                              / (IMG_DRAW_SPI_WRITE_HZ * (uint64_t)(llEnd - llFrameDrawStart)))
+		                 : 0);
+	}
 
 	PROFILE_POINT(CONFIG_IMG_CHUNK_DRAW_DBG_PROFILER, profile_point_end);
 }
@@ -430,7 +564,7 @@ vImgChunkDrawTask(void* pvArg)
 	{
 		// if(ulImgChunkSyncDraw(portMAX_DELAY))
 		{
-			draw_img_chunk(pxImageDecoderGetMagicChunk());
+			draw_img_stripe(pxImageDecoderGetStripe());
 		}
 	}
 
@@ -451,7 +585,7 @@ vImgOsdDrawTask(void* pvArg)
 			sprintf(&gui_text_buf[0], "%u", ulMemoryModelGet(MEMORY_MODEL_WIFI_SCAN_CHANNEL));
 			tft_oled.drawString(&gui_text_buf[0], 32, 20);
 		}
-	} while(!xImageDecoderChunksAvailable());
+	} while(!xImageDecoderStripesAvailable());
 
 	tft_oled.clear();
 	draw_gui();
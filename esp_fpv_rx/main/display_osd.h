@@ -37,6 +37,10 @@ extern "C" {
 #define TEXT_POS_X_FOR_FPS (32)
 #define TEXT_POS_Y_FOR_FPS (96)
 
+// Upscale factor of the image, it's in the same line after FPS and empty for full size
+#define TEXT_POS_X_FOR_IMG_SCALE (48)
+#define TEXT_POS_Y_FOR_IMG_SCALE (96)
+
 #define TEXT_FOR_FRAME_TIME       ("Tfr:")
 #define TEXT_POS_X_FOR_FRAME_TIME (32)
 #define TEXT_POS_Y_FOR_FRAME_TIME (112)
@@ -29,6 +29,7 @@
 #include <esp_timer.h>
 //
 #include <assert.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -36,6 +37,26 @@
 // ----------------------------------------------------------------------
 // Definitions, type & enum declaration
 
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+// Huffman decoded MCUs in flight between decoder and IDCT tasks.
+// Must be power of 2, each one takes sizeof JMCU
+#define IMG_MCU_RING_SIZE (8)
+#define IMG_MCU_RING_MASK (IMG_MCU_RING_SIZE - 1)
+#endif
+
+#if(CONFIG_IMG_SCALE_GOVERNOR_ENABLE == 1)
+// Decoding time of single frame for the target frame rate, in us
+#define IMG_SCALE_FRAME_BUDGET (1000000UL / CONFIG_IMG_SCALE_TARGET_FPS)
+// Decoder is overloaded only if it's busy most of the time between frames,
+// otherwise frame rate is limited by the link and smaller scale doesn't help
+#define IMG_SCALE_BUSY_PERCENT (75)
+// Larger scale is restored only if it's expected to fit in this part of the budget
+#define IMG_SCALE_HEADROOM_PERCENT (70)
+// Frames what new scale is kept at least, so averages could settle down
+#define IMG_SCALE_HOLD_FRAMES (15)
+// Weight of the last frame in averages is 1/2^N
+#define IMG_SCALE_AVG_SHIFT (2)
+#endif
 
 // ----------------------------------------------------------------------
 // FreeRTOS Variables
@@ -48,11 +69,44 @@ TaskHandle_t xImgDecoderTaskHandler = NULL;
 StaticTask_t xImgDecoderTaskControlBlock;
 StackType_t xImgDecoderStack[STACK_WORDS_SIZE_FOR_TASK_IMG_DECODER];
 
-// From Decoder to Printer task
-#define IMG_CHUNKS_QUEUE_SIZE (IMG_CHUNKS_NUM)
-QueueHandle_t xImgChunksQueueHandler = NULL;
-StaticQueue_t xImgChunksQueueControlBlock;
-uint32_t xImgChunksQueueStorage[IMG_CHUNKS_QUEUE_SIZE];
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+#define STACK_WORDS_SIZE_FOR_TASK_IMG_IDCT (2048)
+#define PRIORITY_LEVEL_FOR_TASK_IMG_IDCT   (1)
+#define PINNED_CORE_FOR_TASK_IMG_IDCT      (1)
+const char* assigned_name_for_task_img_idct = "img_idct";
+TaskHandle_t xImgIdctTaskHandler = NULL;
+StaticTask_t xImgIdctTaskControlBlock;
+StackType_t xImgIdctStack[STACK_WORDS_SIZE_FOR_TASK_IMG_IDCT];
+
+// Given by Decoder when MCU ring is not empty anymore
+SemaphoreHandle_t xMcuReadySemaphore = NULL;
+StaticSemaphore_t xMcuReadySemaphoreControlBlock;
+
+// Given by IDCT task when MCU ring is not full anymore or drained
+SemaphoreHandle_t xMcuFreeSemaphore = NULL;
+StaticSemaphore_t xMcuFreeSemaphoreControlBlock;
+#endif
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+// Given by Receiver every time streamed frame gets more data or it's broken
+SemaphoreHandle_t xImgStreamSemaphore = NULL;
+StaticSemaphore_t xImgStreamSemaphoreControlBlock;
+
+// Timeout can't be 0 ticks
+#define IMG_STREAM_TIMEOUT_MS    (CONFIG_IMG_DECODER_STREAMING_TIMEOUT)
+#define IMG_STREAM_TIMEOUT_TICKS ((pdMS_TO_TICKS(IMG_STREAM_TIMEOUT_MS) > 0) ? pdMS_TO_TICKS(IMG_STREAM_TIMEOUT_MS) : 1)
+#endif
+
+// Filled stripes from Decoder to Printer task
+#define IMG_STRIPES_QUEUE_SIZE (IMG_STRIPES_NUM)
+QueueHandle_t xImgStripesQueueHandler = NULL;
+StaticQueue_t xImgStripesQueueControlBlock;
+uint32_t xImgStripesQueueStorage[IMG_STRIPES_QUEUE_SIZE];
+
+// Pushed stripes from Printer task back to Decoder
+QueueHandle_t xImgFreeStripesQueueHandler = NULL;
+StaticQueue_t xImgFreeStripesQueueControlBlock;
+uint32_t xImgFreeStripesQueueStorage[IMG_STRIPES_QUEUE_SIZE];
 
 // in ms or each 1sec.
 #define FRAME_COUNTER_TIMEOUT (1000)
@@ -72,10 +126,76 @@ uint32_t ulFrameTimeCount = 0;
 uint8_t ucImageMemoryPool[IMAGE_MEMORY_UNPACK_POOL_SIZE] __attribute__((aligned(4)));
 
 uint32_t ulInputImageDataOffset = 0UL;
+uint32_t ulInputImageDataSize = 0UL;
 uint8_t* pucInputImageDataPtr = NULL;
+// Frame is still received, so ulInputImageDataSize grows while it's decoded.
+// Always pdFALSE without CONFIG_IMG_DECODER_STREAMING.
+BaseType_t xInputImageStreamed = pdFALSE;
 
-uint32_t ulImageChunkOffset = 0;
-JpgMagicChunk_t xJpgMagicChunks[IMG_CHUNKS_NUM];
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+// Time in us what decoder spent waiting for streamed data
+uint32_t ulStreamWaitTime = 0UL;
+#endif
+
+#if(CONFIG_IMG_SCALE_GOVERNOR_ENABLE == 1)
+// Steps of the governor from full size to the smallest one, see JDEC.scale
+const uint8_t ucImageScaleSteps[] = {0, 1, 3};
+// Decoding time of each step relative to the full size in %, measured on 240x240 frames.
+// Huffman decoding is the same for every scale, so even 1/8 is not much faster.
+const uint8_t ucImageScaleCost[] = {100, 75, 35};
+
+uint32_t ulImageScaleStep = 0;
+uint32_t ulImageScaleHold = 0;
+// Averages in us
+uint32_t ulImageScaleDecodeTime = 0;
+uint32_t ulImageScaleFrameInterval = 0;
+int64_t llImageScaleLastFrame = 0;
+#endif
+
+// Decoder is prepared once per Jpg header and then it's reused for every frame
+JDEC xImageDecoder;
+JRESULT xImageDecoderState = JDR_PAR;
+uint32_t ulImageDecoderHeaderVersion = 0UL;
+// Offset of entropy coded data, right after the header
+uint32_t ulImageDecoderDataOffset = 0UL;
+
+// Pushed to display right from here by DMA, so it must be in internal RAM
+DMA_ATTR JpgStripe_t xJpgStripes[IMG_STRIPES_NUM];
+// Slices could be decoded on both cores, so each core fills it's own stripe
+JpgStripe_t* pxImageStripeWriter[portNUM_PROCESSORS] = {NULL};
+
+// Stripes pool stats of the current frame
+atomic_uint_least32_t ulStripeStalls = 0;    // How many times decoder waited for a free stripe
+atomic_uint_least32_t ulStripeDroppedMcus = 0; // MCUs what didn't get any stripe
+uint32_t ulStripePeakUsage = 0;              // Most stripes taken from the pool at once
+atomic_uint_least32_t ulStripeFullRows = 0;  // Completely decoded MCU rows, display keeps previous frame in others
+
+#if(JD_USE_RESTART_INTERVAL >= 1)
+// Restart segments of the image being decoded, every intact one is decoded as a separate slice
+wireless_rx_segments_t xSliceSegments = {0};
+// The next slice to be taken by any core
+atomic_uint_least32_t ulSliceNext = 0;
+
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+// Second decoder of the same image for IDCT task, it shares tables with the main one
+uint8_t ucImageSliceMemoryPool[JD_CLONE_POOL_SIZE] __attribute__((aligned(4)));
+JDEC xSliceDecoder;
+
+// Set while IDCT task decodes slices
+atomic_uint_least32_t ulSliceHelperBusy = 0;
+#endif
+#endif
+
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+// Single producer (Decoder task) single consumer (IDCT task) ring.
+// Head is written only by producer, Tail only by consumer.
+JMCU xMcuRing[IMG_MCU_RING_SIZE];
+atomic_uint_least32_t ulMcuRingHead = 0;
+atomic_uint_least32_t ulMcuRingTail = 0;
+
+// Valid while Decoder waits for the ring to be drained
+JDEC* pxMcuRingDecoder = NULL;
+#endif
 
 
 // ----------------------------------------------------------------------
@@ -83,9 +203,41 @@ JpgMagicChunk_t xJpgMagicChunks[IMG_CHUNKS_NUM];
 
 static uint32_t jd_input(JDEC* jdec, uint8_t* buf, uint32_t len);
 
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+static BaseType_t stream_wait_data(uint32_t ulOffset);
+#endif
+
+static uint16_t* jd_output_ptr(JDEC* jdec, JRECT* jrect, uint16_t* pusStride);
+
 static uint32_t jd_output(JDEC* jdec, void* bitmap, JRECT* jrect);
 
-static void process_received_image(void);
+static JpgStripe_t* take_stripe(JDEC* jdec, JRECT* jrect);
+
+static void send_stripe(uint32_t ulCore);
+
+static JRESULT prepare_decoder(uint32_t ulHeaderVersion);
+
+static JRESULT skip_missing_data(JDEC* jdec);
+
+static JRESULT process_received_image(void);
+
+#if(JD_USE_RESTART_INTERVAL >= 1)
+static void decode_slices_worker(JDEC* jdec);
+
+static void decode_slices(JDEC* jdec);
+#endif
+
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+static JMCU* jd_mcu_commit(JDEC* jdec, JMCU* pxMcu);
+
+static void mcu_ring_drain(void);
+
+static void vImageIdctTask(void* pvArg);
+#endif
+
+#if(CONFIG_IMG_SCALE_GOVERNOR_ENABLE == 1)
+static void image_scale_governor(int64_t llStart, uint32_t ulDecodeTime);
+#endif
 
 static void init_image_decoder_rtos(void);
 
@@ -99,54 +251,158 @@ static void vImageProcessorTask(void* pvArg);
 static uint32_t IRAM_ATTR
 jd_input(JDEC* jdec, uint8_t* buf, uint32_t len)
 {
-	if((ulInputImageDataOffset + len) > IMG_JPG_FILE_MAX_SIZE)
+	// Every decoder of the image has it's own read offset
+	uint32_t* pulOffset = (uint32_t*)jdec->device;
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	// Only the part of requested data what is already received is returned
+	if(xInputImageStreamed && (pdTRUE != stream_wait_data(*pulOffset)))
+	{
+		return 0;
+	}
+#endif
+
+	if((*pulOffset + len) > ulInputImageDataSize)
 	{
-		len = IMG_JPG_FILE_MAX_SIZE - ulInputImageDataOffset;
+		len = (*pulOffset < ulInputImageDataSize) ? (ulInputImageDataSize - *pulOffset) : 0;
 	}
 
 	if(buf)
 	{
-		memcpy(buf, &pucInputImageDataPtr[ulInputImageDataOffset], len);
+		memcpy(buf, &pucInputImageDataPtr[*pulOffset], len);
+	}
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	// Framebuffer could be given to the next frame while data was copied
+	if(xInputImageStreamed && (W_RX_STREAM_BROKEN == xWirelessGetRxStream(NULL)))
+	{
+		return 0;
 	}
-	ulInputImageDataOffset += len;
+#endif
+
+	*pulOffset += len;
 
 	return len;
 }
 
 
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+static BaseType_t IRAM_ATTR
+stream_wait_data(uint32_t ulOffset)
+{
+	int64_t llWaitStart = esp_timer_get_time();
+	BaseType_t xAvailable = pdFALSE;
+
+	for(;;)
+	{
+		wireless_rx_stream_state_t xState = xWirelessGetRxStream(&ulInputImageDataSize);
+
+		if((W_RX_STREAM_RECEIVING != xState) || (ulInputImageDataSize > ulOffset))
+		{
+			xAvailable = (W_RX_STREAM_BROKEN != xState) ? pdTRUE : pdFALSE;
+			break;
+		}
+
+		// Nothing new in time, so the rest of the frame is lost
+		if(pdTRUE != xSemaphoreTake(xImgStreamSemaphore, IMG_STREAM_TIMEOUT_TICKS))
+		{
+			break;
+		}
+	}
+
+	ulStreamWaitTime += (uint32_t)(esp_timer_get_time() - llWaitStart);
+
+	return xAvailable;
+}
+#endif
+
+
+static uint16_t* IRAM_ATTR
+jd_output_ptr(JDEC* jdec, JRECT* jrect, uint16_t* pusStride)
+{
+	JpgStripe_t* pxStripe = take_stripe(jdec, jrect);
+
+	// Whole MCU must fit, the rest is converted to workbuf and copied as much as it fits
+	if(pxStripe && ((jrect->left + jdec->msx * 8) <= pxStripe->usW) && !(pxStripe->usW & 7))
+	{
+		*pusStride = pxStripe->usW;
+		return &pxStripe->usBitmapBuf[jrect->left];
+	}
+
+	return NULL;
+}
+
+
 static uint32_t IRAM_ATTR
 jd_output(JDEC* jdec, void* bitmap, JRECT* jrect)
 {
 	PROFILE_POINT(CONFIG_JD_CHUNK_DECODE_TIME_DBG_PROFILER, profile_point_end);
 	PROFILE_POINT(CONFIG_JD_OUTPUT_DBG_PROFILER, profile_point_start);
 
-	JpgMagicChunk_t* pxJpgMagicChunk = NULL;
+	uint32_t ulScale = jdec->scale;
+	JRECT xRect = *jrect;
 
-#ifndef DECODER_QUEUE_NO_SKIPS
-	// if(uxQueueSpacesAvailable(xImgChunksQueueHandler))
-#endif
+	// Scaled MCU is upscaled back to the full size, so stripes and display don't care about scale
+	if(ulScale)
+	{
+		xRect.left = jrect->left << ulScale;
+		xRect.top = jrect->top << ulScale;
+		xRect.right = (((jrect->right + 1) << ulScale) < jdec->width) ? (((jrect->right + 1) << ulScale) - 1)
+		                                                                : (jdec->width - 1);
+		xRect.bottom = (((jrect->bottom + 1) << ulScale) < jdec->height) ? (((jrect->bottom + 1) << ulScale) - 1)
+		                                                                  : (jdec->height - 1);
+	}
+
+	JpgStripe_t* pxStripe = take_stripe(jdec, &xRect);
+
+	if(pxStripe && (xRect.left < pxStripe->usW) && (pxStripe->usH <= IMG_STRIPE_HEIGHT_MAX))
 	{
-		pxJpgMagicChunk = &xJpgMagicChunks[ulImageChunkOffset];
-		pxJpgMagicChunk->usPosX = jrect->left + IMG_CHUNK_POS_X_OFS;
-		pxJpgMagicChunk->usPosY = jrect->top + IMG_CHUNK_POS_Y_OFS;
-		pxJpgMagicChunk->usW = jrect->right + 1 - jrect->left;
-		pxJpgMagicChunk->usH = jrect->bottom + 1 - jrect->top;
-		pxJpgMagicChunk->usPixels = (pxJpgMagicChunk->usW * pxJpgMagicChunk->usH);
+		uint32_t ulRight = ((xRect.right + 1) < pxStripe->usW) ? (xRect.right + 1) : pxStripe->usW;
+		uint16_t* pusDst = &pxStripe->usBitmapBuf[xRect.left];
 
-		if(pxJpgMagicChunk->usPixels <= IMG_CHUCK_BITMAP_BUFF_SIZE)
+		// Already converted in place by jd_output_ptr, otherwise it's in workbuf with full (scaled) MCU stride
+		if(bitmap != pusDst)
 		{
-			memcpy(&pxJpgMagicChunk->usBitmapBuf[0], bitmap, pxJpgMagicChunk->usPixels * sizeof(uint16_t));
+			const uint16_t* pusSrc = (const uint16_t*)bitmap;
+			uint32_t ulSrcStride = (jdec->msx * 8) >> ulScale;
+			uint32_t ulBytes = (ulRight - xRect.left) * sizeof(uint16_t);
+
+			for(uint32_t y = 0; y < pxStripe->usH; y++)
+			{
+				if(!ulScale)
+				{
+					memcpy(pusDst, pusSrc, ulBytes);
+					pusSrc += ulSrcStride;
+				}
+				else if(y & ((1UL << ulScale) - 1))
+				{
+					// The same line of scaled MCU as above
+					memcpy(pusDst, pusDst - pxStripe->usW, ulBytes);
+				}
+				else
+				{
+					for(uint32_t x = 0; x < (ulRight - xRect.left); x++)
+					{
+						pusDst[x] = pusSrc[x >> ulScale];
+					}
+					pusSrc += ulSrcStride;
+				}
+				pusDst += pxStripe->usW;
+			}
+		}
 
-#ifdef DECODER_QUEUE_NO_SKIPS
-			xQueueSend(xImgChunksQueueHandler, &ulImageChunkOffset, portMAX_DELAY);
-#else
-			xQueueSend(xImgChunksQueueHandler, &ulImageChunkOffset, 0);
-#endif
+		pxStripe->usFilledW = ulRight;
 
-			// vImgChunkStartDraw();
-			ulImageChunkOffset = (ulImageChunkOffset + 1) & IMG_CHUNKS_MASK;
+		// Whole row is decoded
+		if(ulRight == pxStripe->usW)
+		{
+			send_stripe(xPortGetCoreID());
 		}
 	}
+	else if(!pxStripe)
+	{
+		atomic_fetch_add(&ulStripeDroppedMcus, 1);
+	}
 
 	PROFILE_POINT(CONFIG_JD_OUTPUT_DBG_PROFILER, profile_point_end);
 	PROFILE_POINT(CONFIG_JD_CHUNK_DECODE_TIME_DBG_PROFILER, profile_point_start);
@@ -155,26 +411,389 @@ jd_output(JDEC* jdec, void* bitmap, JRECT* jrect)
 }
 
 
+static JpgStripe_t* IRAM_ATTR
+take_stripe(JDEC* jdec, JRECT* jrect)
+{
+	uint32_t ulCore = xPortGetCoreID();
+	JpgStripe_t* pxStripe = pxImageStripeWriter[ulCore];
+	uint16_t usPosY = jrect->top + IMG_CHUNK_POS_Y_OFS;
+
+	// Rest of the row is lost, when the next slice or frame starts
+	if(pxStripe && ((pxStripe->usPosY != usPosY) || (!jrect->left && pxStripe->usFilledW)))
+	{
+		send_stripe(ulCore);
+		pxStripe = NULL;
+	}
+
+	// Stripe is taken only at the row start, so decoded part of it is always from the left side
+	if(!pxStripe && !jrect->left)
+	{
+		uint32_t ulStripe = IMG_STRIPES_NUM;
+
+		if(pdTRUE != xQueueReceive(xImgFreeStripesQueueHandler, &ulStripe, 0))
+		{
+			atomic_fetch_add(&ulStripeStalls, 1);
+
+#if defined(DECODER_QUEUE_NO_SKIPS) || (CONFIG_IMG_DECODER_DUAL_CORE == 1)
+			// Waiting here stalls only IDCT task, Huffman decoding goes on till the MCU ring is full
+			xQueueReceive(xImgFreeStripesQueueHandler, &ulStripe, portMAX_DELAY);
+#else
+			// Whole row is skipped if Printer task is too slow
+			ulStripe = IMG_STRIPES_NUM;
+#endif
+		}
+
+		if(ulStripe < IMG_STRIPES_NUM)
+		{
+			uint32_t ulUsage = IMG_STRIPES_NUM - uxQueueMessagesWaiting(xImgFreeStripesQueueHandler);
+			if(ulUsage > ulStripePeakUsage)
+			{
+				ulStripePeakUsage = ulUsage;
+			}
+
+			pxStripe = &xJpgStripes[ulStripe];
+			pxStripe->usPosX = IMG_CHUNK_POS_X_OFS;
+			pxStripe->usPosY = usPosY;
+			pxStripe->usW = (jdec->width < IMG_STRIPE_WIDTH_MAX) ? jdec->width : IMG_STRIPE_WIDTH_MAX;
+			pxStripe->usH = jrect->bottom + 1 - jrect->top;
+			pxStripe->usFilledW = 0;
+			pxStripe->usLastRow = ((jrect->bottom + 1) >= jdec->height);
+			pxImageStripeWriter[ulCore] = pxStripe;
+		}
+	}
+
+	return pxStripe;
+}
+
+
 static void IRAM_ATTR
-process_received_image(void)
+send_stripe(uint32_t ulCore)
+{
+	JpgStripe_t* pxStripe = pxImageStripeWriter[ulCore];
+
+	if(pxStripe)
+	{
+		uint32_t ulStripe = (uint32_t)(pxStripe - &xJpgStripes[0]);
+		pxImageStripeWriter[ulCore] = NULL;
+
+		if(pxStripe->usFilledW == pxStripe->usW)
+		{
+			atomic_fetch_add(&ulStripeFullRows, 1);
+		}
+
+		// Never blocks, there are no more stripes than the queue size
+		xQueueSend(xImgStripesQueueHandler, &ulStripe, portMAX_DELAY);
+	}
+}
+
+
+static JRESULT IRAM_ATTR
+prepare_decoder(uint32_t ulHeaderVersion)
 {
 	JRESULT jresult = JDR_OK;
-	JDEC jdec;
 
-	ulInputImageDataOffset = 0UL;
+	// Header is the same as in the previous frame, so Huffman and quantizer tables are still valid
+	if((JDR_OK != xImageDecoderState) || (ulHeaderVersion != ulImageDecoderHeaderVersion) ||
+	   (CONFIG_IMG_DECODER_REUSE_HEADER == 0))
+	{
+		ulInputImageDataOffset = 0UL;
+
+		// Analyze input data
+		jresult = jd_prepare(&xImageDecoder,
+		                     jd_input,
+		                     &ucImageMemoryPool[0],
+		                     IMAGE_MEMORY_UNPACK_POOL_SIZE,
+		                     (void*)&ulInputImageDataOffset);
+
+		ulImageDecoderHeaderVersion = ulHeaderVersion;
+		xImageDecoderState = jresult;
+
+		if(JDR_OK != jresult)
+		{
+			return jresult;
+		}
+
+		// MCUs are converted right into stripes, slice decoders get it with jd_clone
+		xImageDecoder.outptr = jd_output_ptr;
+
+		// Data after SOS what was read together with the header is not used anymore
+		ulImageDecoderDataOffset =
+		    ulInputImageDataOffset - (uint32_t)(xImageDecoder.dpend - xImageDecoder.dptr - 1);
+	}
+
+	// The rest of the frame is still received, so jd_input copies entropy coded data as it arrives.
+	// Framebuffer is not changed, so the frame could be decoded again in place if stream is broken.
+	if(xInputImageStreamed)
+	{
+		ulInputImageDataOffset = ulImageDecoderDataOffset;
+		jd_rewind(&xImageDecoder);
+		return jresult;
+	}
+
+	if(ulImageDecoderDataOffset >= ulInputImageDataSize)
+	{
+		return JDR_INP;
+	}
+
+	// Whole frame is already in the framebuffer, so it's decoded in place without input buffer
+	jd_rewind_mem(&xImageDecoder,
+	              &pucInputImageDataPtr[ulImageDecoderDataOffset],
+	              ulInputImageDataSize - ulImageDecoderDataOffset);
+
+	return jresult;
+}
+
+
+static JRESULT IRAM_ATTR
+skip_missing_data(JDEC* jdec)
+{
+	uint32_t ulIntactSize = ulWirelessGetRxIntactSize();
+
+	if(ulIntactSize >= ulInputImageDataSize)
+	{
+		return JDR_OK;
+	}
+
+	if(ulIntactSize <= ulImageDecoderDataOffset)
+	{
+		return JDR_INP;
+	}
+
+	// Everything after the first missing block would be decoded into garbage, so decoding stops there.
+	// Rows below are not pushed at all, so display keeps them from the previous frame.
+	jd_rewind_mem(jdec,
+	              &pucInputImageDataPtr[ulImageDecoderDataOffset],
+	              ulIntactSize - ulImageDecoderDataOffset);
+
+	return JDR_OK;
+}
+
+
+static JRESULT IRAM_ATTR
+process_received_image(void)
+{
+	JRESULT jresult = JDR_OK;
+	JDEC* pxJdec = &xImageDecoder;
 
 	PROFILE_POINT(CONFIG_JD_DECODE_DBG_PROFILER, profile_point_start);
 
-	// Analyze input data
-	jresult = jd_prepare(&jdec, jd_input, &ucImageMemoryPool[0], IMAGE_MEMORY_UNPACK_POOL_SIZE, 0);
+	ulInputImageDataSize = ulWirelessGetRxFrameSize();
+	jresult = prepare_decoder(ulWirelessGetRxHeaderVersion());
 
+#if(CONFIG_IMG_SCALE_GOVERNOR_ENABLE == 1)
+	// Slice decoder gets it with jd_clone
+	pxJdec->scale = ucImageScaleSteps[ulImageScaleStep];
+#endif
+
+#if(JD_USE_RESTART_INTERVAL >= 1)
+	// Transmitter inserts restart markers, so only broken slices are lost and display keeps previous frame there.
+	// Segments of streamed frame are not known yet, so it's decoded in order.
+	if((JDR_OK == jresult) && pxJdec->nrst && !xInputImageStreamed)
+	{
+		decode_slices(pxJdec);
+	}
+	else
+#endif
 	if(JDR_OK == jresult)
 	{
-		jd_decomp(&jdec, jd_output);
+		// Streamed frame is stopped by jd_input at the first gap
+		if(!xInputImageStreamed)
+		{
+			jresult = skip_missing_data(pxJdec);
+		}
+
+		if(JDR_OK == jresult)
+		{
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+			pxMcuRingDecoder = pxJdec;
+			jresult = jd_decomp_mcus(pxJdec, jd_mcu_commit);
+			// IDCT task still uses jdec and input buffer, even if frame is broken
+			mcu_ring_drain();
+			pxMcuRingDecoder = NULL;
+#else
+			jresult = jd_decomp(pxJdec, jd_output);
+#endif
+		}
+	}
+
+	// Every core is done with the frame, so partially decoded rows are shown too
+	for(uint32_t ulCore = 0; ulCore < portNUM_PROCESSORS; ulCore++)
+	{
+		send_stripe(ulCore);
+	}
+
+	ASYNC_PRINTF(CONFIG_IMG_STRIPES_STATS_DBG_PRINTOUT,
+	             async_print_type_u32,
+	             "Stripe stalls: %u\n",
+	             atomic_exchange(&ulStripeStalls, 0));
+	ASYNC_PRINTF(CONFIG_IMG_STRIPES_STATS_DBG_PRINTOUT,
+	             async_print_type_u32,
+	             "Stripe dropped MCUs: %u\n",
+	             atomic_exchange(&ulStripeDroppedMcus, 0));
+	ASYNC_PRINTF(CONFIG_IMG_STRIPES_STATS_DBG_PRINTOUT, async_print_type_u32, "Stripes peak: %u\n", ulStripePeakUsage);
+	ulStripePeakUsage = 0;
+
+	uint32_t ulFullRows = atomic_exchange(&ulStripeFullRows, 0);
+	if(JDR_OK == xImageDecoderState)
+	{
+		uint32_t ulRows = (pxJdec->height + pxJdec->msy * 8 - 1) / (pxJdec->msy * 8);
+		ASYNC_PRINTF(CONFIG_IMG_CONCEALED_ROWS_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Rows kept from previous frame: %u\n",
+		             (ulRows > ulFullRows) ? (ulRows - ulFullRows) : 0);
 	}
 
 	PROFILE_POINT(CONFIG_JD_DECODE_DBG_PROFILER, profile_point_end);
+
+	return jresult;
+}
+
+
+#if(JD_USE_RESTART_INTERVAL >= 1)
+static void IRAM_ATTR
+decode_slices_worker(JDEC* jdec)
+{
+	uint32_t ulSlice = 0;
+
+	while((ulSlice = atomic_fetch_add(&ulSliceNext, 1)) < IMG_JPG_SEGMENTS_MAX_NUM)
+	{
+		if(!(xSliceSegments.ulIntactMap & (1UL << ulSlice)))
+		{
+			continue;
+		}
+
+		uint32_t ulOffset = xSliceSegments.usSegmentOffset[ulSlice];
+
+		if(ulOffset >= ulInputImageDataSize)
+		{
+			continue;
+		}
+
+		jd_rewind_mem(jdec, &pucInputImageDataPtr[ulOffset], ulInputImageDataSize - ulOffset);
+		jd_decomp_slice(jdec, jd_output, (uint16_t)ulSlice);
+	}
+}
+
+
+static void IRAM_ATTR
+decode_slices(JDEC* jdec)
+{
+	vWirelessGetRxSegments(&xSliceSegments);
+	atomic_store(&ulSliceNext, 0);
+
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+	// IDCT task is idle between frames, so it takes every other slice
+	if(JDR_OK == jd_clone(&xSliceDecoder,
+	                      jdec,
+	                      &ucImageSliceMemoryPool[0],
+	                      sizeof(ucImageSliceMemoryPool),
+	                      NULL))
+	{
+		atomic_store(&ulSliceHelperBusy, 1);
+		xSemaphoreGive(xMcuReadySemaphore);
+	}
+#endif
+
+	decode_slices_worker(jdec);
+
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+	// Slice decoder and input buffer are used by IDCT task till it's done
+	while(atomic_load(&ulSliceHelperBusy))
+	{
+		xSemaphoreTake(xMcuFreeSemaphore, portMAX_DELAY);
+	}
+#endif
 }
+#endif
+
+
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+static JMCU* IRAM_ATTR
+jd_mcu_commit(JDEC* jdec, JMCU* pxMcu)
+{
+	(void)jdec;
+	uint32_t ulHead = atomic_load_explicit(&ulMcuRingHead, memory_order_relaxed);
+
+	if(pxMcu)
+	{
+		PROFILE_POINT(CONFIG_JD_HUFFMAN_STAGE_DBG_PROFILER, profile_point_end);
+
+		atomic_store(&ulMcuRingHead, ++ulHead);
+
+		// IDCT task may sleep only on empty ring
+		if((ulHead - atomic_load(&ulMcuRingTail)) == 1)
+		{
+			xSemaphoreGive(xMcuReadySemaphore);
+		}
+	}
+
+	while((ulHead - atomic_load(&ulMcuRingTail)) >= IMG_MCU_RING_SIZE)
+	{
+		xSemaphoreTake(xMcuFreeSemaphore, portMAX_DELAY);
+	}
+
+	PROFILE_POINT(CONFIG_JD_HUFFMAN_STAGE_DBG_PROFILER, profile_point_start);
+
+	return &xMcuRing[ulHead & IMG_MCU_RING_MASK];
+}
+
+
+static void IRAM_ATTR
+mcu_ring_drain(void)
+{
+	while(atomic_load(&ulMcuRingTail) != atomic_load_explicit(&ulMcuRingHead, memory_order_relaxed))
+	{
+		xSemaphoreTake(xMcuFreeSemaphore, portMAX_DELAY);
+	}
+}
+#endif
+
+
+#if(CONFIG_IMG_SCALE_GOVERNOR_ENABLE == 1)
+static void
+image_scale_governor(int64_t llStart, uint32_t ulDecodeTime)
+{
+	uint32_t ulInterval = llImageScaleLastFrame ? (uint32_t)(llStart - llImageScaleLastFrame) : ulDecodeTime;
+	llImageScaleLastFrame = llStart;
+
+	ulImageScaleDecodeTime += (ulDecodeTime >> IMG_SCALE_AVG_SHIFT) - (ulImageScaleDecodeTime >> IMG_SCALE_AVG_SHIFT);
+	ulImageScaleFrameInterval +=
+	    (ulInterval >> IMG_SCALE_AVG_SHIFT) - (ulImageScaleFrameInterval >> IMG_SCALE_AVG_SHIFT);
+
+	if(ulImageScaleHold)
+	{
+		--ulImageScaleHold;
+		return;
+	}
+
+	uint32_t ulStep = ulImageScaleStep;
+
+	if((ulImageScaleDecodeTime > IMG_SCALE_FRAME_BUDGET) &&
+	   ((ulImageScaleDecodeTime * 100) > (ulImageScaleFrameInterval * IMG_SCALE_BUSY_PERCENT)) &&
+	   ((ulStep + 1) < sizeof(ucImageScaleSteps)))
+	{
+		++ulStep;
+	}
+	else if(ulStep && (((ulImageScaleDecodeTime * ucImageScaleCost[ulStep - 1]) / ucImageScaleCost[ulStep]) * 100 <
+	                   (IMG_SCALE_FRAME_BUDGET * IMG_SCALE_HEADROOM_PERCENT)))
+	{
+		--ulStep;
+	}
+
+	if(ulStep != ulImageScaleStep)
+	{
+		// Expected time of the new scale, till it's measured
+		ulImageScaleDecodeTime = (ulImageScaleDecodeTime * ucImageScaleCost[ulStep]) / ucImageScaleCost[ulImageScaleStep];
+		ulImageScaleStep = ulStep;
+		ulImageScaleHold = IMG_SCALE_HOLD_FRAMES;
+
+		vMemoryModelSet(MEMORY_MODEL_IMG_SCALE, ucImageScaleSteps[ulStep]);
+
+		ASYNC_PRINTF(
+		    CONFIG_IMG_SCALE_DBG_PRINTOUT, async_print_type_u32, "Image scale 1/%u\n", 1UL << ucImageScaleSteps[ulStep]);
+	}
+}
+#endif
 
 
 static void
@@ -189,9 +808,27 @@ init_image_decoder_rtos(void)
 	assert(xFrameCounterTimer);
 
 
-	xImgChunksQueueHandler = xQueueCreateStatic(
-	    IMG_CHUNKS_QUEUE_SIZE, sizeof(uint32_t), (uint8_t*)(&xImgChunksQueueStorage[0]), &xImgChunksQueueControlBlock);
-	assert(xImgChunksQueueHandler);
+	xImgStripesQueueHandler = xQueueCreateStatic(IMG_STRIPES_QUEUE_SIZE,
+	                                             sizeof(uint32_t),
+	                                             (uint8_t*)(&xImgStripesQueueStorage[0]),
+	                                             &xImgStripesQueueControlBlock);
+	assert(xImgStripesQueueHandler);
+
+	xImgFreeStripesQueueHandler = xQueueCreateStatic(IMG_STRIPES_QUEUE_SIZE,
+	                                                 sizeof(uint32_t),
+	                                                 (uint8_t*)(&xImgFreeStripesQueueStorage[0]),
+	                                                 &xImgFreeStripesQueueControlBlock);
+	assert(xImgFreeStripesQueueHandler);
+
+	for(uint32_t ulStripe = 0; ulStripe < IMG_STRIPES_NUM; ulStripe++)
+	{
+		xQueueSend(xImgFreeStripesQueueHandler, &ulStripe, 0);
+	}
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	xImgStreamSemaphore = xSemaphoreCreateBinaryStatic(&xImgStreamSemaphoreControlBlock);
+	assert(xImgStreamSemaphore);
+#endif
 
 
 	xImgDecoderTaskHandler = xTaskCreateStaticPinnedToCore((TaskFunction_t)(vImageProcessorTask),
@@ -203,24 +840,51 @@ init_image_decoder_rtos(void)
 	                                                       &xImgDecoderTaskControlBlock,
 	                                                       (BaseType_t)PINNED_CORE_FOR_TASK_IMG_DECODER);
 	assert(xImgDecoderTaskHandler);
+
+
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+	xMcuReadySemaphore = xSemaphoreCreateBinaryStatic(&xMcuReadySemaphoreControlBlock);
+	assert(xMcuReadySemaphore);
+
+	xMcuFreeSemaphore = xSemaphoreCreateBinaryStatic(&xMcuFreeSemaphoreControlBlock);
+	assert(xMcuFreeSemaphore);
+
+	xImgIdctTaskHandler = xTaskCreateStaticPinnedToCore((TaskFunction_t)(vImageIdctTask),
+	                                                    assigned_name_for_task_img_idct,
+	                                                    STACK_WORDS_SIZE_FOR_TASK_IMG_IDCT,
+	                                                    NULL,
+	                                                    PRIORITY_LEVEL_FOR_TASK_IMG_IDCT,
+	                                                    xImgIdctStack,
+	                                                    &xImgIdctTaskControlBlock,
+	                                                    (BaseType_t)PINNED_CORE_FOR_TASK_IMG_IDCT);
+	assert(xImgIdctTaskHandler);
+#endif
 }
 
 // ----------------------------------------------------------------------
 // Accessors functions
 
-JpgMagicChunk_t* IRAM_ATTR
-pxImageDecoderGetMagicChunk(void)
+JpgStripe_t* IRAM_ATTR
+pxImageDecoderGetStripe(void)
+{
+	uint32_t ulStripe = 0;
+	xQueueReceive(xImgStripesQueueHandler, &ulStripe, portMAX_DELAY);
+	return &xJpgStripes[ulStripe];
+}
+
+
+void IRAM_ATTR
+vImageDecoderReleaseStripe(JpgStripe_t* pxStripe)
 {
-	uint32_t ulChunkOffset = 0;
-	xQueueReceive(xImgChunksQueueHandler, &ulChunkOffset, portMAX_DELAY);
-	return &xJpgMagicChunks[ulChunkOffset];
+	uint32_t ulStripe = (uint32_t)(pxStripe - &xJpgStripes[0]);
+	xQueueSend(xImgFreeStripesQueueHandler, &ulStripe, portMAX_DELAY);
 }
 
 
 BaseType_t IRAM_ATTR
-xImageDecoderChunksAvailable(void)
+xImageDecoderStripesAvailable(void)
 {
-	return (uxQueueSpacesAvailable(xImgChunksQueueHandler) == IMG_CHUNKS_QUEUE_SIZE) ? pdFALSE : pdTRUE;
+	return (uxQueueSpacesAvailable(xImgStripesQueueHandler) == IMG_STRIPES_QUEUE_SIZE) ? pdFALSE : pdTRUE;
 }
 
 void
@@ -229,6 +893,14 @@ vImageProcessorStartDecode(void)
 	xTaskNotifyGive(xImgDecoderTaskHandler);
 }
 
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+void IRAM_ATTR
+vImageProcessorStreamUpdate(void)
+{
+	xSemaphoreGive(xImgStreamSemaphore);
+}
+#endif
+
 
 // ----------------------------------------------------------------------
 // FreeRTOS functions
@@ -248,6 +920,7 @@ vImageProcessorTask(void* pvArg)
 {
 	(void)pvArg;
 	int64_t fr_start = 0, fr_end = 0;
+	JRESULT jresult = JDR_OK;
 
 	task_sync_get_bits(TASK_SYNC_EVENT_BIT_IMG_PROCESS);
 
@@ -262,17 +935,59 @@ vImageProcessorTask(void* pvArg)
 		if(ulTaskNotifyTake(pdTRUE, portMAX_DELAY))
 		{
 			pucInputImageDataPtr = pucWirelessTakeCurrentRxBuffer();
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+			// Nothing is ready, so start with the frame what is still in the air
+			if(!pucInputImageDataPtr)
+			{
+				pucInputImageDataPtr = pucWirelessTakeStreamRxBuffer();
+				xInputImageStreamed = pucInputImageDataPtr ? pdTRUE : pdFALSE;
+				ulStreamWaitTime = 0UL;
+			}
+#endif
+
+			// Newer frame was already taken with previous notification
+			if(!pucInputImageDataPtr)
+			{
+				continue;
+			}
+
 			// Tell to Transmitter: "JPG is accepted, now send the next frame"
-			xWirelessSendEvent(W_MSG_EVENT_FRAME_RECEIVED);
+			// Streamed frame is accepted by Receiver once it's last block is received
+			if(!xInputImageStreamed)
+			{
+				xWirelessSendEvent(W_MSG_EVENT_FRAME_RECEIVED);
+			}
 
 			fr_start = esp_timer_get_time();
-			process_received_image();
+			jresult = process_received_image();
 			fr_end = esp_timer_get_time();
 
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+			if(xInputImageStreamed)
+			{
+				xInputImageStreamed = pdFALSE;
+				vWirelessReleaseStreamRxBuffer((JDR_OK == jresult) ? pdTRUE : pdFALSE);
+
+				// Broken stream is decoded again once the frame is ready, so it's counted then
+				if(JDR_OK != jresult)
+				{
+					continue;
+				}
+
+				// Transmitter adapts to decoding time, not to the airtime
+				fr_start += ulStreamWaitTime;
+			}
+#endif
+
 			// Accumulate FPS and Frame time
 			ulFrameTimeCount += (uint32_t)((fr_end - fr_start) / 1000);
 			++ulFramesCount;
 
+#if(CONFIG_IMG_SCALE_GOVERNOR_ENABLE == 1)
+			image_scale_governor(fr_start, (uint32_t)(fr_end - fr_start));
+#endif
+
 			// How much time did decoding take
 			ASYNC_PRINTF(
 			    CONFIG_IMAGE_DECODE_TIME_DBG_PRINTOUT, async_print_type_u32, "ulFrameTimeCount: %ums\n", ulFrameTimeCount);
@@ -282,6 +997,53 @@ vImageProcessorTask(void* pvArg)
 	vTaskDelete(NULL);
 }
 
+#if(CONFIG_IMG_DECODER_DUAL_CORE == 1)
+static void
+vImageIdctTask(void* pvArg)
+{
+	(void)pvArg;
+
+	ASYNC_PRINTF(CONFIG_ENABLE_TASK_START_EVENT_DBG_PRINTOUT, async_print_type_str, assigned_name_for_task_img_idct, 0);
+
+	for(;;)
+	{
+		xSemaphoreTake(xMcuReadySemaphore, portMAX_DELAY);
+
+		uint32_t ulTail = atomic_load_explicit(&ulMcuRingTail, memory_order_relaxed);
+		uint32_t ulHead = 0;
+
+		while(ulTail != (ulHead = atomic_load(&ulMcuRingHead)))
+		{
+			PROFILE_POINT(CONFIG_JD_IDCT_STAGE_DBG_PROFILER, profile_point_start);
+
+			jd_output_mcu(pxMcuRingDecoder, &xMcuRing[ulTail & IMG_MCU_RING_MASK], jd_output);
+
+			PROFILE_POINT(CONFIG_JD_IDCT_STAGE_DBG_PROFILER, profile_point_end);
+
+			atomic_store(&ulMcuRingTail, ++ulTail);
+
+			// Decoder may sleep on full ring or while waiting for the end of the frame
+			if(((ulHead - ulTail) == (IMG_MCU_RING_SIZE - 1)) || (ulHead == ulTail))
+			{
+				xSemaphoreGive(xMcuFreeSemaphore);
+			}
+		}
+
+#if(JD_USE_RESTART_INTERVAL >= 1)
+		if(atomic_load(&ulSliceHelperBusy))
+		{
+			decode_slices_worker(&xSliceDecoder);
+
+			atomic_store(&ulSliceHelperBusy, 0);
+			xSemaphoreGive(xMcuFreeSemaphore);
+		}
+#endif
+	}
+
+	vTaskDelete(NULL);
+}
+#endif
+
 
 // ----------------------------------------------------------------------
 // Core functions
@@ -289,5 +1051,7 @@ vImageProcessorTask(void* pvArg)
 void
 init_image_decoder(void)
 {
+	assert(xMemoryModelRegisterItem(MEMORY_MODEL_IMG_SCALE));
+
 	init_image_decoder_rtos();
 }
\ No newline at end of file
@@ -16,17 +16,20 @@ extern "C" {
 // ----------------------------------------------------------------------
 // Definitions, type & enum declaration
 
-// TODO: BD-0002 replace magic number for IMG chunk size.
-#define IMG_CHUCK_BITMAP_BUFF_SIZE (256)
+// Whole MCU row of decoded image, it's pushed to display by single DMA transfer.
+// Wider images are cut on the right side.
+#define IMG_STRIPE_WIDTH_MAX  (240)
+#define IMG_STRIPE_HEIGHT_MAX (16)
 typedef struct
 {
-	uint16_t usPosX;
+	uint16_t usPosX;    // Left-top position on the screen
 	uint16_t usPosY;
-	uint16_t usPixels;
-	uint16_t usW;
-	uint16_t usH;
-	uint16_t usBitmapBuf[IMG_CHUCK_BITMAP_BUFF_SIZE];
-} JpgMagicChunk_t;
+	uint16_t usW;       // Width of the row, it is also a line stride of usBitmapBuf
+	uint16_t usH;       // Height of MCU row
+	uint16_t usFilledW; // Decoded part of each line, less than usW if the rest of row is broken
+	uint16_t usLastRow; // Set for the bottom row of the image
+	uint16_t usBitmapBuf[IMG_STRIPE_WIDTH_MAX * IMG_STRIPE_HEIGHT_MAX];
+} JpgStripe_t;
 
 
 // This values for 240x240(280)
@@ -34,10 +37,9 @@ typedef struct
 #define IMG_CHUNK_POS_X_OFS (20)
 #define IMG_CHUNK_POS_Y_OFS (0)
 
-// Amount of small decoded blocks of image provided from jd_output decoder
-// Be careful, each chunk use sizeof JpgMagicChunk_t
-#define IMG_CHUNKS_NUM  (32)
-#define IMG_CHUNKS_MASK (IMG_CHUNKS_NUM - 1)
+// Amount of stripes, so each core what outputs decoded MCUs could fill one,
+// while another one is pushed by DMA. Be careful, each stripe use sizeof JpgStripe_t
+#define IMG_STRIPES_NUM (4)
 
 // Do not change this, it is the minimum size in bytes of the workspace needed by the decoder
 #define IMAGE_MEMORY_UNPACK_POOL_SIZE (TJPGD_WORKSPACE_SIZE)
@@ -57,13 +59,18 @@ extern uint32_t ulAvgFPS;
 // ----------------------------------------------------------------------
 // Accessors functions
 
-JpgMagicChunk_t *pxImageDecoderGetMagicChunk(void);
+JpgStripe_t *pxImageDecoderGetStripe(void);
 
-// uint32_t ulImageDecoderGetChunk(void);
-BaseType_t xImageDecoderChunksAvailable(void);
+void vImageDecoderReleaseStripe(JpgStripe_t *pxStripe);
+
+BaseType_t xImageDecoderStripesAvailable(void);
 
 void vImageProcessorStartDecode(void);
 
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+void vImageProcessorStreamUpdate(void);
+#endif
+
 // ----------------------------------------------------------------------
 // Core functions
 
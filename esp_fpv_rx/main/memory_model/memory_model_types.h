@@ -21,6 +21,8 @@ typedef enum
 	MEMORY_MODEL_WIFI_RTT_VALUE,
 	MEMORY_MODEL_DATA_RX_RATE,
 	MEMORY_MODEL_WIFI_RX_RSSI,
+	MEMORY_MODEL_IMG_GRAYSCALE,
+	MEMORY_MODEL_IMG_SCALE,
 	MEMORY_MODEL_TOTAL,
 	MEMORY_MODEL_EMPTY = 0xffffffff
 } memory_model_types_t;
@@ -25,12 +25,19 @@
 
 #include "tjpgd.h"
 
+#include <debug_tools_esp.h>
 #include <esp_attr.h>
 
 
 static uint8_t jd_workbuf[768];
 static jd_yuv_t jd_mcubuf[384];
 
+#if JD_FASTDECODE == 2
+#define HUFF_BIT  10 /* Bit length to apply fast huffman decode */
+#define HUFF_LEN  (1 << HUFF_BIT)
+#define HUFF_MASK (HUFF_LEN - 1)
+#endif
+
 
 /*-----------------------------------------------*/
 /* Zigzag-order to raster-order conversion table */
@@ -257,12 +264,99 @@ create_huffman_tbl(                     /* 0:OK, !0:Failed */
 
 		memcpy(pd, data += 16, np); /* Load decoded data corresponds to each code ward */
 		data += np;
+
+#if JD_FASTDECODE == 2
+		/* Create fast huffman decode table: bit length and decoded data of each code up to HUFF_BIT bits,
+		/  0 where next code is longer and has to be searched */
+		uint16_t* tbl = (uint16_t*)alloc_pool(jd, HUFF_LEN * sizeof(uint16_t));
+		if(!tbl)
+			return JDR_MEM1; /* Err: not enough memory */
+		jd->hufflut[num][cls] = tbl;
+		memset(tbl, 0, HUFF_LEN * sizeof(uint16_t));
+		ph = jd->huffcode[num][cls] + 1;
+		for(size_t i = 0; i < HUFF_BIT; ++i)
+		{
+			for(b = pb[i]; b; b--, ph++, pd++)
+			{
+				if(*ph >> (i + 1))
+					continue; /* Overflown code of broken table, never matched by huffext() too */
+				uint_fast16_t ti = *ph << (HUFF_BIT - 1 - i);
+				uint_fast16_t td = ((i + 1) << 8) | *pd;
+				for(uint_fast16_t span = 1 << (HUFF_BIT - 1 - i); span; span--)
+					tbl[ti++] = (uint16_t)td;
+			}
+		}
+#endif
 	} while(ndata -= 17 + np);
 
 	return JDR_OK;
 }
 
 
+/*-----------------------------------------------------------------------*/
+/* Re-fill input buffer                                                  */
+/*-----------------------------------------------------------------------*/
+/* Returns end of the data at top of input buffer, so there is no more   */
+/* data if it's the same as jd->inbuf. Stream in memory is never         */
+/* re-filled, see jd_rewind_mem().                                       */
+
+static inline uint8_t* IRAM_ATTR
+fill_inbuf(JDEC* jd /* Pointer to the decompressor object */
+)
+{
+	if(jd->memsrc)
+		return jd->inbuf;
+
+	return jd->inbuf + jd->infunc(jd, jd->inbuf, JD_SZBUF);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Peek and skip bits straight in the input buffer                       */
+/*-----------------------------------------------------------------------*/
+/* Takes unread bits of current byte and two following ones, so there   */
+/* are 16 bits at least. Fails when bytes are not in the buffer yet or   */
+/* one of them is a flag, bit by bit functions below handle these.       */
+
+#if JD_FASTDECODE == 2
+static inline __attribute__((always_inline)) uint_fast8_t
+peek_bits(                /* Number of bits in the window, 0:Not available */
+          JDEC* jd,       /* Pointer to the decompressor object */
+          uint32_t* win   /* Bits from MSB of the window to LSB */
+)
+{
+	const uint8_t* dp = jd->dptr;
+	uint_fast8_t msk = jd->dbit;
+
+	if(dp + 2 >= jd->dpend || dp[1] == 0xFF || dp[2] == 0xFF)
+		return 0;
+
+	*win = ((uint32_t)(dp[0] & ((1 << msk) - 1)) << 16) | ((uint32_t)dp[1] << 8) | dp[2];
+	return msk + 16;
+}
+
+
+static inline __attribute__((always_inline)) void
+skip_bits(JDEC* jd,          /* Pointer to the decompressor object */
+          uint_fast8_t nbit  /* Number of bits to skip, up to bits in window of peek_bits() */
+)
+{
+	uint_fast8_t msk = jd->dbit;
+
+	if(nbit <= msk)
+	{
+		jd->dbit = msk - nbit;
+	}
+	else
+	{ /* Leave read ptr at the last byte touched, same as bit by bit functions do */
+		nbit -= msk;
+		jd->dptr += (nbit + 7) >> 3;
+		jd->dbit = (8 - (nbit & 7)) & 7;
+	}
+}
+#endif
+
+
 /*-----------------------------------------------------------------------*/
 /* Extract a huffman decoded data from input stream                      */
 /*-----------------------------------------------------------------------*/
@@ -289,7 +383,7 @@ huffext(                    /* >=0: decoded data, <0: error code */
 			if(++dp == dpend)
 			{                 /* No input data is available, re-fill input buffer */
 				dp = jd->inbuf; /* Top of input buffer */
-				jd->dpend = dpend = dp + jd->infunc(jd, dp, JD_SZBUF);
+				jd->dpend = dpend = fill_inbuf(jd);
 				if(dp == dpend)
 					return 0 - (int_fast16_t)JDR_INP; /* Err: read error or wrong stream termination */
 			}
@@ -300,7 +394,7 @@ huffext(                    /* >=0: decoded data, <0: error code */
 				if(++dp == dpend)
 				{                 /* No input data is available, re-fill input buffer */
 					dp = jd->inbuf; /* Top of input buffer */
-					jd->dpend = dpend = dp + jd->infunc(jd, dp, JD_SZBUF);
+					jd->dpend = dpend = fill_inbuf(jd);
 					if(dp == dpend)
 						return 0 - (int_fast16_t)JDR_INP; /* Err: read error or wrong stream termination */
 				}
@@ -334,6 +428,34 @@ huffext_match:
 }
 
 
+#if JD_FASTDECODE == 2
+static inline __attribute__((always_inline)) int_fast16_t
+huffext_fast(                     /* >=0: decoded data, <0: error code */
+             JDEC* jd,            /* Pointer to the decompressor object */
+             const uint16_t* tbl, /* Pointer to the fast huffman decode table */
+             const uint8_t* hb,   /* Pointer to the bit distribution table */
+             const uint16_t* hc,  /* Pointer to the code word table */
+             const uint8_t* hd    /* Pointer to the data table */
+)
+{
+	uint32_t w;
+	uint_fast8_t n = peek_bits(jd, &w);
+
+	if(n)
+	{
+		uint_fast16_t td = tbl[(w >> (n - HUFF_BIT)) & HUFF_MASK];
+		if(td)
+		{ /* Short code is found in the table */
+			skip_bits(jd, td >> 8);
+			return td & 0xFF;
+		}
+	}
+
+	return huffext(jd, hb, hc, hd); /* Long code, or window is not available */
+}
+#endif
+
+
 /*-----------------------------------------------------------------------*/
 /* Extract N bits from input stream                                      */
 /*-----------------------------------------------------------------------*/
@@ -344,6 +466,16 @@ bitext(                  /* >=0: extracted data, <0: error code */
        int_fast16_t nbit /* Number of bits to extract (1 to 11) */
 )
 {
+#if JD_FASTDECODE == 2
+	uint32_t win;
+	uint_fast8_t n = peek_bits(jd, &win);
+	if(n)
+	{
+		skip_bits(jd, nbit);
+		return (win >> (n - nbit)) & ((1 << nbit) - 1);
+	}
+#endif
+
 	uint_fast8_t msk = jd->dbit;
 	uint8_t* dp = jd->dptr;
 	uint32_t w = *dp;
@@ -356,7 +488,7 @@ bitext(                  /* >=0: extracted data, <0: error code */
 			if(++dp == dpend)
 			{                 /* No input data is available, re-fill input buffer */
 				dp = jd->inbuf; /* Top of input buffer */
-				dpend = dp + jd->infunc(jd, dp, JD_SZBUF);
+				dpend = fill_inbuf(jd);
 				if(dp == dpend)
 					return 0 - (int_fast16_t)JDR_INP; /* Err: read error or wrong stream termination */
 				jd->dpend = dpend;
@@ -368,7 +500,7 @@ bitext(                  /* >=0: extracted data, <0: error code */
 				if(++dp == dpend)
 				{                 /* No input data is available, re-fill input buffer */
 					dp = jd->inbuf; /* Top of input buffer */
-					dpend = dp + jd->infunc(jd, dp, JD_SZBUF);
+					dpend = fill_inbuf(jd);
 					if(dp == dpend)
 						return 0 - (int_fast16_t)JDR_INP; /* Err: read error or wrong stream termination */
 					jd->dpend = dpend;
@@ -401,26 +533,26 @@ restart(JDEC* jd,          /* Pointer to the decompressor object */
 	uint_fast16_t d;
 	uint8_t *dp, *dpend;
 
-	/* Discard padding bits and get two bytes from the input stream */
+	/* Discard padding bits and skip fill bytes till any RSTn or EOI marker */
 	dp = jd->dptr;
 	dpend = jd->dpend;
 	d = 0;
-	for(size_t i = 0; i < 2; i++)
+	do
 	{
 		if(++dp == dpend)
 		{ /* No input data is available, re-fill input buffer */
 			dp = jd->inbuf;
-			jd->dpend = dpend = dp + jd->infunc(jd, dp, JD_SZBUF);
+			jd->dpend = dpend = fill_inbuf(jd);
 			if(dp == dpend)
 				return JDR_INP;
 		}
-		d = (d << 8) | *dp; /* Get a byte */
-	}
+		d = ((d << 8) | *dp) & 0xFFFF; /* Get a byte */
+	} while((d & 0xFFF8) != 0xFFD0 && d != 0xFFD9);
 	jd->dptr = dp;
 	jd->dbit = 0;
 
 	/* Check the marker */
-	if((d & 0xFFD8) != 0xFFD0 || (d & 7) != (rstn & 7))
+	if(d == 0xFFD9 || (d & 7) != (rstn & 7))
 	{
 		return JDR_FMT1; /* Err: expected RSTn marker is not detected (may be collapted data) */
 	}
@@ -436,9 +568,22 @@ restart(JDEC* jd,          /* Pointer to the decompressor object */
 /* Apply Inverse-DCT in Arai Algorithm (see also aa_idct.png)            */
 /*-----------------------------------------------------------------------*/
 
-static void IRAM_ATTR
-block_idct(int32_t* src, /* Input block data (de-quantized and pre-scaled for Arai Algorithm) */
-           jd_yuv_t* dst /* Pointer to the destination to store the block as byte array */
+/* Non zero coefficients of the block are only in the top-left corner
+/  of this size, see mcu_load_block() */
+#define JD_IDCT_DC   0 /* Only DC element */
+#define JD_IDCT_2X2  1
+#define JD_IDCT_4X4  2
+#define JD_IDCT_FULL 3
+
+/* Transform 8 elements what are `pitch` apart, elements from n-th one
+/  are zero and they are not read. n must be a constant, so arithmetic
+/  on zeros is dropped by compiler and the result is the same as full one. */
+static inline __attribute__((always_inline)) void
+idct_1d(const int32_t* src, /* Input elements */
+        uint_fast8_t pitch, /* Distance between elements */
+        uint_fast8_t n,     /* Amount of leading elements what could be non zero */
+        int32_t dc,         /* Added to the first element */
+        int32_t* out        /* 8 transformed values */
 )
 {
 	const int32_t M13 = (int32_t)(1.41421 * 256);
@@ -448,136 +593,280 @@ block_idct(int32_t* src, /* Input block data (de-quantized and pre-scaled for Ar
 	int32_t v0, v1, v2, v3, v4, v5, v6, v7;
 	int32_t t10, t11, t12, t13;
 
-	/* Process columns */
-	for(size_t i = 0; i < 8; ++i)
+	/* Get and Process the even elements */
+	t12 = src[pitch * 0] + dc;
+	t10 = (n > 4) ? src[pitch * 4] : 0;
+	t10 += t12;
+	t12 = (t12 << 1) - t10;
+
+	t11 = (n > 2) ? src[pitch * 2] : 0;
+	t13 = (n > 6) ? src[pitch * 6] : 0;
+	t13 += t11;
+	t11 = (t11 << 1) - t13;
+	t11 = t11 * M13 >> 8;
+	t11 -= t13;
+
+	v0 = t10 + t13;
+	v3 = t10 - t13;
+	v1 = t12 + t11;
+	v2 = t12 - t11;
+
+	/* Get and Process the odd elements */
+	v4 = (n > 1) ? src[pitch * 1] : 0;
+	v5 = (n > 7) ? src[pitch * 7] : 0;
+	v5 += v4;
+	v4 = (v4 << 1) - v5;
+
+	v7 = (n > 3) ? src[pitch * 3] : 0;
+	v6 = (n > 5) ? src[pitch * 5] : 0;
+	v6 -= v7;
+	v7 = (v7 << 1) + v6;
+	v7 += v5;
+
+	t13 = v4 + v6;
+	t13 *= F5;
+	v6 = v6 * M4 >> 8;
+	v6 += v7;
+	v6 = t13 - v6;
+	v5 = (v5 << 1) - v7;
+	v5 = v5 * M13 >> 8;
+	v5 -= v6;
+	v4 *= F2;
+	v4 += v5;
+	v4 = t13 - v4;
+
+	out[0] = v0 + v7;
+	out[7] = v0 - v7;
+	out[1] = v1 + v6;
+	out[6] = v1 - v6;
+	out[2] = v2 + v5;
+	out[5] = v2 - v5;
+	out[3] = v3 + v4;
+	out[4] = v3 - v4;
+}
+
+
+/* Non zero coefficients are only in n x n top-left corner, n must be a constant */
+static inline __attribute__((always_inline)) void
+block_idct_n(int32_t* src,  /* Input block data (de-quantized and pre-scaled for Arai Algorithm) */
+             jd_yuv_t* dst, /* Pointer to the destination to store the block as byte array */
+             uint_fast8_t n /* Size of the corner */
+)
+{
+	int32_t out[8];
+
+	/* Process columns, the rest of them stay zero */
+	for(size_t i = 0; i < n; ++i)
 	{
-		/* Get and Process the even elements */
-		t12 = src[8 * 0];
-		t10 = src[8 * 4];
-		t10 += t12;
-		t12 = (t12 << 1) - t10;
-
-		t11 = src[8 * 2];
-		t13 = src[8 * 6];
-		t13 += t11;
-		t11 = (t11 << 1) - t13;
-		t11 = t11 * M13 >> 8;
-		t11 = t11 - t13;
-
-		v0 = t10 + t13;
-		v3 = t10 - t13;
-		v1 = t12 + t11;
-		v2 = t12 - t11;
-
-		/* Get and Process the odd elements */
-		v4 = src[8 * 1];
-		v5 = src[8 * 7];
-		v5 += v4;
-		v4 = (v4 << 1) - v5;
-
-		v7 = src[8 * 3];
-		v6 = src[8 * 5];
-		v6 -= v7;
-		v7 = (v7 << 1) + v6;
-		v7 += v5;
-
-		t13 = v4 + v6;
-		t13 *= F5;
-		v6 = v6 * M4 >> 8;
-		v6 += v7;
-		v6 = t13 - v6;
-		v5 = (v5 << 1) - v7;
-		v5 = v5 * M13 >> 8;
-		v5 -= v6;
-		v4 *= F2;
-		v4 += v5;
-		v4 = t13 - v4;
+		idct_1d(src + i, 8, n, 0, out);
 
 		/* Write-back transformed values */
-		src[8 * 0] = v0 + v7;
-		src[8 * 7] = v0 - v7;
-		src[8 * 1] = v1 + v6;
-		src[8 * 6] = v1 - v6;
-		src[8 * 2] = v2 + v5;
-		src[8 * 5] = v2 - v5;
-		src[8 * 3] = v3 + v4;
-		src[8 * 4] = v3 - v4;
-
-		++src; /* Next column */
+		for(size_t k = 0; k < 8; ++k)
+		{
+			src[8 * k + i] = out[k];
+		}
 	}
 
 	/* Process rows */
-	src -= 8;
 	for(size_t i = 0; i < 8; ++i)
 	{
-		/* Get and Process the even elements */
-		t12 = src[0] + (128L << 8); /* remove DC offset (-128) here */
-		t10 = src[4];
-		t10 += t12;
-		t12 = (t12 << 1) - t10;
-
-		t11 = src[2];
-		t13 = src[6];
-		t13 += t11;
-		t11 = (t11 << 1) - t13;
-		t11 = t11 * M13 >> 8;
-		t11 -= t13;
-
-		v0 = t10 + t13;
-		v3 = t10 - t13;
-		v1 = t12 + t11;
-		v2 = t12 - t11;
-
-		/* Get and Process the odd elements */
-		v4 = src[1];
-		v5 = src[7];
-		v5 += v4;
-		v4 = (v4 << 1) - v5;
-
-		v7 = src[3];
-		v6 = src[5];
-		v6 -= v7;
-		v7 = (v7 << 1) + v6;
-		v7 += v5;
-
-		t13 = v4 + v6;
-		t13 *= F5;
-		v6 = v6 * M4 >> 8;
-		v6 += v7;
-		v6 = t13 - v6;
-		v5 = (v5 << 1) - v7;
-		v5 = v5 * M13 >> 8;
-		v5 -= v6;
-		v4 *= F2;
-		v4 += v5;
-		v4 = t13 - v4;
+		idct_1d(src, 1, n, 128L << 8, out); /* remove DC offset (-128) here */
 
 		/* Descale the transformed values 8 bits and output */
+		for(size_t k = 0; k < 8; ++k)
+		{
 #if JD_FASTDECODE >= 1
-		dst[0] = (int16_t)((v0 + v7) >> 8);
-		dst[7] = (int16_t)((v0 - v7) >> 8);
-		dst[1] = (int16_t)((v1 + v6) >> 8);
-		dst[6] = (int16_t)((v1 - v6) >> 8);
-		dst[2] = (int16_t)((v2 + v5) >> 8);
-		dst[5] = (int16_t)((v2 - v5) >> 8);
-		dst[3] = (int16_t)((v3 + v4) >> 8);
-		dst[4] = (int16_t)((v3 - v4) >> 8);
+			dst[k] = (int16_t)(out[k] >> 8);
 #else
-		dst[0] = BYTECLIP((v0 + v7) >> 8);
-		dst[7] = BYTECLIP((v0 - v7) >> 8);
-		dst[1] = BYTECLIP((v1 + v6) >> 8);
-		dst[6] = BYTECLIP((v1 - v6) >> 8);
-		dst[2] = BYTECLIP((v2 + v5) >> 8);
-		dst[5] = BYTECLIP((v2 - v5) >> 8);
-		dst[3] = BYTECLIP((v3 + v4) >> 8);
-		dst[4] = BYTECLIP((v3 - v4) >> 8);
+			dst[k] = BYTECLIP(out[k] >> 8);
 #endif
+		}
 		dst += 8;
 		src += 8; /* Next row */
 	}
 }
 
 
+static void IRAM_ATTR
+block_idct(int32_t* src, /* Input block data (de-quantized and pre-scaled for Arai Algorithm) */
+           jd_yuv_t* dst /* Pointer to the destination to store the block as byte array */
+)
+{
+	block_idct_n(src, dst, 8);
+}
+
+
+static void IRAM_ATTR
+block_idct_4x4(int32_t* src, jd_yuv_t* dst)
+{
+	block_idct_n(src, dst, 4);
+}
+
+
+static void IRAM_ATTR
+block_idct_2x2(int32_t* src, jd_yuv_t* dst)
+{
+	block_idct_n(src, dst, 2);
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Extract and de-quantize single block of an MCU                        */
+/*-----------------------------------------------------------------------*/
+
+static int_fast16_t IRAM_ATTR
+mcu_load_block(                    /* >=0:IDCT size JD_IDCT_*, <0:Error code */
+               JDEC* jd,           /* Pointer to the decompressor object */
+               uint_fast8_t cmp,   /* Component number 0:Y, 1:Cb, 2:Cr */
+               int32_t* tmp        /* Block working buffer for de-quantize and IDCT */
+)
+{
+	int_fast16_t b, d, e = 0;
+	uint_fast8_t i, z, zmap = 0;
+	const uint8_t *hb, *hd;
+	const uint16_t* hc;
+	uint_fast8_t id = cmp ? 1 : 0; /* Huffman table ID of the component */
+
+	/* Extract a DC element from input stream */
+	hb = jd->huffbits[id][0]; /* Huffman table for the DC element */
+	hc = jd->huffcode[id][0];
+	hd = jd->huffdata[id][0];
+#if JD_FASTDECODE == 2
+	b = huffext_fast(jd, jd->hufflut[id][0], hb, hc, hd); /* Extract a huffman coded data (bit length) */
+#else
+	b = huffext(jd, hb, hc, hd); /* Extract a huffman coded data (bit length) */
+#endif
+	if(b < 0)
+		return b;         /* Err: invalid code or input */
+	d = jd->dcv[cmp]; /* DC value of previous block */
+	if(b)
+	{                    /* If there is any difference from previous block */
+		e = bitext(jd, b); /* Extract data bits */
+		if(e < 0)
+			return e;         /* Err: input */
+		b = 1 << (b - 1); /* MSB position */
+		if(!(e & b))
+			e -= (b << 1) - 1; /* Restore sign if needed */
+		d += e;              /* Get current value */
+		jd->dcv[cmp] = d;    /* Save current DC value for next block */
+	}
+	const int32_t* dqf = jd->qttbl[jd->qtid[cmp]]; /* De-quantizer table ID for this component */
+	tmp[0] = d * dqf[0] >> 8; /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+
+	/* Extract following 63 AC elements from input stream, with 1/8 output they are only skipped */
+#if JD_USE_SCALE
+	const uint_fast8_t dconly = (jd->scale == 3);
+#else
+	const uint_fast8_t dconly = 0;
+#endif
+	if(!dconly)
+		memset(&tmp[1], 0, 4 * 63); /* Clear rest of elements */
+	hb = jd->huffbits[id][1];   /* Huffman table for the AC elements */
+	hc = jd->huffcode[id][1];
+	hd = jd->huffdata[id][1];
+	i = 1; /* Top of the AC elements */
+	do
+	{
+#if JD_FASTDECODE == 2
+		b = huffext_fast(jd, jd->hufflut[id][1], hb, hc, hd); /* Extract zero runs and bit length */
+#else
+		b = huffext(jd, hb, hc, hd); /* Extract a huffman coded value (zero runs and bit length) */
+#endif
+		if(b == 0)
+			break; /* EOB? */
+		if(b < 0)
+			return b; /* Err: invalid code or input error */
+		i += b >> 4;
+		if(i > 63)
+			return 0 - (int_fast16_t)JDR_FMT1; /* Err: zero run is out of the block (may be collapted data) */
+		if(b &= 0x0F)
+		{                    /* Bit length */
+			d = bitext(jd, b); /* Extract data bits */
+			if(d < 0)
+				return d;         /* Err: input device */
+			if(dconly)
+				continue;         /* Data bits are dropped */
+			b = 1 << (b - 1); /* MSB position */
+			if(!(d & b))
+				d -= (b << 1) - 1;      /* Restore negative value if needed */
+			z = ZIG(i);               /* Zigzag-order to raster-order converted index */
+			tmp[z] = d * dqf[z] >> 8; /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+			zmap |= z;                /* Bits of row (5..3) and column (2..0) of all elements */
+		}
+	} while(++i != 64); /* Next AC element */
+
+	if(i == 1)
+		return JD_IDCT_DC; /* EOB right after DC means there is no AC element */
+	if(!(zmap & 0x36))
+		return JD_IDCT_2X2; /* Row and column are less than 2 */
+	if(!(zmap & 0x24))
+		return JD_IDCT_4X4; /* Row and column are less than 4 */
+	return JD_IDCT_FULL;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Apply IDCT to single de-quantized block                               */
+/*-----------------------------------------------------------------------*/
+
+static void IRAM_ATTR
+mcu_block_idct(int32_t* tmp,      /* De-quantized block, used as working buffer */
+               jd_yuv_t* bp,      /* Pointer to the destination block in MCU buffer */
+               uint_fast8_t size /* IDCT size JD_IDCT_* from mcu_load_block() */
+)
+{
+	if(size == JD_IDCT_DC)
+	{ /* If no AC element, IDCT can be ommited and the block is filled with DC value */
+		jd_yuv_t d = (jd_yuv_t)((*tmp >> 8) + 128); /* Descaled like IDCT does, negative DC is floored */
+		if(JD_FASTDECODE >= 1)
+		{
+			for(uint_fast8_t i = 0; i < 64; bp[i++] = d)
+				;
+		}
+		else
+		{
+			memset(bp, d, 64);
+		}
+	}
+	else if(size == JD_IDCT_2X2)
+	{
+		block_idct_2x2(tmp, bp); /* Only low frequencies, zero elements are skipped */
+	}
+	else if(size == JD_IDCT_4X4)
+	{
+		block_idct_4x4(tmp, bp);
+	}
+	else
+	{
+		block_idct(tmp, bp); /* Apply IDCT and store the block to the MCU buffer */
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Limit IDCT size to the output scaling ratio                           */
+/*-----------------------------------------------------------------------*/
+/* Only every n-th pixel of the block is output, so frequencies above    */
+/* (8 >> scale) are dropped and smaller corner is transformed. With 1/8  */
+/* it's only DC element, what is the mean of the block.                  */
+
+static inline __attribute__((always_inline)) uint_fast8_t
+mcu_idct_size(JDEC* jd, uint_fast8_t size /* IDCT size JD_IDCT_* from mcu_load_block() */
+)
+{
+#if !JD_USE_SPARSE_IDCT
+	size = JD_IDCT_FULL; /* Zero elements are transformed too */
+#endif
+#if JD_USE_SCALE
+	if(size > JD_IDCT_FULL - jd->scale)
+		size = JD_IDCT_FULL - jd->scale;
+#else
+	(void)jd;
+#endif
+	return size;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /* Load all blocks in an MCU into working buffer                         */
 /*-----------------------------------------------------------------------*/
@@ -588,96 +877,223 @@ mcu_load(JDEC* jd,     /* Pointer to the decompressor object */
          int32_t* tmp  /* Block working buffer for de-quantize and IDCT */
 )
 {
-	int_fast16_t b, d, e = 0;
-	uint_fast8_t blk, nby, nbc, i, z = 0;
-	const uint8_t *hb, *hd;
-	const uint16_t* hc;
+	uint_fast8_t blk, nby, nbc;
 
-	nby = jd->msx * jd->msy; /* Number of Y blocks (1, 2 or 4) */
-	nbc = 2;                 /* Number of C blocks (2) */
+	nby = jd->msx * jd->msy;         /* Number of Y blocks (1, 2 or 4) */
+	nbc = (jd->ncomp == 3) ? 2 : 0; /* Number of C blocks (2, or 0 if grayscale) */
 
 	for(blk = 0; blk < nby + nbc; blk++)
 	{
 		uint_fast8_t cmp = (blk < nby) ? 0 : blk - nby + 1; /* Component number 0:Y, 1:Cb, 2:Cr */
-		uint_fast8_t id = cmp ? 1 : 0;                      /* Huffman table ID of the component */
+		int_fast16_t size = mcu_load_block(jd, cmp, tmp);
+		if(size < 0)
+			return (JRESULT)(-size);
 
-		/* Extract a DC element from input stream */
-		hb = jd->huffbits[id][0]; /* Huffman table for the DC element */
-		hc = jd->huffcode[id][0];
-		hd = jd->huffdata[id][0];
-		b = huffext(jd, hb, hc, hd); /* Extract a huffman coded data (bit length) */
-		if(b < 0)
-			return (JRESULT)(-b); /* Err: invalid code or input */
-		d = jd->dcv[cmp];       /* DC value of previous block */
-		if(b)
-		{                    /* If there is any difference from previous block */
-			e = bitext(jd, b); /* Extract data bits */
-			if(e < 0)
-				return (JRESULT)(-e); /* Err: input */
-			b = 1 << (b - 1);       /* MSB position */
-			if(!(e & b))
-				e -= (b << 1) - 1; /* Restore sign if needed */
-			d += e;              /* Get current value */
-			jd->dcv[cmp] = d;    /* Save current DC value for next block */
-		}
-		const int32_t* dqf = jd->qttbl[jd->qtid[cmp]]; /* De-quantizer table ID for this component */
-		tmp[0] = d * dqf[0] >> 8; /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
+		mcu_block_idct(tmp, bp, mcu_idct_size(jd, size));
+		bp += 64; /* Next block */
+	}
 
-		/* Extract following 63 AC elements from input stream */
-		memset(&tmp[1], 0, 4 * 63); /* Clear rest of elements */
-		hb = jd->huffbits[id][1];   /* Huffman table for the AC elements */
-		hc = jd->huffcode[id][1];
-		hd = jd->huffdata[id][1];
-		i = 1; /* Top of the AC elements */
-		do
-		{
-			b = huffext(jd, hb, hc, hd); /* Extract a huffman coded value (zero runs and bit length) */
-			if(b == 0)
-				break; /* EOB? */
-			if(b < 0)
-				return (JRESULT)(-b); /* Err: invalid code or input error */
-			i += b >> 4;
-			if(b &= 0x0F)
-			{                    /* Bit length */
-				d = bitext(jd, b); /* Extract data bits */
-				if(d < 0)
-					return (JRESULT)(-d); /* Err: input device */
-				b = 1 << (b - 1);       /* MSB position */
-				if(!(d & b))
-					d -= (b << 1) - 1;      /* Restore negative value if needed */
-				z = ZIG(i);               /* Zigzag-order to raster-order converted index */
-				tmp[z] = d * dqf[z] >> 8; /* De-quantize, apply scale factor of Arai algorithm and descale 8 bits */
-			}
-		} while(++i != 64); /* Next AC element */
+	return JDR_OK; /* All blocks have been loaded successfully */
+}
 
-		if(z == 1)
-		{ /* If no AC element or scale ratio is 1/8, IDCT can be ommited and the block is filled with DC value */
-			d = (jd_yuv_t)((*tmp / 256) + 128);
-			if(JD_FASTDECODE >= 1)
-			{
-				for(i = 0; i < 64; bp[i++] = d)
-					;
-			}
-			else
+
+/*-----------------------------------------------------------------------*/
+/* Load de-quantized coefficients of all blocks in an MCU                */
+/*-----------------------------------------------------------------------*/
+
+static JRESULT IRAM_ATTR
+mcu_load_coef(JDEC* jd, /* Pointer to the decompressor object */
+              JMCU* mcu /* Where to store coefficients */
+)
+{
+	uint_fast8_t blk, nby, nbc;
+
+	nby = jd->msx * jd->msy;         /* Number of Y blocks (1, 2 or 4) */
+	nbc = (jd->ncomp == 3) ? 2 : 0; /* Number of C blocks (2, or 0 if grayscale) */
+	mcu->idctmap = 0;
+
+	for(blk = 0; blk < nby + nbc; blk++)
+	{
+		uint_fast8_t cmp = (blk < nby) ? 0 : blk - nby + 1; /* Component number 0:Y, 1:Cb, 2:Cr */
+		int_fast16_t size = mcu_load_block(jd, cmp, &mcu->coef[blk][0]);
+		if(size < 0)
+			return (JRESULT)(-size);
+
+		mcu->idctmap |= (uint16_t)(size << (blk * 2));
+	}
+
+	return JDR_OK;
+}
+
+
+#if JD_FORMAT == 1
+
+/*-----------------------------------------------------------------------*/
+/* Convert YCbCr MCU straight to byte swapped RGB565                     */
+/*-----------------------------------------------------------------------*/
+
+/* Fixed point coefficients, scaled up 20 bits. Results are truncated toward zero,
+/  so they are the same as float math in previous version for chroma in -512..511 range,
+/  except G for 32 of 1M Cb/Cr pairs where float rounding differs by 1 */
+#define YCC_FIX_SHIFT 20
+#define YCC_FIX_RR    1470105 /* 1.402 */
+#define YCC_FIX_GB    360857  /* 0.34414 */
+#define YCC_FIX_GR    748830  /* 0.71414 */
+#define YCC_FIX_BB    1858078 /* 1.772 */
+
+/* Products are summed as unsigned, so chroma of broken data wraps around instead of signed overflow */
+#define YCC_FIX_MUL(c, k) ((uint32_t)(c) * (k))
+#define YCC_FIX_TRUNC(u)  (((int32_t)(u) + (((int32_t)(u) >> 31) & ((1 << YCC_FIX_SHIFT) - 1))) >> YCC_FIX_SHIFT)
+
+#define RGB565_SWAPPED(r, g, b) \
+	(uint16_t)(((r) & 0xF8) | ((g) >> 5) | (((g) & 0x1C) << 11) | (((b) & 0xF8) << 5))
+
+static inline __attribute__((always_inline)) void
+mcu_yuv_to_rgb565(const jd_yuv_t* mcubuf,
+                  uint16_t* dst,
+                  const uint_fast16_t stride, /* Pixels from line to line in dst */
+                  const int8_t* btbase,
+                  const uint_fast8_t ixshift, /* 1 if MCU is two blocks wide */
+                  const uint_fast8_t iyshift  /* 1 if MCU is two blocks high */
+)
+{
+	const uint_fast16_t mx = 8 << ixshift;
+	const uint_fast16_t my = 8 << iyshift;
+
+	for(uint_fast16_t iy = 0; iy < my; iy++)
+	{
+		const int8_t* btbl = &btbase[(iy & 3) << 3];
+		const jd_yuv_t* py = &mcubuf[((iy & 8) + iy) << 3];
+		const jd_yuv_t* pc = &mcubuf[((mx << iyshift) + (iy >> iyshift)) << 3];
+
+		for(uint_fast16_t ix = 0; ix < mx; ix += 8)
+		{
+			for(uint_fast8_t i = 0; i < 8; i += 1 << ixshift)
 			{
-				memset(bp, d, 64);
+				int32_t cb = pc[0] - 128; /* Get Cb/Cr component and restore right level */
+				int32_t cr = pc[64] - 128;
+				++pc;
+
+				/* Convert CbCr to RGB, shared by all Y of the same chroma sample */
+				int32_t rr = YCC_FIX_TRUNC(YCC_FIX_MUL(cr, YCC_FIX_RR));
+				int32_t gg = YCC_FIX_TRUNC(YCC_FIX_MUL(cb, YCC_FIX_GB) + YCC_FIX_MUL(cr, YCC_FIX_GR));
+				int32_t bb = YCC_FIX_TRUNC(YCC_FIX_MUL(cb, YCC_FIX_BB));
+
+				int32_t yy = btbl[i] + py[i];
+				*dst++ = RGB565_SWAPPED(BYTECLIP(yy + rr), BYTECLIP(yy - gg), BYTECLIP(yy + bb));
+
+				if(ixshift)
+				{
+					yy = btbl[i + 1] + py[i + 1];
+					*dst++ = RGB565_SWAPPED(BYTECLIP(yy + rr), BYTECLIP(yy - gg), BYTECLIP(yy + bb));
+				}
 			}
+
+			py += 64; /* Next Y block of double block width */
 		}
-		else
+		dst += stride - mx;
+	}
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Expand grayscale MCU to byte swapped RGB565                           */
+/*-----------------------------------------------------------------------*/
+
+#define GRAY565(v)    RGB565_SWAPPED((v), (v), (v))
+#define GRAY565_X8(v) GRAY565(v), GRAY565(v + 1), GRAY565(v + 2), GRAY565(v + 3), \
+                      GRAY565(v + 4), GRAY565(v + 5), GRAY565(v + 6), GRAY565(v + 7)
+
+/* Clipped Y to RGB565 pixel, there is no chroma to add */
+// clang-format off
+static const uint16_t DRAM_ATTR Gray565[256] = {
+	GRAY565_X8(0),   GRAY565_X8(8),   GRAY565_X8(16),  GRAY565_X8(24),  GRAY565_X8(32),  GRAY565_X8(40),
+	GRAY565_X8(48),  GRAY565_X8(56),  GRAY565_X8(64),  GRAY565_X8(72),  GRAY565_X8(80),  GRAY565_X8(88),
+	GRAY565_X8(96),  GRAY565_X8(104), GRAY565_X8(112), GRAY565_X8(120), GRAY565_X8(128), GRAY565_X8(136),
+	GRAY565_X8(144), GRAY565_X8(152), GRAY565_X8(160), GRAY565_X8(168), GRAY565_X8(176), GRAY565_X8(184),
+	GRAY565_X8(192), GRAY565_X8(200), GRAY565_X8(208), GRAY565_X8(216), GRAY565_X8(224), GRAY565_X8(232),
+	GRAY565_X8(240), GRAY565_X8(248)
+};
+// clang-format on
+
+static inline __attribute__((always_inline)) void
+mcu_y_to_rgb565(const jd_yuv_t* mcubuf, /* Single Y block */
+                uint16_t* dst,
+                const uint_fast16_t stride, /* Pixels from line to line in dst */
+                const int8_t* btbase)
+{
+	for(uint_fast8_t iy = 0; iy < 8; iy++)
+	{
+		const int8_t* btbl = &btbase[(iy & 3) << 3];
+		const jd_yuv_t* py = &mcubuf[iy << 3];
+
+		for(uint_fast8_t i = 0; i < 8; i++)
 		{
-			block_idct(tmp, bp); /* Apply IDCT and store the block to the MCU buffer */
+			dst[i] = Gray565[BYTECLIP(btbl[i] + py[i])];
 		}
-
-		bp += 64; /* Next block */
+		dst += stride;
 	}
+}
 
-	return JDR_OK; /* All blocks have been loaded successfully */
+
+#if JD_USE_SCALE
+/*-----------------------------------------------------------------------*/
+/* Convert every n-th pixel of MCU to byte swapped RGB565                */
+/*-----------------------------------------------------------------------*/
+
+static void IRAM_ATTR
+mcu_scaled_to_rgb565(JDEC* jd, /* Pointer to the decompressor object */
+                     const jd_yuv_t* mcubuf,
+                     uint16_t* dst, /* Scaled MCU, lines are packed one by one */
+                     const int8_t* btbase)
+{
+	const uint_fast8_t step = 1 << jd->scale;
+	const uint_fast8_t ixshift = jd->msx - 1;
+	const uint_fast8_t iyshift = jd->msy - 1;
+	const uint_fast16_t mx = jd->msx * 8;
+	const uint_fast16_t my = jd->msy * 8;
+
+	for(uint_fast16_t iy = 0; iy < my; iy += step)
+	{
+		const int8_t* btbl = &btbase[((iy >> jd->scale) & 3) << 3];
+		const jd_yuv_t* py = &mcubuf[((iy & 8) + iy) << 3];
+		const jd_yuv_t* pc = &mcubuf[((mx << iyshift) + (iy >> iyshift)) << 3];
+
+		for(uint_fast16_t ix = 0; ix < mx; ix += step)
+		{
+			int32_t yy = btbl[(ix >> jd->scale) & 7] + py[((ix & 8) << 3) + (ix & 7)];
+
+			if(jd->ncomp == 1)
+			{
+				*dst++ = Gray565[BYTECLIP(yy)];
+				continue;
+			}
+
+			int32_t cb = pc[ix >> ixshift] - 128; /* Get Cb/Cr component and restore right level */
+			int32_t cr = pc[(ix >> ixshift) + 64] - 128;
+
+			int32_t rr = YCC_FIX_TRUNC(YCC_FIX_MUL(cr, YCC_FIX_RR));
+			int32_t gg = YCC_FIX_TRUNC(YCC_FIX_MUL(cb, YCC_FIX_GB) + YCC_FIX_MUL(cr, YCC_FIX_GR));
+			int32_t bb = YCC_FIX_TRUNC(YCC_FIX_MUL(cb, YCC_FIX_BB));
+
+			*dst++ = RGB565_SWAPPED(BYTECLIP(yy + rr), BYTECLIP(yy - gg), BYTECLIP(yy + bb));
+		}
+	}
 }
+#endif /* JD_USE_SCALE */
+
+#endif /* JD_FORMAT == 1 */
 
 
 /*-----------------------------------------------------------------------*/
 /* Output an MCU: Convert YCrCb to RGB and output it in RGB form         */
 /*-----------------------------------------------------------------------*/
+/* RGB565 output can be converted right to the frame memory: outptr()    */
+/* is given output rect and returns where its left-top pixel goes and    */
+/* line stride in pixels, room for whole MCU is needed. If it returns    */
+/* NULL, workbuf is used. outfunc() gets that pointer anyway.            */
+/* Scaled MCU always goes to workbuf with packed lines, and rect is in   */
+/* the scaled image then.                                                */
 
 static JRESULT IRAM_ATTR
 mcu_output(JDEC* jd, /* Pointer to the decompressor object */
@@ -688,20 +1104,75 @@ mcu_output(JDEC* jd, /* Pointer to the decompressor object */
            uint_fast16_t y                            /* MCU position in the image (top of the MCU) */
 )
 {
-	uint_fast16_t ix, iy, mx, my, rx, ry;
-	jd_yuv_t *py, *pc;
+	uint_fast16_t mx, my, rx, ry;
 	JRECT rect;
 
 	mx = jd->msx * 8;
 	my = jd->msy * 8;                                /* MCU size (pixel) */
-	rx = (x + mx <= jd->width) ? mx : jd->width - x; /* Output rectangular size (it may be clipped at right/bottom end) */
-	ry = (y + my <= jd->height) ? my : jd->height - y;
+	rx = ((int32_t)(x + mx) <= jd->width) ? mx : jd->width - x; /* Output rectangular size (it may be clipped at right/bottom end) */
+	ry = ((int32_t)(y + my) <= jd->height) ? my : jd->height - y;
 
 	rect.left = x;
 	rect.right = x + rx - 1; /* Rectangular area in the frame buffer */
 	rect.top = y;
 	rect.bottom = y + ry - 1;
 
+#if JD_FORMAT == 1
+	/* Each layout gets it's own copy with constant loop bounds.
+	/  Clipped MCU at right/bottom edge keeps full MCU stride, same as before */
+	const int8_t* btbase = Bayer[jd->bayer];
+	uint16_t* dst = (uint16_t*)workbuf;
+	uint16_t stride = mx;
+
+#if JD_USE_SCALE
+	if(jd->scale)
+	{ /* Partial MCU at right/bottom end keeps at least one pixel */
+		rect.left = x >> jd->scale;
+		rect.right = rect.left + ((rx + (1 << jd->scale) - 1) >> jd->scale) - 1;
+		rect.top = y >> jd->scale;
+		rect.bottom = rect.top + ((ry + (1 << jd->scale) - 1) >> jd->scale) - 1;
+
+		mcu_scaled_to_rgb565(jd, mcubuf, dst, btbase);
+		return outfunc(jd, workbuf, &rect) ? JDR_OK : JDR_INTR;
+	}
+#endif
+
+	if(jd->outptr)
+	{ /* Convert right to the place where the MCU goes, if there is one */
+		uint16_t* p = jd->outptr(jd, &rect, &stride);
+		if(p)
+			workbuf = (uint8_t*)(dst = p);
+		else
+			stride = mx;
+	}
+
+	PROFILE_POINT(CONFIG_JD_COLOR_CONVERT_DBG_PROFILER, profile_point_start);
+
+	if(jd->ncomp == 1)
+	{
+		mcu_y_to_rgb565(mcubuf, dst, stride, btbase); /* Grayscale, chroma is not converted at all */
+	}
+	else if(mx == 16)
+	{
+		if(my == 16)
+		{
+			mcu_yuv_to_rgb565(mcubuf, dst, stride, btbase, 1, 1); /* H2V2, 4:2:0 */
+		}
+		else
+		{
+			mcu_yuv_to_rgb565(mcubuf, dst, stride, btbase, 1, 0); /* H2V1, 4:2:2 */
+		}
+	}
+	else
+	{
+		mcu_yuv_to_rgb565(mcubuf, dst, stride, btbase, 0, 0); /* H1V1, 4:4:4 */
+	}
+
+	PROFILE_POINT(CONFIG_JD_COLOR_CONVERT_DBG_PROFILER, profile_point_end);
+#else
+	uint_fast16_t ix, iy;
+	jd_yuv_t *py, *pc;
+
 	static const float frr = 1.402;
 	static const float fgr = 0.71414;
 	static const float fgb = 0.34414;
@@ -782,23 +1253,9 @@ mcu_output(JDEC* jd, /* Pointer to the decompressor object */
 	// 	}
 	// }
 
-	/* Convert RGB888 to RGB565 if needed */
-	if(JD_FORMAT == 1)
-	{
-		uint8_t* s = (uint8_t*)workbuf;
-		uint16_t w, *d = (uint16_t*)s;
-		unsigned int n = rx * ry;
-
-		do
-		{
-			w = (*s++ & 0xF8) << 8;     // RRRRR-----------
-			w |= (*s++ & 0xFC) << 3;    // -----GGGGGG-----
-			w |= *s++ >> 3;             // -----------BBBBB
-			*d++ = (w << 8) | (w >> 8); // Swap bytes
-		} while(--n);
-	}
+#endif /* JD_FORMAT == 1 */
 
-	/* Output the RGB rectangular */
+	/* Output the RGB rectangular, it's already in place if it was given by outptr() */
 	return outfunc(jd, workbuf, &rect) ? JDR_OK : JDR_INTR;
 }
 
@@ -827,6 +1284,12 @@ jd_prepare(JDEC* jd,
 	jd->infunc = infunc;   /* Stream input function */
 	jd->device = dev;      /* I/O device identifier */
 	jd->nrst = 0;          /* No restart interval (default) */
+	jd->scale = 0;         /* No output scaling (default) */
+	jd->ncomp = 0;         /* Not known till SOF0 */
+	jd->memsrc = 0;        /* Header is read with input function */
+	jd->outptr = 0;        /* RGB output goes to workbuf (default) */
+	jd->mcubuf = jd_mcubuf;
+	jd->workbuf = jd_workbuf;
 
 	jd->inbuf = seg = jd->dptr = (uint8_t*)alloc_pool(jd, JD_SZBUF); /* Allocate stream input buffer */
 	if(!seg)
@@ -867,7 +1330,7 @@ jd_prepare(JDEC* jd,
 		/* Load segment data */
 		if(dctr < len)
 		{
-			if(len - dctr > (JD_SZBUF - (jd->dptr - jd->inbuf)))
+			if((len - dctr) > (uint32_t)(JD_SZBUF - (jd->dptr - jd->inbuf)))
 				return JDR_MEM2;
 			dctr += infunc(jd, jd->dptr + dctr, len - dctr);
 			if(dctr < len)
@@ -882,14 +1345,23 @@ jd_prepare(JDEC* jd,
 		case 0xC0:                        /* SOF0 (baseline JPEG) */
 			jd->width = LDB_WORD(seg + 3);  /* Image width in unit of pixel */
 			jd->height = LDB_WORD(seg + 1); /* Image height in unit of pixel */
-			if(seg[5] != 3)
-				return JDR_FMT3; /* Err: Supports only Y/Cb/Cr format */
+			jd->ncomp = seg[5];
+			if(jd->ncomp != 3 && jd->ncomp != 1)
+				return JDR_FMT3; /* Err: Supports only Y/Cb/Cr or grayscale format */
+#if JD_FORMAT != 1
+			if(jd->ncomp != 3)
+				return JDR_FMT3; /* Err: Grayscale is converted only to RGB565 */
+#endif
 
-			/* Check three image components */
-			for(i = 0; i < 3; i++)
+			/* Check image components */
+			for(i = 0; i < jd->ncomp; i++)
 			{
 				b = seg[7 + 3 * i]; /* Get sampling factor */
-				if(!i)
+				if(jd->ncomp == 1)
+				{ /* Single component scan is never interleaved, MCU is one block */
+					jd->msx = jd->msy = 1;
+				}
+				else if(!i)
 				{ /* Y component */
 					if(b != 0x11 && b != 0x22 && b != 0x21)
 					{                  /* Check sampling factor */
@@ -935,11 +1407,11 @@ jd_prepare(JDEC* jd,
 			if(!jd->width || !jd->height)
 				return JDR_FMT1; /* Err: Invalid image size */
 
-			if(seg[0] != 3)
-				return JDR_FMT3; /* Err: Supports only three color components format */
+			if(seg[0] != jd->ncomp)
+				return JDR_FMT3; /* Err: All components must be in the single scan */
 
 			/* Check if all tables corresponding to each components have been loaded */
-			for(i = 0; i < 3; i++)
+			for(i = 0; i < jd->ncomp; i++)
 			{
 				b = seg[2 + 2 * i]; /* Get huffman table ID */
 				if(b != 0x00 && b != 0x11)
@@ -988,6 +1460,54 @@ jd_prepare(JDEC* jd,
 }
 
 
+/*-----------------------------------------------------------------------*/
+/* Reuse prepared decompressor for the next image                        */
+/*-----------------------------------------------------------------------*/
+/* Tables made by jd_prepare() are kept, so the image must have the same */
+/* header. Input function must provide the stream from the first byte of */
+/* entropy coded data, the header is not read again.                     */
+
+void IRAM_ATTR
+jd_rewind(JDEC* jd /* Decompressor prepared with jd_prepare() */
+)
+{
+	/* Drop buffered data, so the first read re-fills input buffer */
+	jd->memsrc = 0;
+	jd->dptr = jd->inbuf;
+	jd->dpend = jd->inbuf + 1;
+	jd->dbit = 0;
+
+	/* Initialize DC values */
+	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Reuse prepared decompressor for the next image in memory              */
+/*-----------------------------------------------------------------------*/
+/* The same as jd_rewind(), but entropy coded data is read right from    */
+/* the memory without input function and input buffer. Stuffed zero     */
+/* bytes are overwritten in place, so data can be decoded only once, it  */
+/* must be copied to decode it again. One byte before data is read but   */
+/* not used, so data must not be the start of the memory block.          */
+
+void IRAM_ATTR
+jd_rewind_mem(JDEC* jd,      /* Decompressor prepared with jd_prepare() */
+              uint8_t* data, /* The first byte of entropy coded data */
+              size_t size    /* Amount of bytes till the end of received data */
+)
+{
+	/* The first read moves to the first byte */
+	jd->memsrc = 1;
+	jd->dptr = data - 1;
+	jd->dpend = data + size;
+	jd->dbit = 0;
+
+	/* Initialize DC values */
+	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;
+}
+
+
 /*-----------------------------------------------------------------------*/
 /* Start to decompress the JPEG picture                                  */
 /*-----------------------------------------------------------------------*/
@@ -999,7 +1519,7 @@ jd_decomp(JDEC* jd, uint32_t (*outfunc)(JDEC*, void*, JRECT*) /* RGB output func
 	uint16_t x, y, mx, my;
 	JRESULT rc = JDR_OK;
 #if JD_USE_RESTART_INTERVAL >= 1
-	uint16_t rst, rsc = 0;
+	uint16_t rst = 0, rsc = 0;
 #endif
 
 	jd->bayer = (jd->bayer + 1) & 7;
@@ -1028,12 +1548,12 @@ jd_decomp(JDEC* jd, uint32_t (*outfunc)(JDEC*, void*, JRECT*) /* RGB output func
 			}
 #endif
 			/* Load an MCU (decompress huffman coded stream and apply IDCT) */
-			rc = mcu_load(jd, jd_mcubuf, (int32_t*)jd_workbuf);
+			rc = mcu_load(jd, jd->mcubuf, (int32_t*)jd->workbuf);
 			if(rc != JDR_OK)
 				return rc;
 
 			/* Output the MCU (color space conversion, scaling and output) */
-			rc = mcu_output(jd, jd_mcubuf, (uint8_t*)jd_workbuf, outfunc, x, y);
+			rc = mcu_output(jd, jd->mcubuf, jd->workbuf, outfunc, x, y);
 			if(rc != JDR_OK)
 				return rc;
 		}
@@ -1041,3 +1561,181 @@ jd_decomp(JDEC* jd, uint32_t (*outfunc)(JDEC*, void*, JRECT*) /* RGB output func
 
 	return rc;
 }
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress huffman coded stream into coefficient MCUs                 */
+/*-----------------------------------------------------------------------*/
+/* First half of jd_decomp(), the other one is jd_output_mcu().          */
+/* mcufunc() is called with NULL to get the first MCU slot, then with    */
+/* every filled slot. It returns the next slot to fill, or NULL to abort.*/
+
+JRESULT IRAM_ATTR
+jd_decomp_mcus(JDEC* jd, JMCU* (*mcufunc)(JDEC*, JMCU*) /* MCU commit function */
+)
+{
+	uint16_t x, y, mx, my;
+	JRESULT rc = JDR_OK;
+	JMCU* mcu;
+#if JD_USE_RESTART_INTERVAL >= 1
+	uint16_t rst = 0, rsc = 0;
+#endif
+
+	jd->bayer = (jd->bayer + 1) & 7;
+
+	/* Size of the MCU (pixel) */
+	mx = jd->msx * 8;
+	my = jd->msy * 8;
+
+	/* Initialize DC values */
+	jd->dcv[2] = jd->dcv[1] = jd->dcv[0] = 0;
+
+	mcu = mcufunc(jd, NULL);
+	if(!mcu)
+		return JDR_INTR;
+
+	/* Vertical loop of MCUs */
+	for(y = 0; y < jd->height; y += my)
+	{
+		/* Horizontal loop of MCUs */
+		for(x = 0; x < jd->width; x += mx)
+		{
+#if JD_USE_RESTART_INTERVAL >= 1
+			/* Process restart interval if enabled */
+			if(jd->nrst && rst++ == jd->nrst)
+			{
+				rc = restart(jd, rsc++);
+				if(rc != JDR_OK)
+					return rc;
+				rst = 1;
+			}
+#endif
+			/* Load an MCU (decompress huffman coded stream only) */
+			rc = mcu_load_coef(jd, mcu);
+			if(rc != JDR_OK)
+				return rc;
+
+			mcu->x = x;
+			mcu->y = y;
+
+			mcu = mcufunc(jd, mcu);
+			if(!mcu)
+				return JDR_INTR;
+		}
+	}
+
+	return rc;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Output single coefficient MCU                                         */
+/*-----------------------------------------------------------------------*/
+/* IDCT, color space conversion, scaling and output of an MCU made by    */
+/* jd_decomp_mcus(). Must not be called concurrently with jd_decomp().   */
+
+JRESULT IRAM_ATTR
+jd_output_mcu(JDEC* jd, JMCU* mcu, uint32_t (*outfunc)(JDEC*, void*, JRECT*) /* RGB output function */
+)
+{
+	uint_fast8_t blk, nblk;
+	jd_yuv_t* bp = jd->mcubuf;
+
+	nblk = jd->msx * jd->msy + ((jd->ncomp == 3) ? 2 : 0); /* Y blocks (1, 2 or 4) and C blocks (2 or 0) */
+
+	for(blk = 0; blk < nblk; blk++)
+	{
+		mcu_block_idct(&mcu->coef[blk][0], bp, mcu_idct_size(jd, (mcu->idctmap >> (blk * 2)) & 3));
+		bp += 64; /* Next block */
+	}
+
+	return mcu_output(jd, jd->mcubuf, jd->workbuf, outfunc, mcu->x, mcu->y);
+}
+
+
+#if JD_USE_RESTART_INTERVAL >= 1
+/*-----------------------------------------------------------------------*/
+/* Make one more decompressor for the same image                         */
+/*-----------------------------------------------------------------------*/
+/* Tables are shared with the source, so it must be alive as long as the */
+/* clone. Clone has own buffers, so both of them could decode different  */
+/* restart intervals at the same time with jd_decomp_slice().            */
+
+JRESULT IRAM_ATTR
+jd_clone(JDEC* jd,
+         const JDEC* src, /* Decompressor prepared with jd_prepare() */
+         void* pool,      /* Work memory of at least JD_CLONE_POOL_SIZE bytes */
+         size_t sz_pool,
+         void* dev /* I/O device identifier for the clone */
+)
+{
+	*jd = *src;
+	jd->pool = pool;
+	jd->sz_pool = sz_pool;
+	jd->device = dev;
+
+	jd->inbuf = (uint8_t*)alloc_pool(jd, JD_SZBUF);
+	jd->mcubuf = (jd_yuv_t*)alloc_pool(jd, 384 * sizeof(jd_yuv_t));
+	jd->workbuf = (uint8_t*)alloc_pool(jd, 768);
+	if(!jd->inbuf || !jd->mcubuf || !jd->workbuf)
+		return JDR_MEM1;
+
+	return JDR_OK;
+}
+
+
+/*-----------------------------------------------------------------------*/
+/* Decompress single restart interval                                    */
+/*-----------------------------------------------------------------------*/
+/* Decompressor must be rewound with jd_rewind() or jd_rewind_mem() to   */
+/* the first byte of the interval: right after the header for the first  */
+/* one, or fill bytes and RSTn marker what precedes it for the others.   */
+
+JRESULT IRAM_ATTR
+jd_decomp_slice(JDEC* jd,
+                uint32_t (*outfunc)(JDEC*, void*, JRECT*), /* RGB output function */
+                uint16_t interval                          /* Index of the restart interval */
+)
+{
+	uint_fast16_t mx, my, nx;
+	uint32_t mcu, mcu_end;
+	JRESULT rc = JDR_OK;
+
+	if(!jd->nrst)
+		return JDR_PAR;
+
+	/* Size of the MCU (pixel) and amount of MCUs in the image */
+	mx = jd->msx * 8;
+	my = jd->msy * 8;
+	nx = (jd->width + mx - 1) / mx;
+	mcu_end = nx * ((jd->height + my - 1) / my);
+
+	mcu = (uint32_t)interval * jd->nrst;
+	if(mcu >= mcu_end)
+		return JDR_PAR;
+	if(mcu_end - mcu > jd->nrst)
+		mcu_end = mcu + jd->nrst;
+
+	if(interval)
+	{
+		rc = restart(jd, interval - 1);
+		if(rc != JDR_OK)
+			return rc;
+	}
+
+	for(; mcu < mcu_end; mcu++)
+	{
+		/* Load an MCU (decompress huffman coded stream and apply IDCT) */
+		rc = mcu_load(jd, jd->mcubuf, (int32_t*)jd->workbuf);
+		if(rc != JDR_OK)
+			return rc;
+
+		/* Output the MCU (color space conversion, scaling and output) */
+		rc = mcu_output(jd, jd->mcubuf, jd->workbuf, outfunc, (mcu % nx) * mx, (mcu / nx) * my);
+		if(rc != JDR_OK)
+			return rc;
+	}
+
+	return rc;
+}
+#endif
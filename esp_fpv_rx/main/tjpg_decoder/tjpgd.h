@@ -53,6 +53,16 @@ typedef struct
 } JRECT;
 
 
+/* De-quantized coefficients of an MCU, see jd_decomp_mcus() */
+#define JD_MCU_BLOCKS_MAX 6
+typedef struct
+{
+	int32_t coef[JD_MCU_BLOCKS_MAX][64]; /* De-quantized blocks in order of Y0..Y3, Cb, Cr (only Y0 if grayscale) */
+	uint16_t x, y;                       /* Left-top position of the MCU in the image */
+	uint16_t idctmap;                    /* 2 bits per block, size of non zero corner of the block */
+} JMCU;
+
+
 /* Decompressor object structure */
 typedef struct JDEC JDEC;
 struct JDEC
@@ -62,7 +72,9 @@ struct JDEC
 	uint8_t* inbuf;				/* Bit stream input buffer */
 	uint8_t dbit;				/* Current bit in the current read byte */
 	uint8_t bayer;				/* Output bayer gain */
+	uint8_t scale;				/* Output scaling ratio 0:1/1, 1:1/2, 2:1/4, 3:1/8, see JD_USE_SCALE */
 	uint8_t msx, msy;			/* MCU size in unit of block (width, height) */
+	uint8_t ncomp;				/* Number of color components 1:grayscale, 3:color */
 	uint8_t qtid[3];			/* Quantization table ID of each component */
 	int16_t dcv[3];				/* Previous DC element of each component */
 	uint16_t nrst;				/* Restart inverval */
@@ -70,17 +82,36 @@ struct JDEC
 	uint8_t* huffbits[2][2];	/* Huffman bit distribution tables [id][dcac] */
 	uint16_t* huffcode[2][2];	/* Huffman code word tables [id][dcac] */
 	uint8_t* huffdata[2][2];	/* Huffman decoded data tables [id][dcac] */
+#if JD_FASTDECODE == 2
+	uint16_t* hufflut[2][2];	/* Fast huffman decode tables [id][dcac] */
+#endif
 	int32_t* qttbl[4];			/* Dequantizer tables [id] */
 	void* pool;					/* Pointer to available memory pool */
 	uint16_t sz_pool;			/* Size of momory pool (bytes available) */
 	uint32_t (*infunc)(JDEC*, uint8_t*, uint32_t);/* Pointer to jpeg stream input function */
 	void* device;				/* Pointer to I/O device identifiler for the session */
+	jd_yuv_t* mcubuf;			/* MCU buffer, own for each decompressor made by jd_clone() */
+	uint8_t* workbuf;			/* RGB output buffer, own for each decompressor made by jd_clone() */
+	uint8_t memsrc;				/* Stream is read right from the memory, see jd_rewind_mem() */
+	uint16_t* (*outptr)(JDEC*, JRECT*, uint16_t*);/* Optional RGB565 destination of the MCU, see mcu_output() */
 };
 
 
+/* Memory pool needed by jd_clone(): input buffer, MCU buffer and RGB buffer */
+#define JD_CLONE_POOL_SIZE (JD_SZBUF + 384 * sizeof(jd_yuv_t) + 768)
+
+
 /* TJpgDec API functions */
 JRESULT jd_prepare(JDEC* jd, uint32_t (*infunc)(JDEC*, uint8_t*, uint32_t), void* pool, size_t sz_pool, void* dev);
+void jd_rewind(JDEC* jd);
+void jd_rewind_mem(JDEC* jd, uint8_t* data, size_t size);
 JRESULT jd_decomp(JDEC* jd, uint32_t (*outfunc)(JDEC*, void*, JRECT*));
+JRESULT jd_decomp_mcus(JDEC* jd, JMCU* (*mcufunc)(JDEC*, JMCU*));
+JRESULT jd_output_mcu(JDEC* jd, JMCU* mcu, uint32_t (*outfunc)(JDEC*, void*, JRECT*));
+#if JD_USE_RESTART_INTERVAL >= 1
+JRESULT jd_clone(JDEC* jd, const JDEC* src, void* pool, size_t sz_pool, void* dev);
+JRESULT jd_decomp_slice(JDEC* jd, uint32_t (*outfunc)(JDEC*, void*, JRECT*), uint16_t interval);
+#endif
 
 
 #ifdef __cplusplus
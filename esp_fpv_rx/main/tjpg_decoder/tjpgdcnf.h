@@ -2,18 +2,24 @@
 /* TJpgDec System Configurations R0.03          */
 /*----------------------------------------------*/
 
+#include <sdkconfig.h>
+
 #define JD_SZBUF 1024
 /* Specifies size of stream input buffer */
 
+#ifndef JD_FORMAT
 #define JD_FORMAT 1
-/* Specifies output pixel format.
+#endif
+/* Specifies output pixel format. Host tests build other values, see host_tests/CMakeLists.txt
 /  0: RGB888 (24-bit/pix)
 /  1: RGB565 (16-bit/pix)
 /  2: Grayscale (8-bit/pix)
 */
 
+#ifndef JD_USE_SCALE
 #define JD_USE_SCALE 1
-/* Switches output descaling feature.
+#endif
+/* Switches output descaling feature. Ratio is set by JDEC.scale before decompression.
 /  0: Disable
 /  1: Enable
 */
@@ -24,27 +30,41 @@
 /  1: Enable
 */
 
-#define JD_FASTDECODE 1
-/* Optimization level
+#ifndef JD_FASTDECODE
+#define JD_FASTDECODE 2
+#endif
+/* Optimization level. Host tests build 1 as reference of lookup tables
 /  0: Basic optimization. Suitable for 8/16-bit MCUs.
 /     Workspace of 3100 bytes needed.
 /  1: + 32-bit barrel shifter. Suitable for 32-bit MCUs.
 /     Workspace of 3480 bytes needed.
-/  2: + Table conversion for huffman decoding (wants 6 << HUFF_BIT bytes of RAM).
-/     Workspace of 9644 bytes needed.
+/  2: + Table conversion for huffman decoding (wants 8 << HUFF_BIT bytes of RAM).
+/     Workspace of 11692 bytes needed, 8 KB of it are lookup tables of 4 huffman tables.
+*/
+
+#ifndef JD_USE_SPARSE_IDCT
+#define JD_USE_SPARSE_IDCT 1
+#endif
+/* IDCT of only non zero corner of the block, see mcu_load_block(). Host tests build 0 as reference
+/  0: Disable, every block is transformed in full
+/  1: Enable, DC only fill, 2x2, 4x4 or full transform
 */
 
-#define JD_USE_RESTART_INTERVAL 0
+#define JD_USE_RESTART_INTERVAL 1
 /* Switches processing of DRI. Most images don't use it.
 /  0: Disable
 /  1: Enable
 */
 
+#if JD_USE_SCALE && (JD_FORMAT != 1)
+#error "JD_USE_SCALE is done only for RGB565 output"
+#endif
+
 // Do not change this, it is the minimum size in bytes of the workspace needed by the decoder
 #if JD_FASTDECODE == 0
 #define TJPGD_WORKSPACE_SIZE 3100
 #elif JD_FASTDECODE == 1
 #define TJPGD_WORKSPACE_SIZE 3500
 #elif JD_FASTDECODE == 2
-#define TJPGD_WORKSPACE_SIZE (3500 + 6144)
+#define TJPGD_WORKSPACE_SIZE (3500 + 8192)
 #endif
\ No newline at end of file
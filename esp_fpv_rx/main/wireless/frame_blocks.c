@@ -0,0 +1,279 @@
+/**
+ * @file frame_blocks.c
+ *
+ * Block maps and sequence numbers of Rx frame assembly.
+ */
+
+#include "frame_blocks.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#endif
+//
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Core functions
+
+void IRAM_ATTR
+vFrameBlocksReset(frame_blocks_t* pxBlocks, uint8_t ucFrameId)
+{
+	memset(&pxBlocks->ulBlocksMap[0], 0, sizeof(pxBlocks->ulBlocksMap));
+	pxBlocks->usBlocksReceived = 0;
+	pxBlocks->usBlocksTotal = 0;
+	pxBlocks->ucFinalSize = 0;
+	pxBlocks->ucFrameId = ucFrameId;
+	pxBlocks->ucSynced = 1;
+	pxBlocks->ucDelivered = 0;
+}
+
+
+uint8_t IRAM_ATTR
+ucFrameBlocksCheck(const frame_sequence_t* pxSequence, const frame_blocks_t* pxBlocks, uint8_t ucFrameId)
+{
+	// Signed difference handles wrap around of 8bit sequence number
+	if(pxSequence->ucSynced && ((int8_t)(ucFrameId - pxSequence->ucLastDeliveredId) <= 0))
+	{
+		return FRAME_BLOCKS_STALE;
+	}
+
+	if(!pxBlocks->ucSynced)
+	{
+		return FRAME_BLOCKS_NEW;
+	}
+
+	int8_t icFramesDiff = (int8_t)(ucFrameId - pxBlocks->ucFrameId);
+
+	if(icFramesDiff < 0)
+	{
+		return FRAME_BLOCKS_STALE;
+	}
+
+	if(icFramesDiff > 0)
+	{
+		// Frame from the same slot wasn't completed in time
+		return (!pxBlocks->ucDelivered && pxBlocks->usBlocksReceived) ? FRAME_BLOCKS_DROP : FRAME_BLOCKS_NEW;
+	}
+
+	return FRAME_BLOCKS_CURRENT;
+}
+
+
+uint32_t IRAM_ATTR
+ulFrameBlocksAdd(frame_blocks_t* pxBlocks,
+                 uint16_t usBlockId,
+                 uint8_t ucFinalBlock,
+                 uint8_t ucSegment,
+                 uint8_t ucDataSize)
+{
+	uint32_t ulWordId = usBlockId >> 5;
+	uint32_t ulBitMask = 1UL << (usBlockId & 31);
+
+	assert(usBlockId < FRAME_BLOCKS_MAX_NUM);
+
+	if(pxBlocks->ucDelivered || (pxBlocks->ulBlocksMap[ulWordId] & ulBitMask))
+	{
+		return 0;
+	}
+
+	pxBlocks->ucBlockSegment[usBlockId] = ucSegment;
+	pxBlocks->ulBlocksMap[ulWordId] |= ulBitMask;
+	++pxBlocks->usBlocksReceived;
+
+	if(ucFinalBlock)
+	{
+		pxBlocks->usBlocksTotal = usBlockId + 1;
+		pxBlocks->ucFinalSize = ucDataSize;
+	}
+
+	return 1;
+}
+
+
+uint32_t IRAM_ATTR
+ulFrameBlocksHas(const frame_blocks_t* pxBlocks, uint32_t ulBlockId)
+{
+	return (pxBlocks->ulBlocksMap[ulBlockId >> 5] >> (ulBlockId & 31)) & 1;
+}
+
+
+uint32_t IRAM_ATTR
+ulFrameBlocksSize(const frame_blocks_t* pxBlocks, uint32_t ulBlocks, uint32_t ulBlockSize)
+{
+	uint32_t ulBlocksTotal = pxBlocks->usBlocksTotal;
+
+	if(ulBlocksTotal && (ulBlocks >= ulBlocksTotal) && pxBlocks->ucFinalSize)
+	{
+		return (ulBlocksTotal - 1) * ulBlockSize + pxBlocks->ucFinalSize;
+	}
+
+	return ulBlocks * ulBlockSize;
+}
+
+
+uint32_t IRAM_ATTR
+ulFrameBlocksIsComplete(const frame_blocks_t* pxBlocks, uint32_t ulThreshold)
+{
+	uint32_t ulBlocksTotal = pxBlocks->usBlocksTotal;
+
+	if(!ulBlocksTotal || pxBlocks->ucDelivered)
+	{
+		return 0;
+	}
+
+	return ((pxBlocks->usBlocksReceived * 100UL) >= (ulBlocksTotal * ulThreshold)) ? 1 : 0;
+}
+
+
+uint32_t IRAM_ATTR
+ulFrameBlocksIsOlder(const frame_blocks_t* pxBlocks, uint8_t ucFrameId)
+{
+	return (pxBlocks->ucSynced && !pxBlocks->ucDelivered && ((int8_t)(pxBlocks->ucFrameId - ucFrameId) < 0)) ? 1 : 0;
+}
+
+
+uint32_t IRAM_ATTR
+ulFrameBlocksInOrder(const frame_blocks_t* pxBlocks, uint32_t ulInOrder, uint32_t ulBlocksMax)
+{
+	while((ulInOrder < ulBlocksMax) && ulFrameBlocksHas(pxBlocks, ulInOrder))
+	{
+		++ulInOrder;
+	}
+
+	return ulInOrder;
+}
+
+
+void IRAM_ATTR
+vFrameBlocksMissing(const frame_blocks_t* pxBlocks, uint32_t ulBlocksMax, uint32_t* pulMissingMap, uint32_t ulWords)
+{
+	uint32_t ulBlocksTotal = pxBlocks->usBlocksTotal ? pxBlocks->usBlocksTotal : ulBlocksMax;
+
+	for(uint32_t i = 0; i < ulWords; i++)
+	{
+		uint32_t ulMissing = 0;
+
+		if(i < FRAME_BLOCKS_MAP_WORDS)
+		{
+			ulMissing = ~pxBlocks->ulBlocksMap[i];
+		}
+
+		// Clear bits of blocks out of the frame
+		if(ulBlocksTotal <= (i * 32))
+		{
+			ulMissing = 0;
+		}
+		else if(ulBlocksTotal < ((i + 1) * 32))
+		{
+			ulMissing &= (1UL << (ulBlocksTotal & 31)) - 1;
+		}
+
+		pulMissingMap[i] = ulMissing;
+	}
+}
+
+
+void IRAM_ATTR
+vFrameBlocksFindSegments(const frame_blocks_t* pxBlocks,
+                         uint32_t ulBlockSize,
+                         uint32_t ulDataOffset,
+                         frame_segments_t* pxSegments)
+{
+	int32_t lRunStart = -1;    // The first block of the segment being checked, -1 if it's broken
+	uint32_t ulRunSegment = 0; // Segment of the last block with known segment id
+	uint32_t ulPrevEnd = 0;    // Previous block is received and it's the last one of it's segment
+	uint32_t ulRestored = 0;   // Amount of restored blocks right before the current one
+
+	pxSegments->ulIntactMap = 0;
+	pxSegments->usIntactSize =
+	    (uint16_t)(ulFrameBlocksSize(pxBlocks, pxBlocks->usBlocksTotal, ulBlockSize) + ulDataOffset);
+
+	for(uint32_t i = 0; i < pxBlocks->usBlocksTotal; i++)
+	{
+		uint32_t ulSegment = pxBlocks->ucBlockSegment[i];
+
+		if(!ulFrameBlocksHas(pxBlocks, i))
+		{
+			if(pxSegments->usIntactSize > (i * ulBlockSize + ulDataOffset))
+			{
+				pxSegments->usIntactSize = (uint16_t)(i * ulBlockSize + ulDataOffset);
+			}
+
+			lRunStart = -1;
+			ulPrevEnd = 0;
+			ulRestored = 0;
+			continue;
+		}
+
+		if(ulSegment == FRAME_BLOCK_SEGMENT_UNKNOWN)
+		{
+			// Restored block continues the segment, or starts the next one right after the last block
+			if(!i || ulPrevEnd)
+			{
+				lRunStart = (int32_t)i;
+				ulRunSegment = i ? (ulRunSegment + 1) : 0;
+			}
+
+			ulPrevEnd = 0;
+			++ulRestored;
+			continue;
+		}
+
+		uint32_t ulEnd = ulSegment & FRAME_BLOCK_SEGMENT_END;
+		ulSegment &= ~FRAME_BLOCK_SEGMENT_END;
+
+		if(!i || ulPrevEnd)
+		{
+			lRunStart = (int32_t)i;
+			ulRunSegment = ulSegment;
+		}
+		else if((lRunStart >= 0) && ulRestored && (ulSegment == (ulRunSegment + 1)))
+		{
+			// The last block of previous segment was restored, it's end doesn't matter for decoder
+			if(ulRunSegment < FRAME_SEGMENTS_MAX_NUM)
+			{
+				pxSegments->ulIntactMap |= (1UL << ulRunSegment);
+				pxSegments->usSegmentOffset[ulRunSegment] = (uint16_t)(lRunStart * ulBlockSize + ulDataOffset);
+			}
+
+			// With several restored blocks it's unknown which one starts the current segment
+			lRunStart = (ulRestored == 1) ? (int32_t)i : -1;
+			ulRunSegment = ulSegment;
+		}
+		else if(ulSegment != ulRunSegment)
+		{
+			lRunStart = -1;
+			ulRunSegment = ulSegment;
+		}
+
+		if(ulEnd && (lRunStart >= 0) && (ulRunSegment < FRAME_SEGMENTS_MAX_NUM))
+		{
+			pxSegments->ulIntactMap |= (1UL << ulRunSegment);
+			pxSegments->usSegmentOffset[ulRunSegment] = (uint16_t)(lRunStart * ulBlockSize + ulDataOffset);
+		}
+
+		ulPrevEnd = ulEnd;
+		ulRestored = 0;
+	}
+}
+
+
+void IRAM_ATTR
+vFrameSequenceRestart(frame_sequence_t* pxSequence, uint8_t ucFrameId)
+{
+	// Frames what are still in the air were compressed with previous header
+	pxSequence->ucLastDeliveredId = (uint8_t)(ucFrameId - 1);
+	pxSequence->ucSynced = 1;
+}
+
+
+void IRAM_ATTR
+vFrameSequenceDeliver(frame_sequence_t* pxSequence, uint8_t ucFrameId)
+{
+	pxSequence->ucLastDeliveredId = ucFrameId;
+	pxSequence->ucSynced = 1;
+}
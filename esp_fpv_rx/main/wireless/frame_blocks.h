@@ -0,0 +1,217 @@
+/**
+ * @file frame_blocks.h
+ *
+ * Bookkeeping of image frame blocks what Rx frame assembly does for every packet:
+ * which frame the packet belongs to, which blocks of the frame are received,
+ * when the frame is complete enougth and which restart segments of it are intact.
+ * Packets of two frames are mixed in the air, they could be lost, duplicated or come late,
+ * so frame ids are compared with wrap around of 8bit sequence number.
+ *
+ * Framebuffers, decoder handoff and timers stay in wireless_main.c.
+ * Caller holds the same lock what guards frame assembly, every function is short.
+ *
+ * @note Keep this module free from ESP-IDF and FreeRTOS dependencies,
+ *       so packet traces could be replayed through it on the host.
+ */
+
+#ifndef _FRAME_BLOCKS_H
+#define _FRAME_BLOCKS_H
+
+//
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Maximum amount of blocks in single frame, the same what NAK packet could describe
+#define FRAME_BLOCKS_MAX_NUM (128)
+// Amount of 32bit words to keep one bit per each block
+#define FRAME_BLOCKS_MAP_WORDS (FRAME_BLOCKS_MAX_NUM / 32)
+
+// Restart segments of the image what Transmitter inserts restart markers into, id is sent in 5 bits
+#define FRAME_SEGMENTS_MAX_NUM (32)
+
+// Segment of the block what was restored by FEC, so it's header is unknown
+#define FRAME_BLOCK_SEGMENT_UNKNOWN (0xFF)
+// Set in segment of the last block of restart segment
+#define FRAME_BLOCK_SEGMENT_END (0x80)
+
+// Result of @ref ''ucFrameBlocksCheck''
+#define FRAME_BLOCKS_STALE   (0) // Frame is older than slot or delivered one, packet must be dropped
+#define FRAME_BLOCKS_CURRENT (1) // Slot already assembles this frame
+#define FRAME_BLOCKS_NEW     (2) // Slot must be reset for this frame
+#define FRAME_BLOCKS_DROP    (3) // The same, and older frame of the slot is abandoned unfinished
+
+// Keeps track of which blocks of the image frame are already received
+typedef struct
+{
+	uint32_t ulBlocksMap[FRAME_BLOCKS_MAP_WORDS]; // One bit per each received block
+	uint16_t usBlocksReceived;                    // Amount of unique blocks received for this frame
+	uint16_t usBlocksTotal;                       // Known only when final block is received, 0 otherwise
+	uint8_t ucFinalSize;                          // Amount of data in the final block, 0 if it's unknown
+	uint8_t ucFrameId;                            // Sequence number of the frame being assembled
+	uint8_t ucSynced;                             // Slot is assigned to some frame id
+	uint8_t ucDelivered;                          // Frame was already passed to the decoder or abandoned
+	uint8_t ucBlockSegment[FRAME_BLOCKS_MAX_NUM]; // Restart segment of each block, see @ref ''FRAME_BLOCK_SEGMENT_END''
+} frame_blocks_t;
+
+// Frames are delivered only in order, older ones are dropped
+typedef struct
+{
+	uint8_t ucLastDeliveredId; // Sequence number of the last delivered frame
+	uint8_t ucSynced;          // ucLastDeliveredId is valid
+} frame_sequence_t;
+
+typedef struct
+{
+	uint32_t ulIntactMap;                             // One bit per each segment what is received completely
+	uint16_t usSegmentOffset[FRAME_SEGMENTS_MAX_NUM]; // Where each intact segment starts in framebuffer
+	uint16_t usIntactSize;                            // Data from the start of the frame till the first missing block
+} frame_segments_t;
+
+// ----------------------------------------------------------------------
+// Core functions
+
+/**
+ * @brief Assign the slot to the frame, no blocks are received yet
+ *
+ * @param pxBlocks Blocks of the slot
+ * @param ucFrameId Sequence number of the new frame
+ */
+void vFrameBlocksReset(frame_blocks_t* pxBlocks, uint8_t ucFrameId);
+
+/**
+ * @brief Check what the packet of the frame means for the slot, frame id & 1 selects it.
+ *        Nothing is changed, so it's done before decryption and stale packets costs nothing.
+ *
+ * @param pxSequence Delivered frames
+ * @param pxBlocks Blocks of the slot
+ * @param ucFrameId Sequence number from the packet header
+ *
+ * @retval See @ref ''FRAME_BLOCKS_STALE''
+ */
+uint8_t ucFrameBlocksCheck(const frame_sequence_t* pxSequence, const frame_blocks_t* pxBlocks, uint8_t ucFrameId);
+
+/**
+ * @brief Mark block as received for the frame
+ *
+ * @param pxBlocks Blocks of the frame
+ * @param usBlockId Index of the block in frame, less than @ref ''FRAME_BLOCKS_MAX_NUM''
+ * @param ucFinalBlock Is this block is last one in the frame
+ * @param ucSegment Restart segment from the packet header, @ref ''FRAME_BLOCK_SEGMENT_UNKNOWN'' if there is no header
+ * @param ucDataSize Amount of data in the block, used only for the final one
+ *
+ * @retval 0 if block is duplicate or frame is already delivered, 1 otherwise
+ */
+uint32_t ulFrameBlocksAdd(frame_blocks_t* pxBlocks,
+                          uint16_t usBlockId,
+                          uint8_t ucFinalBlock,
+                          uint8_t ucSegment,
+                          uint8_t ucDataSize);
+
+/**
+ * @brief Check if the block is received
+ *
+ * @param pxBlocks Blocks of the frame
+ * @param ulBlockId Index of the block in frame
+ *
+ * @retval 1 if block is received, 0 otherwise
+ */
+uint32_t ulFrameBlocksHas(const frame_blocks_t* pxBlocks, uint32_t ulBlockId);
+
+/**
+ * @brief Get amount of image data in the first blocks of the frame.
+ *        Final block is usually shorter, it's counted as full only if it's size is unknown,
+ *        what happens when it's restored by FEC.
+ *
+ * @param pxBlocks Blocks of the frame
+ * @param ulBlocks Amount of blocks from the start of the frame
+ * @param ulBlockSize Amount of image data in each block except the final one
+ *
+ * @retval Amount of bytes
+ */
+uint32_t ulFrameBlocksSize(const frame_blocks_t* pxBlocks, uint32_t ulBlocks, uint32_t ulBlockSize);
+
+/**
+ * @brief Check if enougth blocks of the frame are received to start decoding
+ *
+ * @param pxBlocks Blocks of the frame
+ * @param ulThreshold Received blocks of total amount, in percents
+ *
+ * @retval 1 if total amount of blocks is known, threshold is reached and frame is not delivered yet, 0 otherwise
+ */
+uint32_t ulFrameBlocksIsComplete(const frame_blocks_t* pxBlocks, uint32_t ulThreshold);
+
+/**
+ * @brief Check if the frame of the slot would be shown after the newer delivered one, so it must be abandoned
+ *
+ * @param pxBlocks Blocks of the slot
+ * @param ucFrameId Sequence number of the delivered frame
+ *
+ * @retval 1 if slot assembles older frame what is not delivered yet, 0 otherwise
+ */
+uint32_t ulFrameBlocksIsOlder(const frame_blocks_t* pxBlocks, uint8_t ucFrameId);
+
+/**
+ * @brief Count blocks received in order, without any gap
+ *
+ * @param pxBlocks Blocks of the frame
+ * @param ulInOrder Amount of blocks known to be received in order, the search starts there
+ * @param ulBlocksMax Maximum amount of blocks in frame
+ *
+ * @retval Amount of blocks from the start of the frame till the first missing one
+ */
+uint32_t ulFrameBlocksInOrder(const frame_blocks_t* pxBlocks, uint32_t ulInOrder, uint32_t ulBlocksMax);
+
+/**
+ * @brief Make map of the blocks what are missing to request them again
+ *
+ * @param pxBlocks Blocks of the frame
+ * @param ulBlocksMax Amount of blocks to request if total amount is unknown yet
+ * @param pulMissingMap Where to store one bit per each missing block
+ * @param ulWords Amount of 32bit words in pulMissingMap
+ */
+void vFrameBlocksMissing(const frame_blocks_t* pxBlocks,
+                         uint32_t ulBlocksMax,
+                         uint32_t* pulMissingMap,
+                         uint32_t ulWords);
+
+/**
+ * @brief Find restart segments what could be decoded without any missing block.
+ *        Segment starts at the beginning of the block, right after the last block of the previous one.
+ *
+ * @param pxBlocks Blocks of the frame, total amount of them must be known
+ * @param ulBlockSize Amount of image data in each block except the final one
+ * @param ulDataOffset Where the first block is in framebuffer, right after Jpg header
+ * @param pxSegments Where to store intact segments
+ */
+void vFrameBlocksFindSegments(const frame_blocks_t* pxBlocks,
+                              uint32_t ulBlockSize,
+                              uint32_t ulDataOffset,
+                              frame_segments_t* pxSegments);
+
+/**
+ * @brief New frame sequence is started, frames before it are stale
+ *
+ * @param pxSequence Delivered frames
+ * @param ucFrameId The first frame of new sequence
+ */
+void vFrameSequenceRestart(frame_sequence_t* pxSequence, uint8_t ucFrameId);
+
+/**
+ * @brief Frame is passed to the decoder, it and all older frames are stale now
+ *
+ * @param pxSequence Delivered frames
+ * @param ucFrameId Delivered frame
+ */
+void vFrameSequenceDeliver(frame_sequence_t* pxSequence, uint8_t ucFrameId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FRAME_BLOCKS_H */
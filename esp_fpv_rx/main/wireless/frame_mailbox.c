@@ -0,0 +1,98 @@
+/**
+ * @file frame_mailbox.c
+ *
+ * Handoff of complete frames from frame assembly to Jpg decoder.
+ */
+
+#include "frame_mailbox.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#endif
+//
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Core functions
+
+void
+vFrameMailboxInit(frame_mailbox_t* pxMailbox, uint8_t ucBuffers, uint8_t ucDecoding)
+{
+	assert((ucBuffers <= FRAME_MAILBOX_BUFFERS_MAX_NUM) && (ucDecoding < ucBuffers));
+
+	memset(pxMailbox, 0, sizeof(frame_mailbox_t));
+	pxMailbox->ucBuffers = ucBuffers;
+	pxMailbox->ucReady = FRAME_MAILBOX_NONE;
+	pxMailbox->ucDecoding = ucDecoding;
+	pxMailbox->ucState[ucDecoding] = FRAME_BUF_DECODING;
+}
+
+
+uint8_t IRAM_ATTR
+ucFrameMailboxPublish(frame_mailbox_t* pxMailbox, uint8_t ucBuf)
+{
+	uint8_t ucSkipped = pxMailbox->ucReady;
+
+	assert((ucBuf < pxMailbox->ucBuffers) && (pxMailbox->ucState[ucBuf] == FRAME_BUF_FILLING));
+
+	// Decoder is still busy with even older frame, skip the previous one
+	if(ucSkipped != FRAME_MAILBOX_NONE)
+	{
+		pxMailbox->ucState[ucSkipped] = FRAME_BUF_FILLING;
+		++pxMailbox->ulSkipped;
+	}
+
+	pxMailbox->ucState[ucBuf] = FRAME_BUF_READY;
+	pxMailbox->ucReady = ucBuf;
+	++pxMailbox->ulPublished;
+
+	return ucSkipped;
+}
+
+
+uint8_t IRAM_ATTR
+ucFrameMailboxRevoke(frame_mailbox_t* pxMailbox, uint8_t ucBuf)
+{
+	uint8_t ucReady = pxMailbox->ucReady;
+
+	if((ucReady == FRAME_MAILBOX_NONE) || ((ucBuf != FRAME_MAILBOX_NONE) && (ucBuf != ucReady)))
+	{
+		return FRAME_MAILBOX_NONE;
+	}
+
+	pxMailbox->ucState[ucReady] = FRAME_BUF_FILLING;
+	pxMailbox->ucReady = FRAME_MAILBOX_NONE;
+	++pxMailbox->ulSkipped;
+
+	return ucReady;
+}
+
+
+uint8_t IRAM_ATTR
+ucFrameMailboxTake(frame_mailbox_t* pxMailbox, uint8_t* pucReleased)
+{
+	uint8_t ucReady = pxMailbox->ucReady;
+
+	if(ucReady == FRAME_MAILBOX_NONE)
+	{
+		return FRAME_MAILBOX_NONE;
+	}
+
+	// Previously decoded framebuffer is free now, it goes to the slot of taken frame
+	pxMailbox->ucState[pxMailbox->ucDecoding] = FRAME_BUF_FILLING;
+	if(pucReleased)
+	{
+		*pucReleased = pxMailbox->ucDecoding;
+	}
+
+	pxMailbox->ucState[ucReady] = FRAME_BUF_DECODING;
+	pxMailbox->ucDecoding = ucReady;
+	pxMailbox->ucReady = FRAME_MAILBOX_NONE;
+	++pxMailbox->ulTaken;
+
+	return ucReady;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file frame_mailbox.h
+ *
+ * Ownership of Rx framebuffers between frame assembly and Jpg decoder.
+ * Every framebuffer is in one of three states: filling, ready or decoding.
+ * There is at most one ready framebuffer. Newer complete frame replaces it, so decoder always
+ * takes the newest one, and each replaced frame is counted as skipped.
+ *
+ * State is changed together with frame assembly state (NAK map, stream, segments and size of the frame),
+ * what the decoder copies when it takes the frame. Atomic exchange of the buffer index alone would leave
+ * them unguarded, so caller holds the same lock what guards frame assembly. Every function is
+ * a few stores without loops or waits, so the lock is never held for long.
+ *
+ * @note Keep this module free from ESP-IDF and FreeRTOS dependencies,
+ *       so it could be stress tested on the host with real threads.
+ */
+
+#ifndef _FRAME_MAILBOX_H
+#define _FRAME_MAILBOX_H
+
+//
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Maximum amount of framebuffers what mailbox could track
+#define FRAME_MAILBOX_BUFFERS_MAX_NUM (4)
+
+// There is no framebuffer
+#define FRAME_MAILBOX_NONE (0xFF)
+
+// Owner of each framebuffer
+#define FRAME_BUF_FILLING  (0) // Assembly slot receives the frame into it, decoder could only read it as a stream
+#define FRAME_BUF_READY    (1) // Complete frame waits for the decoder
+#define FRAME_BUF_DECODING (2) // Decoder reads it, nobody else may write there
+
+typedef struct
+{
+	uint8_t ucState[FRAME_MAILBOX_BUFFERS_MAX_NUM]; // See @ref ''FRAME_BUF_FILLING''
+	uint8_t ucBuffers;                              // Amount of tracked framebuffers
+	uint8_t ucReady;                                // Ready framebuffer, @ref ''FRAME_MAILBOX_NONE'' if there is none
+	uint8_t ucDecoding;                             // Framebuffer owned by the decoder
+	uint32_t ulPublished;                           // Frames passed to the mailbox
+	uint32_t ulTaken;                               // Frames taken by the decoder
+	uint32_t ulSkipped;                             // Frames replaced or revoked before decoder took them
+} frame_mailbox_t;
+
+// ----------------------------------------------------------------------
+// Core functions
+
+/**
+ * @brief Make all framebuffers filling except the decoder one
+ *
+ * @param pxMailbox Mailbox state
+ * @param ucBuffers Amount of framebuffers, up to @ref ''FRAME_MAILBOX_BUFFERS_MAX_NUM''
+ * @param ucDecoding Framebuffer what decoder owns at start
+ */
+void vFrameMailboxInit(frame_mailbox_t* pxMailbox, uint8_t ucBuffers, uint8_t ucDecoding);
+
+/**
+ * @brief Complete frame waits for the decoder, older ready frame is skipped
+ *
+ * @param pxMailbox Mailbox state
+ * @param ucBuf Filling framebuffer with complete frame
+ *
+ * @retval Skipped framebuffer, it's filling again, or @ref ''FRAME_MAILBOX_NONE''
+ */
+uint8_t ucFrameMailboxPublish(frame_mailbox_t* pxMailbox, uint8_t ucBuf);
+
+/**
+ * @brief Ready frame is not valid anymore, so it's skipped and it's framebuffer is filling again
+ *
+ * @param pxMailbox Mailbox state
+ * @param ucBuf Framebuffer to revoke, @ref ''FRAME_MAILBOX_NONE'' to revoke any ready one
+ *
+ * @retval Revoked framebuffer or @ref ''FRAME_MAILBOX_NONE'' if it was not ready
+ */
+uint8_t ucFrameMailboxRevoke(frame_mailbox_t* pxMailbox, uint8_t ucBuf);
+
+/**
+ * @brief Decoder takes the ready frame. It's previous framebuffer is given back for filling.
+ *
+ * @param pxMailbox Mailbox state
+ * @param pucReleased Where to store framebuffer released by decoder, could be NULL
+ *
+ * @retval Framebuffer to decode or @ref ''FRAME_MAILBOX_NONE'' if there is no ready frame
+ */
+uint8_t ucFrameMailboxTake(frame_mailbox_t* pxMailbox, uint8_t* pucReleased);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FRAME_MAILBOX_H */
@@ -8,10 +8,14 @@
 
 #include "button_poller.h"
 #include "data_common.h"
+#include "frame_blocks.h"
+#include "frame_mailbox.h"
 #include "image_decoder.h"
 #include "memory_model/memory_model.h"
 #include "pins_definitions.h"
 #include "wireless_conf.h"
+#include "wireless_fec.h"
+#include "wireless_rate.h"
 
 #include <debug_tools_esp.h>
 //
@@ -51,6 +55,52 @@
 // Amount of system ticks to wait event queue
 #define WIRELESS_EVENT_MAX_WAIT_TIMEOUT (5)
 
+// Amount of image data bytes inside of the first AES block, right after usBlockId
+#define WIFI_CRYPT_IMAGE_DATA_SIZE (WIFI_CRYPT_BLOCK_SIZE - sizeof(((PacketImageData_t*)0)->usBlockId))
+
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+// Maximum amount of FEC groups in single image frame
+#define FEC_GROUPS_MAX_NUM \
+	((IMG_JPG_BLOCKS_MAX_NUM + CONFIG_WIRELESS_FEC_DATA_BLOCKS - 1) / CONFIG_WIRELESS_FEC_DATA_BLOCKS)
+#endif
+
+// Amount of image frames what are assembled at the same time, frame id & 1 selects the slot.
+// Transmitter sends the next frame while previous one is still in the air.
+#define FRAME_ASSEMBLY_SLOTS_NUM  (2)
+#define FRAME_ASSEMBLY_SLOTS_MASK (FRAME_ASSEMBLY_SLOTS_NUM - 1)
+
+// Index of the framebuffer in @ref ''xFrameMailbox'', what is one of @ref ''ucRxImageBuf''
+#define FRAME_BUF_ID(pucBuf) ((uint8_t)((uint32_t)((pucBuf) - &ucRxImageBuf[0][0]) / IMG_JPG_FILE_MAX_SIZE))
+
+_Static_assert(IMG_JPG_BLOCKS_MAX_NUM <= FRAME_BLOCKS_MAX_NUM, "Blocks of the frame don't fit into block map");
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+// Decoder reads the frame while it's received, see @ref ''pxFrameStream''
+#define FRAME_STREAM_NONE   (0) // Frame is passed to the decoder once it's ready
+#define FRAME_STREAM_ACTIVE (1) // Frame is not passed to the decoder again, even if decoder is done with it
+#define FRAME_STREAM_FAILED (2) // Stream is broken, so frame is passed to the decoder once it's ready
+#endif
+
+// Image frame being assembled
+typedef struct
+{
+	frame_blocks_t xBlocks;           // Which blocks of the frame are already received
+	uint8_t ucNakRequests;            // Amount of retransmission requests for this frame
+	uint8_t* pucFrameBuf;             // Framebuffer where this frame is assembled
+	wireless_rx_segments_t xSegments; // Segments what are complete, found once frame is delivered
+	uint32_t ulHeaderVersion;         // Version of Jpg header in framebuffer, set once frame is delivered
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	uint16_t usBlocksInOrder; // Amount of blocks from the start of the frame till the first missing one
+	uint8_t ucStreamState;    // See @ref ''FRAME_STREAM_ACTIVE''
+#endif
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+	uint8_t ucFecParityBuf[FEC_GROUPS_MAX_NUM][CONFIG_WIRELESS_FEC_PARITY_BLOCKS][PACKET_IMAGE_DATA_MAX_SIZE];
+	uint8_t ucFecParityMap[FEC_GROUPS_MAX_NUM]; // One bit per each received parity block
+	uint8_t ucFecGroupEnd[FEC_GROUPS_MAX_NUM];  // Index right after the last data block in group
+#endif
+} frame_assembly_t;
+
 
 #if WIRELESS_USE_RAW_80211_PACKET
 typedef struct
@@ -77,14 +127,31 @@ QueueHandle_t xEventQueueHandler = NULL;
 StaticQueue_t xEventQueueControlBlock;
 wireless_msg_events_t xEventQueueStorage[EVENT_QUEUE_SIZE];
 
-SemaphoreHandle_t xDataTransmitterTxLockHandler = NULL;
-StaticSemaphore_t xDataTransmitterTxLockControlBlock;
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+// Credits of ESP-NOW Tx window, one is taken for each packet passed to the driver
+// and given back from send callback
+SemaphoreHandle_t xTxCreditsHandler = NULL;
+StaticSemaphore_t xTxCreditsControlBlock;
+#endif
 
 // in ms or each 1s
 #define NET_STATS_TIMER_TIMEOUT (1000)
 TimerHandle_t xNetStatsTimer = NULL;
 StaticTimer_t xNetStatsTimerControlBlock;
 
+#if(CONFIG_IMG_GRAYSCALE_MODE == 2)
+// Amount of link reports what new colour mode is kept at least, so it doesn't flip on every report
+#define IMG_GRAYSCALE_HOLD_PERIODS (5)
+#endif
+
+// Timer period can't be 0 ticks
+#define FRAME_GAP_TIMER_TICKS(ms) ((pdMS_TO_TICKS(ms) > 0) ? pdMS_TO_TICKS(ms) : 1)
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+TimerHandle_t xFrameGapTimer = NULL;
+StaticTimer_t xFrameGapTimerControlBlock;
+#endif
+
 // ----------------------------------------------------------------------
 // Variables
 
@@ -133,9 +200,22 @@ wifi_espnow_raw_packet_t wifi_espnow_raw_packet;
 #endif
 
 uint8_t ucRxImageBuf[IMG_JPG_FRAMEBUFFERS_MAX_NUM][IMG_JPG_FILE_MAX_SIZE] = {0};
-
-uint32_t ulImgCurBufNum = 0UL;
-uint8_t* pucImgCurRxBufPtr = &ucRxImageBuf[0][0];
+// Owner of each framebuffer, changed only under @ref ''xFrameReadyLock''
+frame_mailbox_t xFrameMailbox;
+
+// Framebuffer owned by the decoder, the rest of them belong to frame assembly slots
+uint8_t* pucImgDecodeBufPtr = &ucRxImageBuf[FRAME_ASSEMBLY_SLOTS_NUM][0];
+uint8_t ucImgDecodeFrameId = 0;
+// New Jpg header was received while decoder was busy, so it's not applied to decoder framebuffer yet
+BaseType_t xImgDecodeBufHeaderStale = pdFALSE;
+// Restart segments of the frame in @ref ''pucImgDecodeBufPtr''
+wireless_rx_segments_t xImgDecodeSegments = {0};
+// Increased every time the whole Jpg header is received
+uint32_t ulRxHeaderVersion = 0;
+// Version of Jpg header in @ref ''pucImgDecodeBufPtr''
+uint32_t ulImgDecodeHeaderVersion = 0;
+// Size of received data in @ref ''pucImgDecodeBufPtr'', including the header
+uint32_t ulImgDecodeFrameSize = 0;
 
 uint32_t ulReceivedData = 0;
 uint32_t ulTotalReceivedData = 0;
@@ -146,9 +226,97 @@ int8_t icLinkRSSI = -98;
 
 uint8_t ucEncryptedData[2][256];
 
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+// Time when each packet in flight was passed to the driver, the oldest one is at ulTxWindowHead
+int64_t llTxWindowSendTime[CONFIG_WIRELESS_TX_WINDOW_SIZE];
+uint32_t ulTxWindowHead = 0;
+uint32_t ulTxWindowCount = 0;
+// Time when previous packet was confirmed by send callback
+int64_t llTxLastDoneTime = 0;
+portMUX_TYPE xTxWindowLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+// How often collected statistics of Tx rates are averaged
+#define WIFI_RATE_UPDATE_PERIOD_US (100 * 1000)
+// How long new rate waits for packets in flight to be done
+#define WIFI_RATE_SWITCH_MAX_WAIT_TICKS (pdMS_TO_TICKS(50) + 1)
+
+// Same order as @ref ''wireless_rate_id_t''
+// clang-format off
+const wifi_phy_rate_t xWifiPhyRates[WIRELESS_RATE_NUM] = {
+	WIFI_PHY_RATE_LORA_250K,
+	WIFI_PHY_RATE_LORA_500K,
+	WIFI_PHY_RATE_1M_L,
+	WIFI_PHY_RATE_2M_S,
+	WIFI_PHY_RATE_5M_S,
+	WIFI_PHY_RATE_11M_S,
+	WIFI_PHY_RATE_MCS0_LGI,
+	WIFI_PHY_RATE_MCS1_LGI,
+	WIFI_PHY_RATE_MCS2_LGI,
+	WIFI_PHY_RATE_MCS3_LGI,
+	WIFI_PHY_RATE_MCS4_LGI,
+	WIFI_PHY_RATE_MCS5_LGI,
+	WIFI_PHY_RATE_MCS6_LGI,
+	WIFI_PHY_RATE_MCS7_LGI,
+};
+// clang-format on
+
+wireless_rate_t xTxRate;
+// Rate of each packet in flight, same indexing as @ref ''llTxWindowSendTime''
+uint8_t ucTxWindowRate[CONFIG_WIRELESS_TX_WINDOW_SIZE];
+// Rate what ESP-NOW is configured to use right now
+uint8_t ucTxRateApplied = WIRELESS_RATE_1M_L;
+// ESP-NOW rate is being changed, packets sent right now could use any of two rates
+BaseType_t xTxRateSwitching = pdFALSE;
+int64_t llTxRateUpdateTime = 0;
+#endif
+
+wireless_tx_stats_t xTxStats = {0};
+
 uint16_t usDataOffsetExtra = 0;
 BaseType_t xFirstFrame = pdTRUE;
 
+frame_assembly_t xFrameAssembly[FRAME_ASSEMBLY_SLOTS_NUM] = {
+    {.pucFrameBuf = &ucRxImageBuf[0][0]},
+    {.pucFrameBuf = &ucRxImageBuf[1][0]},
+};
+// Slot of the last received image packet
+frame_assembly_t* pxLastFrame = &xFrameAssembly[0];
+// Delivered frame what decoder didn't take yet, NULL if there is none
+frame_assembly_t* pxFrameReady = NULL;
+portMUX_TYPE xFrameReadyLock = portMUX_INITIALIZER_UNLOCKED;
+// Frames are delivered only in order, older ones are dropped
+frame_sequence_t xFrameSequence = {0};
+uint32_t ulDroppedFrames = 0;
+uint32_t ulReportedDroppedFrames = 0;
+uint32_t ulStalePackets = 0;
+
+#if(CONFIG_IMG_GRAYSCALE_MODE == 2)
+// Link reports left before colour mode could be switched again
+uint32_t ulColorModeHold = 0;
+#endif
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+int64_t llFrameLastBlockTime = 0;
+uint32_t ulNakRequests = 0;
+// Frame what missing blocks are requested for and it's blocks at the moment of request
+uint8_t ucNakFrameId = 0;
+uint32_t ulNakMissingMap[PACKET_NAK_MAP_WORDS] = {0};
+#endif
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+uint32_t ulFecRestoredBlocks = 0;
+#endif
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+// Frame what decoder reads while it's still received, NULL if there is none.
+// It's cleared before the slot is reset, so decoder never reads data of the next frame as a valid one.
+frame_assembly_t* pxFrameStream = NULL;
+uint32_t ulStreamedFrames = 0;
+uint32_t ulBrokenStreams = 0;
+#endif
+
 PacketFrame_t xPacket;
 
 
@@ -163,14 +331,180 @@ static void wifi_espnow_dump_mac(const uint8_t* mac_addr);
 
 static void wifi_set_tx_power(int8_t ic_new_tx_power);
 
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+/**
+ * @brief Wait for free credit in Tx window and remember when packet is passed to the driver.
+ * 
+ * @param xTicksToWait Maximum time to wait for one of the packets in flight to be done
+ * 
+ * @retval pdTRUE if packet could be sent right now
+ */
+static BaseType_t wifi_tx_window_take(TickType_t xTicksToWait);
+
+/**
+ * @brief Return credit of the last packet what was rejected by the driver
+ */
+static void wifi_tx_window_cancel(void);
+
+/**
+ * @brief Return credit of the oldest packet in flight and count it's airtime
+ * 
+ * @param status Result from @ref ''wifi_espnow_packet_tx_cb''
+ */
+static void wifi_tx_window_release(esp_now_send_status_t status);
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+/**
+ * @brief Switch ESP-NOW to the new PHY rate if it's not used already
+ * 
+ * @param ucRate See @ref ''wireless_rate_id_t''
+ */
+static void wifi_tx_rate_apply(uint8_t ucRate);
+
+/**
+ * @brief Switch ESP-NOW to the rate chosen by rate control.
+ *        Packets queued in the driver are sent with the rate what is set when they leave the queue,
+ *        so new rate is applied only when all packets in flight are done.
+ */
+static void wifi_tx_rate_switch(void);
+#endif
+
+/**
+ * @brief Pass packet to ESP-NOW when Tx window allows it.
+ *        If driver is out of buffers, wait for any packet in flight and try again.
+ * 
+ * @param pucData Packet to send
+ * @param xDataLen Amount of bytes in packet
+ * @param xTicksToWait How long to wait for free credit, retries are done only if it's not 0
+ * 
+ * @retval See @ref ''esp_err_t''
+ */
+static esp_err_t wifi_espnow_send(const uint8_t* pucData, size_t xDataLen, TickType_t xTicksToWait);
+#endif
+
 /**
  * @brief Send packet with ESP_NOW or as raw 802.11 blob
  * 
  * @param pxPacketFrame byte array with data need to be sent
+ * @param xTicksToWait How long to wait for free place in Tx window
  * 
  * @retval See @ref ''esp_err_t''
  */
-static esp_err_t send_new_packet(const PacketFrame_t* pxPacketFrame);
+static esp_err_t send_new_packet(const PacketFrame_t* pxPacketFrame, TickType_t xTicksToWait);
+
+/**
+ * @brief Forget everything about previous frame in slot and start to assemble new one
+ * 
+ * @param pxFrame Assembly slot of the new frame
+ * @param ucFrameId Sequence number of the new frame
+ */
+static void frame_assembly_reset(frame_assembly_t* pxFrame, uint8_t ucFrameId);
+
+/**
+ * @brief Forget all frames in flight, Transmitter starts a new frame sequence.
+ * 
+ * @param ucFrameId Sequence number of the first frame in new sequence, older ones are stale
+ */
+static void frame_assembly_restart(uint8_t ucFrameId);
+
+/**
+ * @brief Find assembly slot for the packet.
+ *        Newer frame id will abandon older frame what occupies the same slot.
+ * 
+ * @param ucFrameId Sequence number from the packet header
+ * 
+ * @retval Slot of the frame, or NULL if packet is stale and must be dropped
+ * 
+ * @note This check is O(1) and done before decryption, so stale packets costs nothing.
+ */
+static frame_assembly_t* frame_assembly_check_frame(uint8_t ucFrameId);
+
+/**
+ * @brief Mark block as received for the frame.
+ * 
+ * @param pxFrame Assembly slot of the frame
+ * @param usBlockId Index of the block in frame
+ * @param ucFinalBlock Is this block is last one in the frame
+ * @param ucSegment Restart segment from the packet header, @ref ''FRAME_BLOCK_SEGMENT_UNKNOWN'' if there is no header
+ * @param ucDataSize Amount of image data in the block
+ * 
+ * @retval pdFALSE if block is duplicate or frame is already delivered, pdTRUE otherwise
+ */
+static BaseType_t frame_assembly_add_block(
+    frame_assembly_t* pxFrame, uint16_t usBlockId, uint8_t ucFinalBlock, uint8_t ucSegment, uint8_t ucDataSize);
+
+/**
+ * @brief Check if enougth blocks of the frame are received to start decoding.
+ *        Ready frame is passed to the decoder and all older frames are abandoned.
+ * 
+ * @param pxFrame Assembly slot of the frame
+ * 
+ * @retval pdTRUE only once per frame, when @ref ''CONFIG_IMG_FRAME_COMPLETENESS_THRESHOLD'' is reached.
+ *         pdFALSE for the frame what decoder already reads, see @ref ''pxFrameStream''
+ */
+static BaseType_t frame_assembly_is_ready(frame_assembly_t* pxFrame);
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+/**
+ * @brief Move the end of the frame data what could be read by decoder right now.
+ *        Stream is broken as soon as any block after the first gap is received.
+ * 
+ * @param pxFrame Assembly slot of the frame, data of each new block must be already copied to framebuffer
+ */
+static void frame_assembly_stream_update(frame_assembly_t* pxFrame);
+
+/**
+ * @brief Tell decoder to stop reading the frame, it will be passed to the decoder again once it's ready.
+ * 
+ * @param pxFrame Assembly slot of the frame
+ */
+static void frame_assembly_stream_break(frame_assembly_t* pxFrame);
+#endif
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+/**
+ * @brief Ask Transmitter to send again missing blocks of the frame,
+ *        if frame is not yet delivered and retries are not exhausted.
+ *        Bitmap of missing blocks is taken right here, so it matches the request.
+ *        If final block is not yet received, everything after the last known block is missing too.
+ * 
+ * @param pxFrame Assembly slot of the frame
+ * 
+ * @note Called from WiFi task and from timer task, all NAK state is changed under @ref ''xFrameReadyLock''
+ */
+static void frame_assembly_request_missing(frame_assembly_t* pxFrame);
+
+/**
+ * @brief Fill NAK packet with bitmap taken by the last request
+ * 
+ * @param pxPacketNak Packet to fill
+ */
+static void frame_assembly_fill_nak(PacketNak_t* pxPacketNak);
+#endif // CONFIG_WIRELESS_NAK_MAX_RETRIES
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+/**
+ * @brief Restore lost data blocks of FEC group if enougth parity blocks are received.
+ * 
+ * @param pxFrame Assembly slot of the frame
+ * @param ulGroupId Index of FEC group in the frame
+ */
+static void frame_assembly_fec_recover(frame_assembly_t* pxFrame, uint32_t ulGroupId);
+#endif
+
+/**
+ * @brief Copy image data of received packet to it's final place.
+ * 
+ * @param pucDest Where to place image data
+ * @param pxPacketImageData Received packet
+ * @param pucDecrypted Decrypted first @ref ''WIFI_CRYPT_IMAGE_DATA_SIZE'' bytes of image data,
+ *                     or NULL if packet is not encrypted
+ * @param xSize Amount of bytes to copy
+ */
+static void wifi_copy_image_data(uint8_t* pucDest,
+                                 const PacketImageData_t* pxPacketImageData,
+                                 const uint8_t* pucDecrypted,
+                                 size_t xSize);
 
 /**
  * @brief This function decrypt data from @ref ''wifi_espnow_packet_rx_cb'' 
@@ -220,6 +554,15 @@ static void wifi_espnow_packet_tx_cb(const uint8_t* mac_addr, esp_now_send_statu
  */
 static void vWirelessUpdateCallback(memory_model_types_t xDataId);
 
+#if(CONFIG_IMG_GRAYSCALE_MODE == 2)
+/**
+ * @brief Ask for grayscale image when frame rate is too low, and for colour one when it's high enougth
+ * 
+ * @param ulRxBytes Amount of bytes received during the last report period, nothing is changed without link
+ */
+static void wifi_color_mode_update(uint32_t ulRxBytes);
+#endif
+
 /**
  * @brief Initialize memory_model for WiFi.
  */
@@ -235,6 +578,14 @@ static void init_wifi_rtos(void);
  */
 static void vNetStatsTimer(TimerHandle_t xTimer);
 
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+/**
+ * @brief Request missing blocks if no image data was received for 
+ *        @ref ''CONFIG_WIRELESS_NAK_GAP_TIMEOUT'' ms
+ */
+static void vFrameGapTimer(TimerHandle_t xTimer);
+#endif
+
 /**
  * @brief Send everything from @ref ''xFramePacketQueueHandler'' over wifi.
  * 
@@ -300,54 +651,614 @@ wifi_set_tx_power(int8_t ic_new_tx_power)
 }
 
 
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+static BaseType_t IRAM_ATTR
+wifi_tx_window_take(TickType_t xTicksToWait)
+{
+	if(xSemaphoreTake(xTxCreditsHandler, xTicksToWait) != pdTRUE)
+	{
+		return pdFALSE;
+	}
+
+	uint32_t ulSlot;
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	// Senders what can't wait are called from WiFi task, driver API is never used from there
+	if(xTicksToWait)
+	{
+		wifi_tx_rate_switch();
+	}
+#endif
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	ulSlot = (ulTxWindowHead + ulTxWindowCount) % CONFIG_WIRELESS_TX_WINDOW_SIZE;
+	llTxWindowSendTime[ulSlot] = esp_timer_get_time();
+	++ulTxWindowCount;
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	// Rate is unknown while it's being switched, such packet is not counted at all
+	ucTxWindowRate[ulSlot] = (xTxRateSwitching == pdTRUE) ? WIRELESS_RATE_NUM : ucTxRateApplied;
+#endif
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	return pdTRUE;
+}
+
+
+static void IRAM_ATTR
+wifi_tx_window_cancel(void)
+{
+	portENTER_CRITICAL(&xTxWindowLock);
+	--ulTxWindowCount;
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	xSemaphoreGive(xTxCreditsHandler);
+}
+
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+static void IRAM_ATTR
+wifi_tx_rate_apply(uint8_t ucRate)
+{
+	if(ucRate == ucTxRateApplied)
+	{
+		return;
+	}
+
+	if(esp_wifi_config_espnow_rate(WIFI_IF_STA, xWifiPhyRates[ucRate]) == ESP_OK)
+	{
+		ucTxRateApplied = ucRate;
+
+		ASYNC_PRINTF(CONFIG_WIRELESS_RATE_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Tx rate kbps %u\n",
+		             ulWirelessRateKbps(ucRate));
+	}
+}
+
+
+static void IRAM_ATTR
+wifi_tx_rate_switch(void)
+{
+	uint32_t ulInFlight;
+	uint8_t ucRate;
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	ulInFlight = ulTxWindowCount;
+	// Probe never stalls the window, it's taken only when there is nothing in flight
+	ucRate = ulInFlight ? ucWirelessRateGetBest(&xTxRate) : ucWirelessRateSelect(&xTxRate);
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	if(ucRate == ucTxRateApplied)
+	{
+		return;
+	}
+
+	// Every send callback wakes up the task, lost callback doesn't block it forever
+	for(uint32_t i = 0; ulInFlight && (i < WIFI_RATE_SWITCH_MAX_WAIT_TICKS); i++)
+	{
+		ulTaskNotifyTake(pdTRUE, 1);
+
+		portENTER_CRITICAL(&xTxWindowLock);
+		ulInFlight = ulTxWindowCount;
+		portEXIT_CRITICAL(&xTxWindowLock);
+	}
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	xTxRateSwitching = pdTRUE;
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	wifi_tx_rate_apply(ucRate);
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	xTxRateSwitching = pdFALSE;
+	portEXIT_CRITICAL(&xTxWindowLock);
+}
+#endif
+
+
+static void IRAM_ATTR
+wifi_tx_window_release(esp_now_send_status_t status)
+{
+	int64_t llNow = esp_timer_get_time();
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	if(ulTxWindowCount)
+	{
+		// Packet is waiting in driver queue while previous one is in the air
+		int64_t llStartTime = llTxWindowSendTime[ulTxWindowHead];
+		if(llStartTime < llTxLastDoneTime)
+		{
+			llStartTime = llTxLastDoneTime;
+		}
+
+		xTxStats.ullAirtime += (uint64_t)(llNow - llStartTime);
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+		vWirelessRateReport(&xTxRate, ucTxWindowRate[ulTxWindowHead], (status == ESP_NOW_SEND_SUCCESS));
+#endif
+
+		ulTxWindowHead = (ulTxWindowHead + 1) % CONFIG_WIRELESS_TX_WINDOW_SIZE;
+		--ulTxWindowCount;
+	}
+	llTxLastDoneTime = llNow;
+
+	if(status == ESP_NOW_SEND_SUCCESS)
+	{
+		++xTxStats.ulPacketsSent;
+	}
+	else
+	{
+		++xTxStats.ulPacketsFailed;
+	}
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	if((llNow - llTxRateUpdateTime) >= WIFI_RATE_UPDATE_PERIOD_US)
+	{
+		llTxRateUpdateTime = llNow;
+		ucWirelessRateUpdate(&xTxRate);
+	}
+#endif
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	xSemaphoreGive(xTxCreditsHandler);
+	xTaskNotifyGive(xDataTransmitterTaskHandler);
+}
+
+
 static esp_err_t IRAM_ATTR
-send_new_packet(const PacketFrame_t* pxPacketFrame)
+wifi_espnow_send(const uint8_t* pucData, size_t xDataLen, TickType_t xTicksToWait)
+{
+	esp_err_t xRes = ESP_ERR_TIMEOUT;
+	uint32_t ulRetries = 0;
+
+	while(wifi_tx_window_take(xTicksToWait) == pdTRUE)
+	{
+		xRes = esp_now_send(NULL, pucData, xDataLen);
+
+		if(ESP_OK == xRes)
+		{
+			return xRes;
+		}
+
+		// Send callback will never be called for this one
+		wifi_tx_window_cancel();
+
+		if((xRes != ESP_ERR_ESPNOW_NO_MEM) || !xTicksToWait || (ulRetries >= CONFIG_WIRELESS_TX_NO_MEM_RETRIES))
+		{
+			break;
+		}
+
+		++ulRetries;
+		++xTxStats.ulNoMemRetries;
+
+		// Driver queue is full, back off till any packet in flight is done
+		ulTaskNotifyTake(pdTRUE, 1);
+	}
+
+	++xTxStats.ulPacketsDropped;
+	return xRes;
+}
+#endif
+
+
+static esp_err_t IRAM_ATTR
+send_new_packet(const PacketFrame_t* pxPacketFrame, TickType_t xTicksToWait)
 {
 	PROFILE_POINT(CONFIG_ESP_NOW_TASK_PACKET_SEND_DBG_PROFILER, profile_point_start);
 
-	const PacketFrame_t* pxPacketFrameToSend = NULL;
-	uint32_t ulTxDataLen = sizeof(PacketHeader_t) + pxPacketFrame->xHeader.ucDataSize;
+	const PacketFrame_t* pxPacketFrameToSend = NULL;
+	uint32_t ulTxDataLen = sizeof(PacketHeader_t) + pxPacketFrame->xHeader.ucDataSize;
+
+	if((BaseType_t)pxPacketFrame->xHeader.ucEncrypted == pdTRUE)
+	{
+		PacketFrame_t* pxPacketEncrypted = (PacketFrame_t*)&ucEncryptedData[0][0];
+		pxPacketEncrypted->xHeader.ulValue = pxPacketFrame->xHeader.ulValue;
+
+		wifi_crypt_packet(&pxPacketFrame->ucFrameData[0],
+		                  &pxPacketEncrypted->ucFrameData[0],
+		                  pxPacketEncrypted->xHeader.ucDataSize,
+		                  ESP_AES_ENCRYPT);
+		pxPacketFrameToSend = (const PacketFrame_t*)pxPacketEncrypted;
+	}
+	else
+	{
+		pxPacketFrameToSend = pxPacketFrame;
+	}
+
+#if(WIRELESS_USE_RAW_80211_PACKET == 1)
+	(void)xTicksToWait;
+
+	// TODO: BD-0005 add random stuff for magic_packet.random
+	// wifi_espnow_raw_packet.magic_packet.random = (uint32_t)
+	wifi_espnow_raw_packet.magic_packet.content.length = ulTxDataLen;
+	memcpy(wifi_espnow_raw_packet.magic_packet.content.body, pxPacketFrameToSend, ulTxDataLen);
+	esp_err_t xRes =
+	    esp_wifi_80211_tx(WIFI_IF_STA, &wifi_espnow_raw_packet, sizeof(wifi_espnow_packet_t) + ulTxDataLen, true);
+#else
+	esp_err_t xRes = wifi_espnow_send((const uint8_t*)pxPacketFrameToSend, ulTxDataLen, xTicksToWait);
+#endif
+
+	PROFILE_POINT(CONFIG_ESP_NOW_TASK_PACKET_SEND_DBG_PROFILER, profile_point_end);
+
+	if(ESP_OK != xRes)
+	{
+		// do something...
+		ASYNC_PRINTF(CONFIG_ESP_NOW_SEND_PACKET_FAIL_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "esp_now_send failed with %u\n",
+		             (uint32_t)xRes);
+	}
+
+	return xRes;
+}
+
+
+static void IRAM_ATTR
+frame_assembly_reset(frame_assembly_t* pxFrame, uint8_t ucFrameId)
+{
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	BaseType_t xStreamed = pdFALSE;
+#endif
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+	// Decoder was too slow to take it
+	if(pxFrameReady == pxFrame)
+	{
+		ucFrameMailboxRevoke(&xFrameMailbox, FRAME_BUF_ID(pxFrame->pucFrameBuf));
+		pxFrameReady = NULL;
+		++ulDroppedFrames;
+	}
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	// Decoder must stop to read the framebuffer before the next frame is written there
+	if(pxFrameStream == pxFrame)
+	{
+		pxFrameStream = NULL;
+		xStreamed = pdTRUE;
+	}
+#endif
+
+	// Gap timer could check this slot right now
+	vFrameBlocksReset(&pxFrame->xBlocks, ucFrameId);
+	pxFrame->ucNakRequests = 0;
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	if(xStreamed)
+	{
+		vImageProcessorStreamUpdate();
+	}
+
+	pxFrame->usBlocksInOrder = 0;
+	pxFrame->ucStreamState = FRAME_STREAM_NONE;
+#endif
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+	// Watch for gaps in the new frame
+	xTimerChangePeriod(xFrameGapTimer, FRAME_GAP_TIMER_TICKS(CONFIG_WIRELESS_NAK_GAP_TIMEOUT), 0);
+#endif
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+	memset(&pxFrame->ucFecParityMap[0], 0, sizeof(pxFrame->ucFecParityMap));
+#endif
+}
+
+
+static void IRAM_ATTR
+frame_assembly_restart(uint8_t ucFrameId)
+{
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	frame_assembly_t* pxStream = NULL;
+#endif
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+	if(pxFrameReady)
+	{
+		ucFrameMailboxRevoke(&xFrameMailbox, FRAME_BUF_ID(pxFrameReady->pucFrameBuf));
+		pxFrameReady = NULL;
+	}
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	pxStream = pxFrameStream;
+	pxFrameStream = NULL;
+#endif
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	// Header of the new sequence could be written over the streamed frame
+	if(pxStream)
+	{
+		vImageProcessorStreamUpdate();
+	}
+#endif
+
+	for(uint32_t i = 0; i < FRAME_ASSEMBLY_SLOTS_NUM; i++)
+	{
+		xFrameAssembly[i].xBlocks.ucSynced = (uint8_t)pdFALSE;
+	}
+
+	vFrameSequenceRestart(&xFrameSequence, ucFrameId);
+}
+
+
+static frame_assembly_t* IRAM_ATTR
+frame_assembly_check_frame(uint8_t ucFrameId)
+{
+	frame_assembly_t* pxFrame = &xFrameAssembly[ucFrameId & FRAME_ASSEMBLY_SLOTS_MASK];
+	uint8_t ucCheck = ucFrameBlocksCheck(&xFrameSequence, &pxFrame->xBlocks, ucFrameId);
+
+	if(ucCheck == FRAME_BLOCKS_STALE)
+	{
+		++ulStalePackets;
+		return NULL;
+	}
+
+	if(ucCheck == FRAME_BLOCKS_DROP)
+	{
+		// Frame from the same slot wasn't completed in time, so abandon it
+		++ulDroppedFrames;
+	}
+
+	if(ucCheck != FRAME_BLOCKS_CURRENT)
+	{
+		frame_assembly_reset(pxFrame, ucFrameId);
+	}
+
+	return pxFrame;
+}
+
+
+static BaseType_t IRAM_ATTR
+frame_assembly_add_block(
+    frame_assembly_t* pxFrame, uint16_t usBlockId, uint8_t ucFinalBlock, uint8_t ucSegment, uint8_t ucDataSize)
+{
+	// Block map is read by NAK request from timer task
+	portENTER_CRITICAL(&xFrameReadyLock);
+	uint32_t ulAdded = ulFrameBlocksAdd(&pxFrame->xBlocks, usBlockId, ucFinalBlock, ucSegment, ucDataSize);
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	return ulAdded ? pdTRUE : pdFALSE;
+}
+
+
+static BaseType_t IRAM_ATTR
+frame_assembly_is_ready(frame_assembly_t* pxFrame)
+{
+	if(!ulFrameBlocksIsComplete(&pxFrame->xBlocks, CONFIG_IMG_FRAME_COMPLETENESS_THRESHOLD))
+	{
+		return pdFALSE;
+	}
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+	pxFrame->xBlocks.ucDelivered = (uint8_t)pdTRUE;
+	portEXIT_CRITICAL(&xFrameReadyLock);
+	pxFrame->ulHeaderVersion = ulRxHeaderVersion;
+	vFrameBlocksFindSegments(&pxFrame->xBlocks, PACKET_IMAGE_DATA_MAX_SIZE, usDataOffsetExtra, &pxFrame->xSegments);
+
+	// Older frame would be shown after the newer one, so it's not needed anymore
+	for(uint32_t i = 0; i < FRAME_ASSEMBLY_SLOTS_NUM; i++)
+	{
+		frame_assembly_t* pxOther = &xFrameAssembly[i];
+
+		if(ulFrameBlocksIsOlder(&pxOther->xBlocks, pxFrame->xBlocks.ucFrameId))
+		{
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+			frame_assembly_stream_break(pxOther);
+#endif
+			portENTER_CRITICAL(&xFrameReadyLock);
+			pxOther->xBlocks.ucDelivered = (uint8_t)pdTRUE;
+			portEXIT_CRITICAL(&xFrameReadyLock);
+
+			if(pxOther->xBlocks.usBlocksReceived)
+			{
+				++ulDroppedFrames;
+			}
+		}
+	}
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	BaseType_t xStreamed = pdFALSE;
+#endif
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	// Decoder already reads this frame, so it only has to know there is no more data
+	xStreamed = (pxFrame->ucStreamState == FRAME_STREAM_ACTIVE) ? pdTRUE : pdFALSE;
+	if(!xStreamed)
+#endif
+	{
+		// Decoder is still busy with even older frame, skip the previous one
+		if(ucFrameMailboxPublish(&xFrameMailbox, FRAME_BUF_ID(pxFrame->pucFrameBuf)) != FRAME_MAILBOX_NONE)
+		{
+			++ulDroppedFrames;
+		}
+		pxFrameReady = pxFrame;
+	}
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	vFrameSequenceDeliver(&xFrameSequence, pxFrame->xBlocks.ucFrameId);
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+	if(xStreamed)
+	{
+		++ulStreamedFrames;
+		vImageProcessorStreamUpdate();
+
+		// Tell to Transmitter: "JPG is accepted, now send the next frame"
+		xWirelessSendEvent(W_MSG_EVENT_FRAME_RECEIVED);
+		return pdFALSE;
+	}
+#endif
+
+	return pdTRUE;
+}
+
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+static void IRAM_ATTR
+frame_assembly_stream_update(frame_assembly_t* pxFrame)
+{
+	uint32_t ulInOrder = ulFrameBlocksInOrder(&pxFrame->xBlocks, pxFrame->usBlocksInOrder, IMG_JPG_BLOCKS_MAX_NUM);
+
+	pxFrame->usBlocksInOrder = (uint16_t)ulInOrder;
+
+	if(pxFrameStream != pxFrame)
+	{
+		// The first block of the new frame, idle decoder could start to read it right now
+		if(ulInOrder && (pxFrame->xBlocks.usBlocksReceived == 1) && (pxFrame->ucStreamState == FRAME_STREAM_NONE))
+		{
+			vImageProcessorStartDecode();
+		}
+		return;
+	}
+
+	// Packets are sent in order, so block after the gap means the missing one is lost or late
+	if(pxFrame->xBlocks.usBlocksReceived != ulInOrder)
+	{
+		frame_assembly_stream_break(pxFrame);
+		return;
+	}
+
+	vImageProcessorStreamUpdate();
+}
+
+
+static void IRAM_ATTR
+frame_assembly_stream_break(frame_assembly_t* pxFrame)
+{
+	BaseType_t xStreamed = pdFALSE;
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+	if(pxFrame->ucStreamState == FRAME_STREAM_ACTIVE)
+	{
+		pxFrame->ucStreamState = FRAME_STREAM_FAILED;
+		xStreamed = (pxFrameStream == pxFrame) ? pdTRUE : pdFALSE;
+	}
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	// Decoder may wait for the data what will never come
+	if(xStreamed)
+	{
+		vImageProcessorStreamUpdate();
+	}
+}
+#endif
+
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+static void IRAM_ATTR
+frame_assembly_request_missing(frame_assembly_t* pxFrame)
+{
+	portENTER_CRITICAL(&xFrameReadyLock);
+	if(pxFrame->xBlocks.ucDelivered || (pxFrame->ucNakRequests >= CONFIG_WIRELESS_NAK_MAX_RETRIES))
+	{
+		portEXIT_CRITICAL(&xFrameReadyLock);
+		return;
+	}
+
+	++pxFrame->ucNakRequests;
+	ucNakFrameId = pxFrame->xBlocks.ucFrameId;
+	vFrameBlocksMissing(&pxFrame->xBlocks, IMG_JPG_BLOCKS_MAX_NUM, &ulNakMissingMap[0], PACKET_NAK_MAP_WORDS);
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	xWirelessSendEvent(W_MSG_EVENT_FRAME_NAK);
+}
+
+static void
+frame_assembly_fill_nak(PacketNak_t* pxPacketNak)
+{
+	portENTER_CRITICAL(&xFrameReadyLock);
+	pxPacketNak->xHeader.ucFrameId = ucNakFrameId;
+	memcpy(&pxPacketNak->ulMissingMap[0], &ulNakMissingMap[0], sizeof(pxPacketNak->ulMissingMap));
+	portEXIT_CRITICAL(&xFrameReadyLock);
+}
+#endif // CONFIG_WIRELESS_NAK_MAX_RETRIES
+
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+static void IRAM_ATTR
+frame_assembly_fec_recover(frame_assembly_t* pxFrame, uint32_t ulGroupId)
+{
+	uint8_t* pucData[CONFIG_WIRELESS_FEC_DATA_BLOCKS];
+	uint8_t* pucParity[CONFIG_WIRELESS_FEC_PARITY_BLOCKS];
+	uint32_t ulMissingMap = 0;
+	uint32_t ulParityMap = pxFrame->ucFecParityMap[ulGroupId];
+
+	if(!ulParityMap || pxFrame->xBlocks.ucDelivered)
+	{
+		return;
+	}
+
+	uint32_t ulGroupStart = ulGroupId * CONFIG_WIRELESS_FEC_DATA_BLOCKS;
+	uint32_t ulGroupEnd = pxFrame->ucFecGroupEnd[ulGroupId];
+
+	// Restored blocks are always full size, so they must fit into framebuffer
+	if((ulGroupEnd * PACKET_IMAGE_DATA_MAX_SIZE + usDataOffsetExtra) > IMG_JPG_FILE_MAX_SIZE)
+	{
+		return;
+	}
+
+	for(uint32_t i = 0; i < (ulGroupEnd - ulGroupStart); i++)
+	{
+		uint32_t ulBlockId = ulGroupStart + i;
+
+		if(!ulFrameBlocksHas(&pxFrame->xBlocks, ulBlockId))
+		{
+			ulMissingMap |= (1UL << i);
+		}
+
+		pucData[i] = &pxFrame->pucFrameBuf[ulBlockId * PACKET_IMAGE_DATA_MAX_SIZE + usDataOffsetExtra];
+	}
 
-	if((BaseType_t)pxPacketFrame->xHeader.ucEncrypted == pdTRUE)
+	if(!ulMissingMap || (__builtin_popcount(ulMissingMap) > __builtin_popcount(ulParityMap)))
 	{
-		PacketFrame_t* pxPacketEncrypted = (PacketFrame_t*)&ucEncryptedData[0][0];
-		pxPacketEncrypted->xHeader.ulValue = pxPacketFrame->xHeader.ulValue;
+		return;
+	}
 
-		wifi_crypt_packet(&pxPacketFrame->ucFrameData[0],
-		                  &pxPacketEncrypted->ucFrameData[0],
-		                  pxPacketEncrypted->xHeader.ucDataSize,
-		                  ESP_AES_ENCRYPT);
-		pxPacketFrameToSend = (const PacketFrame_t*)pxPacketEncrypted;
+	for(uint32_t i = 0; i < CONFIG_WIRELESS_FEC_PARITY_BLOCKS; i++)
+	{
+		pucParity[i] = &pxFrame->ucFecParityBuf[ulGroupId][i][0];
 	}
-	else
+
+	int32_t lRestored = lFecRecover(
+	    pucData, ulGroupEnd - ulGroupStart, ulMissingMap, pucParity, ulParityMap, PACKET_IMAGE_DATA_MAX_SIZE);
+
+	// Parity blocks are spoiled after recovery attempt
+	pxFrame->ucFecParityMap[ulGroupId] = 0;
+
+	if(lRestored > 0)
 	{
-		pxPacketFrameToSend = pxPacketFrame;
+		ulFecRestoredBlocks += (uint32_t)lRestored;
+
+		for(uint32_t i = 0; i < (ulGroupEnd - ulGroupStart); i++)
+		{
+			if(ulMissingMap & (1UL << i))
+			{
+				frame_assembly_add_block(
+				    pxFrame, ulGroupStart + i, pdFALSE, FRAME_BLOCK_SEGMENT_UNKNOWN, PACKET_IMAGE_DATA_MAX_SIZE);
+			}
+		}
 	}
+}
+#endif // CONFIG_WIRELESS_FEC_ENABLE
 
-#if(WIRELESS_USE_RAW_80211_PACKET == 1)
-	// TODO: BD-0005 add random stuff for magic_packet.random
-	// wifi_espnow_raw_packet.magic_packet.random = (uint32_t)
-	wifi_espnow_raw_packet.magic_packet.content.length = ulTxDataLen;
-	memcpy(wifi_espnow_raw_packet.magic_packet.content.body, pxPacketFrameToSend, ulTxDataLen);
-	esp_err_t xRes =
-	    esp_wifi_80211_tx(WIFI_IF_STA, &wifi_espnow_raw_packet, sizeof(wifi_espnow_packet_t) + ulTxDataLen, true);
-#else
-	xSemaphoreTake(xDataTransmitterTxLockHandler, portMAX_DELAY);
-	esp_err_t xRes = esp_now_send(NULL, (const uint8_t*)pxPacketFrameToSend, ulTxDataLen);
-#endif
 
-	PROFILE_POINT(CONFIG_ESP_NOW_TASK_PACKET_SEND_DBG_PROFILER, profile_point_end);
+static void IRAM_ATTR
+wifi_copy_image_data(uint8_t* pucDest,
+                     const PacketImageData_t* pxPacketImageData,
+                     const uint8_t* pucDecrypted,
+                     size_t xSize)
+{
+	size_t xDecryptedSize = 0;
 
-	if(ESP_OK != xRes)
+	if(pucDecrypted)
 	{
-		// do something...
-		ASYNC_PRINTF(CONFIG_ESP_NOW_SEND_PACKET_FAIL_DBG_PRINTOUT,
-		             async_print_type_u32,
-		             "esp_now_send failed with %u\n",
-		             (uint32_t)xRes);
+		xDecryptedSize = (xSize < WIFI_CRYPT_IMAGE_DATA_SIZE) ? xSize : WIFI_CRYPT_IMAGE_DATA_SIZE;
+		memcpy(&pucDest[0], &pucDecrypted[0], xDecryptedSize);
 	}
 
-	return xRes;
+	// Everything after the first AES block is sent as is
+	memcpy(&pucDest[xDecryptedSize], &pxPacketImageData->ucImageData[xDecryptedSize], xSize - xDecryptedSize);
 }
 
 
@@ -355,19 +1266,86 @@ static void IRAM_ATTR
 wifi_espnow_parse_new_data(const uint8_t* data, int data_len)
 {
 	const PacketFrame_t* pxPacketFrame = (const PacketFrame_t*)data;
+	// Source of image data, only first AES block of it could be encrypted
+	const PacketImageData_t* pxPacketPayload = (const PacketImageData_t*)data;
+	// Header and decrypted first AES block of image packet
+	uint32_t ulPacketHead[(sizeof(PacketHeader_t) + WIFI_CRYPT_BLOCK_SIZE) / sizeof(uint32_t)];
+	const uint8_t* pucDecrypted = NULL;
+	frame_assembly_t* pxFrame = NULL;
 
 	PROFILE_POINT(CONFIG_ESP_NOW_RX_DATA_DBG_PROFILER, profile_point_start);
 
-	if(pxPacketFrame->xHeader.ucEncrypted)
+	if(data_len < (int)sizeof(PacketHeader_t))
 	{
-		PacketFrame_t* pxPacketEncrypted = (PacketFrame_t*)&ucEncryptedData[1][0];
-		pxPacketEncrypted->xHeader.ulValue = pxPacketFrame->xHeader.ulValue;
+		PROFILE_POINT(CONFIG_ESP_NOW_RX_DATA_DBG_PROFILER, profile_point_end);
+		return;
+	}
 
-		wifi_crypt_packet(&pxPacketFrame->ucFrameData[0],
-		                  &pxPacketEncrypted->ucFrameData[0],
-		                  pxPacketEncrypted->xHeader.ucDataSize,
-		                  ESP_AES_DECRYPT);
-		pxPacketFrame = (const PacketFrame_t*)pxPacketEncrypted;
+	// Image data is copied right from the driver buffer, so it can't be longer than received packet.
+	// Block id comes before the data, so it's size is never 0.
+	if(((pxPacketFrame->xHeader.ucType == PACKET_TYPE_FRAME_DATA) ||
+	    (pxPacketFrame->xHeader.ucType == PACKET_TYPE_FRAME_PARITY) ||
+	    (pxPacketFrame->xHeader.ucType == PACKET_TYPE_INITIAL_HEADER_DATA)) &&
+	   (!pxPacketFrame->xHeader.ucDataSize ||
+	    ((sizeof(PacketHeader_t) + pxPacketFrame->xHeader.ucDataSize) > (size_t)data_len)))
+	{
+		PROFILE_POINT(CONFIG_ESP_NOW_RX_DATA_DBG_PROFILER, profile_point_end);
+		return;
+	}
+
+	// Header is never encrypted, so old frames can be dropped before wasting time on AES
+	if((pxPacketFrame->xHeader.ucType == PACKET_TYPE_FRAME_DATA) ||
+	   (pxPacketFrame->xHeader.ucType == PACKET_TYPE_FRAME_PARITY))
+	{
+		pxFrame = frame_assembly_check_frame(pxPacketFrame->xHeader.ucFrameId);
+
+		if(!pxFrame)
+		{
+			PROFILE_POINT(CONFIG_ESP_NOW_RX_DATA_DBG_PROFILER, profile_point_end);
+			return;
+		}
+
+		// Both are checked by gap timer
+		portENTER_CRITICAL(&xFrameReadyLock);
+		pxLastFrame = pxFrame;
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+		llFrameLastBlockTime = esp_timer_get_time();
+#endif
+		portEXIT_CRITICAL(&xFrameReadyLock);
+	}
+
+	if(pxPacketFrame->xHeader.ucEncrypted)
+	{
+		if(((pxPacketFrame->xHeader.ucType == PACKET_TYPE_FRAME_DATA) ||
+		    (pxPacketFrame->xHeader.ucType == PACKET_TYPE_FRAME_PARITY) ||
+		    (pxPacketFrame->xHeader.ucType == PACKET_TYPE_INITIAL_HEADER_DATA)) &&
+		   (pxPacketFrame->xHeader.ucDataSize >= WIFI_CRYPT_BLOCK_SIZE))
+		{
+			// Decrypt only the first block, the rest of image data
+			// is copied once right to the framebuffer by @ref ''wifi_copy_image_data''
+			PacketFrame_t* pxPacketHead = (PacketFrame_t*)&ulPacketHead[0];
+			pxPacketHead->xHeader.ulValue = pxPacketFrame->xHeader.ulValue;
+
+			wifi_crypt_packet(&pxPacketFrame->ucFrameData[0],
+			                  &pxPacketHead->ucFrameData[0],
+			                  WIFI_CRYPT_BLOCK_SIZE,
+			                  ESP_AES_DECRYPT);
+
+			pucDecrypted = &((const PacketImageData_t*)pxPacketHead)->ucImageData[0];
+			pxPacketFrame = (const PacketFrame_t*)pxPacketHead;
+		}
+		else
+		{
+			PacketFrame_t* pxPacketEncrypted = (PacketFrame_t*)&ucEncryptedData[1][0];
+			pxPacketEncrypted->xHeader.ulValue = pxPacketFrame->xHeader.ulValue;
+
+			wifi_crypt_packet(&pxPacketFrame->ucFrameData[0],
+			                  &pxPacketEncrypted->ucFrameData[0],
+			                  pxPacketEncrypted->xHeader.ucDataSize,
+			                  ESP_AES_DECRYPT);
+			pxPacketFrame = (const PacketFrame_t*)pxPacketEncrypted;
+			pxPacketPayload = (const PacketImageData_t*)pxPacketEncrypted;
+		}
 	}
 
 	// Count whole amount of received data, not only playload!
@@ -381,21 +1359,44 @@ wifi_espnow_parse_new_data(const uint8_t* data, int data_len)
 	case PACKET_TYPE_INITIAL_HEADER_DATA: {
 		const PacketImageData_t* pxPacketImageData = (const PacketImageData_t*)pxPacketFrame;
 		uint16_t usDataOffset = pxPacketImageData->usBlockId * PACKET_IMAGE_DATA_MAX_SIZE;
+		// Header belongs to the next frame, so it's slot is not used by anyone else
+		uint8_t* pucHeaderBuf =
+		    xFrameAssembly[pxPacketImageData->xHeader.ucFrameId & FRAME_ASSEMBLY_SLOTS_MASK].pucFrameBuf;
+
+		// Header is (re)sent from the begining, it also means new frame sequence
+		if(!pxPacketImageData->usBlockId)
+		{
+			usDataOffsetExtra = 0;
+			frame_assembly_restart(pxPacketImageData->xHeader.ucFrameId);
+		}
+
+		if((usDataOffset + pxPacketImageData->xHeader.ucDataSize - 1) > IMG_JPG_FILE_MAX_SIZE)
+		{
+			break;
+		}
 
-		memcpy(&pucImgCurRxBufPtr[usDataOffset],
-		       &pxPacketImageData->ucImageData[0],
-		       pxPacketImageData->xHeader.ucDataSize - 1);
+		wifi_copy_image_data(&pucHeaderBuf[usDataOffset],
+		                     pxPacketPayload,
+		                     pucDecrypted,
+		                     pxPacketImageData->xHeader.ucDataSize - 1);
 
 		usDataOffsetExtra += (pxPacketImageData->xHeader.ucDataSize - 1);
 
 		if(pxPacketImageData->xHeader.ucFinalBlock)
 		{
-			// Apply constant table data to all framebuffers
+			// Apply constant table data to all framebuffers,
+			// except the one what is decoded right now
+			portENTER_CRITICAL(&xFrameReadyLock);
+			uint8_t* pucDecodeBuf = pucImgDecodeBufPtr;
+			xImgDecodeBufHeaderStale = pdTRUE;
+			++ulRxHeaderVersion;
+			portEXIT_CRITICAL(&xFrameReadyLock);
+
 			for(size_t i = 0; i < IMG_JPG_FRAMEBUFFERS_MAX_NUM; i++)
 			{
-				if(i != ulImgCurBufNum)
+				if((&ucRxImageBuf[i][0] != pucHeaderBuf) && (&ucRxImageBuf[i][0] != pucDecodeBuf))
 				{
-					memcpy(&ucRxImageBuf[i][0], &pucImgCurRxBufPtr[0], usDataOffsetExtra);
+					memcpy(&ucRxImageBuf[i][0], pucHeaderBuf, usDataOffsetExtra);
 				}
 			}
 		}
@@ -406,17 +1407,127 @@ wifi_espnow_parse_new_data(const uint8_t* data, int data_len)
 		const PacketImageData_t* pxPacketImageData = (const PacketImageData_t*)pxPacketFrame;
 		uint16_t usDataOffset = pxPacketImageData->usBlockId * PACKET_IMAGE_DATA_MAX_SIZE + usDataOffsetExtra;
 
-		memcpy(&pucImgCurRxBufPtr[usDataOffset],
-		       &pxPacketImageData->ucImageData[0],
-		       pxPacketImageData->xHeader.ucDataSize - 1);
+		if((pxPacketImageData->usBlockId >= IMG_JPG_BLOCKS_MAX_NUM) ||
+		   ((usDataOffset + pxPacketImageData->xHeader.ucDataSize - 1) > IMG_JPG_FILE_MAX_SIZE))
+		{
+			break;
+		}
+
+		uint8_t ucSegment = pxPacketImageData->xHeader.ucSegmentId;
+
+		if(pxPacketImageData->xHeader.ucSegmentEnd)
+		{
+			ucSegment |= FRAME_BLOCK_SEGMENT_END;
+		}
+
+		if(frame_assembly_add_block(pxFrame,
+		                            pxPacketImageData->usBlockId,
+		                            pxPacketImageData->xHeader.ucFinalBlock,
+		                            ucSegment,
+		                            (uint8_t)(pxPacketImageData->xHeader.ucDataSize - 1)) == pdFALSE)
+		{
+			break;
+		}
+
+		// Slot gets another framebuffer when decoder takes the frame, and it's never done while frame is received
+		assert(xFrameMailbox.ucState[FRAME_BUF_ID(pxFrame->pucFrameBuf)] == FRAME_BUF_FILLING);
+
+		wifi_copy_image_data(&pxFrame->pucFrameBuf[usDataOffset],
+		                     pxPacketPayload,
+		                     pucDecrypted,
+		                     pxPacketImageData->xHeader.ucDataSize - 1);
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+		uint32_t ulGroupId = pxPacketImageData->usBlockId / CONFIG_WIRELESS_FEC_DATA_BLOCKS;
+
+		if(pxPacketImageData->xHeader.ucFinalBlock)
+		{
+			// Parity was calculated with zero padded final block
+			uint32_t ulPadStart = usDataOffset + pxPacketImageData->xHeader.ucDataSize - 1;
+			uint32_t ulPadEnd = usDataOffset + PACKET_IMAGE_DATA_MAX_SIZE;
+
+			if(ulPadEnd > IMG_JPG_FILE_MAX_SIZE)
+			{
+				ulPadEnd = IMG_JPG_FILE_MAX_SIZE;
+			}
+
+			memset(&pxFrame->pucFrameBuf[ulPadStart], 0, ulPadEnd - ulPadStart);
+		}
+
+		frame_assembly_fec_recover(pxFrame, ulGroupId);
+#endif
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+		frame_assembly_stream_update(pxFrame);
+#endif
+
+		if(frame_assembly_is_ready(pxFrame) == pdTRUE)
+		{
+			vImageProcessorStartDecode();
+		}
+#if((CONFIG_WIRELESS_NAK_MAX_RETRIES > 0) && (CONFIG_WIRELESS_FEC_ENABLE == 0))
+		else if(pxPacketImageData->xHeader.ucFinalBlock)
+		{
+			frame_assembly_request_missing(pxFrame);
+		}
+#endif
+
+		break;
+	}
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+	case PACKET_TYPE_FRAME_PARITY: {
+		const PacketImageData_t* pxPacketImageData = (const PacketImageData_t*)pxPacketFrame;
+		uint32_t ulGroupEnd = pxPacketImageData->usBlockId;
+		uint32_t ulParityId = pxPacketImageData->xHeader.ucParityId;
+
+		if(!ulGroupEnd || (ulGroupEnd > IMG_JPG_BLOCKS_MAX_NUM) || (ulParityId >= CONFIG_WIRELESS_FEC_PARITY_BLOCKS) ||
+		   (pxPacketImageData->xHeader.ucDataSize != (PACKET_IMAGE_DATA_MAX_SIZE + 1)))
+		{
+			break;
+		}
 
+		uint32_t ulGroupId = (ulGroupEnd - 1) / CONFIG_WIRELESS_FEC_DATA_BLOCKS;
+
+		if(pxFrame->xBlocks.ucDelivered || (pxFrame->ucFecParityMap[ulGroupId] & (1UL << ulParityId)))
+		{
+			break;
+		}
+
+		wifi_copy_image_data(&pxFrame->ucFecParityBuf[ulGroupId][ulParityId][0],
+		                     pxPacketPayload,
+		                     pucDecrypted,
+		                     PACKET_IMAGE_DATA_MAX_SIZE);
+		pxFrame->ucFecParityMap[ulGroupId] |= (1UL << ulParityId);
+		pxFrame->ucFecGroupEnd[ulGroupId] = (uint8_t)ulGroupEnd;
+
+		// Total amount of blocks is known even if final data block is lost
 		if(pxPacketImageData->xHeader.ucFinalBlock)
+		{
+			pxFrame->xBlocks.usBlocksTotal = (uint16_t)ulGroupEnd;
+		}
+
+		frame_assembly_fec_recover(pxFrame, ulGroupId);
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+		frame_assembly_stream_update(pxFrame);
+#endif
+
+		if(frame_assembly_is_ready(pxFrame) == pdTRUE)
 		{
 			vImageProcessorStartDecode();
 		}
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+		// Last parity of the frame is the last packet of the frame
+		else if(pxPacketImageData->xHeader.ucFinalBlock && (ulParityId == (CONFIG_WIRELESS_FEC_PARITY_BLOCKS - 1)))
+		{
+			frame_assembly_request_missing(pxFrame);
+		}
+#endif
 
 		break;
 	}
+#endif // CONFIG_WIRELESS_FEC_ENABLE
 
 		// case PACKET_TYPE_TELEMETRY: {
 		// 	memcpy(&xCamTelemetryPkt, pxPacketFrame, sizeof(TelemetryPacket_t));
@@ -483,9 +1594,8 @@ static void IRAM_ATTR
 wifi_espnow_packet_tx_cb(const uint8_t* mac_addr, esp_now_send_status_t status)
 {
 	(void)mac_addr;
-	(void)status;
 
-	xSemaphoreGive(xDataTransmitterTxLockHandler);
+	wifi_tx_window_release(status);
 }
 
 static void IRAM_ATTR
@@ -518,12 +1628,41 @@ vWirelessUpdateCallback(memory_model_types_t xDataId)
 		break;
 	}
 
+	case MEMORY_MODEL_IMG_GRAYSCALE: {
+		xWirelessSendEvent(W_MSG_EVENT_COLOR_MODE);
+		break;
+	}
+
 	default:
 		break;
 	}
 }
 
 
+#if(CONFIG_IMG_GRAYSCALE_MODE == 2)
+static void
+wifi_color_mode_update(uint32_t ulRxBytes)
+{
+	uint32_t ulGrayscale = ulMemoryModelGet(MEMORY_MODEL_IMG_GRAYSCALE);
+
+	if(ulColorModeHold)
+	{
+		--ulColorModeHold;
+		return;
+	}
+
+	if(ulRxBytes && ((!ulGrayscale && (ulAvgFPS < CONFIG_IMG_GRAYSCALE_FPS_LOW)) ||
+	                 (ulGrayscale && (ulAvgFPS > CONFIG_IMG_GRAYSCALE_FPS_HIGH))))
+	{
+		ulColorModeHold = IMG_GRAYSCALE_HOLD_PERIODS;
+		vMemoryModelSet(MEMORY_MODEL_IMG_GRAYSCALE, !ulGrayscale);
+
+		ASYNC_PRINTF(CONFIG_IMG_GRAYSCALE_DBG_PRINTOUT, async_print_type_u32, "Grayscale %u\n", !ulGrayscale);
+	}
+}
+#endif
+
+
 static void
 init_wifi_memory_model(void)
 {
@@ -534,12 +1673,14 @@ init_wifi_memory_model(void)
 	assert(xMemoryModelRegisterItem(MEMORY_MODEL_WIFI_RTT_VALUE));
 	assert(xMemoryModelRegisterItem(MEMORY_MODEL_DATA_RX_RATE));
 	assert(xMemoryModelRegisterItem(MEMORY_MODEL_WIFI_RX_RSSI));
+	assert(xMemoryModelRegisterItem(MEMORY_MODEL_IMG_GRAYSCALE));
 
 	vMemoryModelSet(MEMORY_MODEL_WIFI_TX_POWER_1, DEFAULT_WIFI_TX_POWER_1);
 	vMemoryModelSet(MEMORY_MODEL_WIFI_CURRENT_CHANNEL, DEFAULT_WIFI_CHANNEL);
 	vMemoryModelSet(MEMORY_MODEL_WIFI_RTT_VALUE, 0);
 	vMemoryModelSet(MEMORY_MODEL_DATA_RX_RATE, 1);
 	vMemoryModelSet(MEMORY_MODEL_WIFI_RX_RSSI, -98);
+	vMemoryModelSet(MEMORY_MODEL_IMG_GRAYSCALE, (CONFIG_IMG_GRAYSCALE_MODE == 1));
 
 	assert(xMemoryModelRegisterCallback((memory_model_callback_t)vWirelessUpdateCallback));
 }
@@ -556,13 +1697,25 @@ init_wifi_rtos(void)
 	                                    &xNetStatsTimerControlBlock);
 	assert(xNetStatsTimer);
 
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+	xFrameGapTimer = xTimerCreateStatic("xFrameGapTimer",
+	                                    FRAME_GAP_TIMER_TICKS(CONFIG_WIRELESS_NAK_GAP_TIMEOUT),
+	                                    pdFALSE,
+	                                    NULL,
+	                                    (TimerCallbackFunction_t)(vFrameGapTimer),
+	                                    &xFrameGapTimerControlBlock);
+	assert(xFrameGapTimer);
+#endif
+
 	xEventQueueHandler = xQueueCreateStatic(
 	    EVENT_QUEUE_SIZE, sizeof(wireless_msg_events_t), (uint8_t*)(&xEventQueueStorage[0]), &xEventQueueControlBlock);
 	assert(xEventQueueHandler);
 
 #if(WIRELESS_USE_RAW_80211_PACKET == 0)
-	xDataTransmitterTxLockHandler = xSemaphoreCreateBinaryStatic(&xDataTransmitterTxLockControlBlock);
-	assert(xDataTransmitterTxLockHandler);
+	xTxCreditsHandler = xSemaphoreCreateCountingStatic(CONFIG_WIRELESS_TX_WINDOW_SIZE,
+	                                                   CONFIG_WIRELESS_TX_WINDOW_SIZE,
+	                                                   &xTxCreditsControlBlock);
+	assert(xTxCreditsHandler);
 #endif
 
 	xDataTransmitterTaskHandler = xTaskCreateStaticPinnedToCore((TaskFunction_t)(vDataTransmitterTask),
@@ -579,6 +1732,18 @@ init_wifi_rtos(void)
 // ----------------------------------------------------------------------
 // Accessors functions
 
+void
+vWirelessGetTxStats(wireless_tx_stats_t* pxStats)
+{
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+	portENTER_CRITICAL(&xTxWindowLock);
+	memcpy(pxStats, &xTxStats, sizeof(wireless_tx_stats_t));
+	portEXIT_CRITICAL(&xTxWindowLock);
+#else
+	memcpy(pxStats, &xTxStats, sizeof(wireless_tx_stats_t));
+#endif
+}
+
 void
 vWirelessGetOwnMAC(uint8_t* pucMAC)
 {
@@ -596,12 +1761,146 @@ vWirelessSetNodeKeys(pairing_data_t* pxKeysData)
 uint8_t* IRAM_ATTR
 pucWirelessTakeCurrentRxBuffer(void)
 {
-	uint32_t ulImgPrevBufNum = ulImgCurBufNum;
+	uint8_t* pucFrameBuf = NULL;
+	uint8_t* pucStaleBuf = NULL;
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+	if(pxFrameReady)
+	{
+		// Previously decoded framebuffer is free now, so give it to the slot instead
+		ucFrameMailboxTake(&xFrameMailbox, NULL);
+		pucFrameBuf = pxFrameReady->pucFrameBuf;
+		pxFrameReady->pucFrameBuf = pucImgDecodeBufPtr;
+
+		if(xImgDecodeBufHeaderStale == pdTRUE)
+		{
+			xImgDecodeBufHeaderStale = pdFALSE;
+			pucStaleBuf = pucImgDecodeBufPtr;
+		}
+
+		pucImgDecodeBufPtr = pucFrameBuf;
+		ucImgDecodeFrameId = pxFrameReady->xBlocks.ucFrameId;
+		memcpy(&xImgDecodeSegments, &pxFrameReady->xSegments, sizeof(wireless_rx_segments_t));
+		ulImgDecodeHeaderVersion = pxFrameReady->ulHeaderVersion;
+		// Final block is usually shorter, bytes after it are left from previous frames
+		ulImgDecodeFrameSize =
+		    ulFrameBlocksSize(&pxFrameReady->xBlocks, pxFrameReady->xBlocks.usBlocksTotal, PACKET_IMAGE_DATA_MAX_SIZE) +
+		    usDataOffsetExtra;
+		pxFrameReady = NULL;
+	}
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	if(ulImgDecodeFrameSize > IMG_JPG_FILE_MAX_SIZE)
+	{
+		ulImgDecodeFrameSize = IMG_JPG_FILE_MAX_SIZE;
+	}
+
+	// Every framebuffer from assembly slot already has the new header
+	if(pucStaleBuf)
+	{
+		memcpy(pucStaleBuf, pucFrameBuf, usDataOffsetExtra);
+	}
+
+	return pucFrameBuf;
+}
+
+
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+uint8_t* IRAM_ATTR
+pucWirelessTakeStreamRxBuffer(void)
+{
+	frame_assembly_t* pxFrame = pxLastFrame;
+	uint8_t* pucFrameBuf = NULL;
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+	// Ready frame is always decoded first, and only the frame without gaps is worth to start
+	if(!pxFrameReady && !pxFrameStream && pxFrame->xBlocks.ucSynced && !pxFrame->xBlocks.ucDelivered &&
+	   (pxFrame->ucStreamState == FRAME_STREAM_NONE) && pxFrame->usBlocksInOrder &&
+	   (pxFrame->usBlocksInOrder == pxFrame->xBlocks.usBlocksReceived))
+	{
+		pxFrame->ucStreamState = FRAME_STREAM_ACTIVE;
+		pxFrameStream = pxFrame;
+		pucFrameBuf = pxFrame->pucFrameBuf;
+		ucImgDecodeFrameId = pxFrame->xBlocks.ucFrameId;
+		ulImgDecodeHeaderVersion = ulRxHeaderVersion;
+	}
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	return pucFrameBuf;
+}
+
+
+wireless_rx_stream_state_t IRAM_ATTR
+xWirelessGetRxStream(uint32_t* pulSize)
+{
+	wireless_rx_stream_state_t xState = W_RX_STREAM_BROKEN;
+	uint32_t ulSize = 0;
+
+	portENTER_CRITICAL(&xFrameReadyLock);
+	const frame_assembly_t* pxFrame = pxFrameStream;
+	if(pxFrame && (pxFrame->ucStreamState == FRAME_STREAM_ACTIVE))
+	{
+		xState = pxFrame->xBlocks.ucDelivered ? W_RX_STREAM_COMPLETE : W_RX_STREAM_RECEIVING;
+		ulSize = ulFrameBlocksSize(&pxFrame->xBlocks, pxFrame->usBlocksInOrder, PACKET_IMAGE_DATA_MAX_SIZE) +
+		         usDataOffsetExtra;
+	}
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	if(pulSize)
+	{
+		*pulSize = (ulSize < IMG_JPG_FILE_MAX_SIZE) ? ulSize : IMG_JPG_FILE_MAX_SIZE;
+	}
+
+	return xState;
+}
+
+
+void IRAM_ATTR
+vWirelessReleaseStreamRxBuffer(BaseType_t xDecoded)
+{
+	portENTER_CRITICAL(&xFrameReadyLock);
+	// Frame what is not delivered yet will be passed to the decoder again once it's ready
+	if(pxFrameStream && !xDecoded && (pxFrameStream->ucStreamState == FRAME_STREAM_ACTIVE))
+	{
+		pxFrameStream->ucStreamState = FRAME_STREAM_FAILED;
+	}
+	pxFrameStream = NULL;
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	if(!xDecoded)
+	{
+		++ulBrokenStreams;
+	}
+}
+#endif
+
+
+void
+vWirelessGetRxSegments(wireless_rx_segments_t* pxSegments)
+{
+	memcpy(pxSegments, &xImgDecodeSegments, sizeof(wireless_rx_segments_t));
+}
+
+
+uint32_t
+ulWirelessGetRxHeaderVersion(void)
+{
+	return ulImgDecodeHeaderVersion;
+}
+
+
+uint32_t
+ulWirelessGetRxFrameSize(void)
+{
+	return ulImgDecodeFrameSize;
+}
 
-	ulImgCurBufNum = (ulImgCurBufNum + 1) & IMG_JPG_FRAMEBUFFERS_MASK;
-	pucImgCurRxBufPtr = &ucRxImageBuf[ulImgCurBufNum][0];
 
-	return &ucRxImageBuf[ulImgPrevBufNum][0];
+uint32_t
+ulWirelessGetRxIntactSize(void)
+{
+	return (xImgDecodeSegments.usIntactSize < ulImgDecodeFrameSize) ? xImgDecodeSegments.usIntactSize
+	                                                                : ulImgDecodeFrameSize;
 }
 
 
@@ -620,7 +1919,38 @@ vNetStatsTimer(TimerHandle_t xTimer)
 	(void)xTimer;
 	xWirelessSendEvent(W_MSG_EVENT_PING);
 	xWirelessSendEvent(W_MSG_EVENT_RTT);
+	// Colour mode is sent again, in case if previous packet was lost
+	xWirelessSendEvent(W_MSG_EVENT_COLOR_MODE);
+}
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+static void
+vFrameGapTimer(TimerHandle_t xTimer)
+{
+	// Frame assembly is changed by WiFi task while timer task checks it
+	portENTER_CRITICAL(&xFrameReadyLock);
+	frame_assembly_t* pxFrame = pxLastFrame;
+	BaseType_t xWaiting = (!pxFrame->xBlocks.ucDelivered && pxFrame->xBlocks.usBlocksReceived) ? pdTRUE : pdFALSE;
+	int64_t llLastBlockTime = llFrameLastBlockTime;
+	portEXIT_CRITICAL(&xFrameReadyLock);
+
+	if(xWaiting == pdFALSE)
+	{
+		return;
+	}
+
+	int64_t llIdleTime = (esp_timer_get_time() - llLastBlockTime) / 1000;
+
+	if(llIdleTime < CONFIG_WIRELESS_NAK_GAP_TIMEOUT)
+	{
+		// Image data is still coming, check later
+		xTimerChangePeriod(xTimer, FRAME_GAP_TIMER_TICKS(CONFIG_WIRELESS_NAK_GAP_TIMEOUT - llIdleTime), 0);
+		return;
+	}
+
+	frame_assembly_request_missing(pxFrame);
 }
+#endif
 
 static void
 vDataTransmitterTask(void* pvArg)
@@ -630,10 +1960,6 @@ vDataTransmitterTask(void* pvArg)
 
 	task_sync_get_bits(TASK_SYNC_EVENT_BIT_DATA_TX);
 
-#if(WIRELESS_USE_RAW_80211_PACKET == 0)
-	xSemaphoreGive(xDataTransmitterTxLockHandler);
-#endif
-
 	ASYNC_PRINTF(CONFIG_ENABLE_TASK_START_EVENT_DBG_PRINTOUT, async_print_type_str, assigned_name_for_task_data_tx, 0);
 
 	// Force channels scan if user requested so.
@@ -658,10 +1984,14 @@ vDataTransmitterTask(void* pvArg)
 			switch(xEvent)
 			{
 			case W_MSG_EVENT_FRAME_RECEIVED: {
-				PacketHeader_t* pxPacket = (PacketHeader_t*)&xPacket;
-				pxPacket->ulValue = 0;
-				pxPacket->ucType = PACKET_TYPE_ACK;
-				send_new_packet((const PacketFrame_t*)pxPacket);
+				// Ack is cumulative: every frame before this one is done too
+				PacketFrame_t* pxPacket = (PacketFrame_t*)&xPacket;
+				pxPacket->xHeader.ulValue = 0;
+				pxPacket->xHeader.ucType = PACKET_TYPE_ACK;
+				pxPacket->xHeader.ucFrameId = ucImgDecodeFrameId;
+				pxPacket->xHeader.ucDataSize = 1;
+				pxPacket->ucFrameData[0] = CONFIG_WIRELESS_FRAME_WINDOW_SIZE;
+				send_new_packet((const PacketFrame_t*)pxPacket, portMAX_DELAY);
 				break;
 			}
 
@@ -671,7 +2001,7 @@ vDataTransmitterTask(void* pvArg)
 				pxPacket->xHeader.ucType = PACKET_TYPE_PING;
 				pxPacket->xHeader.ucDataSize = sizeof(uint64_t);
 				pxPacket->ullTimestamp = esp_timer_get_time();
-				send_new_packet((const PacketFrame_t*)pxPacket);
+				send_new_packet((const PacketFrame_t*)pxPacket, portMAX_DELAY);
 				break;
 			}
 
@@ -679,6 +2009,97 @@ vDataTransmitterTask(void* pvArg)
 				uint32_t ulDataDiff = ulTotalReceivedData - ulReceivedData;
 				ulReceivedData = ulTotalReceivedData;
 				vMemoryModelSet(MEMORY_MODEL_DATA_RX_RATE, ulDataDiff);
+
+				// Let Transmitter adjust image quality to the link
+				PacketLinkStats_t* pxPacket = (PacketLinkStats_t*)&xPacket;
+				pxPacket->xHeader.ulValue = 0;
+				pxPacket->xHeader.ucType = PACKET_TYPE_LINK_STATS;
+				pxPacket->xHeader.ucDataSize = sizeof(PacketLinkStats_t) - sizeof(PacketHeader_t);
+				pxPacket->ulRxBytes = ulDataDiff;
+				pxPacket->usPeriodMs = NET_STATS_TIMER_TIMEOUT;
+				pxPacket->usFramesDecoded = (uint16_t)ulAvgFPS;
+				pxPacket->usFramesDropped = (uint16_t)(ulDroppedFrames - ulReportedDroppedFrames);
+				pxPacket->usDecodeTimeMs = (uint16_t)ulAvgFrameTime;
+				pxPacket->icRssi = icLinkRSSI;
+				ulReportedDroppedFrames = ulDroppedFrames;
+				send_new_packet((const PacketFrame_t*)pxPacket, portMAX_DELAY);
+
+#if(CONFIG_IMG_GRAYSCALE_MODE == 2)
+				wifi_color_mode_update(ulDataDiff);
+#endif
+
+				ASYNC_PRINTF(CONFIG_FRAME_ASSEMBLY_STATS_DBG_PRINTOUT,
+				             async_print_type_u32,
+				             "Dropped frames %u\n",
+				             ulDroppedFrames);
+				ASYNC_PRINTF(CONFIG_FRAME_ASSEMBLY_STATS_DBG_PRINTOUT,
+				             async_print_type_u32,
+				             "Skipped frames %u\n",
+				             xFrameMailbox.ulSkipped);
+				ASYNC_PRINTF(CONFIG_FRAME_ASSEMBLY_STATS_DBG_PRINTOUT,
+				             async_print_type_u32,
+				             "Stale packets %u\n",
+				             ulStalePackets);
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+				ASYNC_PRINTF(CONFIG_FRAME_ASSEMBLY_STATS_DBG_PRINTOUT,
+				             async_print_type_u32,
+				             "FEC restored blocks %u\n",
+				             ulFecRestoredBlocks);
+#endif
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+				ASYNC_PRINTF(CONFIG_FRAME_ASSEMBLY_STATS_DBG_PRINTOUT,
+				             async_print_type_u32,
+				             "NAK requests %u\n",
+				             ulNakRequests);
+#endif
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+				ASYNC_PRINTF(CONFIG_FRAME_ASSEMBLY_STATS_DBG_PRINTOUT,
+				             async_print_type_u32,
+				             "Streamed frames %u\n",
+				             ulStreamedFrames);
+				ASYNC_PRINTF(CONFIG_FRAME_ASSEMBLY_STATS_DBG_PRINTOUT,
+				             async_print_type_u32,
+				             "Broken streams %u\n",
+				             ulBrokenStreams);
+#endif
+
+#if(CONFIG_WIRELESS_TX_STATS_DBG_PRINTOUT == 1)
+				wireless_tx_stats_t xStats;
+				vWirelessGetTxStats(&xStats);
+
+				ASYNC_PRINTF(1, async_print_type_u32, "Tx packets sent %u\n", xStats.ulPacketsSent);
+				ASYNC_PRINTF(1, async_print_type_u32, "Tx packets failed %u\n", xStats.ulPacketsFailed);
+				ASYNC_PRINTF(1, async_print_type_u32, "Tx NO_MEM retries %u\n", xStats.ulNoMemRetries);
+				ASYNC_PRINTF(1, async_print_type_u32, "Tx packets dropped %u\n", xStats.ulPacketsDropped);
+				ASYNC_PRINTF(1, async_print_type_u32, "Tx airtime ms %u\n", (uint32_t)(xStats.ullAirtime / 1000));
+#endif
+				break;
+			}
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+			case W_MSG_EVENT_FRAME_NAK: {
+				PacketNak_t* pxPacket = (PacketNak_t*)&xPacket;
+				pxPacket->xHeader.ulValue = 0;
+				pxPacket->xHeader.ucType = PACKET_TYPE_NAK;
+				pxPacket->xHeader.ucDataSize = sizeof(pxPacket->ulMissingMap);
+				frame_assembly_fill_nak(pxPacket);
+				send_new_packet((const PacketFrame_t*)pxPacket, portMAX_DELAY);
+
+				++ulNakRequests;
+
+				// Check again later if retransmitted blocks are lost as well
+				xTimerChangePeriod(xFrameGapTimer, FRAME_GAP_TIMER_TICKS(CONFIG_WIRELESS_NAK_GAP_TIMEOUT), 0);
+				break;
+			}
+#endif
+
+			case W_MSG_EVENT_COLOR_MODE: {
+				PacketFrame_t* pxPacket = (PacketFrame_t*)&xPacket;
+				pxPacket->xHeader.ulValue = 0;
+				pxPacket->xHeader.ucType = PACKET_TYPE_COLOR_MODE;
+				pxPacket->xHeader.ucDataSize = 1;
+				pxPacket->ucFrameData[0] = (uint8_t)ulMemoryModelGet(MEMORY_MODEL_IMG_GRAYSCALE);
+				send_new_packet((const PacketFrame_t*)pxPacket, portMAX_DELAY);
 				break;
 			}
 
@@ -697,7 +2118,7 @@ vDataTransmitterTask(void* pvArg)
 				uint8_t ucCurrentChannel = (uint8_t)ulMemoryModelGet(MEMORY_MODEL_WIFI_CURRENT_CHANNEL);
 				pxPacket->ucFrameData[0] = ucCurrentChannel;
 
-				esp_err_t xRes = send_new_packet((const PacketFrame_t*)pxPacket);
+				esp_err_t xRes = send_new_packet((const PacketFrame_t*)pxPacket, portMAX_DELAY);
 
 				if(ESP_OK == xRes)
 				{
@@ -728,7 +2149,7 @@ vDataTransmitterTask(void* pvArg)
 				pxPacket->xHeader.ucType = PACKET_TYPE_TX_POWER_UPDATE;
 				pxPacket->xHeader.ucDataSize = 1;
 				pxPacket->ucFrameData[0] = (uint8_t)ulMemoryModelGet(MEMORY_MODEL_WIFI_TX_POWER_2);
-				send_new_packet((const PacketFrame_t*)pxPacket);
+				send_new_packet((const PacketFrame_t*)pxPacket, portMAX_DELAY);
 				break;
 			}
 
@@ -779,7 +2200,6 @@ init_wifi(void)
 
 	ESP_ERROR_CHECK(esp_wifi_set_country_code(DEFAULT_WIFI_COUNTRY_CODE, false));
 	ESP_ERROR_CHECK(esp_wifi_set_channel(DEFAULT_WIFI_CHANNEL, WIFI_SECOND_CHAN_NONE));
-	ESP_ERROR_CHECK(esp_wifi_internal_set_fix_rate(WIFI_IF_STA, true, DEFAULT_WIFI_DATA_RATE));
 
 	wifi_set_tx_power(DEFAULT_WIFI_TX_POWER_1);
 
@@ -795,6 +2215,11 @@ init_espnow(void)
 #if(WIRELESS_USE_RAW_80211_PACKET == 0)
 	ESP_ERROR_CHECK(esp_now_init());
 	ESP_ERROR_CHECK(esp_wifi_config_espnow_rate(WIFI_IF_STA, DEFAULT_WIFI_DATA_RATE));
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	// Same rate as DEFAULT_WIFI_DATA_RATE
+	vWirelessRateInit(&xTxRate, WIRELESS_RATE_1M_L);
+#endif
 	ESP_ERROR_CHECK(esp_now_set_pmk((const uint8_t*)&(xWifiEncryptionGetKeys())->ucPMK[0]));
 	ESP_ERROR_CHECK(esp_now_register_recv_cb(wifi_espnow_packet_rx_cb));
 	ESP_ERROR_CHECK(esp_now_register_send_cb(wifi_espnow_packet_tx_cb));
@@ -806,6 +2231,12 @@ init_espnow(void)
 void
 init_wireless(void)
 {
+	vFrameMailboxInit(&xFrameMailbox, IMG_JPG_FRAMEBUFFERS_MAX_NUM, FRAME_BUF_ID(pucImgDecodeBufPtr));
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+	vFecInit();
+#endif
+
 	init_wifi();
 	init_encryption();
 	init_espnow();
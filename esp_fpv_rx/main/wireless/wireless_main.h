@@ -8,6 +8,7 @@
 #ifndef _WIRELESS_MAIN_H
 #define _WIRELESS_MAIN_H
 
+#include "frame_blocks.h"
 //
 #include <sdkconfig.h>
 //
@@ -25,9 +26,9 @@ extern "C" {
 // Definitions, type & enum declaration
 
 // ----------------------------
-// Maximum amount of framebuffers for Rx data from Transmitter
-#define IMG_JPG_FRAMEBUFFERS_MAX_NUM (2)
-#define IMG_JPG_FRAMEBUFFERS_MASK    (IMG_JPG_FRAMEBUFFERS_MAX_NUM - 1)
+// Maximum amount of framebuffers for Rx data from Transmitter:
+// one for each of two frames being assembled and one for the decoder
+#define IMG_JPG_FRAMEBUFFERS_MAX_NUM (3)
 
 // 16k for QVGA is pretty enougth
 #define IMG_JPG_FILE_MAX_SIZE (16 * 1024)
@@ -44,7 +45,10 @@ typedef enum
 	PACKET_TYPE_PING,
 	PACKET_TYPE_SWITCH_CHANNEL,
 	PACKET_TYPE_TX_POWER_UPDATE,
-	PACKET_TYPE_ENABLE_LED
+	PACKET_TYPE_ENABLE_LED,
+	PACKET_TYPE_FRAME_PARITY,
+	PACKET_TYPE_LINK_STATS,
+	PACKET_TYPE_COLOR_MODE
 } wifi_packet_type_t;
 
 typedef enum
@@ -56,12 +60,23 @@ typedef enum
 	W_MSG_EVENT_SWITCH_CURRENT_CHANNEL,
 	W_MSG_EVENT_UPDATE_TX_POWER_1,
 	W_MSG_EVENT_UPDATE_TX_POWER_2,
+	W_MSG_EVENT_FRAME_NAK,
+	W_MSG_EVENT_COLOR_MODE,
 	W_MSG_EVENT_TOTAL
 } wireless_msg_events_t;
 
 // ----------------------------
 
 
+typedef struct
+{
+	uint32_t ulPacketsSent;    // Packets confirmed by send callback
+	uint32_t ulPacketsFailed;  // Packets what were not acknowledged by the other node
+	uint32_t ulNoMemRetries;   // Times when driver had no free buffers and packet was sent again
+	uint32_t ulPacketsDropped; // Packets what were never passed to the driver
+	uint64_t ullAirtime;       // Time in us spent by confirmed packets in the air, including MAC retries
+} wireless_tx_stats_t;
+
 typedef struct
 {
 	uint16_t usApNum;
@@ -135,11 +150,18 @@ typedef struct
 				{
 					uint8_t ucEncrypted : 1;  // Received ucFrameData[] is encrypted
 					uint8_t ucFinalBlock : 1; // All previously splitted data is now fully transmitted and ready for process
-					uint8_t ucUnused : 6;
+					uint8_t ucParityId : 3;   // Index of parity block in FEC group, see @ref ''PACKET_TYPE_FRAME_PARITY''
+					uint8_t ucUnused : 3;
+				};
+				struct
+				{
+					uint8_t : 2;
+					uint8_t ucSegmentId : 5;  // Restart segment of @ref ''PACKET_TYPE_FRAME_DATA'' block
+					uint8_t ucSegmentEnd : 1; // The last data block of the restart segment
 				};
 			};
 			uint8_t ucDataSize; // Amount of bytes in ucFrameData[]
-			uint8_t ucReserved; // For padding and easy 32bit value copy via ulValue
+			uint8_t ucFrameId;  // Sequence number of the image frame this packet belongs to
 		};
 	};
 } PacketHeader_t; // 4 bytes total
@@ -161,14 +183,56 @@ typedef struct
 	uint8_t ucImageData[PACKET_FREE_DATA_SIZE - 1];
 } PacketImageData_t; // About 5~250 bytes
 
+// PACKET_TYPE_FRAME_PARITY reuses PacketImageData_t:
+//  - usBlockId is the index right after the last data block of protected group;
+//  - ucImageData[] is always PACKET_IMAGE_DATA_MAX_SIZE bytes,
+//    shorter final data block is treated as zero padded.
+
 #define PACKET_IMAGE_DATA_MAX_SIZE (PACKET_FREE_DATA_SIZE - 1)
 
+// Maximum amount of blocks what single Jpg frame could be splitted to
+#define IMG_JPG_BLOCKS_MAX_NUM ((IMG_JPG_FILE_MAX_SIZE + PACKET_IMAGE_DATA_MAX_SIZE - 1) / PACKET_IMAGE_DATA_MAX_SIZE)
+
+// Restart segments of the image what Transmitter inserts restart markers into, id is sent in 5 bits
+#define IMG_JPG_SEGMENTS_MAX_NUM (FRAME_SEGMENTS_MAX_NUM)
+
+// Intact segments of the frame, see @ref ''vFrameBlocksFindSegments''
+typedef frame_segments_t wireless_rx_segments_t;
+
+// State of the frame what decoder reads while it's still received
+typedef enum
+{
+	W_RX_STREAM_RECEIVING, // More data of the frame is on the way
+	W_RX_STREAM_COMPLETE,  // Frame is delivered, there will be no more data
+	W_RX_STREAM_BROKEN     // Frame has a gap or it's abandoned, decoder must stop reading it
+} wireless_rx_stream_state_t;
+
 typedef struct
 {
 	PacketHeader_t xHeader;
 	uint64_t ullTimestamp;
 } PacketPing_t; // About 12 bytes
 
+// Enougth to describe up to 128 blocks of single image frame
+#define PACKET_NAK_MAP_WORDS (4)
+
+typedef struct
+{
+	PacketHeader_t xHeader;                     // ucFrameId is the frame to retransmit blocks from
+	uint32_t ulMissingMap[PACKET_NAK_MAP_WORDS]; // Bit set for each block what need to be sent again
+} PacketNak_t; // About 20 bytes
+
+typedef struct
+{
+	PacketHeader_t xHeader;
+	uint32_t ulRxBytes;       // Amount of bytes received by Receiver during report period
+	uint16_t usPeriodMs;      // Duration of report period
+	uint16_t usFramesDecoded; // Frames shown by Receiver during report period
+	uint16_t usFramesDropped; // Frames abandoned by Receiver during report period
+	uint16_t usDecodeTimeMs;  // Average time used to decode single frame
+	int8_t icRssi;            // Signal level of Transmitter packets at Receiver, in dBm
+} PacketLinkStats_t; // About 17 bytes
+
 
 #pragma pack(pop)
 
@@ -179,6 +243,13 @@ typedef struct
 // ----------------------------------------------------------------------
 // Accessors functions
 
+/**
+ * @brief Get statistics of ESP-NOW Tx window
+ * 
+ * @param pxStats Where to store collected values
+ */
+void vWirelessGetTxStats(wireless_tx_stats_t* pxStats);
+
 /**
  * @brief Fill device MAC address which is required for Pairing
  * 
@@ -193,11 +264,14 @@ void vWirelessGetOwnMAC(uint8_t* pucMAC);
  */
 void vWirelessSetNodeKeys(pairing_data_t* pxKeysData);
 
+// Amount of bytes at the begining of ucFrameData[] what are changed by @ref ''wifi_crypt_packet''
+#define WIFI_CRYPT_BLOCK_SIZE (16)
+
 /**
  * @brief Encrypts first 16 bytes of input buffer
  * 
  * @param pucDataIn Input buffer with data to encrypt
- * @param pucDataOut Output buffer where encrypted data will be placed
+ * @param pucDataOut Output buffer where encrypted data will be placed, could be the same as pucDataIn
  * @param xInputSize Size of input buffer and amount of data in it
  * @param ucMode pass 1 for decrypt, pass 0 to encrypt. Check @ref ''AES_DECRYPT''
  * 
@@ -222,10 +296,67 @@ const pairing_data_t* xWifiEncryptionGetKeys(void);
 /**
  * @brief Get pointer to data and swap buffers: Receiving and Decoding
  * 
- * @return pointer to current buffer with image data
+ * @return pointer to buffer with the newest received frame,
+ *         or NULL if there is no new frame since the last call
  */
 uint8_t* pucWirelessTakeCurrentRxBuffer(void);
 
+#if(CONFIG_IMG_DECODER_STREAMING == 1)
+/**
+ * @brief Start to read the frame what is still being received, if decoder has no ready frame to take
+ * 
+ * @return pointer to framebuffer of the frame, it's valid until @ref ''vWirelessReleaseStreamRxBuffer'',
+ *         or NULL if there is no frame without gaps to start with
+ */
+uint8_t* pucWirelessTakeStreamRxBuffer(void);
+
+/**
+ * @brief Check how much data of the frame from @ref ''pucWirelessTakeStreamRxBuffer'' could be read
+ * 
+ * @param pulSize Where to store amount of bytes from the start of the header till the first missing block
+ * 
+ * @retval See @ref ''wireless_rx_stream_state_t'', data what was read is valid only if stream is not broken after that
+ */
+wireless_rx_stream_state_t xWirelessGetRxStream(uint32_t* pulSize);
+
+/**
+ * @brief Stop to read the frame from @ref ''pucWirelessTakeStreamRxBuffer''
+ * 
+ * @param xDecoded pdFALSE if frame must be passed to the decoder again once it's ready
+ */
+void vWirelessReleaseStreamRxBuffer(BaseType_t xDecoded);
+#endif
+
+/**
+ * @brief Get restart segments of the frame what was taken with the last @ref ''pucWirelessTakeCurrentRxBuffer''
+ * 
+ * @param pxSegments Where to store segments map, it's empty if image has no restart markers
+ */
+void vWirelessGetRxSegments(wireless_rx_segments_t* pxSegments);
+
+/**
+ * @brief Get version of Jpg header in the frame what was taken with the last @ref ''pucWirelessTakeCurrentRxBuffer''
+ * 
+ * @retval Version what is changed every time new header is received, so the same version means the same header
+ */
+uint32_t ulWirelessGetRxHeaderVersion(void);
+
+/**
+ * @brief Get size of the frame what was taken with the last @ref ''pucWirelessTakeCurrentRxBuffer''
+ * 
+ * @retval Amount of bytes from the start of the header till the end of the last block
+ */
+uint32_t ulWirelessGetRxFrameSize(void);
+
+/**
+ * @brief Get size of the part of the frame what is received without gaps,
+ *        for the frame what was taken with the last @ref ''pucWirelessTakeCurrentRxBuffer''
+ * 
+ * @retval Amount of bytes from the start of the header till the first missing block,
+ *         the same as @ref ''ulWirelessGetRxFrameSize'' if nothing is missing
+ */
+uint32_t ulWirelessGetRxIntactSize(void);
+
 /**
  * @brief
  */
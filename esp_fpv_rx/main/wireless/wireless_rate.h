@@ -0,0 +1,141 @@
+/**
+ * @file wireless_rate.h
+ *
+ * Adaptive PHY rate selection, similar to Minstrel.
+ * Success probability of every rate is tracked from send callbacks,
+ * the rate with the best expected throughput is used for most packets
+ * and small part of packets is used to probe neighbour rates.
+ * Rates what need better signal than the other node reports are never used.
+ *
+ * @note Keep this module free from ESP-IDF and FreeRTOS dependencies,
+ *       so it could be tested on the host against synthetic loss curves.
+ */
+
+#ifndef _WIRELESS_RATE_H
+#define _WIRELESS_RATE_H
+
+//
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Rates are sorted by expected throughput, from the most robust one.
+// Order must match PHY rate table in wireless_main.c
+typedef enum
+{
+	WIRELESS_RATE_LORA_250K = 0,
+	WIRELESS_RATE_LORA_500K,
+	WIRELESS_RATE_1M_L,
+	WIRELESS_RATE_2M_S,
+	WIRELESS_RATE_5M_S,
+	WIRELESS_RATE_11M_S,
+	WIRELESS_RATE_MCS0,
+	WIRELESS_RATE_MCS1,
+	WIRELESS_RATE_MCS2,
+	WIRELESS_RATE_MCS3,
+	WIRELESS_RATE_MCS4,
+	WIRELESS_RATE_MCS5,
+	WIRELESS_RATE_MCS6,
+	WIRELESS_RATE_MCS7,
+	WIRELESS_RATE_NUM
+} wireless_rate_id_t;
+
+// Fixed point one for success probability
+#define WIRELESS_RATE_PROB_ONE (1024)
+
+typedef struct
+{
+	uint32_t ulAttempts; // Packets sent with this rate during current period
+	uint32_t ulSuccess;  // Packets confirmed by the other node during current period
+	uint16_t usProb;     // Averaged success probability, see @ref ''WIRELESS_RATE_PROB_ONE''
+	uint8_t ucValid;     // Rate was ever tried, so usProb means something
+} wireless_rate_stats_t;
+
+typedef struct
+{
+	wireless_rate_stats_t xStats[WIRELESS_RATE_NUM];
+	uint32_t ulPackets;     // Packets selected since init, used to spread probes
+	uint8_t ucBestRate;     // Rate used for all packets except probes
+	uint8_t ucSampleOffset; // Next neighbour rate to probe
+	int8_t icRssi;          // Signal level reported by the other node, 0 till the first report
+} wireless_rate_t;
+
+// ----------------------------------------------------------------------
+// Accessors functions
+
+/**
+ * @brief Get nominal bitrate of the rate
+ *
+ * @param ucRate See @ref ''wireless_rate_id_t''
+ *
+ * @retval Bitrate in kbit/s
+ */
+uint32_t ulWirelessRateKbps(uint8_t ucRate);
+
+/**
+ * @brief Get rate what is used for all packets except probes
+ *
+ * @param pxRate Rate control state
+ *
+ * @retval See @ref ''wireless_rate_id_t''
+ */
+uint8_t ucWirelessRateGetBest(const wireless_rate_t* pxRate);
+
+/**
+ * @brief Limit rates to the ones what the other node could receive with reported signal level.
+ *        Current best rate is dropped at once if it's not usable anymore.
+ *
+ * @param pxRate Rate control state
+ * @param icRssi RSSI of our packets measured by the other node, in dBm
+ */
+void vWirelessRateSetRssi(wireless_rate_t* pxRate, int8_t icRssi);
+
+// ----------------------------------------------------------------------
+// Core functions
+
+/**
+ * @brief Reset all statistics
+ *
+ * @param pxRate Rate control state
+ * @param ucStartRate Rate what is used till there is no statistics
+ */
+void vWirelessRateInit(wireless_rate_t* pxRate, uint8_t ucStartRate);
+
+/**
+ * @brief Choose rate for the next packet
+ *
+ * @param pxRate Rate control state
+ *
+ * @retval See @ref ''wireless_rate_id_t''
+ */
+uint8_t ucWirelessRateSelect(wireless_rate_t* pxRate);
+
+/**
+ * @brief Count result of the packet sent with selected rate
+ *
+ * @param pxRate Rate control state
+ * @param ucRate Rate what packet was sent with
+ * @param ulSuccess Non zero if packet was confirmed by the other node
+ */
+void vWirelessRateReport(wireless_rate_t* pxRate, uint8_t ucRate, uint32_t ulSuccess);
+
+/**
+ * @brief Average statistics of the last period and choose the best rate.
+ *        Should be called periodically, about every 100ms.
+ *
+ * @param pxRate Rate control state
+ *
+ * @retval The best rate, see @ref ''wireless_rate_id_t''
+ */
+uint8_t ucWirelessRateUpdate(wireless_rate_t* pxRate);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WIRELESS_RATE_H */
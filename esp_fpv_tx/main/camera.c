@@ -2,6 +2,8 @@
 
 #include "camera_pins.h"
 #include "data_common.h"
+#include "jpeg_restart.h"
+#include "rate_control.h"
 #include "wireless/wireless_main.h"
 
 //
@@ -38,6 +40,39 @@
 // Amount of time needed to scan channels for the best one (1 minute)
 #define FORCE_FRAME_UPDATE_ON_START_TIMER_TIMEOUT (60000)
 
+#if(CONFIG_CAMERA_RATE_CONTROL_ENABLE == 1)
+// JPEG quality change per single controller step
+#define RATE_CONTROL_QUALITY_STEP (4)
+// Part of airtime what image data is allowed to use, the rest is for retries and control packets
+#define RATE_CONTROL_LINK_LOAD (80)
+// Frame loss in percents what always leads to smaller frames
+#define RATE_CONTROL_LOSS_HIGH (10)
+// Frame loss in percents what allows to try bigger frames
+#define RATE_CONTROL_LOSS_LOW (2)
+// Dead zone around frame size budget in percents
+#define RATE_CONTROL_HYSTERESIS (15)
+// Amount of good link reports in a row before frames get bigger
+#define RATE_CONTROL_UPGRADE_WAIT (3)
+// Amount of link reports ignored after each change
+#define RATE_CONTROL_HOLD_PERIODS (1)
+#endif
+
+// Values of sensor's special effect
+#define CAMERA_SPECIAL_EFFECT_NONE      (0)
+#define CAMERA_SPECIAL_EFFECT_GRAYSCALE (2)
+
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+// Header with DRI segment, sensor's header is about 600 bytes
+#define JPEG_RESTART_HEADER_MAX_SIZE (1024)
+// DMA words are unpacked by such pieces before restart markers insertion
+#define JPEG_RESTART_UNPACK_SIZE (32)
+#endif
+
+// Non zero if any byte of 32bit word is zero
+#define WORD_HAS_ZERO_BYTE(w) (((w)-0x01010101UL) & ~(w)&0x80808080UL)
+// Non zero if any byte of 32bit word is the second byte of EOI marker
+#define WORD_HAS_EOI_BYTE(w) WORD_HAS_ZERO_BYTE((w) ^ 0xD9D9D9D9UL)
+
 // ----------------------------------------------------------------------
 // FreeRTOS Variables
 
@@ -53,7 +88,8 @@ StackType_t xCameraStack[STACK_WORDS_SIZE_FOR_TASK_CAMERA];
 TimerHandle_t xForceFrameUpdateTimer = NULL;
 StaticTimer_t xForceFrameUpdateTimerControlBlock;
 
-//
+// Counts requests to check if new frame could be taken,
+// amount of frames in flight is limited by @ref ''ucFrameCredits''
 #define MAX_NEW_FRAMES_TO_START (5)
 SemaphoreHandle_t xFrameStartCounterHandler = NULL;
 StaticSemaphore_t xFrameStartCounterControlBlock;
@@ -66,12 +102,98 @@ static uint16_t usDataOffsetExtra = 0;
 static uint8_t ucImageData[IMG_JPG_FILE_MAX_SIZE];
 static uint16_t usImageDataSize = 0;
 
+/// Offset right after the EOI marker in @ref ''ucImageData'', 0 while it's not found
+static uint16_t usImageEoiOffset = 0;
+
+/// Current frame is sent block by block while DMA is still filling it
+static BaseType_t xStreamFrame = pdFALSE;
+/// Current frame was taken for streaming, so it's never sent from @ref ''ucImageData'',
+/// even when stream is already finished at EOI
+static BaseType_t xStreamedFrame = pdFALSE;
+/// Tx packet what is being filled by DMA right now, NULL if there is none
+static uint8_t* pucStreamBlock = NULL;
+/// Amount of bytes in @ref ''pucStreamBlock''
+static uint16_t usStreamBlockFill = 0;
+/// Last byte of streamed data, to catch EOI marker splitted between two DMA chunks
+static uint8_t ucStreamPrevByte = 0;
+
 static BaseType_t xFirstFrameHeaderSync = pdTRUE;
 
 /// DMA always trigger callback function, but this flag allow to copy
 /// AND transfer data over WiFi
 static volatile BaseType_t xTakeFrame = pdFALSE;
 
+/// Amount of frames to skip before Jpg header is sent again,
+/// so header is taken from the frame captured with new settings
+static uint8_t ucHeaderSyncSkipFrames = 0;
+
+/// Colour mode asked by Receiver, see @ref ''vCameraSetGrayscale''
+static volatile uint8_t ucGrayscaleRequested = 0;
+/// Colour mode of the sensor, it's applied to the image with the next Jpg header
+static volatile uint8_t ucGrayscale = 0;
+
+/// Amount of image bytes in the frame being streamed
+static uint32_t ulStreamFrameBytes = 0;
+/// Image data sent since the last link report
+static uint32_t ulSentFrameBytes = 0;
+static uint32_t ulSentFrames = 0;
+
+/// Amount of frames requested with @ref ''take_new_image_frame'' since start.
+/// Every taken frame gets it's own frame id, so it's the id of the next frame as well.
+static uint8_t ucFramesTaken = 0;
+/// Id of the oldest frame what is not yet acknowledged by Receiver
+static uint8_t ucFramesAcked = 0;
+/// Amount of frames Receiver allows to be in flight, updated with every Ack
+static uint8_t ucFrameCredits = 1;
+static portMUX_TYPE xFrameWindowLock = portMUX_INITIALIZER_UNLOCKED;
+
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+static uint8_t* camera_restart_get_block(void);
+static uint8_t camera_restart_send_block(uint8_t* pucBlock,
+                                         size_t xSize,
+                                         uint8_t ucSegmentId,
+                                         uint8_t ucSegmentEnd,
+                                         uint8_t ucFinal);
+
+static const jpeg_restart_config_t xJpegRestartConfig = {
+    .pucGetBlock = camera_restart_get_block,
+    .ucSendBlock = camera_restart_send_block,
+    .usBlockSize = PACKET_IMAGE_DATA_MAX_SIZE,
+    .ucRowsPerSegment = CONFIG_CAMERA_JPEG_RESTART_ROWS,
+};
+
+/// Restart markers are inserted only if the sensor's header is supported, see @ref ''xJpegRestart.ucValid''
+static jpeg_restart_t xJpegRestart;
+static uint8_t ucJpegRestartHeader[JPEG_RESTART_HEADER_MAX_SIZE];
+#endif
+
+#if(CONFIG_CAMERA_RATE_CONTROL_ENABLE == 1)
+/// Frame sizes what quality controller could switch between, from the smallest one.
+/// The last one must be the same as in @ref ''xCamConfig_no_psram'', DMA buffers are allocated for it.
+static const framesize_t xFrameSizeLadder[] = {FRAMESIZE_QQVGA, FRAMESIZE_HQVGA, FRAMESIZE_240X240};
+
+static const rate_control_config_t xRateControlConfig = {
+    .ucQualityBest = CONFIG_CAMERA_JPEG_QUALITY_BEST,
+    .ucQualityWorst = CONFIG_CAMERA_JPEG_QUALITY_WORST,
+    .ucQualityStep = RATE_CONTROL_QUALITY_STEP,
+    .ucFrameSizeMax = (sizeof(xFrameSizeLadder) / sizeof(xFrameSizeLadder[0])) - 1,
+    .ucTargetFps = CONFIG_CAMERA_RATE_CONTROL_TARGET_FPS,
+    .ucLinkLoadPercent = RATE_CONTROL_LINK_LOAD,
+    .ucLossHighPercent = RATE_CONTROL_LOSS_HIGH,
+    .ucLossLowPercent = RATE_CONTROL_LOSS_LOW,
+    .ucHysteresisPercent = RATE_CONTROL_HYSTERESIS,
+    .ucUpgradeWaitMin = RATE_CONTROL_UPGRADE_WAIT,
+    .ucHoldPeriods = RATE_CONTROL_HOLD_PERIODS,
+};
+
+static rate_control_state_t xRateControlState;
+/// The last report from Receiver, waiting to be processed by Camera task
+static rate_control_input_t xLinkReport;
+static BaseType_t xLinkReportReady = pdFALSE;
+/// Airtime counter of Tx window at the previous report
+static uint64_t ullLastTxAirtime = 0;
+#endif
+
 // ----------------------------
 // clang-format off
 static const camera_config_t xCamConfig_no_psram = {
@@ -116,6 +238,60 @@ static const camera_config_t xCamConfig_no_psram = {
 // ----------------------------------------------------------------------
 // Static functions declaration
 
+/**
+ * @brief Look for EOI marker in freshly copied image data
+ * 
+ * @param ulStart Offset of the first byte to check in @ref ''ucImageData''
+ * @param ulEnd Offset right after the last byte to check
+ * 
+ * @retval Offset right after EOI marker or 0 if there is no EOI
+ */
+static uint16_t camera_find_eoi(uint32_t ulStart, uint32_t ulEnd);
+
+/**
+ * @brief Look for EOI marker in data what was just written to the stream block
+ * 
+ * @param pucData Data to check
+ * @param xSize Amount of bytes to check
+ * 
+ * @retval Amount of bytes till the end of EOI marker or 0 if there is no EOI
+ */
+static size_t camera_stream_find_eoi(const uint8_t* pucData, size_t xSize);
+
+/**
+ * @brief Convert DMA words directly into Tx packets of the frame.
+ *        Each complete block is sent at once, final block is sent when EOI marker is found.
+ * 
+ * @param src DMA buffer with one byte of data in every word
+ * @param count Amount of bytes in DMA buffer
+ */
+static void camera_stream_unpack(const uint32_t* src, size_t count);
+
+/**
+ * @brief Send current stream block as the last one in frame
+ */
+static void camera_stream_finish(void);
+
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+/**
+ * @brief Pass DMA words of the streamed frame through restart markers insertion.
+ *        Frame is finished once the last MCU is sent.
+ * 
+ * @param src DMA buffer with one byte of data in every word
+ * @param count Amount of bytes in DMA buffer
+ */
+static void camera_restart_unpack(const uint32_t* src, size_t count);
+
+/**
+ * @brief Send whole image from @ref ''ucImageData'' with restart markers inserted
+ * 
+ * @param ulSize Amount of image bytes after the header
+ * 
+ * @retval Amount of bytes sent
+ */
+static uint32_t camera_restart_send_image(uint32_t ulSize);
+#endif
+
 /**
  * @brief Grab frame from Camera, splits into chunks by 250 bytes
  *        and add to Tx queue
@@ -142,6 +318,38 @@ static void vForceFrameUpdateTimer(TimerHandle_t xTimer);
  */
 static uint32_t ulWaitNewFrameAck(TickType_t xTicksToSync);
 
+/**
+ * @brief Request new frame if Receiver has free credit for it
+ *        and previous request is already picked up by DMA callback.
+ * 
+ * @retval pdTRUE if @ref ''take_new_image_frame'' was called
+ */
+static BaseType_t camera_frame_window_take(void);
+
+/**
+ * @brief Count image data of the frame what was just sent
+ * 
+ * @param ulBytes Amount of image bytes in frame, without the header
+ */
+static void camera_frame_sent(uint32_t ulBytes);
+
+/**
+ * @brief Send Jpg header again with the next frame what is captured with current sensor settings
+ */
+static void camera_request_header_sync(void);
+
+/**
+ * @brief Switch sensor to the colour mode what Receiver asked for
+ */
+static void camera_color_mode_update(void);
+
+#if(CONFIG_CAMERA_RATE_CONTROL_ENABLE == 1)
+/**
+ * @brief Apply new quality and frame size if link report from Receiver asks for it
+ */
+static void camera_rate_control_update(void);
+#endif
+
 /**
  * @brief Creates FreeRTOS objects what need to maintain the Camera
  */
@@ -176,6 +384,133 @@ take_new_image_frame(void)
 }
 
 
+static BaseType_t
+camera_frame_window_take(void)
+{
+	BaseType_t xRes = pdFALSE;
+
+	portENTER_CRITICAL(&xFrameWindowLock);
+	if((xTakeFrame == pdFALSE) && ((uint8_t)(ucFramesTaken - ucFramesAcked) < ucFrameCredits))
+	{
+		++ucFramesTaken;
+		take_new_image_frame();
+		xRes = pdTRUE;
+	}
+	portEXIT_CRITICAL(&xFrameWindowLock);
+
+	return xRes;
+}
+
+
+static void IRAM_ATTR
+camera_frame_sent(uint32_t ulBytes)
+{
+	portENTER_CRITICAL(&xFrameWindowLock);
+	ulSentFrameBytes += ulBytes;
+	++ulSentFrames;
+	portEXIT_CRITICAL(&xFrameWindowLock);
+}
+
+
+static void
+camera_request_header_sync(void)
+{
+	portENTER_CRITICAL(&xFrameWindowLock);
+	// Frame in progress is captured with previous settings
+	ucHeaderSyncSkipFrames = 1;
+	xFirstFrameHeaderSync = pdTRUE;
+	portEXIT_CRITICAL(&xFrameWindowLock);
+}
+
+
+static void
+camera_color_mode_update(void)
+{
+	uint8_t ucRequested = ucGrayscaleRequested;
+
+	if(ucRequested == ucGrayscale)
+	{
+		return;
+	}
+
+	// Chroma is flat, even if it's still sent
+	sensor_t* pxSensor = esp_camera_sensor_get();
+	pxSensor->set_special_effect(pxSensor,
+	                             ucRequested ? CAMERA_SPECIAL_EFFECT_GRAYSCALE : CAMERA_SPECIAL_EFFECT_NONE);
+	ucGrayscale = ucRequested;
+
+	// Components are described by the header, Receiver drops frames with the old one
+	camera_request_header_sync();
+
+	ASYNC_PRINTF(CONFIG_CAMERA_COLOR_MODE_DBG_PRINTOUT, async_print_type_u32, "Grayscale %u\n", ucRequested);
+}
+
+
+#if(CONFIG_CAMERA_RATE_CONTROL_ENABLE == 1)
+static void
+camera_rate_control_update(void)
+{
+	rate_control_input_t xInput;
+	wireless_tx_stats_t xTxStats;
+
+	portENTER_CRITICAL(&xFrameWindowLock);
+	if(xLinkReportReady == pdFALSE)
+	{
+		portEXIT_CRITICAL(&xFrameWindowLock);
+		return;
+	}
+
+	xLinkReportReady = pdFALSE;
+	memcpy(&xInput, &xLinkReport, sizeof(rate_control_input_t));
+	xInput.ulFrameBytes = ulSentFrames ? (ulSentFrameBytes / ulSentFrames) : 0;
+	ulSentFrameBytes = 0;
+	ulSentFrames = 0;
+	portEXIT_CRITICAL(&xFrameWindowLock);
+
+	vWirelessGetTxStats(&xTxStats);
+	xInput.ulAirtimeUs = (uint32_t)(xTxStats.ullAirtime - ullLastTxAirtime);
+	ullLastTxAirtime = xTxStats.ullAirtime;
+
+	rate_control_action_t xAction = xRateControlUpdate(&xRateControlConfig, &xRateControlState, &xInput);
+
+	ASYNC_PRINTF(CONFIG_CAMERA_RATE_CONTROL_DBG_PRINTOUT,
+	             async_print_type_u32,
+	             "Frame budget %u\n",
+	             xRateControlState.ulFrameBudget);
+
+	if(xAction == RATE_CONTROL_KEEP)
+	{
+		return;
+	}
+
+	sensor_t* pxSensor = esp_camera_sensor_get();
+	framesize_t xFrameSize = xFrameSizeLadder[xRateControlState.ucFrameSize];
+
+	if(pxSensor->status.quality != xRateControlState.ucQuality)
+	{
+		pxSensor->set_quality(pxSensor, xRateControlState.ucQuality);
+	}
+
+	if(pxSensor->status.framesize != xFrameSize)
+	{
+		pxSensor->set_framesize(pxSensor, xFrameSize);
+	}
+
+	// Quantization tables and frame size are part of the header
+	camera_request_header_sync();
+
+	ASYNC_PRINTF(CONFIG_CAMERA_RATE_CONTROL_DBG_PRINTOUT,
+	             async_print_type_u32,
+	             "Jpg quality %u\n",
+	             xRateControlState.ucQuality);
+	ASYNC_PRINTF(CONFIG_CAMERA_RATE_CONTROL_DBG_PRINTOUT,
+	             async_print_type_u32,
+	             "Frame size %u\n",
+	             xRateControlState.ucFrameSize);
+}
+#endif
+
+
 void
 send_jpg_header(uint8_t* pucImageData)
 {
@@ -199,11 +534,280 @@ send_jpg_header(uint8_t* pucImageData)
 	// + 'DQT'
 	usDataOffsetExtra = ofs;
 
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+	size_t xRestartHeaderSize = 0;
+
+	if((usDataOffsetExtra + JPEG_RESTART_DRI_SIZE) <= JPEG_RESTART_HEADER_MAX_SIZE)
+	{
+		xRestartHeaderSize = xJpegRestartParseHeader(&xJpegRestart,
+		                                             &xJpegRestartConfig,
+		                                             &pucImageData[0],
+		                                             usDataOffsetExtra,
+		                                             &ucJpegRestartHeader[0],
+		                                             ucGrayscale);
+	}
+
+	// Receiver gets the same image without restart markers, if sensor's one is not supported
+	if(xRestartHeaderSize)
+	{
+		vWirelessSendArray(PACKET_TYPE_INITIAL_HEADER_DATA, &ucJpegRestartHeader[0], xRestartHeaderSize, pdTRUE);
+		return;
+	}
+#endif
+
 	// Now we can send our Jpg header
 	vWirelessSendArray(PACKET_TYPE_INITIAL_HEADER_DATA, &pucImageData[0], usDataOffsetExtra, pdTRUE);
 }
 
 
+static uint16_t IRAM_ATTR
+camera_find_eoi(uint32_t ulStart, uint32_t ulEnd)
+{
+	// Header tables could contain anything, skip them
+	if(ulStart <= usDataOffsetExtra)
+	{
+		ulStart = usDataOffsetExtra + 1;
+	}
+
+	for(uint32_t i = ulStart; i < ulEnd; i++)
+	{
+		if((ucImageData[i] == 0xD9) && (ucImageData[i - 1] == 0xFF))
+		{
+			return (uint16_t)(i + 1);
+		}
+	}
+
+	return 0;
+}
+
+
+static size_t IRAM_ATTR
+camera_stream_find_eoi(const uint8_t* pucData, size_t xSize)
+{
+	uint8_t ucPrevByte = ucStreamPrevByte;
+
+	for(size_t i = 0; i < xSize; i++)
+	{
+		if((ucPrevByte == 0xFF) && (pucData[i] == 0xD9))
+		{
+			return i + 1;
+		}
+		ucPrevByte = pucData[i];
+	}
+
+	ucStreamPrevByte = ucPrevByte;
+	return 0;
+}
+
+
+static void IRAM_ATTR
+camera_stream_finish(void)
+{
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+	if(xJpegRestart.ucValid)
+	{
+		xStreamFrame = pdFALSE;
+		camera_frame_sent(ulJpegRestartFinish(&xJpegRestart));
+
+		PROFILE_POINT(CONFIG_JPG_FRAME_TX_LATENCY_DBG_PROFILER, profile_point_end);
+		return;
+	}
+#endif
+
+	if(!pucStreamBlock)
+	{
+		pucStreamBlock = pucWirelessGetFrameBlockBuffer();
+		usStreamBlockFill = 0;
+	}
+
+	xWirelessSendFrameBlock(pucStreamBlock, usStreamBlockFill, pdTRUE, pdTRUE, 0, pdFALSE);
+	pucStreamBlock = NULL;
+	xStreamFrame = pdFALSE;
+
+	camera_frame_sent(ulStreamFrameBytes + usStreamBlockFill);
+	ulStreamFrameBytes = 0;
+
+	PROFILE_POINT(CONFIG_JPG_FRAME_TX_LATENCY_DBG_PROFILER, profile_point_end);
+}
+
+
+static void IRAM_ATTR
+camera_stream_unpack(const uint32_t* src, size_t count)
+{
+	// Header is the same for every frame and it was sent once
+	if(usImageDataSize < usDataOffsetExtra)
+	{
+		size_t xSkip = usDataOffsetExtra - usImageDataSize;
+
+		if(xSkip >= count)
+		{
+			return;
+		}
+
+		src += xSkip;
+		count -= xSkip;
+	}
+
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+	if(xJpegRestart.ucValid)
+	{
+		camera_restart_unpack(src, count);
+		return;
+	}
+#endif
+
+	while(count)
+	{
+		if(!pucStreamBlock)
+		{
+			pucStreamBlock = pucWirelessGetFrameBlockBuffer();
+			usStreamBlockFill = 0;
+		}
+
+		size_t xChunk = PACKET_IMAGE_DATA_MAX_SIZE - usStreamBlockFill;
+		if(xChunk > count)
+		{
+			xChunk = count;
+		}
+
+		uint8_t* pucDest = &pucStreamBlock[usStreamBlockFill];
+		size_t i = 0;
+		size_t xEoi = 0;
+
+		count -= xChunk;
+
+		// Packet data doesn't start at 32bit boundary
+		while((i < xChunk) && ((uintptr_t)&pucDest[i] & 3))
+		{
+			pucDest[i++] = (uint8_t)*src++;
+		}
+		xEoi = camera_stream_find_eoi(&pucDest[0], i);
+
+		while(!xEoi && ((xChunk - i) >= 8))
+		{
+			uint32_t ulWord0 = src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24);
+			uint32_t ulWord1 = src[4] | (src[5] << 8) | (src[6] << 16) | (src[7] << 24);
+
+			((uint32_t*)&pucDest[i])[0] = ulWord0;
+			((uint32_t*)&pucDest[i])[1] = ulWord1;
+
+			// Cheap check for 0xD9 byte, precise check only if it's there
+			if(WORD_HAS_EOI_BYTE(ulWord0) | WORD_HAS_EOI_BYTE(ulWord1))
+			{
+				xEoi = camera_stream_find_eoi(&pucDest[i], 8);
+				xEoi = xEoi ? (i + xEoi) : 0;
+			}
+			else
+			{
+				ucStreamPrevByte = (uint8_t)(ulWord1 >> 24);
+			}
+
+			i += 8;
+			src += 8;
+		}
+
+		if(!xEoi)
+		{
+			size_t xTail = i;
+
+			while(i < xChunk)
+			{
+				pucDest[i++] = (uint8_t)*src++;
+			}
+
+			xEoi = camera_stream_find_eoi(&pucDest[xTail], i - xTail);
+			xEoi = xEoi ? (xTail + xEoi) : 0;
+		}
+
+		if(xEoi)
+		{
+			// Everything after EOI is garbage
+			usStreamBlockFill += xEoi;
+			camera_stream_finish();
+			return;
+		}
+
+		usStreamBlockFill += xChunk;
+
+		if(usStreamBlockFill == PACKET_IMAGE_DATA_MAX_SIZE)
+		{
+			BaseType_t xSent =
+			    xWirelessSendFrameBlock(pucStreamBlock, PACKET_IMAGE_DATA_MAX_SIZE, pdFALSE, pdTRUE, 0, pdFALSE);
+			pucStreamBlock = NULL;
+			ulStreamFrameBytes += PACKET_IMAGE_DATA_MAX_SIZE;
+
+			// Frame is too huge, it was already finished with this block
+			if(xSent == pdFALSE)
+			{
+				xStreamFrame = pdFALSE;
+				camera_frame_sent(ulStreamFrameBytes);
+				ulStreamFrameBytes = 0;
+
+				PROFILE_POINT(CONFIG_JPG_FRAME_TX_LATENCY_DBG_PROFILER, profile_point_end);
+				return;
+			}
+		}
+	}
+}
+
+
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+static uint8_t* IRAM_ATTR
+camera_restart_get_block(void)
+{
+	return pucWirelessGetFrameBlockBuffer();
+}
+
+
+static uint8_t IRAM_ATTR
+camera_restart_send_block(uint8_t* pucBlock, size_t xSize, uint8_t ucSegmentId, uint8_t ucSegmentEnd, uint8_t ucFinal)
+{
+	return (xWirelessSendFrameBlock(pucBlock,
+	                                xSize,
+	                                ucFinal ? pdTRUE : pdFALSE,
+	                                pdTRUE,
+	                                ucSegmentId,
+	                                ucSegmentEnd ? pdTRUE : pdFALSE) == pdTRUE);
+}
+
+
+static void IRAM_ATTR
+camera_restart_unpack(const uint32_t* src, size_t count)
+{
+	uint8_t ucChunk[JPEG_RESTART_UNPACK_SIZE];
+
+	while(count && (xStreamFrame == pdTRUE))
+	{
+		size_t xChunk = (count > JPEG_RESTART_UNPACK_SIZE) ? JPEG_RESTART_UNPACK_SIZE : count;
+
+		for(size_t i = 0; i < xChunk; i++)
+		{
+			ucChunk[i] = (uint8_t)src[i];
+		}
+
+		src += xChunk;
+		count -= xChunk;
+
+		// Everything after the last MCU is garbage
+		if(ulJpegRestartPush(&xJpegRestart, &ucChunk[0], xChunk))
+		{
+			camera_stream_finish();
+		}
+	}
+}
+
+
+static uint32_t
+camera_restart_send_image(uint32_t ulSize)
+{
+	vJpegRestartStartFrame(&xJpegRestart);
+	ulJpegRestartPush(&xJpegRestart, &ucImageData[usDataOffsetExtra], ulSize);
+
+	return ulJpegRestartFinish(&xJpegRestart);
+}
+#endif
+
+
 static void IRAM_ATTR
 camera_data_available(const void* data, size_t count, bool last_dma_transfer)
 {
@@ -211,6 +815,44 @@ camera_data_available(const void* data, size_t count, bool last_dma_transfer)
 
 	if(data != NULL)
 	{
+		if(!usImageDataSize)
+		{
+			PROFILE_POINT(CONFIG_JPG_FRAME_TX_LATENCY_DBG_PROFILER, profile_point_start);
+
+#if(CONFIG_CAMERA_STREAM_FRAME_DATA == 1)
+			// Header size is known only after the first frame
+			if((xTakeFrame == pdTRUE) && (xFirstFrameHeaderSync == pdFALSE))
+			{
+				xTakeFrame = pdFALSE;
+				xStreamFrame = pdTRUE;
+				xStreamedFrame = pdTRUE;
+				pucStreamBlock = NULL;
+				ucStreamPrevByte = 0;
+				ulStreamFrameBytes = 0;
+
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+				vJpegRestartStartFrame(&xJpegRestart);
+#endif
+
+				// Next frame could be captured while this one is in the air
+				vStartNewFrame();
+			}
+#endif
+		}
+
+		// The rest of streamed frame after EOI is garbage
+		if(xStreamedFrame == pdTRUE)
+		{
+			if(xStreamFrame == pdTRUE)
+			{
+				camera_stream_unpack((const uint32_t*)data, count);
+			}
+			usImageDataSize += count;
+
+			PROFILE_POINT(CONFIG_JPG_DMA_COPY_TIME_DBG_PROFILER, profile_point_end);
+			return;
+		}
+
 		const uint32_t* src = (const uint32_t*)data;
 		uint32_t* pulDest = (uint32_t*)&ucImageData[usImageDataSize];
 		usImageDataSize += count;
@@ -220,8 +862,18 @@ camera_data_available(const void* data, size_t count, bool last_dma_transfer)
 		// Turns out this is fastest way to copy data
 		do
 		{
-			pulDest[0] = src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24);
-			pulDest[1] = src[4] | (src[5] << 8) | (src[6] << 16) | (src[7] << 24);
+			uint32_t ulWord0 = src[0] | (src[1] << 8) | (src[2] << 16) | (src[3] << 24);
+			uint32_t ulWord1 = src[4] | (src[5] << 8) | (src[6] << 16) | (src[7] << 24);
+
+			pulDest[0] = ulWord0;
+			pulDest[1] = ulWord1;
+
+			// Cheap check for 0xD9 byte, precise check only if it's there
+			if(!usImageEoiOffset && (WORD_HAS_EOI_BYTE(ulWord0) | WORD_HAS_EOI_BYTE(ulWord1)))
+			{
+				uint32_t ulOffset = (uint8_t*)pulDest - &ucImageData[0];
+				usImageEoiOffset = camera_find_eoi(ulOffset, ulOffset + 8);
+			}
 
 			pulDest += 2;
 			src += 8;
@@ -236,15 +888,37 @@ camera_data_available(const void* data, size_t count, bool last_dma_transfer)
 			{
 				*pucDest++ = (uint8_t)*src++;
 			} while(--count);
+
+			if(!usImageEoiOffset)
+			{
+				usImageEoiOffset = camera_find_eoi((uint8_t*)pulDest - &ucImageData[0], usImageDataSize);
+			}
 		}
 	}
 	else
 	{
 		if(last_dma_transfer)
 		{
-			if(xTakeFrame == pdTRUE)
+			if(xStreamedFrame == pdTRUE)
+			{
+				// No EOI in whole frame, so send everything what is left
+				if(xStreamFrame == pdTRUE)
+				{
+					camera_stream_finish();
+				}
+
+				// Request for the next frame, if any, is taken at the start of the next one
+				xStreamedFrame = pdFALSE;
+			}
+			else if((xTakeFrame == pdTRUE) && ucHeaderSyncSkipFrames)
+			{
+				// New sensor settings could be not applied to this frame yet
+				--ucHeaderSyncSkipFrames;
+			}
+			else if(xTakeFrame == pdTRUE)
 			{
 				xTakeFrame = pdFALSE;
+				vStartNewFrame();
 
 				if(xFirstFrameHeaderSync)
 				{
@@ -252,26 +926,45 @@ camera_data_available(const void* data, size_t count, bool last_dma_transfer)
 					send_jpg_header(&ucImageData[0]);
 				}
 
-				usImageDataSize -= (usDataOffsetExtra);
-
 				PROFILE_POINT(CONFIG_JPG_EOI_SEARCH_TIME_DBG_PROFILER, profile_point_start);
 
-				// Start from the second half of the image what potentially contain garbage
-				uint8_t* pucGarbage = (uint8_t*)&ucImageData[usDataOffsetExtra + (usImageDataSize / 2)];
-
-				// With a blank image (covered lid on lens) it takes ~16±2us to find EOI (240x240)
-				// On complex image with bunch of details it takes ~70±8us to find EOI (240x240)
-				while(*(uint16_t*)pucGarbage++ != 0xD9FF)
-					;
-				usImageDataSize = pucGarbage - (uint8_t*)&ucImageData[usDataOffsetExtra];
+				// EOI is normally found while data was copied, but for the very first frame
+				// header size was unknown and marker could be found inside of the header tables
+				if(usImageEoiOffset <= usDataOffsetExtra)
+				{
+					// Start from the second half of the image what potentially contain garbage
+					uint32_t ulHalf = usDataOffsetExtra + ((usImageDataSize - usDataOffsetExtra) / 2);
+					usImageEoiOffset = camera_find_eoi(ulHalf, usImageDataSize);
+
+					if(!usImageEoiOffset)
+					{
+						usImageEoiOffset = usImageDataSize;
+					}
+				}
 
 				PROFILE_POINT(CONFIG_JPG_EOI_SEARCH_TIME_DBG_PROFILER, profile_point_end);
 
-				// Copy data to Tx queue
-				vWirelessSendArray(PACKET_TYPE_FRAME_DATA, &ucImageData[usDataOffsetExtra], usImageDataSize, pdTRUE);
+#if(CONFIG_CAMERA_JPEG_RESTART_ROWS > 0)
+				if(xJpegRestart.ucValid)
+				{
+					camera_frame_sent(camera_restart_send_image(usImageEoiOffset - usDataOffsetExtra));
+				}
+				else
+#endif
+				{
+					// Copy data to Tx queue
+					vWirelessSendArray(PACKET_TYPE_FRAME_DATA,
+					                   &ucImageData[usDataOffsetExtra],
+					                   usImageEoiOffset - usDataOffsetExtra,
+					                   pdTRUE);
+					camera_frame_sent(usImageEoiOffset - usDataOffsetExtra);
+				}
+
+				PROFILE_POINT(CONFIG_JPG_FRAME_TX_LATENCY_DBG_PROFILER, profile_point_end);
 			}
 
 			usImageDataSize = 0;
+			usImageEoiOffset = 0;
 		}
 	}
 
@@ -347,6 +1040,61 @@ vEnableForcedFrameUpdate(void)
 	xTimerChangePeriod(xForceFrameUpdateTimer, FORCE_FRAME_UPDATE_TIMER_TIMEOUT, 0UL);
 }
 
+void
+vCameraFrameAcked(uint8_t ucFrameId, uint8_t ucCredits)
+{
+	uint8_t ucNextFrameId = (uint8_t)(ucFrameId + 1);
+
+	portENTER_CRITICAL(&xFrameWindowLock);
+	// Ack is cumulative, so lost one is covered by the next.
+	// Ignore stale and duplicate Acks what are out of frames in flight.
+	if((uint8_t)(ucNextFrameId - ucFramesAcked) <= (uint8_t)(ucFramesTaken - ucFramesAcked))
+	{
+		ucFramesAcked = ucNextFrameId;
+	}
+	ucFrameCredits = ucCredits ? ucCredits : 1;
+	portEXIT_CRITICAL(&xFrameWindowLock);
+
+	vStartNewFrame();
+}
+
+void
+vCameraLinkReport(uint32_t ulPeriodMs,
+                  uint32_t ulRxBytes,
+                  uint32_t ulFramesDecoded,
+                  uint32_t ulFramesDropped,
+                  uint32_t ulDecodeTimeMs)
+{
+#if(CONFIG_CAMERA_RATE_CONTROL_ENABLE == 1)
+	portENTER_CRITICAL(&xFrameWindowLock);
+	xLinkReport.ulPeriodMs = ulPeriodMs;
+	xLinkReport.ulRxBytes = ulRxBytes;
+	xLinkReport.ulFramesDecoded = ulFramesDecoded;
+	xLinkReport.ulFramesDropped = ulFramesDropped;
+	xLinkReport.ulDecodeTimeMs = ulDecodeTimeMs;
+	xLinkReportReady = pdTRUE;
+	portEXIT_CRITICAL(&xFrameWindowLock);
+
+	// Wake up Camera task to apply it
+	vStartNewFrame();
+#else
+	(void)ulPeriodMs;
+	(void)ulRxBytes;
+	(void)ulFramesDecoded;
+	(void)ulFramesDropped;
+	(void)ulDecodeTimeMs;
+#endif
+}
+
+void
+vCameraSetGrayscale(uint32_t ulGrayscale)
+{
+	ucGrayscaleRequested = ulGrayscale ? 1 : 0;
+
+	// Wake up Camera task to apply it
+	vStartNewFrame();
+}
+
 void
 vStartNewFrame(void)
 {
@@ -363,6 +1111,13 @@ static void
 vForceFrameUpdateTimer(TimerHandle_t xTimer)
 {
 	(void)xTimer;
+
+	// Nothing is acknowledged for too long, so treat every frame in flight as lost.
+	// Only requested but not yet captured frame is still on it's way.
+	portENTER_CRITICAL(&xFrameWindowLock);
+	ucFramesAcked = (uint8_t)(ucFramesTaken - ((xTakeFrame == pdTRUE) ? 1 : 0));
+	portEXIT_CRITICAL(&xFrameWindowLock);
+
 	vStartNewFrame();
 
 	ASYNC_PRINTF(CONFIG_TIMER_FRAME_UPDATE_DBG_PRINTOUT, async_print_type_str, "vForceFrameUpdateTimer\n", 0);
@@ -404,14 +1159,20 @@ vCameraTask(void* pvArg)
 		if(ulWaitNewFrameAck(portMAX_DELAY))
 #endif
 		{
+			camera_color_mode_update();
+
+#if(CONFIG_CAMERA_RATE_CONTROL_ENABLE == 1)
+			camera_rate_control_update();
+#endif
+
 #if (CONFIG_IMAGE_TX_TIME_DBG_PRINTOUT == 1)
 			fr_start = esp_timer_get_time();
-			take_new_image_frame();
+			camera_frame_window_take();
 			fr_end = esp_timer_get_time();
 
 			ASYNC_PRINTF(1, async_print_type_u32, "tFr time: %u\n", fr_end - fr_start);
 #else
-			take_new_image_frame();
+			camera_frame_window_take();
 #endif
 		}
 
@@ -457,6 +1218,13 @@ init_camera(void)
 {
 	init_camera_rtos();
 
+#if(CONFIG_CAMERA_RATE_CONTROL_ENABLE == 1)
+	vRateControlInit(&xRateControlConfig,
+	                 &xRateControlState,
+	                 (uint8_t)xCamConfig_no_psram.jpeg_quality,
+	                 xRateControlConfig.ucFrameSizeMax);
+#endif
+
 	esp_err_t err = err = esp_camera_init(&xCamConfig_no_psram, camera_data_available);
 
 	if(err != ESP_OK)
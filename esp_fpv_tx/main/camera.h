@@ -53,6 +53,39 @@ void vResetForcedFrameUpdate(void);
  */
 void vStartNewFrame(void);
 
+/**
+ * @brief Release frames acknowledged by Receiver and start the next one if possible
+ * 
+ * @param ucFrameId Id of the newest frame Receiver is done with, all previous ones are done too
+ * @param ucCredits Amount of frames Receiver allows to be in flight
+ */
+void vCameraFrameAcked(uint8_t ucFrameId, uint8_t ucCredits);
+
+/**
+ * @brief Pass link statistics from Receiver to quality controller.
+ *        New quality and frame size are applied by Camera task before the next frame.
+ * 
+ * @param ulPeriodMs Time covered by this report
+ * @param ulRxBytes Amount of bytes received by Receiver during period
+ * @param ulFramesDecoded Frames shown by Receiver during period
+ * @param ulFramesDropped Frames abandoned by Receiver during period
+ * @param ulDecodeTimeMs Average time used by Receiver to decode single frame
+ */
+void vCameraLinkReport(uint32_t ulPeriodMs,
+                       uint32_t ulRxBytes,
+                       uint32_t ulFramesDecoded,
+                       uint32_t ulFramesDropped,
+                       uint32_t ulDecodeTimeMs);
+
+/**
+ * @brief Switch between colour and grayscale image, it's applied by Camera task before the next frame.
+ *        Grayscale image has no chroma at all, if restart markers are inserted,
+ *        otherwise chroma of the sensor's image is just flat.
+ * 
+ * @param ulGrayscale Non zero to send only luma of the image
+ */
+void vCameraSetGrayscale(uint32_t ulGrayscale);
+
 // ----------------------------------------------------------------------
 // Core functions
 /**
@@ -0,0 +1,799 @@
+/**
+ * @file jpeg_restart.c
+ *
+ * Restart markers insertion.
+ *
+ * Every Huffman code and it's extra bits are copied to the output as is,
+ * only DC difference is coded again, since DC predictors are reset after
+ * every RSTn marker in the output stream and never in the input one.
+ * Input is pushed in any pieces, so it works right from camera DMA callback.
+ *
+ * Grayscale output keeps Y blocks only. Single component scan is never interleaved
+ * and it's blocks go in raster order, what is the same order as in the input
+ * only if the input MCU is a single row of Y blocks.
+ */
+
+#include "jpeg_restart.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#endif
+//
+#include <stdint.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define JPEG_MARKER_SOF0 (0xC0)
+#define JPEG_MARKER_DHT  (0xC4)
+#define JPEG_MARKER_SOI  (0xD8)
+#define JPEG_MARKER_EOI  (0xD9)
+#define JPEG_MARKER_SOS  (0xDA)
+#define JPEG_MARKER_DRI  (0xDD)
+#define JPEG_MARKER_RST0 (0xD0)
+
+// DC difference of 8 bit samples never needs more than 11 bits
+#define JPEG_DC_CATEGORIES (12)
+
+// Longest Huffman code
+#define JPEG_CODE_BITS_MAX (16)
+
+// Amount of 0xFF bytes added to truncated image, enough to finish any MCU
+#define JPEG_TRUNCATED_PADDING (1024)
+
+// ----------------------------------------------------------------------
+// Static functions declaration
+
+/**
+ * @brief Build decoder and DC encoder tables from DHT segment content
+ *
+ * @retval Amount of bytes used from pucData, 0 if table is broken
+ */
+static size_t jpeg_restart_parse_dht(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize);
+
+/**
+ * @brief Get components sampling and MCU layout from SOF0 segment content
+ *
+ * @retval 0 if image is not supported
+ */
+static uint32_t jpeg_restart_parse_sof(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize);
+
+/**
+ * @brief Get Huffman tables of components from SOS segment content
+ *
+ * @retval 0 if scan is not supported
+ */
+static uint32_t jpeg_restart_parse_sos(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize);
+
+static void jpeg_restart_put_byte(jpeg_restart_t* pxRestart, uint8_t ucByte);
+
+static void jpeg_restart_put_bits(jpeg_restart_t* pxRestart, uint32_t ulBits, uint32_t ulSize);
+
+/**
+ * @brief Pad the last byte with 1 bits and fill the rest of output block
+ */
+static void jpeg_restart_end_segment(jpeg_restart_t* pxRestart, uint8_t ucFinal);
+
+/**
+ * @brief Decode single Huffman code with it's extra bits and code it again
+ *
+ * @retval 0 if there is not enough input bits
+ */
+static uint32_t jpeg_restart_step(jpeg_restart_t* pxRestart);
+
+/**
+ * @brief Decode the rest of input with 1 bits, the same as padding of the last byte
+ */
+static void jpeg_restart_pad(jpeg_restart_t* pxRestart);
+
+static void jpeg_restart_push_byte(jpeg_restart_t* pxRestart, uint8_t ucByte);
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static size_t
+jpeg_restart_parse_dht(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize)
+{
+	if(xSize < 17)
+	{
+		return 0;
+	}
+
+	uint32_t ulClass = pucData[0] >> 4;
+	uint32_t ulId = pucData[0] & 15;
+	const uint8_t* pucBits = &pucData[1];
+	size_t xValues = 0;
+
+	if((ulClass > 1) || (ulId > 1))
+	{
+		return 0;
+	}
+
+	for(uint32_t i = 0; i < JPEG_CODE_BITS_MAX; i++)
+	{
+		xValues += pucBits[i];
+	}
+
+	if((xValues > sizeof(pxRestart->xHuff[0][0].ucValues)) || ((17 + xValues) > xSize))
+	{
+		return 0;
+	}
+
+	jpeg_restart_huff_t* pxHuff = &pxRestart->xHuff[ulClass][ulId];
+	memset(pxHuff, 0, sizeof(jpeg_restart_huff_t));
+	memcpy(&pxHuff->ucValues[0], &pucData[17], xValues);
+
+	// Canonical codes, see JPEG spec. Annex C
+	uint32_t ulCode = 0;
+	uint32_t ulIndex = 0;
+
+	for(uint32_t ulLen = 1; ulLen <= JPEG_CODE_BITS_MAX; ulLen++)
+	{
+		uint32_t ulCount = pucBits[ulLen - 1];
+
+		pxHuff->lValOffset[ulLen] = (int32_t)ulIndex - (int32_t)ulCode;
+		pxHuff->lMaxCode[ulLen] = ulCount ? (int32_t)(ulCode + ulCount - 1) : -1;
+
+		for(uint32_t i = 0; i < ulCount; i++)
+		{
+			uint8_t ucValue = pxHuff->ucValues[ulIndex + i];
+
+			if(!ulClass && (ucValue < JPEG_DC_CATEGORIES))
+			{
+				pxHuff->usCode[ucValue] = (uint16_t)(ulCode + i);
+				pxHuff->ucSize[ucValue] = (uint8_t)ulLen;
+			}
+		}
+
+		ulIndex += ulCount;
+		ulCode = (ulCode + ulCount) << 1;
+	}
+
+	return 17 + xValues;
+}
+
+
+static uint32_t
+jpeg_restart_parse_sof(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize)
+{
+	if((xSize < 6) || (pucData[0] != 8))
+	{
+		return 0;
+	}
+
+	uint32_t ulHeight = (pucData[1] << 8) | pucData[2];
+	uint32_t ulWidth = (pucData[3] << 8) | pucData[4];
+	uint32_t ulComps = pucData[5];
+	uint32_t ulMaxH = 1, ulMaxV = 1;
+
+	if(!ulWidth || !ulHeight || ((ulComps != 1) && (ulComps != 3)) || (xSize < (6 + ulComps * 3)))
+	{
+		return 0;
+	}
+
+	pxRestart->ucMcuBlocks = 0;
+
+	for(uint32_t c = 0; c < ulComps; c++)
+	{
+		uint32_t ulH = pucData[7 + c * 3] >> 4;
+		uint32_t ulV = pucData[7 + c * 3] & 15;
+
+		// Single component scan is never interleaved, MCU is always one block
+		if(ulComps == 1)
+		{
+			ulH = ulV = 1;
+		}
+
+		if(!ulH || !ulV || ((pxRestart->ucMcuBlocks + ulH * ulV) > JPEG_RESTART_MCU_BLOCKS_MAX))
+		{
+			return 0;
+		}
+
+		for(uint32_t i = 0; i < (ulH * ulV); i++)
+		{
+			pxRestart->ucBlockComp[pxRestart->ucMcuBlocks++] = (uint8_t)c;
+		}
+
+		ulMaxH = (ulH > ulMaxH) ? ulH : ulMaxH;
+		ulMaxV = (ulV > ulMaxV) ? ulV : ulMaxV;
+	}
+
+	uint32_t ulMcusPerRow = (ulWidth + ulMaxH * 8 - 1) / (ulMaxH * 8);
+	uint32_t ulMcuRows = (ulHeight + ulMaxV * 8 - 1) / (ulMaxV * 8);
+	uint32_t ulRows = pxRestart->pxConfig->ucRowsPerSegment;
+	uint32_t ulRowsMin = (ulMcuRows + JPEG_RESTART_SEGMENTS_MAX - 1) / JPEG_RESTART_SEGMENTS_MAX;
+
+	ulRows = (ulRows < ulRowsMin) ? ulRowsMin : ulRows;
+
+	pxRestart->ulMcusTotal = ulMcusPerRow * ulMcuRows;
+	pxRestart->ulMcusPerSegment = ulMcusPerRow * ulRows;
+	pxRestart->usMcusPerRow = (uint16_t)ulMcusPerRow;
+
+	// Otherwise Y blocks would have to be reordered, so colour image is sent
+	if((ulComps != 3) || (ulMaxV != 1) || (pucData[7] != ((ulMaxH << 4) | 1)))
+	{
+		pxRestart->ucLumaOnly = 0;
+	}
+
+	if(pxRestart->ucLumaOnly)
+	{
+		// Right blocks of the last MCU in a row could be out of the image, they are not sent
+		pxRestart->ucLumaBlocks = (uint8_t)ulMaxH;
+		pxRestart->usLumaCols = (uint16_t)((ulWidth + 7) / 8);
+		ulMcusPerRow = pxRestart->usLumaCols;
+	}
+
+	if((ulMcusPerRow * ulRows) > 0xFFFF)
+	{
+		return 0;
+	}
+
+	pxRestart->usRestartInterval = (uint16_t)(ulMcusPerRow * ulRows);
+
+	return 1;
+}
+
+
+static uint32_t
+jpeg_restart_parse_sos(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize)
+{
+	uint32_t ulComps = xSize ? pucData[0] : 0;
+
+	if(!ulComps || (ulComps > 3) || (xSize < (1 + ulComps * 2 + 3)))
+	{
+		return 0;
+	}
+
+	for(uint32_t c = 0; c < ulComps; c++)
+	{
+		uint32_t ulTables = pucData[2 + c * 2];
+
+		if(((ulTables >> 4) > 1) || ((ulTables & 15) > 1))
+		{
+			return 0;
+		}
+
+		// Every DC category is needed to code DC difference again
+		for(uint32_t i = 0; i < JPEG_DC_CATEGORIES; i++)
+		{
+			if(!pxRestart->xHuff[0][ulTables >> 4].ucSize[i])
+			{
+				return 0;
+			}
+		}
+
+		pxRestart->ucCompTables[c] = (uint8_t)ulTables;
+	}
+
+	return 1;
+}
+
+
+static void IRAM_ATTR
+jpeg_restart_put_byte(jpeg_restart_t* pxRestart, uint8_t ucByte)
+{
+	const jpeg_restart_config_t* pxConfig = pxRestart->pxConfig;
+
+	// Image was cut, nothing is sent any more
+	if(pxRestart->ucDone)
+	{
+		return;
+	}
+
+	// Full block is sent only when more data comes, so the last block of the segment is always known
+	if(pxRestart->pucBlock && (pxRestart->usBlockFill == pxConfig->usBlockSize))
+	{
+		uint8_t ucSent = pxConfig->ucSendBlock(pxRestart->pucBlock, pxRestart->usBlockFill, pxRestart->ucSegment, 0, 0);
+		pxRestart->pucBlock = NULL;
+
+		if(!ucSent)
+		{
+			pxRestart->ucDone = 1;
+			return;
+		}
+	}
+
+	if(!pxRestart->pucBlock)
+	{
+		pxRestart->pucBlock = pxConfig->pucGetBlock();
+		pxRestart->usBlockFill = 0;
+	}
+
+	pxRestart->pucBlock[pxRestart->usBlockFill++] = ucByte;
+	++pxRestart->ulOutBytes;
+}
+
+
+static void IRAM_ATTR
+jpeg_restart_put_bits(jpeg_restart_t* pxRestart, uint32_t ulBits, uint32_t ulSize)
+{
+	uint32_t ulAcc = (pxRestart->ulOutAcc << ulSize) | (ulBits & ((1UL << ulSize) - 1));
+	uint32_t ulCount = pxRestart->ucOutBits + ulSize;
+
+	while(ulCount >= 8)
+	{
+		ulCount -= 8;
+		uint8_t ucByte = (uint8_t)(ulAcc >> ulCount);
+
+		jpeg_restart_put_byte(pxRestart, ucByte);
+
+		if(ucByte == 0xFF)
+		{
+			jpeg_restart_put_byte(pxRestart, 0x00);
+		}
+	}
+
+	pxRestart->ulOutAcc = ulAcc;
+	pxRestart->ucOutBits = (uint8_t)ulCount;
+}
+
+
+static void IRAM_ATTR
+jpeg_restart_end_segment(jpeg_restart_t* pxRestart, uint8_t ucFinal)
+{
+	const jpeg_restart_config_t* pxConfig = pxRestart->pxConfig;
+
+	if(pxRestart->ucOutBits)
+	{
+		jpeg_restart_put_bits(pxRestart, 0xFF, 8 - pxRestart->ucOutBits);
+	}
+
+	// Image was cut while the rest of the segment is sent
+	if(pxRestart->ucDone)
+	{
+		return;
+	}
+
+	if(ucFinal)
+	{
+		jpeg_restart_put_byte(pxRestart, 0xFF);
+		jpeg_restart_put_byte(pxRestart, JPEG_MARKER_EOI);
+
+		if(pxRestart->ucDone)
+		{
+			return;
+		}
+	}
+	else
+	{
+		// Fill bytes are allowed before any marker, next segment starts from the new block
+		uint32_t ulFill = pxConfig->usBlockSize - pxRestart->usBlockFill;
+
+		memset(&pxRestart->pucBlock[pxRestart->usBlockFill], 0xFF, ulFill);
+		pxRestart->usBlockFill += ulFill;
+		pxRestart->ulOutBytes += ulFill;
+	}
+
+	uint8_t ucSent =
+	    pxConfig->ucSendBlock(pxRestart->pucBlock, pxRestart->usBlockFill, pxRestart->ucSegment, 1, ucFinal);
+	pxRestart->pucBlock = NULL;
+
+	if(ucFinal || !ucSent)
+	{
+		pxRestart->ucDone = 1;
+		return;
+	}
+
+	jpeg_restart_put_byte(pxRestart, 0xFF);
+	jpeg_restart_put_byte(pxRestart, (uint8_t)(JPEG_MARKER_RST0 + (pxRestart->ucSegment & 7)));
+	++pxRestart->ucSegment;
+
+	memset(&pxRestart->sOutPred[0], 0, sizeof(pxRestart->sOutPred));
+}
+
+
+static uint32_t IRAM_ATTR
+jpeg_restart_step(jpeg_restart_t* pxRestart)
+{
+	uint32_t ulComp = pxRestart->ucBlockComp[pxRestart->ucBlock];
+	uint32_t ulTables = pxRestart->ucCompTables[ulComp];
+	uint32_t ulDc = (pxRestart->ucCoef == 0);
+	// Block is decoded anyway, to know where the next one starts
+	uint32_t ulSkip = pxRestart->ucLumaOnly &&
+	                  (ulComp || ((pxRestart->usMcuCol * pxRestart->ucLumaBlocks + pxRestart->ucBlock) >=
+	                              pxRestart->usLumaCols));
+
+	if(!pxRestart->ucSymLen)
+	{
+		if(pxRestart->ucInBits < JPEG_CODE_BITS_MAX)
+		{
+			return 0;
+		}
+
+		const jpeg_restart_huff_t* pxHuff =
+		    ulDc ? &pxRestart->xHuff[0][ulTables >> 4] : &pxRestart->xHuff[1][ulTables & 15];
+		uint32_t ulPeek = (pxRestart->ulInAcc >> (pxRestart->ucInBits - JPEG_CODE_BITS_MAX)) & 0xFFFF;
+		uint32_t ulLen = 1;
+		uint32_t ulCode = 0;
+
+		for(; ulLen <= JPEG_CODE_BITS_MAX; ulLen++)
+		{
+			ulCode = ulPeek >> (JPEG_CODE_BITS_MAX - ulLen);
+
+			if((int32_t)ulCode <= pxHuff->lMaxCode[ulLen])
+			{
+				break;
+			}
+		}
+
+		if(ulLen > JPEG_CODE_BITS_MAX)
+		{
+			pxRestart->ucError = 1;
+			return 0;
+		}
+
+		pxRestart->ucSymbol = pxHuff->ucValues[(int32_t)ulCode + pxHuff->lValOffset[ulLen]];
+		pxRestart->usSymCode = (uint16_t)ulCode;
+		pxRestart->ucSymLen = (uint8_t)ulLen;
+		pxRestart->ucInBits -= (uint8_t)ulLen;
+	}
+
+	uint32_t ulSymbol = pxRestart->ucSymbol;
+	uint32_t ulExtraSize = ulDc ? ulSymbol : (ulSymbol & 15);
+
+	if(pxRestart->ucInBits < ulExtraSize)
+	{
+		return 0;
+	}
+
+	pxRestart->ucInBits -= (uint8_t)ulExtraSize;
+	uint32_t ulExtra = (pxRestart->ulInAcc >> pxRestart->ucInBits) & ((1UL << ulExtraSize) - 1);
+
+	if(ulDc)
+	{
+		if(ulSymbol >= JPEG_DC_CATEGORIES)
+		{
+			pxRestart->ucError = 1;
+			return 0;
+		}
+
+		int32_t lDiff = (int32_t)ulExtra;
+
+		if(ulExtraSize && !(ulExtra & (1UL << (ulExtraSize - 1))))
+		{
+			lDiff -= (int32_t)(1UL << ulExtraSize) - 1;
+		}
+
+		int32_t lValue = pxRestart->sInPred[ulComp] + lDiff;
+		pxRestart->sInPred[ulComp] = (int16_t)lValue;
+		pxRestart->ucCoef = 1;
+
+		if(ulSkip)
+		{
+			pxRestart->ucSymLen = 0;
+			return 1;
+		}
+
+		lDiff = lValue - pxRestart->sOutPred[ulComp];
+		pxRestart->sOutPred[ulComp] = (int16_t)lValue;
+
+		uint32_t ulAbs = (lDiff < 0) ? (uint32_t)-lDiff : (uint32_t)lDiff;
+		uint32_t ulCategory = ulAbs ? (32 - __builtin_clz(ulAbs)) : 0;
+		const jpeg_restart_huff_t* pxHuff = &pxRestart->xHuff[0][ulTables >> 4];
+
+		if(ulCategory >= JPEG_DC_CATEGORIES)
+		{
+			pxRestart->ucError = 1;
+			return 0;
+		}
+
+		jpeg_restart_put_bits(pxRestart, pxHuff->usCode[ulCategory], pxHuff->ucSize[ulCategory]);
+		jpeg_restart_put_bits(pxRestart, (uint32_t)((lDiff < 0) ? (lDiff - 1) : lDiff), ulCategory);
+	}
+	else
+	{
+		if(!ulSkip)
+		{
+			jpeg_restart_put_bits(pxRestart, pxRestart->usSymCode, pxRestart->ucSymLen);
+			jpeg_restart_put_bits(pxRestart, ulExtra, ulExtraSize);
+		}
+
+		// EOB, otherwise skip zero run and the coefficient itself
+		pxRestart->ucCoef = ulSymbol ? (uint8_t)(pxRestart->ucCoef + (ulSymbol >> 4) + 1) : 64;
+
+		if(pxRestart->ucCoef > 64)
+		{
+			pxRestart->ucError = 1;
+			return 0;
+		}
+	}
+
+	pxRestart->ucSymLen = 0;
+
+	if(pxRestart->ucCoef < 64)
+	{
+		return 1;
+	}
+
+	pxRestart->ucCoef = 0;
+
+	if(++pxRestart->ucBlock < pxRestart->ucMcuBlocks)
+	{
+		return 1;
+	}
+
+	pxRestart->ucBlock = 0;
+
+	if(++pxRestart->usMcuCol == pxRestart->usMcusPerRow)
+	{
+		pxRestart->usMcuCol = 0;
+	}
+
+	if(++pxRestart->ulMcu == pxRestart->ulMcusTotal)
+	{
+		jpeg_restart_end_segment(pxRestart, 1);
+		return 0;
+	}
+
+	if(!(pxRestart->ulMcu % pxRestart->ulMcusPerSegment))
+	{
+		jpeg_restart_end_segment(pxRestart, 0);
+	}
+
+	return 1;
+}
+
+
+static void IRAM_ATTR
+jpeg_restart_pad(jpeg_restart_t* pxRestart)
+{
+	for(uint32_t i = 0; (i < JPEG_TRUNCATED_PADDING) && !pxRestart->ucDone && !pxRestart->ucError; i++)
+	{
+		pxRestart->ulInAcc = (pxRestart->ulInAcc << 8) | 0xFF;
+		pxRestart->ucInBits += 8;
+
+		while(!pxRestart->ucDone && !pxRestart->ucError && jpeg_restart_step(pxRestart))
+		{
+		}
+	}
+}
+
+
+static void IRAM_ATTR
+jpeg_restart_push_byte(jpeg_restart_t* pxRestart, uint8_t ucByte)
+{
+	if(pxRestart->ucInFF)
+	{
+		if(ucByte == 0xFF)
+		{
+			// Fill byte
+			return;
+		}
+
+		pxRestart->ucInFF = 0;
+
+		if(ucByte != 0x00)
+		{
+			// EOI, the last codes could be shorter than the lookahead
+			jpeg_restart_pad(pxRestart);
+			pxRestart->ucError = !pxRestart->ucDone;
+			return;
+		}
+
+		ucByte = 0xFF;
+	}
+	else if(ucByte == 0xFF)
+	{
+		pxRestart->ucInFF = 1;
+		return;
+	}
+
+	pxRestart->ulInAcc = (pxRestart->ulInAcc << 8) | ucByte;
+	pxRestart->ucInBits += 8;
+
+	while(!pxRestart->ucDone && !pxRestart->ucError && jpeg_restart_step(pxRestart))
+	{
+	}
+}
+
+// ----------------------------------------------------------------------
+// Core functions
+
+size_t
+xJpegRestartParseHeader(jpeg_restart_t* pxRestart,
+                        const jpeg_restart_config_t* pxConfig,
+                        const uint8_t* pucHeader,
+                        size_t xHeaderSize,
+                        uint8_t* pucOut,
+                        uint8_t ucLumaOnly)
+{
+	size_t xOfs = 2;
+	size_t xOutSize = 2;
+	uint32_t ulSofFound = 0;
+
+	memset(pxRestart, 0, sizeof(jpeg_restart_t));
+	pxRestart->pxConfig = pxConfig;
+	pxRestart->ucLumaOnly = ucLumaOnly;
+
+	if((xHeaderSize < 2) || (pucHeader[0] != 0xFF) || (pucHeader[1] != JPEG_MARKER_SOI) || !pxConfig->usBlockSize)
+	{
+		return 0;
+	}
+
+	pucOut[0] = 0xFF;
+	pucOut[1] = JPEG_MARKER_SOI;
+
+	while((xOfs + 4) <= xHeaderSize)
+	{
+		uint8_t ucMarker = pucHeader[xOfs + 1];
+		size_t xLen = (pucHeader[xOfs + 2] << 8) | pucHeader[xOfs + 3];
+		const uint8_t* pucData = &pucHeader[xOfs + 4];
+
+		if((pucHeader[xOfs] != 0xFF) || (xLen < 2) || ((xOfs + 2 + xLen) > xHeaderSize))
+		{
+			return 0;
+		}
+
+		xLen -= 2;
+
+		switch(ucMarker)
+		{
+		case JPEG_MARKER_DHT: {
+			size_t xUsed = 0;
+
+			while(xUsed < xLen)
+			{
+				size_t xTable = jpeg_restart_parse_dht(pxRestart, &pucData[xUsed], xLen - xUsed);
+
+				if(!xTable)
+				{
+					return 0;
+				}
+
+				xUsed += xTable;
+			}
+			break;
+		}
+
+		case JPEG_MARKER_SOF0:
+			if(!jpeg_restart_parse_sof(pxRestart, pucData, xLen))
+			{
+				return 0;
+			}
+			ulSofFound = 1;
+
+			if(pxRestart->ucLumaOnly)
+			{
+				// The same frame with Y component only, MCU of single component image is one block
+				pucOut[xOutSize++] = 0xFF;
+				pucOut[xOutSize++] = JPEG_MARKER_SOF0;
+				pucOut[xOutSize++] = 0;
+				pucOut[xOutSize++] = 11;
+				memcpy(&pucOut[xOutSize], pucData, 5);
+				xOutSize += 5;
+				pucOut[xOutSize++] = 1;
+				pucOut[xOutSize++] = pucData[6];
+				pucOut[xOutSize++] = 0x11;
+				pucOut[xOutSize++] = pucData[8];
+
+				xOfs += 4 + xLen;
+				continue;
+			}
+			break;
+
+		case JPEG_MARKER_DRI:
+			// Sensor already does it, or header was converted twice
+			if((xLen < 2) || (pucData[0] | pucData[1]))
+			{
+				return 0;
+			}
+			// Replaced by the new one
+			xOfs += 4 + xLen;
+			continue;
+
+		case JPEG_MARKER_SOS:
+			if(!ulSofFound || !jpeg_restart_parse_sos(pxRestart, pucData, xLen))
+			{
+				return 0;
+			}
+
+			pucOut[xOutSize++] = 0xFF;
+			pucOut[xOutSize++] = JPEG_MARKER_DRI;
+			pucOut[xOutSize++] = 0;
+			pucOut[xOutSize++] = 4;
+			pucOut[xOutSize++] = (uint8_t)(pxRestart->usRestartInterval >> 8);
+			pucOut[xOutSize++] = (uint8_t)(pxRestart->usRestartInterval);
+
+			if(pxRestart->ucLumaOnly)
+			{
+				// Y selector and tables, then spectral selection and approximation as is
+				pucOut[xOutSize++] = 0xFF;
+				pucOut[xOutSize++] = JPEG_MARKER_SOS;
+				pucOut[xOutSize++] = 0;
+				pucOut[xOutSize++] = 8;
+				pucOut[xOutSize++] = 1;
+				memcpy(&pucOut[xOutSize], &pucData[1], 2);
+				xOutSize += 2;
+				memcpy(&pucOut[xOutSize], &pucData[1 + pucData[0] * 2], 3);
+				xOutSize += 3;
+			}
+			else
+			{
+				memcpy(&pucOut[xOutSize], &pucHeader[xOfs], 4 + xLen);
+				xOutSize += 4 + xLen;
+			}
+
+			pxRestart->ucValid = 1;
+			return xOutSize;
+
+		default:
+			// Progressive, arithmetic coding and so on
+			if((ucMarker >= 0xC1) && (ucMarker <= 0xCF) && (ucMarker != 0xC4) && (ucMarker != 0xC8) &&
+			   (ucMarker != 0xCC))
+			{
+				return 0;
+			}
+			break;
+		}
+
+		memcpy(&pucOut[xOutSize], &pucHeader[xOfs], 4 + xLen);
+		xOutSize += 4 + xLen;
+		xOfs += 4 + xLen;
+	}
+
+	return 0;
+}
+
+
+void IRAM_ATTR
+vJpegRestartStartFrame(jpeg_restart_t* pxRestart)
+{
+	pxRestart->ulInAcc = 0;
+	pxRestart->ucInBits = 0;
+	pxRestart->ucInFF = 0;
+	pxRestart->ucSymLen = 0;
+
+	pxRestart->ulMcu = 0;
+	pxRestart->usMcuCol = 0;
+	pxRestart->ucBlock = 0;
+	pxRestart->ucCoef = 0;
+	memset(&pxRestart->sInPred[0], 0, sizeof(pxRestart->sInPred));
+	memset(&pxRestart->sOutPred[0], 0, sizeof(pxRestart->sOutPred));
+
+	pxRestart->ulOutAcc = 0;
+	pxRestart->ucOutBits = 0;
+	pxRestart->ucSegment = 0;
+	pxRestart->usBlockFill = 0;
+	pxRestart->pucBlock = NULL;
+	pxRestart->ulOutBytes = 0;
+
+	pxRestart->ucDone = 0;
+	pxRestart->ucError = 0;
+}
+
+
+uint32_t IRAM_ATTR
+ulJpegRestartPush(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize)
+{
+	for(size_t i = 0; (i < xSize) && !pxRestart->ucDone && !pxRestart->ucError; i++)
+	{
+		jpeg_restart_push_byte(pxRestart, pucData[i]);
+	}
+
+	return pxRestart->ucDone;
+}
+
+
+uint32_t IRAM_ATTR
+ulJpegRestartFinish(jpeg_restart_t* pxRestart)
+{
+	// Truncated image, whatever is left is decoded with 1 bits
+	jpeg_restart_pad(pxRestart);
+
+	// Broken image is still finished, Receiver decodes segments what are fine
+	if(!pxRestart->ucDone)
+	{
+		if(!pxRestart->pucBlock)
+		{
+			jpeg_restart_put_byte(pxRestart, 0xFF);
+			jpeg_restart_put_byte(pxRestart, 0xFF);
+		}
+
+		jpeg_restart_end_segment(pxRestart, 1);
+	}
+
+	return pxRestart->ulOutBytes;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file jpeg_restart.h
+ *
+ * Lossless insertion of restart markers into baseline JPEG stream.
+ * Camera sensor doesn't emit RSTn markers, so entropy coded data is
+ * Huffman decoded and coded again with restart interval of several MCU rows.
+ * Every restart segment starts at the beginning of output block and the rest
+ * of the last block of the segment is filled with 0xFF fill bytes,
+ * so each segment could be decoded without any other one.
+ * Chroma blocks could be dropped on the way, then the output is grayscale image
+ * with a single component scan.
+ *
+ * @note Keep this module free from ESP-IDF and FreeRTOS dependencies,
+ *       so it could be tested on the host against recorded frames.
+ */
+
+#ifndef _JPEG_RESTART_H
+#define _JPEG_RESTART_H
+
+//
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Segment id is sent with every image block in 5 bits
+#define JPEG_RESTART_SEGMENTS_MAX (32)
+
+// Baseline JPEG allows up to 10 blocks per MCU
+#define JPEG_RESTART_MCU_BLOCKS_MAX (10)
+
+// Size of DRI segment what is added to the header
+#define JPEG_RESTART_DRI_SIZE (6)
+
+typedef struct
+{
+	int32_t lMaxCode[17];  // The biggest code of each length, -1 if there is no codes of this length
+	int32_t lValOffset[17]; // Index in ucValues[] of code value minus the smallest code of each length
+	uint16_t usCode[16];   // Code of each DC category, used to code DC difference again
+	uint8_t ucSize[16];    // Length of each DC category code, 0 if category is not in the table
+	uint8_t ucValues[256]; // Symbols sorted by code
+} jpeg_restart_huff_t;
+
+typedef struct
+{
+	/// Buffer of usBlockSize bytes for the next output block
+	uint8_t* (*pucGetBlock)(void);
+	/// Output block is done, the last one of the image has ucFinal set.
+	/// Returns 0 if image is cut at this block, then the rest of it is dropped.
+	uint8_t (*ucSendBlock)(uint8_t* pucBlock, size_t xSize, uint8_t ucSegmentId, uint8_t ucSegmentEnd, uint8_t ucFinal);
+	uint16_t usBlockSize;     // Size of every output block except the final one
+	uint8_t ucRowsPerSegment; // Restart interval in MCU rows, increased if there are too many segments
+} jpeg_restart_config_t;
+
+typedef struct
+{
+	const jpeg_restart_config_t* pxConfig;
+
+	jpeg_restart_huff_t xHuff[2][2];                     // [DC, AC][table id]
+	uint8_t ucBlockComp[JPEG_RESTART_MCU_BLOCKS_MAX];    // Component of each block in MCU
+	uint8_t ucCompTables[3];                             // DC table id in bit 4, AC table id in bit 0
+	uint8_t ucMcuBlocks;                                 // Amount of blocks in MCU
+	uint32_t ulMcusTotal;                                // Amount of MCUs in the image
+	uint32_t ulMcusPerSegment;                           // Restart interval in MCUs
+	uint8_t ucValid;                                     // Header was parsed and it's supported
+	uint8_t ucLumaOnly;                                  // Only Y blocks are sent, output image is grayscale
+	uint16_t usMcusPerRow;                               // Amount of MCUs in a row of the image
+	uint16_t usLumaCols;                                 // Amount of Y blocks in a row of grayscale image
+	uint8_t ucLumaBlocks;                                // Amount of Y blocks in MCU of input image
+	uint16_t usRestartInterval;                          // Restart interval in MCUs of output image
+
+	// Input
+	uint32_t ulInAcc;  // Input bits, the oldest one is MSB of ucInBits
+	uint8_t ucInBits;  // Amount of bits in ulInAcc
+	uint8_t ucInFF;    // Previous input byte was 0xFF
+	uint8_t ucSymbol;  // Decoded symbol, waiting for it's extra bits
+	uint8_t ucSymLen;  // Length of ucSymbol code, 0 if there is no pending symbol
+	uint16_t usSymCode; // Code of ucSymbol
+
+	// Position in the image
+	uint32_t ulMcu;
+	uint16_t usMcuCol;
+	uint8_t ucBlock;
+	uint8_t ucCoef;
+	int16_t sInPred[3];  // DC predictors of input stream
+	int16_t sOutPred[3]; // DC predictors of output stream, reset at every restart
+
+	// Output
+	uint32_t ulOutAcc;
+	uint8_t ucOutBits;
+	uint8_t ucSegment;
+	uint16_t usBlockFill;
+	uint8_t* pucBlock;
+	uint32_t ulOutBytes; // Amount of bytes sent for the current image
+
+	uint8_t ucDone;  // Final block of the image is sent
+	uint8_t ucError; // Input stream is broken, rest of it is ignored
+} jpeg_restart_t;
+
+// ----------------------------------------------------------------------
+// Core functions
+
+/**
+ * @brief Parse JPEG header and make the same one with restart interval
+ *
+ * @param pxRestart Converter state
+ * @param pxConfig Output configuration, must be valid while converter is used
+ * @param pucHeader Header from SOI till the end of SOS segment
+ * @param xHeaderSize Amount of bytes in pucHeader
+ * @param pucOut Where to store new header, at least xHeaderSize + @ref ''JPEG_RESTART_DRI_SIZE'' bytes
+ * @param ucLumaOnly Drop chroma and make grayscale image. It's possible only if the MCU is a single row
+ *                   of Y blocks, like in 4:2:2 and 4:4:4 images, see @ref ''jpeg_restart_t.ucLumaOnly''
+ *
+ * @retval Size of new header, 0 if the image is not supported
+ */
+size_t xJpegRestartParseHeader(jpeg_restart_t* pxRestart,
+                               const jpeg_restart_config_t* pxConfig,
+                               const uint8_t* pucHeader,
+                               size_t xHeaderSize,
+                               uint8_t* pucOut,
+                               uint8_t ucLumaOnly);
+
+/**
+ * @brief Prepare to the next image with the same header
+ *
+ * @param pxRestart Converter state
+ */
+void vJpegRestartStartFrame(jpeg_restart_t* pxRestart);
+
+/**
+ * @brief Pass the next part of entropy coded data, right after the header.
+ *        Output blocks are sent as soon as they are filled.
+ *
+ * @param pxRestart Converter state
+ * @param pucData Input data
+ * @param xSize Amount of bytes in pucData
+ *
+ * @retval Non zero once the final block of the image is sent, rest of the input is not needed
+ */
+uint32_t ulJpegRestartPush(jpeg_restart_t* pxRestart, const uint8_t* pucData, size_t xSize);
+
+/**
+ * @brief There is no more input for this image. Sends the final block if it's not sent yet,
+ *        so truncated image is finished as well.
+ *
+ * @param pxRestart Converter state
+ *
+ * @retval Amount of bytes sent for the image
+ */
+uint32_t ulJpegRestartFinish(jpeg_restart_t* pxRestart);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _JPEG_RESTART_H */
@@ -0,0 +1,228 @@
+/**
+ * @file rate_control.c
+ *
+ * Closed loop controller of JPEG quality and frame size.
+ *
+ * Budget of single frame is the amount of bytes link is able to carry per second,
+ * spread over frames Receiver is able to show. Link capacity is estimated from
+ * received bytes and time when radio was busy sending them.
+ * Frames get smaller right away when they don't fit, but get bigger only after
+ * several good periods in a row. Every failed upgrade doubles this wait.
+ */
+
+#include "rate_control.h"
+
+//
+#include <stdint.h>
+
+// ----------------------------------------------------------------------
+// Static functions declaration
+
+/**
+ * @brief Make frames smaller: worse quality first, then smaller frame size.
+ *
+ * @retval 0 if everything is already at minimum
+ */
+static uint32_t rate_control_step_down(const rate_control_config_t* pxConfig, rate_control_state_t* pxState);
+
+/**
+ * @brief Make frames bigger: bigger frame size first, then better quality.
+ *
+ * @retval 0 if everything is already at maximum
+ */
+static uint32_t rate_control_step_up(const rate_control_config_t* pxConfig, rate_control_state_t* pxState);
+
+/**
+ * @brief Quality what is used right after frame size is changed,
+ *        so amount of bytes per frame doesn't jump too much.
+ */
+static uint8_t rate_control_mid_quality(const rate_control_config_t* pxConfig);
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint8_t
+rate_control_mid_quality(const rate_control_config_t* pxConfig)
+{
+	return (uint8_t)((pxConfig->ucQualityBest + pxConfig->ucQualityWorst) / 2);
+}
+
+static uint32_t
+rate_control_step_down(const rate_control_config_t* pxConfig, rate_control_state_t* pxState)
+{
+	if(pxState->ucQuality < pxConfig->ucQualityWorst)
+	{
+		uint32_t ulQuality = pxState->ucQuality + pxConfig->ucQualityStep;
+		pxState->ucQuality = (ulQuality > pxConfig->ucQualityWorst) ? pxConfig->ucQualityWorst : (uint8_t)ulQuality;
+		return 1;
+	}
+
+	if(pxState->ucFrameSize)
+	{
+		--pxState->ucFrameSize;
+		pxState->ucQuality = rate_control_mid_quality(pxConfig);
+		return 1;
+	}
+
+	return 0;
+}
+
+static uint32_t
+rate_control_step_up(const rate_control_config_t* pxConfig, rate_control_state_t* pxState)
+{
+	if(pxState->ucFrameSize < pxConfig->ucFrameSizeMax)
+	{
+		// Smaller frame at better quality is the same step back
+		if(pxState->ucQuality > rate_control_mid_quality(pxConfig))
+		{
+			uint32_t ulQuality = (pxState->ucQuality > pxConfig->ucQualityStep) ?
+			                         (pxState->ucQuality - pxConfig->ucQualityStep) :
+			                         pxConfig->ucQualityBest;
+			pxState->ucQuality =
+			    (ulQuality < pxConfig->ucQualityBest) ? pxConfig->ucQualityBest : (uint8_t)ulQuality;
+			return 1;
+		}
+
+		++pxState->ucFrameSize;
+		pxState->ucQuality = pxConfig->ucQualityWorst;
+		return 1;
+	}
+
+	if(pxState->ucQuality > pxConfig->ucQualityBest)
+	{
+		uint32_t ulQuality = (pxState->ucQuality > pxConfig->ucQualityStep) ?
+		                         (pxState->ucQuality - pxConfig->ucQualityStep) :
+		                         pxConfig->ucQualityBest;
+		pxState->ucQuality = (ulQuality < pxConfig->ucQualityBest) ? pxConfig->ucQualityBest : (uint8_t)ulQuality;
+		return 1;
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------
+// Core functions
+
+void
+vRateControlInit(const rate_control_config_t* pxConfig,
+                 rate_control_state_t* pxState,
+                 uint8_t ucQuality,
+                 uint8_t ucFrameSize)
+{
+	if(ucQuality < pxConfig->ucQualityBest)
+	{
+		ucQuality = pxConfig->ucQualityBest;
+	}
+	else if(ucQuality > pxConfig->ucQualityWorst)
+	{
+		ucQuality = pxConfig->ucQualityWorst;
+	}
+
+	pxState->ucQuality = ucQuality;
+	pxState->ucFrameSize = (ucFrameSize > pxConfig->ucFrameSizeMax) ? pxConfig->ucFrameSizeMax : ucFrameSize;
+	pxState->ucHoldPeriods = pxConfig->ucHoldPeriods;
+	pxState->ucGoodPeriods = 0;
+	pxState->ucUpgradeWait = pxConfig->ucUpgradeWaitMin;
+	pxState->ucLastUpgrade = 0;
+	pxState->ulFrameBudget = 0;
+}
+
+rate_control_action_t
+xRateControlUpdate(const rate_control_config_t* pxConfig,
+                   rate_control_state_t* pxState,
+                   const rate_control_input_t* pxInput)
+{
+	uint32_t ulFrames = pxInput->ulFramesDecoded + pxInput->ulFramesDropped;
+
+	// Nothing was sent, so there is nothing to judge
+	if(!pxInput->ulPeriodMs || (!ulFrames && !pxInput->ulFrameBytes))
+	{
+		return RATE_CONTROL_KEEP;
+	}
+
+	uint32_t ulLossPercent = ulFrames ? ((pxInput->ulFramesDropped * 100UL) / ulFrames) : 100UL;
+
+	// Receiver could be slower than the link
+	uint32_t ulFps = pxConfig->ucTargetFps;
+	if(pxInput->ulDecodeTimeMs && ((1000UL / pxInput->ulDecodeTimeMs) < ulFps))
+	{
+		ulFps = 1000UL / pxInput->ulDecodeTimeMs;
+	}
+	ulFps = ulFps ? ulFps : 1;
+
+	// Without airtime link is treated as fully loaded
+	uint64_t ullBusyUs = pxInput->ulAirtimeUs;
+	if(!ullBusyUs || (ullBusyUs > (pxInput->ulPeriodMs * 1000ULL)))
+	{
+		ullBusyUs = pxInput->ulPeriodMs * 1000ULL;
+	}
+
+	uint64_t ullCapacity = ((uint64_t)pxInput->ulRxBytes * 1000000ULL) / ullBusyUs;
+	pxState->ulFrameBudget = (uint32_t)((ullCapacity * pxConfig->ucLinkLoadPercent) / (100ULL * ulFps));
+
+	// Reports of the link with previous settings are still coming
+	if(pxState->ucHoldPeriods)
+	{
+		--pxState->ucHoldPeriods;
+		return RATE_CONTROL_KEEP;
+	}
+
+	uint64_t ullFrameBytes = (uint64_t)pxInput->ulFrameBytes * 100ULL;
+	uint64_t ullBudget = pxState->ulFrameBudget;
+
+	if((ulLossPercent > pxConfig->ucLossHighPercent) ||
+	   (ullFrameBytes > (ullBudget * (100ULL + pxConfig->ucHysteresisPercent))))
+	{
+		// Link didn't survive the last upgrade, don't try it again too soon
+		if(pxState->ucLastUpgrade)
+		{
+			uint32_t ulWait = pxState->ucUpgradeWait * 2UL;
+			pxState->ucUpgradeWait =
+			    (ulWait > RATE_CONTROL_UPGRADE_WAIT_MAX) ? RATE_CONTROL_UPGRADE_WAIT_MAX : (uint8_t)ulWait;
+			pxState->ucLastUpgrade = 0;
+		}
+
+		pxState->ucGoodPeriods = 0;
+
+		if(rate_control_step_down(pxConfig, pxState))
+		{
+			pxState->ucHoldPeriods = pxConfig->ucHoldPeriods;
+			return RATE_CONTROL_DOWNGRADE;
+		}
+
+		return RATE_CONTROL_KEEP;
+	}
+
+	if((ulLossPercent > pxConfig->ucLossLowPercent) ||
+	   (ullFrameBytes > (ullBudget * (100ULL - pxConfig->ucHysteresisPercent))))
+	{
+		// Inside of dead zone
+		pxState->ucGoodPeriods = 0;
+		return RATE_CONTROL_KEEP;
+	}
+
+	if(pxState->ucLastUpgrade)
+	{
+		// Upgrade survived, next one could be tried sooner
+		pxState->ucLastUpgrade = 0;
+		pxState->ucUpgradeWait = (pxState->ucUpgradeWait / 2 > pxConfig->ucUpgradeWaitMin) ?
+		                             (uint8_t)(pxState->ucUpgradeWait / 2) :
+		                             pxConfig->ucUpgradeWaitMin;
+	}
+
+	if(++pxState->ucGoodPeriods < pxState->ucUpgradeWait)
+	{
+		return RATE_CONTROL_KEEP;
+	}
+
+	pxState->ucGoodPeriods = 0;
+
+	if(rate_control_step_up(pxConfig, pxState))
+	{
+		pxState->ucLastUpgrade = 1;
+		pxState->ucHoldPeriods = pxConfig->ucHoldPeriods;
+		return RATE_CONTROL_UPGRADE;
+	}
+
+	return RATE_CONTROL_KEEP;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file rate_control.h
+ *
+ * Closed loop controller of JPEG quality and frame size.
+ * Once per link report from Receiver it decides if image frames should be
+ * smaller, bigger or stay the same.
+ *
+ * @note Keep this module free from ESP-IDF and FreeRTOS dependencies,
+ *       so it could be tested on the host against recorded link traces.
+ */
+
+#ifndef _RATE_CONTROL_H
+#define _RATE_CONTROL_H
+
+//
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Longest wait before the next attempt to increase frame size, in report periods
+#define RATE_CONTROL_UPGRADE_WAIT_MAX (32)
+
+typedef enum
+{
+	RATE_CONTROL_KEEP = 0,
+	RATE_CONTROL_DOWNGRADE,
+	RATE_CONTROL_UPGRADE
+} rate_control_action_t;
+
+typedef struct
+{
+	uint8_t ucQualityBest;       // Lowest allowed JPEG quality value, lower number means higher quality
+	uint8_t ucQualityWorst;      // Highest allowed JPEG quality value
+	uint8_t ucQualityStep;       // Quality change per single step
+	uint8_t ucFrameSizeMax;      // Index of the biggest frame size, 0 is the smallest one
+	uint8_t ucTargetFps;         // Frame rate what link should sustain
+	uint8_t ucLinkLoadPercent;   // Part of airtime what image data is allowed to use
+	uint8_t ucLossHighPercent;   // Frame loss what always leads to smaller frames
+	uint8_t ucLossLowPercent;    // Frame loss what allows to try bigger frames
+	uint8_t ucHysteresisPercent; // Dead zone around frame size budget where nothing is changed
+	uint8_t ucUpgradeWaitMin;    // Amount of good periods in a row before frames get bigger
+	uint8_t ucHoldPeriods;       // Periods after any change what are ignored while link settles
+} rate_control_config_t;
+
+typedef struct
+{
+	uint32_t ulPeriodMs;      // Time covered by this report
+	uint32_t ulRxBytes;       // Amount of bytes received by Receiver during period
+	uint32_t ulFramesDecoded; // Frames shown by Receiver during period
+	uint32_t ulFramesDropped; // Frames abandoned by Receiver during period
+	uint32_t ulDecodeTimeMs;  // Average time used by Receiver to decode single frame, 0 if unknown
+	uint32_t ulFrameBytes;    // Average size of frame sent by Transmitter during period
+	uint32_t ulAirtimeUs;     // Time when radio of Transmitter was busy during period, 0 if unknown
+} rate_control_input_t;
+
+typedef struct
+{
+	uint8_t ucQuality;      // Current JPEG quality value
+	uint8_t ucFrameSize;    // Current index of frame size
+	uint8_t ucHoldPeriods;  // Periods left before link reports are trusted again
+	uint8_t ucGoodPeriods;  // Good periods in a row since the last change
+	uint8_t ucUpgradeWait;  // Good periods needed before the next upgrade
+	uint8_t ucLastUpgrade;  // The last change was an upgrade, so it's still on probation
+	uint32_t ulFrameBudget; // The last calculated frame size budget in bytes
+} rate_control_state_t;
+
+// ----------------------------------------------------------------------
+// Core functions
+
+/**
+ * @brief Set initial controller state
+ *
+ * @param pxConfig Controller limits
+ * @param pxState State to initialize
+ * @param ucQuality Quality what camera is started with
+ * @param ucFrameSize Index of frame size what camera is started with
+ */
+void vRateControlInit(const rate_control_config_t* pxConfig,
+                      rate_control_state_t* pxState,
+                      uint8_t ucQuality,
+                      uint8_t ucFrameSize);
+
+/**
+ * @brief Decide what to do with quality and frame size after single link report.
+ *        Function depends only on passed arguments.
+ *
+ * @param pxConfig Controller limits
+ * @param pxState Controller state, new quality and frame size are stored here
+ * @param pxInput Link statistics for the last period
+ *
+ * @retval What was changed, see @ref ''rate_control_action_t''
+ */
+rate_control_action_t xRateControlUpdate(const rate_control_config_t* pxConfig,
+                                         rate_control_state_t* pxState,
+                                         const rate_control_input_t* pxInput);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RATE_CONTROL_H */
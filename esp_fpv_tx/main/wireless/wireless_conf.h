@@ -24,9 +24,16 @@ extern "C" {
 // By default will set WiFi to long range (WIFI_PROTOCOL_LR) mode.
 // But note what WIFI_PROTOCOL_11B mode use less power but of cost lower range.
 // Select between WIFI_PROTOCOL_LR and WIFI_PROTOCOL_11B
+// Rate control switches between LR, 11b and 11n rates, so all of them
+// must be enabled on both nodes to receive whatever the other one sends.
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+#define DEFAULT_WIFI_MODE (WIFI_PROTOCOL_11B | WIFI_PROTOCOL_11G | WIFI_PROTOCOL_11N | WIFI_PROTOCOL_LR)
+#else
 #define DEFAULT_WIFI_MODE (WIFI_PROTOCOL_LR)
+#endif
 
 // By default ESP-NOW use 1M.
+// With rate control it's only the starting point.
 #define DEFAULT_WIFI_DATA_RATE (WIFI_PHY_RATE_1M_L)
 
 // By default device will use as much as possible power for Transmitting
@@ -233,13 +233,17 @@ wifi_crypt_packet(const uint8_t* pucDataIn, uint8_t* pucDataOut, size_t xInputSi
 
 	// At encryption and sometime decryption less memcpy() is used and we use 1-2us less time, but it's a danger game!
 	// Thanks to aligned data with 256 bytes buffers!
-	if(xInputSize > AES_ENCRYPTION_MAX_BYTES)
+	if(xInputSize >= AES_ENCRYPTION_MAX_BYTES)
 	{
 		wifi_aes_crypt_ll((uint32_t*)&pucDataIn[0], (uint32_t*)&pucDataOut[0]);
 
-		memcpy(&pucDataOut[AES_ENCRYPTION_MAX_BYTES],
-		       &pucDataIn[AES_ENCRYPTION_MAX_BYTES],
-		       xInputSize - AES_ENCRYPTION_MAX_BYTES);
+		// Nothing to copy when crypt is done in place
+		if(pucDataIn != pucDataOut)
+		{
+			memcpy(&pucDataOut[AES_ENCRYPTION_MAX_BYTES],
+			       &pucDataIn[AES_ENCRYPTION_MAX_BYTES],
+			       xInputSize - AES_ENCRYPTION_MAX_BYTES);
+		}
 	}
 	else
 	{
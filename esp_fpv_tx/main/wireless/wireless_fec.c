@@ -0,0 +1,320 @@
+/**
+ * @file wireless_fec.c
+ *
+ * Erasure code used to restore lost image blocks without retransmission.
+ */
+
+#include "wireless_fec.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#define DRAM_ATTR
+#endif
+//
+#include <stdint.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// x^8 + x^4 + x^3 + x^2 + 1
+#define GF_PRIMITIVE_POLYNOMIAL (0x11D)
+
+// Cauchy matrix points: X(i) = i for data, Y(j) = FEC_PARITY_Y_BASE + j for parity.
+// All of them must be distinct, so data index should never reach this value.
+#define FEC_PARITY_Y_BASE (0x80)
+
+// ----------------------------------------------------------------------
+// Variables
+
+// Exp table is doubled to skip modulo 255 on multiplication
+DRAM_ATTR uint8_t ucGfExp[512];
+DRAM_ATTR uint8_t ucGfLog[256];
+
+// ----------------------------------------------------------------------
+// Static functions declaration
+
+static uint8_t gf_mul(uint8_t ucA, uint8_t ucB);
+
+static uint8_t gf_div(uint8_t ucA, uint8_t ucB);
+
+/**
+ * @brief Coefficient of data block in parity block.
+ *        Cauchy matrix columns are scaled so the first row is all ones.
+ */
+static uint8_t fec_coefficient(uint32_t ulParityId, uint32_t ulDataId);
+
+/**
+ * @brief pucDst[] ^= ucCoef * pucSrc[]
+ */
+static void fec_mul_add(uint8_t* pucDst, const uint8_t* pucSrc, size_t xSize, uint8_t ucCoef);
+
+/**
+ * @brief Invert square matrix with Gauss-Jordan elimination.
+ *
+ * @retval 0 on success, -1 if matrix is singular
+ */
+static int32_t fec_invert_matrix(uint8_t ucMatrix[][FEC_PARITY_BLOCKS_MAX_NUM],
+                                 uint8_t ucInverse[][FEC_PARITY_BLOCKS_MAX_NUM],
+                                 uint32_t ulSize);
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static inline uint8_t IRAM_ATTR
+gf_mul(uint8_t ucA, uint8_t ucB)
+{
+	if(!ucA || !ucB)
+	{
+		return 0;
+	}
+
+	return ucGfExp[ucGfLog[ucA] + ucGfLog[ucB]];
+}
+
+static inline uint8_t IRAM_ATTR
+gf_div(uint8_t ucA, uint8_t ucB)
+{
+	if(!ucA)
+	{
+		return 0;
+	}
+
+	return ucGfExp[ucGfLog[ucA] + 255 - ucGfLog[ucB]];
+}
+
+static uint8_t IRAM_ATTR
+fec_coefficient(uint32_t ulParityId, uint32_t ulDataId)
+{
+	return gf_div((uint8_t)(ulDataId ^ FEC_PARITY_Y_BASE), (uint8_t)(ulDataId ^ (FEC_PARITY_Y_BASE + ulParityId)));
+}
+
+static void IRAM_ATTR
+fec_mul_add(uint8_t* pucDst, const uint8_t* pucSrc, size_t xSize, uint8_t ucCoef)
+{
+	if(!ucCoef)
+	{
+		return;
+	}
+
+	if(ucCoef == 1)
+	{
+		for(size_t i = 0; i < xSize; i++)
+		{
+			pucDst[i] ^= pucSrc[i];
+		}
+		return;
+	}
+
+	const uint8_t* pucExp = &ucGfExp[ucGfLog[ucCoef]];
+
+	for(size_t i = 0; i < xSize; i++)
+	{
+		uint8_t ucValue = pucSrc[i];
+
+		if(ucValue)
+		{
+			pucDst[i] ^= pucExp[ucGfLog[ucValue]];
+		}
+	}
+}
+
+static int32_t
+fec_invert_matrix(uint8_t ucMatrix[][FEC_PARITY_BLOCKS_MAX_NUM],
+                  uint8_t ucInverse[][FEC_PARITY_BLOCKS_MAX_NUM],
+                  uint32_t ulSize)
+{
+	if(ulSize > FEC_PARITY_BLOCKS_MAX_NUM)
+	{
+		return -1;
+	}
+
+	for(uint32_t r = 0; r < ulSize; r++)
+	{
+		for(uint32_t c = 0; c < ulSize; c++)
+		{
+			ucInverse[r][c] = (r == c) ? 1 : 0;
+		}
+	}
+
+	for(uint32_t c = 0; c < ulSize; c++)
+	{
+		uint32_t ulPivot = c;
+
+		while((ulPivot < ulSize) && !ucMatrix[ulPivot][c])
+		{
+			++ulPivot;
+		}
+
+		if(ulPivot == ulSize)
+		{
+			return -1;
+		}
+
+		if(ulPivot != c)
+		{
+			for(uint32_t k = 0; k < ulSize; k++)
+			{
+				uint8_t ucTmp = ucMatrix[c][k];
+				ucMatrix[c][k] = ucMatrix[ulPivot][k];
+				ucMatrix[ulPivot][k] = ucTmp;
+
+				ucTmp = ucInverse[c][k];
+				ucInverse[c][k] = ucInverse[ulPivot][k];
+				ucInverse[ulPivot][k] = ucTmp;
+			}
+		}
+
+		uint8_t ucScale = ucMatrix[c][c];
+
+		for(uint32_t k = 0; k < ulSize; k++)
+		{
+			ucMatrix[c][k] = gf_div(ucMatrix[c][k], ucScale);
+			ucInverse[c][k] = gf_div(ucInverse[c][k], ucScale);
+		}
+
+		for(uint32_t r = 0; r < ulSize; r++)
+		{
+			uint8_t ucFactor = ucMatrix[r][c];
+
+			if((r != c) && ucFactor)
+			{
+				for(uint32_t k = 0; k < ulSize; k++)
+				{
+					ucMatrix[r][k] ^= gf_mul(ucFactor, ucMatrix[c][k]);
+					ucInverse[r][k] ^= gf_mul(ucFactor, ucInverse[c][k]);
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+// ----------------------------------------------------------------------
+// Core functions
+
+void
+vFecInit(void)
+{
+	uint32_t ulValue = 1;
+
+	for(uint32_t i = 0; i < 255; i++)
+	{
+		ucGfExp[i] = (uint8_t)ulValue;
+		ucGfExp[i + 255] = (uint8_t)ulValue;
+		ucGfLog[ulValue] = (uint8_t)i;
+
+		ulValue <<= 1;
+		if(ulValue & 0x100)
+		{
+			ulValue ^= GF_PRIMITIVE_POLYNOMIAL;
+		}
+	}
+
+	// Never used as log(0) is undefined, but keep table fully initialized
+	ucGfExp[510] = ucGfExp[0];
+	ucGfExp[511] = ucGfExp[1];
+	ucGfLog[0] = 0;
+}
+
+void IRAM_ATTR
+vFecEncodeBlock(uint8_t* pucParity, const uint8_t* pucData, size_t xSize, uint32_t ulParityId, uint32_t ulDataId)
+{
+	fec_mul_add(pucParity, pucData, xSize, fec_coefficient(ulParityId, ulDataId));
+}
+
+int32_t IRAM_ATTR
+lFecRecover(uint8_t** ppucData,
+            uint32_t ulDataNum,
+            uint32_t ulMissingMap,
+            uint8_t** ppucParity,
+            uint32_t ulParityMap,
+            size_t xSize)
+{
+	uint32_t ulMissingIds[FEC_PARITY_BLOCKS_MAX_NUM];
+	uint32_t ulParityIds[FEC_PARITY_BLOCKS_MAX_NUM];
+	uint32_t ulMissingNum = 0;
+	uint32_t ulParityNum = 0;
+
+	for(uint32_t i = 0; i < ulDataNum; i++)
+	{
+		if(ulMissingMap & (1UL << i))
+		{
+			if(ulMissingNum == FEC_PARITY_BLOCKS_MAX_NUM)
+			{
+				return -1;
+			}
+			ulMissingIds[ulMissingNum++] = i;
+		}
+	}
+
+	if(!ulMissingNum)
+	{
+		return 0;
+	}
+
+	for(uint32_t j = 0; (j < FEC_PARITY_BLOCKS_MAX_NUM) && (ulParityNum < ulMissingNum); j++)
+	{
+		if(ulParityMap & (1UL << j))
+		{
+			ulParityIds[ulParityNum++] = j;
+		}
+	}
+
+	if(ulParityNum < ulMissingNum)
+	{
+		return -1;
+	}
+
+	// Remove contribution of received data blocks, what's left is a
+	// linear combination of lost blocks only.
+	for(uint32_t r = 0; r < ulParityNum; r++)
+	{
+		for(uint32_t i = 0; i < ulDataNum; i++)
+		{
+			if(!(ulMissingMap & (1UL << i)))
+			{
+				fec_mul_add(ppucParity[ulParityIds[r]], ppucData[i], xSize, fec_coefficient(ulParityIds[r], i));
+			}
+		}
+	}
+
+	// Most common case: single lost block and plain XOR parity
+	if((ulMissingNum == 1) && (ulParityIds[0] == 0))
+	{
+		memcpy(ppucData[ulMissingIds[0]], ppucParity[0], xSize);
+		return 1;
+	}
+
+	uint8_t ucMatrix[FEC_PARITY_BLOCKS_MAX_NUM][FEC_PARITY_BLOCKS_MAX_NUM];
+	uint8_t ucInverse[FEC_PARITY_BLOCKS_MAX_NUM][FEC_PARITY_BLOCKS_MAX_NUM];
+
+	for(uint32_t r = 0; r < ulMissingNum; r++)
+	{
+		for(uint32_t c = 0; c < ulMissingNum; c++)
+		{
+			ucMatrix[r][c] = fec_coefficient(ulParityIds[r], ulMissingIds[c]);
+		}
+	}
+
+	if(fec_invert_matrix(ucMatrix, ucInverse, ulMissingNum))
+	{
+		return -1;
+	}
+
+	for(uint32_t c = 0; c < ulMissingNum; c++)
+	{
+		uint8_t* pucLost = ppucData[ulMissingIds[c]];
+		memset(pucLost, 0, xSize);
+
+		for(uint32_t r = 0; r < ulMissingNum; r++)
+		{
+			fec_mul_add(pucLost, ppucParity[ulParityIds[r]], xSize, ucInverse[c][r]);
+		}
+	}
+
+	return (int32_t)ulMissingNum;
+}
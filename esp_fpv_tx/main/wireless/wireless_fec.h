@@ -0,0 +1,75 @@
+/**
+ * @file wireless_fec.h
+ *
+ * Forward error correction for image data blocks.
+ * Systematic MDS erasure code over GF(2^8) based on a normalized Cauchy matrix.
+ * First parity block of each group is plain XOR of data blocks.
+ *
+ * @note Keep this module free from ESP-IDF and FreeRTOS dependencies,
+ *       so it could be built and benchmarked on the host.
+ */
+
+#ifndef _WIRELESS_FEC_H
+#define _WIRELESS_FEC_H
+
+//
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Maximum amount of data blocks in single group
+#define FEC_DATA_BLOCKS_MAX_NUM (32)
+// Maximum amount of parity blocks in single group
+#define FEC_PARITY_BLOCKS_MAX_NUM (4)
+
+// ----------------------------------------------------------------------
+// Core functions
+
+/**
+ * @brief Build GF(2^8) tables. Must be called once before any other function.
+ */
+void vFecInit(void);
+
+/**
+ * @brief Accumulate single data block into parity block.
+ *
+ * @param pucParity Parity block, must be zeroed before first data block of the group
+ * @param pucData Data block to add
+ * @param xSize Amount of bytes in data block. Missing tail is treated as zeros
+ * @param ulParityId Index of parity block in group
+ * @param ulDataId Index of data block in group
+ */
+void vFecEncodeBlock(uint8_t* pucParity, const uint8_t* pucData, size_t xSize, uint32_t ulParityId, uint32_t ulDataId);
+
+/**
+ * @brief Restore lost data blocks of a group from received data and parity blocks.
+ *
+ * @param ppucData Array of pointers to data blocks, lost ones will be written in place
+ * @param ulDataNum Amount of data blocks in group
+ * @param ulMissingMap Bit set for each lost data block
+ * @param ppucParity Array of pointers to parity blocks
+ * @param ulParityMap Bit set for each received parity block
+ * @param xSize Amount of bytes in each block
+ *
+ * @retval Amount of restored blocks or -1 if there is not enougth parity blocks
+ *
+ * @attention Used parity blocks are overwritten during recovery!
+ */
+int32_t lFecRecover(uint8_t** ppucData,
+                    uint32_t ulDataNum,
+                    uint32_t ulMissingMap,
+                    uint8_t** ppucParity,
+                    uint32_t ulParityMap,
+                    size_t xSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _WIRELESS_FEC_H */
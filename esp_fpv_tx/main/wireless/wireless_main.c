@@ -3,6 +3,8 @@
 #include "camera.h"
 #include "data_common.h"
 #include "wireless_conf.h"
+#include "wireless_fec.h"
+#include "wireless_rate.h"
 
 //
 #include <sdkconfig.h>
@@ -40,9 +42,67 @@
 // ----------------------------------------------------------------------
 // Definitions, type & enum declaration
 
-// Amount of packets in Queue what could be sent
-#define WIFI_TX_PACKETS_NUM      (32)
-#define WIFI_TX_PACKETS_NUM_MASK (WIFI_TX_PACKETS_NUM - 1)
+// Single packet in Tx queue.
+// Every slot starts at 32bit boundary, so ucFrameData[] could be encrypted in place
+// and image data could be written to the slot directly by the camera.
+typedef union
+{
+	PacketFrame_t xFrame;
+	uint32_t ulRaw[64];
+} tx_packet_slot_t; // 256 bytes
+
+// Maximum amount of data blocks in single image frame, the same as IMG_JPG_BLOCKS_MAX_NUM of Receiver.
+// It also fits 8bit usBlockId of @ref ''PacketImageData_t''.
+#define WIFI_TX_FRAME_BLOCKS_MAX_NUM ((IMG_JPG_FILE_MAX_SIZE + PACKET_IMAGE_DATA_MAX_SIZE - 1) / PACKET_IMAGE_DATA_MAX_SIZE)
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+// Parity blocks sent after every group of data blocks, the last group could be shorter
+#define WIFI_TX_FEC_GROUPS_MAX_NUM \
+	((WIFI_TX_FRAME_BLOCKS_MAX_NUM + CONFIG_WIRELESS_FEC_DATA_BLOCKS - 1) / CONFIG_WIRELESS_FEC_DATA_BLOCKS)
+#define WIFI_TX_FRAME_PARITY_MAX_NUM (WIFI_TX_FEC_GROUPS_MAX_NUM * CONFIG_WIRELESS_FEC_PARITY_BLOCKS)
+#else
+#define WIFI_TX_FRAME_PARITY_MAX_NUM (0)
+#endif
+
+// All packets of single image frame
+#define WIFI_TX_FRAME_PACKETS_MAX_NUM (WIFI_TX_FRAME_BLOCKS_MAX_NUM + WIFI_TX_FRAME_PARITY_MAX_NUM)
+
+#if(CONFIG_CAMERA_STREAM_FRAME_DATA == 1)
+// Camera DMA callback must not wait for the radio, so whole frame could be queued at once
+#define FRAME_PACKETS_QUEUE_SIZE (WIFI_TX_FRAME_PACKETS_MAX_NUM)
+#else
+// Camera task waits for free place, a few Tx windows are enougth to keep ESP-NOW busy
+#define FRAME_PACKETS_QUEUE_SIZE (CONFIG_WIRELESS_TX_WINDOW_SIZE * 4)
+#endif
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+// Amount of the last image frames what could be requested again.
+// Receiver keeps no more than two frames in flight, so frame id & 1 is enougth to find it.
+#define WIFI_TX_FRAME_HISTORY_NUM  (2)
+#define WIFI_TX_FRAME_HISTORY_MASK (WIFI_TX_FRAME_HISTORY_NUM - 1)
+
+// Where data blocks of already sent image frame are located in @ref ''xPackets''
+typedef struct
+{
+	uint16_t usSlots[WIFI_TX_FRAME_BLOCKS_MAX_NUM];
+	uint32_t ulBlocks; // Nothing to retransmit when 0
+	uint32_t ulRetries;
+	int64_t llSentTime;
+	uint8_t ucFrameId;
+} tx_frame_history_t;
+
+// Plain text copy of frame id and block id of image data block in the slot, see @ref ''ulSlotBlocks''
+#define WIFI_TX_SLOT_BLOCK(ucFrameId, ulBlockId) (0x80000000UL | ((uint32_t)(ucFrameId) << 16) | (ulBlockId))
+
+// Slots of the last frames are kept for retransmission, the next frame reuses slots of the oldest one.
+// Two more for the slot being filled and the one being sent.
+#define WIFI_TX_PACKETS_NUM (WIFI_TX_FRAME_HISTORY_NUM * WIFI_TX_FRAME_PACKETS_MAX_NUM + 2)
+#else
+// Every queued packet has it's own slot, plus the one being filled and the one being sent
+#define WIFI_TX_PACKETS_NUM (FRAME_PACKETS_QUEUE_SIZE + 2)
+#endif
+
+_Static_assert(FRAME_PACKETS_QUEUE_SIZE <= (WIFI_TX_PACKETS_NUM - 2), "Queued packet could be overwritten");
 
 
 #if WIRELESS_USE_RAW_80211_PACKET
@@ -65,16 +125,16 @@ StaticTask_t xDataTransmitterTaskControlBlock;
 StackType_t xDataTransmitterStack[STACK_WORDS_SIZE_FOR_TASK_DATA_TX];
 
 //
-#define FRAME_PACKETS_QUEUE_SIZE (WIFI_TX_PACKETS_NUM)
 QueueHandle_t xFramePacketQueueHandler = NULL;
 StaticQueue_t xFramePacketQueueControlBlock;
-uint32_t xFramePacketQueueStorage[WIFI_TX_PACKETS_NUM];
+uint32_t xFramePacketQueueStorage[FRAME_PACKETS_QUEUE_SIZE];
 
-// #if(WIRELESS_USE_RAW_80211_PACKET == 0)
-// //
-// SemaphoreHandle_t xDataTransmitterTxLockHandler = NULL;
-// StaticSemaphore_t xDataTransmitterTxLockControlBlock;
-// #endif
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+// Credits of ESP-NOW Tx window, one is taken for each packet passed to the driver
+// and given back from send callback
+SemaphoreHandle_t xTxCreditsHandler = NULL;
+StaticSemaphore_t xTxCreditsControlBlock;
+#endif
 
 // ----------------------------------------------------------------------
 // Variables
@@ -124,9 +184,76 @@ wifi_espnow_raw_packet_t wifi_espnow_raw_packet;
 #endif
 
 uint32_t ulFramePacketOffset = 0UL;
-PacketFrame_t xPackets[WIFI_TX_PACKETS_NUM];
+tx_packet_slot_t xPackets[WIFI_TX_PACKETS_NUM];
+
+// Sequence number of the current image frame, wraps around every 256 frames
+uint8_t ucTxFrameId = 0;
+// Index of the next block when frame is sent with @ref ''xWirelessSendFrameBlock''
+uint32_t ulStreamBlockId = 0;
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+tx_frame_history_t xFrameHistory[WIFI_TX_FRAME_HISTORY_NUM] = {0};
+// What each slot of @ref ''xPackets'' keeps, 0 if it's not an image data block.
+// Slot is encrypted in place while it's sent, so retransmit never reads it's header and block id.
+// Single word per slot, so it's read from WiFi task at any time.
+uint32_t ulSlotBlocks[WIFI_TX_PACKETS_NUM] = {0};
+#endif
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+// Parity blocks of the FEC group being sent right now
+uint8_t ucFecParity[CONFIG_WIRELESS_FEC_PARITY_BLOCKS][PACKET_IMAGE_DATA_MAX_SIZE];
+#endif
+
+// Decrypted copy of received packet
+uint8_t ucEncryptedData[256];
 
-uint8_t ucEncryptedData[2][256];
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+// Time when each packet in flight was passed to the driver, the oldest one is at ulTxWindowHead
+int64_t llTxWindowSendTime[CONFIG_WIRELESS_TX_WINDOW_SIZE];
+uint32_t ulTxWindowHead = 0;
+uint32_t ulTxWindowCount = 0;
+// Time when previous packet was confirmed by send callback
+int64_t llTxLastDoneTime = 0;
+portMUX_TYPE xTxWindowLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+// How often collected statistics of Tx rates are averaged
+#define WIFI_RATE_UPDATE_PERIOD_US (100 * 1000)
+// How long new rate waits for packets in flight to be done
+#define WIFI_RATE_SWITCH_MAX_WAIT_TICKS (pdMS_TO_TICKS(50) + 1)
+
+// Same order as @ref ''wireless_rate_id_t''
+// clang-format off
+const wifi_phy_rate_t xWifiPhyRates[WIRELESS_RATE_NUM] = {
+	WIFI_PHY_RATE_LORA_250K,
+	WIFI_PHY_RATE_LORA_500K,
+	WIFI_PHY_RATE_1M_L,
+	WIFI_PHY_RATE_2M_S,
+	WIFI_PHY_RATE_5M_S,
+	WIFI_PHY_RATE_11M_S,
+	WIFI_PHY_RATE_MCS0_LGI,
+	WIFI_PHY_RATE_MCS1_LGI,
+	WIFI_PHY_RATE_MCS2_LGI,
+	WIFI_PHY_RATE_MCS3_LGI,
+	WIFI_PHY_RATE_MCS4_LGI,
+	WIFI_PHY_RATE_MCS5_LGI,
+	WIFI_PHY_RATE_MCS6_LGI,
+	WIFI_PHY_RATE_MCS7_LGI,
+};
+// clang-format on
+
+wireless_rate_t xTxRate;
+// Rate of each packet in flight, same indexing as @ref ''llTxWindowSendTime''
+uint8_t ucTxWindowRate[CONFIG_WIRELESS_TX_WINDOW_SIZE];
+// Rate what ESP-NOW is configured to use right now
+uint8_t ucTxRateApplied = WIRELESS_RATE_1M_L;
+// ESP-NOW rate is being changed, packets sent right now could use any of two rates
+BaseType_t xTxRateSwitching = pdFALSE;
+int64_t llTxRateUpdateTime = 0;
+#endif
+
+wireless_tx_stats_t xTxStats = {0};
 
 // ----------------------------------------------------------------------
 // Static functions declaration
@@ -141,14 +268,69 @@ static void wifi_espnow_dump_mac(const uint8_t* mac_addr);
 static void wifi_set_tx_power(int8_t ic_new_tx_power);
 
 
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+/**
+ * @brief Wait for free credit in Tx window and remember when packet is passed to the driver.
+ * 
+ * @param xTicksToWait Maximum time to wait for one of the packets in flight to be done
+ * 
+ * @retval pdTRUE if packet could be sent right now
+ */
+static BaseType_t wifi_tx_window_take(TickType_t xTicksToWait);
+
+/**
+ * @brief Return credit of the last packet what was rejected by the driver
+ */
+static void wifi_tx_window_cancel(void);
+
+/**
+ * @brief Return credit of the oldest packet in flight and count it's airtime
+ * 
+ * @param status Result from @ref ''wifi_espnow_packet_tx_cb''
+ */
+static void wifi_tx_window_release(esp_now_send_status_t status);
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+/**
+ * @brief Switch ESP-NOW to the new PHY rate if it's not used already
+ * 
+ * @param ucRate See @ref ''wireless_rate_id_t''
+ */
+static void wifi_tx_rate_apply(uint8_t ucRate);
+
+/**
+ * @brief Switch ESP-NOW to the rate chosen by rate control.
+ *        Packets queued in the driver are sent with the rate what is set when they leave the queue,
+ *        so new rate is applied only when all packets in flight are done.
+ */
+static void wifi_tx_rate_switch(void);
+#endif
+
+/**
+ * @brief Pass packet to ESP-NOW when Tx window allows it.
+ *        If driver is out of buffers, wait for any packet in flight and try again.
+ * 
+ * @param pucData Packet to send
+ * @param xDataLen Amount of bytes in packet
+ * @param xTicksToWait How long to wait for free credit, retries are done only if it's not 0
+ * 
+ * @retval See @ref ''esp_err_t''
+ */
+static esp_err_t wifi_espnow_send(const uint8_t* pucData, size_t xDataLen, TickType_t xTicksToWait);
+#endif
+
 /**
  * @brief Send packet with ESP_NOW or as raw 802.11 blob
  * 
  * @param pxPacketFrame byte array with data need to be sent
+ * @param xTicksToWait How long to wait for free place in Tx window
  * 
  * @retval See @ref ''esp_err_t''
+ * 
+ * @note Encrypted packet is encrypted in place and restored back after it's sent,
+ *       so the same packet could be sent again later.
  */
-static esp_err_t send_new_packet(const PacketFrame_t* pxPacketFrame);
+static esp_err_t send_new_packet(PacketFrame_t* pxPacketFrame, TickType_t xTicksToWait);
 
 /**
  * @brief This function decrypt data from @ref ''wifi_espnow_packet_rx_cb'' 
@@ -188,9 +370,52 @@ static void wifi_espnow_packet_rx_cb(const uint8_t* mac_addr, const uint8_t* dat
  * 
  * @note This function is called ONLY when @ref ''WIRELESS_USE_RAW_80211_PACKET'' is disabled
  */
-// static void wifi_espnow_packet_tx_cb(const uint8_t* mac_addr, esp_now_send_status_t status);
+static void wifi_espnow_packet_tx_cb(const uint8_t* mac_addr, esp_now_send_status_t status);
 #endif // !WIRELESS_USE_RAW_80211_PACKET
 
+/**
+ * @brief Put single block of image data to Tx queue and do everything
+ *        what is needed for FEC and retransmission
+ * 
+ * @param xHeader Header for the packet with type, flags and frame id set
+ * @param ulBlockId Index of the block
+ * @param pucData Block data
+ * @param ulDataSize Amount of bytes in block, no more than @ref ''PACKET_IMAGE_DATA_MAX_SIZE''
+ */
+static void wifi_queue_image_block(PacketHeader_t xHeader, uint32_t ulBlockId, const uint8_t* pucData, size_t ulDataSize);
+
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+/**
+ * @brief Add data block to parity blocks of current FEC group
+ * 
+ * @param pucData Data block to protect
+ * @param ulDataSize Amount of bytes in data block
+ * @param ulBlockId Index of the block in image frame
+ */
+static void wifi_fec_add_block(const uint8_t* pucData, size_t ulDataSize, uint32_t ulBlockId);
+
+/**
+ * @brief Queue parity blocks of current FEC group and start new group
+ * 
+ * @param pxHeader Header used for data blocks of this group
+ * @param ulGroupEnd Index right after the last data block in group
+ * @param xFinalGroup Is this group is the last one in image frame
+ */
+static void wifi_fec_send_parity(const PacketHeader_t* pxHeader, uint32_t ulGroupEnd, BaseType_t xFinalGroup);
+#endif // CONFIG_WIRELESS_FEC_ENABLE
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+/**
+ * @brief Queue again blocks of one of the last image frames requested by Receiver
+ * 
+ * @param pxPacketNak Packet with bitmap of missing blocks
+ * 
+ * @retval pdTRUE if at least one block was queued,
+ *         pdFALSE if frame is too old, out of retries or deadline is passed
+ */
+static BaseType_t wifi_retransmit_blocks(const PacketNak_t* pxPacketNak);
+#endif // CONFIG_WIRELESS_NAK_MAX_RETRIES
+
 /**
  * @brief Creates FreeRTOS objects what need to maintain WiFi.
  */
@@ -260,42 +485,236 @@ wifi_set_tx_power(int8_t ic_new_tx_power)
 }
 
 
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+static BaseType_t IRAM_ATTR
+wifi_tx_window_take(TickType_t xTicksToWait)
+{
+	if(xSemaphoreTake(xTxCreditsHandler, xTicksToWait) != pdTRUE)
+	{
+		return pdFALSE;
+	}
+
+	uint32_t ulSlot;
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	// Senders what can't wait are called from WiFi task, driver API is never used from there
+	if(xTicksToWait)
+	{
+		wifi_tx_rate_switch();
+	}
+#endif
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	ulSlot = (ulTxWindowHead + ulTxWindowCount) % CONFIG_WIRELESS_TX_WINDOW_SIZE;
+	llTxWindowSendTime[ulSlot] = esp_timer_get_time();
+	++ulTxWindowCount;
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	// Rate is unknown while it's being switched, such packet is not counted at all
+	ucTxWindowRate[ulSlot] = (xTxRateSwitching == pdTRUE) ? WIRELESS_RATE_NUM : ucTxRateApplied;
+#endif
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	return pdTRUE;
+}
+
+
+static void IRAM_ATTR
+wifi_tx_window_cancel(void)
+{
+	portENTER_CRITICAL(&xTxWindowLock);
+	--ulTxWindowCount;
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	xSemaphoreGive(xTxCreditsHandler);
+}
+
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+static void IRAM_ATTR
+wifi_tx_rate_apply(uint8_t ucRate)
+{
+	if(ucRate == ucTxRateApplied)
+	{
+		return;
+	}
+
+	if(esp_wifi_config_espnow_rate(WIFI_IF_STA, xWifiPhyRates[ucRate]) == ESP_OK)
+	{
+		ucTxRateApplied = ucRate;
+
+		ASYNC_PRINTF(CONFIG_WIRELESS_RATE_DBG_PRINTOUT,
+		             async_print_type_u32,
+		             "Tx rate kbps %u\n",
+		             ulWirelessRateKbps(ucRate));
+	}
+}
+
+
+static void IRAM_ATTR
+wifi_tx_rate_switch(void)
+{
+	uint32_t ulInFlight;
+	uint8_t ucRate;
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	ulInFlight = ulTxWindowCount;
+	// Probe never stalls the window, it's taken only when there is nothing in flight
+	ucRate = ulInFlight ? ucWirelessRateGetBest(&xTxRate) : ucWirelessRateSelect(&xTxRate);
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	if(ucRate == ucTxRateApplied)
+	{
+		return;
+	}
+
+	// Every send callback wakes up the task, lost callback doesn't block it forever
+	for(uint32_t i = 0; ulInFlight && (i < WIFI_RATE_SWITCH_MAX_WAIT_TICKS); i++)
+	{
+		ulTaskNotifyTake(pdTRUE, 1);
+
+		portENTER_CRITICAL(&xTxWindowLock);
+		ulInFlight = ulTxWindowCount;
+		portEXIT_CRITICAL(&xTxWindowLock);
+	}
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	xTxRateSwitching = pdTRUE;
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	wifi_tx_rate_apply(ucRate);
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	xTxRateSwitching = pdFALSE;
+	portEXIT_CRITICAL(&xTxWindowLock);
+}
+#endif
+
+
+static void IRAM_ATTR
+wifi_tx_window_release(esp_now_send_status_t status)
+{
+	int64_t llNow = esp_timer_get_time();
+
+	portENTER_CRITICAL(&xTxWindowLock);
+	if(ulTxWindowCount)
+	{
+		// Packet is waiting in driver queue while previous one is in the air
+		int64_t llStartTime = llTxWindowSendTime[ulTxWindowHead];
+		if(llStartTime < llTxLastDoneTime)
+		{
+			llStartTime = llTxLastDoneTime;
+		}
+
+		xTxStats.ullAirtime += (uint64_t)(llNow - llStartTime);
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+		vWirelessRateReport(&xTxRate, ucTxWindowRate[ulTxWindowHead], (status == ESP_NOW_SEND_SUCCESS));
+#endif
+
+		ulTxWindowHead = (ulTxWindowHead + 1) % CONFIG_WIRELESS_TX_WINDOW_SIZE;
+		--ulTxWindowCount;
+	}
+	llTxLastDoneTime = llNow;
+
+	if(status == ESP_NOW_SEND_SUCCESS)
+	{
+		++xTxStats.ulPacketsSent;
+	}
+	else
+	{
+		++xTxStats.ulPacketsFailed;
+	}
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	if((llNow - llTxRateUpdateTime) >= WIFI_RATE_UPDATE_PERIOD_US)
+	{
+		llTxRateUpdateTime = llNow;
+		ucWirelessRateUpdate(&xTxRate);
+	}
+#endif
+	portEXIT_CRITICAL(&xTxWindowLock);
+
+	xSemaphoreGive(xTxCreditsHandler);
+	xTaskNotifyGive(xDataTransmitterTaskHandler);
+}
+
+
 static esp_err_t IRAM_ATTR
-send_new_packet(const PacketFrame_t* pxPacketFrame)
+wifi_espnow_send(const uint8_t* pucData, size_t xDataLen, TickType_t xTicksToWait)
+{
+	esp_err_t xRes = ESP_ERR_TIMEOUT;
+	uint32_t ulRetries = 0;
+
+	while(wifi_tx_window_take(xTicksToWait) == pdTRUE)
+	{
+		xRes = esp_now_send(NULL, pucData, xDataLen);
+
+		if(ESP_OK == xRes)
+		{
+			return xRes;
+		}
+
+		// Send callback will never be called for this one
+		wifi_tx_window_cancel();
+
+		if((xRes != ESP_ERR_ESPNOW_NO_MEM) || !xTicksToWait || (ulRetries >= CONFIG_WIRELESS_TX_NO_MEM_RETRIES))
+		{
+			break;
+		}
+
+		++ulRetries;
+		++xTxStats.ulNoMemRetries;
+
+		// Driver queue is full, back off till any packet in flight is done
+		ulTaskNotifyTake(pdTRUE, 1);
+	}
+
+	++xTxStats.ulPacketsDropped;
+	return xRes;
+}
+#endif
+
+
+static esp_err_t IRAM_ATTR
+send_new_packet(PacketFrame_t* pxPacketFrame, TickType_t xTicksToWait)
 {
 	PROFILE_POINT(CONFIG_ESP_NOW_TASK_PACKET_SEND_DBG_PROFILER, profile_point_start);
 
-	const PacketFrame_t* pxPacketFrameToSend = NULL;
 	uint32_t ulTxDataLen = sizeof(PacketHeader_t) + pxPacketFrame->xHeader.ucDataSize;
+	BaseType_t xEncrypted = (BaseType_t)pxPacketFrame->xHeader.ucEncrypted;
+	uint32_t ulPlainText[WIFI_CRYPT_BLOCK_SIZE / sizeof(uint32_t)];
 
-	if((BaseType_t)pxPacketFrame->xHeader.ucEncrypted == pdTRUE)
+	// Only first AES block is changed, so keep it to restore after the packet is sent.
+	// Retransmit checks @ref ''ulSlotBlocks'' instead of the slot, so it never sees cipher text.
+	if(xEncrypted == pdTRUE)
 	{
-		PacketFrame_t* pxPacketEncrypted = (PacketFrame_t*)&ucEncryptedData[0][0];
-		pxPacketEncrypted->xHeader.ulValue = pxPacketFrame->xHeader.ulValue;
-
+		memcpy(&ulPlainText[0], &pxPacketFrame->ucFrameData[0], sizeof(ulPlainText));
 		wifi_crypt_packet(&pxPacketFrame->ucFrameData[0],
-		                  &pxPacketEncrypted->ucFrameData[0],
-		                  pxPacketEncrypted->xHeader.ucDataSize,
+		                  &pxPacketFrame->ucFrameData[0],
+		                  pxPacketFrame->xHeader.ucDataSize,
 		                  ESP_AES_ENCRYPT);
-		pxPacketFrameToSend = (const PacketFrame_t*)pxPacketEncrypted;
-	}
-	else
-	{
-		pxPacketFrameToSend = pxPacketFrame;
 	}
 
 #if(WIRELESS_USE_RAW_80211_PACKET == 1)
+	(void)xTicksToWait;
+
 	// TODO: add random stuff
 	// wifi_espnow_raw_packet.magic_packet.random = (uint32_t)
 	wifi_espnow_raw_packet.magic_packet.content.length = ulTxDataLen;
-	memcpy(wifi_espnow_raw_packet.magic_packet.content.body, pxPacketFrameToSend, ulTxDataLen);
+	memcpy(wifi_espnow_raw_packet.magic_packet.content.body, pxPacketFrame, ulTxDataLen);
 	esp_err_t xRes =
 	    esp_wifi_80211_tx(WIFI_IF_STA, &wifi_espnow_raw_packet, sizeof(wifi_espnow_packet_t) + ulTxDataLen, true);
 #else
-	// xSemaphoreTake(xDataTransmitterTxLockHandler, portMAX_DELAY);
-	esp_err_t xRes = esp_now_send(NULL, (const uint8_t*)pxPacketFrameToSend, ulTxDataLen);
+	// ESP-NOW copies data to it's own buffer, so it's safe to restore it right after
+	esp_err_t xRes = wifi_espnow_send((const uint8_t*)pxPacketFrame, ulTxDataLen, xTicksToWait);
 #endif
 
+	if(xEncrypted == pdTRUE)
+	{
+		memcpy(&pxPacketFrame->ucFrameData[0], &ulPlainText[0], sizeof(ulPlainText));
+	}
+
 	PROFILE_POINT(CONFIG_ESP_NOW_TASK_PACKET_SEND_DBG_PROFILER, profile_point_end);
 
 	if(ESP_OK != xRes)
@@ -308,6 +727,56 @@ send_new_packet(const PacketFrame_t* pxPacketFrame)
 	return xRes;
 }
 
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+static BaseType_t IRAM_ATTR
+wifi_retransmit_blocks(const PacketNak_t* pxPacketNak)
+{
+	BaseType_t xRes = pdFALSE;
+	uint8_t ucFrameId = pxPacketNak->xHeader.ucFrameId;
+	tx_frame_history_t* pxFrame = &xFrameHistory[ucFrameId & WIFI_TX_FRAME_HISTORY_MASK];
+	uint32_t ulFrameBlocks = pxFrame->ulBlocks;
+
+	if(!ulFrameBlocks || (ucFrameId != pxFrame->ucFrameId))
+	{
+		return pdFALSE;
+	}
+
+	if((pxFrame->ulRetries >= CONFIG_WIRELESS_NAK_MAX_RETRIES) ||
+	   ((esp_timer_get_time() - pxFrame->llSentTime) > (CONFIG_WIRELESS_NAK_DEADLINE * 1000)))
+	{
+		// Frame is abandoned, forced frame update will start a new one
+		pxFrame->ulBlocks = 0;
+		return pdFALSE;
+	}
+
+	++pxFrame->ulRetries;
+
+	for(uint32_t i = 0; i < ulFrameBlocks; i++)
+	{
+		if(pxPacketNak->ulMissingMap[i >> 5] & (1UL << (i & 31)))
+		{
+			uint32_t ulSlot = pxFrame->usSlots[i];
+
+			// Next frames are sent while this one is still in the air,
+			// so slot could be already reused
+			if(ulSlotBlocks[ulSlot] != WIFI_TX_SLOT_BLOCK(ucFrameId, i))
+			{
+				continue;
+			}
+
+			// Don't wait here, Receiver will ask again if something was not sent
+			if(xQueueSend(xFramePacketQueueHandler, &ulSlot, 0) == pdTRUE)
+			{
+				xRes = pdTRUE;
+			}
+		}
+	}
+
+	return xRes;
+}
+#endif // CONFIG_WIRELESS_NAK_MAX_RETRIES
+
+
 static void IRAM_ATTR
 wifi_espnow_parse_new_data(const uint8_t* data)
 {
@@ -317,7 +786,7 @@ wifi_espnow_parse_new_data(const uint8_t* data)
 
 	if((BaseType_t)pxPacketFrame->xHeader.ucEncrypted == pdTRUE)
 	{
-		PacketFrame_t* pxPacketEncrypted = (PacketFrame_t*)&ucEncryptedData[1][0];
+		PacketFrame_t* pxPacketEncrypted = (PacketFrame_t*)&ucEncryptedData[0];
 		pxPacketEncrypted->xHeader.ulValue = pxPacketFrame->xHeader.ulValue;
 
 		wifi_crypt_packet(&pxPacketFrame->ucFrameData[0],
@@ -331,12 +800,45 @@ wifi_espnow_parse_new_data(const uint8_t* data)
 	{
 	case PACKET_TYPE_ACK: {
 		vResetForcedFrameUpdate();
-		vStartNewFrame();
+
+		// Old Receiver sends empty Ack and waits for every frame
+		if(pxPacketFrame->xHeader.ucDataSize)
+		{
+			vCameraFrameAcked(pxPacketFrame->xHeader.ucFrameId, pxPacketFrame->ucFrameData[0]);
+		}
+		else
+		{
+			vCameraFrameAcked((uint8_t)(ucTxFrameId - 1), 1);
+		}
+		break;
+	}
+
+	case PACKET_TYPE_NAK: {
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+		if(wifi_retransmit_blocks((const PacketNak_t*)pxPacketFrame) == pdTRUE)
+		{
+			// Give Receiver time to get missing blocks instead of sending a new frame
+			vResetForcedFrameUpdate();
+		}
+#endif
 		break;
 	}
 
 	case PACKET_TYPE_PING: {
-		send_new_packet((const PacketFrame_t*)pxPacketFrame);
+		// Ping is never encrypted, so received data is sent back untouched.
+		// Called from WiFi task what also calls send callback, so never wait for Tx window here
+		send_new_packet((PacketFrame_t*)pxPacketFrame, 0);
+
+#if(CONFIG_WIRELESS_TX_STATS_DBG_PRINTOUT == 1)
+		wireless_tx_stats_t xStats;
+		vWirelessGetTxStats(&xStats);
+
+		ASYNC_PRINTF(1, async_print_type_u32, "Tx packets sent %u\n", xStats.ulPacketsSent);
+		ASYNC_PRINTF(1, async_print_type_u32, "Tx packets failed %u\n", xStats.ulPacketsFailed);
+		ASYNC_PRINTF(1, async_print_type_u32, "Tx NO_MEM retries %u\n", xStats.ulNoMemRetries);
+		ASYNC_PRINTF(1, async_print_type_u32, "Tx packets dropped %u\n", xStats.ulPacketsDropped);
+		ASYNC_PRINTF(1, async_print_type_u32, "Tx airtime ms %u\n", (uint32_t)(xStats.ullAirtime / 1000));
+#endif
 		break;
 	}
 
@@ -357,6 +859,29 @@ wifi_espnow_parse_new_data(const uint8_t* data)
 		break;
 	}
 
+	case PACKET_TYPE_LINK_STATS: {
+		const PacketLinkStats_t* pxPacketLinkStats = (const PacketLinkStats_t*)pxPacketFrame;
+
+		vCameraLinkReport(pxPacketLinkStats->usPeriodMs,
+		                  pxPacketLinkStats->ulRxBytes,
+		                  pxPacketLinkStats->usFramesDecoded,
+		                  pxPacketLinkStats->usFramesDropped,
+		                  pxPacketLinkStats->usDecodeTimeMs);
+
+#if((CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1) && (WIRELESS_USE_RAW_80211_PACKET == 0))
+		// Don't probe rates what Receiver can't hear anyway
+		portENTER_CRITICAL(&xTxWindowLock);
+		vWirelessRateSetRssi(&xTxRate, pxPacketLinkStats->icRssi);
+		portEXIT_CRITICAL(&xTxWindowLock);
+#endif
+		break;
+	}
+
+	case PACKET_TYPE_COLOR_MODE: {
+		vCameraSetGrayscale(pxPacketFrame->ucFrameData[0]);
+		break;
+	}
+
 	case PACKET_TYPE_TX_POWER_UPDATE: {
 		wifi_set_tx_power((int8_t)pxPacketFrame->ucFrameData[0]);
 		break;
@@ -401,14 +926,13 @@ wifi_raw_packet_rx_cb(void* buf, wifi_promiscuous_pkt_type_t type)
 #endif // WIRELESS_USE_RAW_80211_PACKET
 
 #if(WIRELESS_USE_RAW_80211_PACKET == 0)
-// static void IRAM_ATTR
-// wifi_espnow_packet_tx_cb(const uint8_t* mac_addr, esp_now_send_status_t status)
-// {
-// 	(void)mac_addr;
-// 	(void)status;
+static void IRAM_ATTR
+wifi_espnow_packet_tx_cb(const uint8_t* mac_addr, esp_now_send_status_t status)
+{
+	(void)mac_addr;
 
-// 	xSemaphoreGive(xDataTransmitterTxLockHandler);
-// }
+	wifi_tx_window_release(status);
+}
 
 static void IRAM_ATTR
 wifi_espnow_packet_rx_cb(const uint8_t* mac_addr, const uint8_t* data, int data_len)
@@ -429,10 +953,12 @@ init_wifi_rtos(void)
 	                                              &xFramePacketQueueControlBlock);
 	assert(xFramePacketQueueHandler);
 
-	// #if(WIRELESS_USE_RAW_80211_PACKET == 0)
-	// 	xDataTransmitterTxLockHandler = xSemaphoreCreateBinaryStatic(&xDataTransmitterTxLockControlBlock);
-	// 	assert(xDataTransmitterTxLockHandler);
-	// #endif
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+	xTxCreditsHandler = xSemaphoreCreateCountingStatic(CONFIG_WIRELESS_TX_WINDOW_SIZE,
+	                                                   CONFIG_WIRELESS_TX_WINDOW_SIZE,
+	                                                   &xTxCreditsControlBlock);
+	assert(xTxCreditsHandler);
+#endif
 
 	xDataTransmitterTaskHandler = xTaskCreateStaticPinnedToCore((TaskFunction_t)(vDataTransmitterTask),
 	                                                            assigned_name_for_task_data_tx,
@@ -448,6 +974,18 @@ init_wifi_rtos(void)
 // ----------------------------------------------------------------------
 // Accessors functions
 
+void
+vWirelessGetTxStats(wireless_tx_stats_t* pxStats)
+{
+#if(WIRELESS_USE_RAW_80211_PACKET == 0)
+	portENTER_CRITICAL(&xTxWindowLock);
+	memcpy(pxStats, &xTxStats, sizeof(wireless_tx_stats_t));
+	portEXIT_CRITICAL(&xTxWindowLock);
+#else
+	memcpy(pxStats, &xTxStats, sizeof(wireless_tx_stats_t));
+#endif
+}
+
 void
 vWirelessGetOwnMAC(uint8_t* pucMAC)
 {
@@ -465,7 +1003,7 @@ vWirelessSetNodeKeys(pairing_data_t* pxKeysData)
 PacketFrame_t*
 get_packet_from_queue(void)
 {
-	return &xPackets[ulFramePacketOffset];
+	return &xPackets[ulFramePacketOffset].xFrame;
 }
 
 void IRAM_ATTR
@@ -474,12 +1012,122 @@ set_packet_to_queue(void)
 	PROFILE_POINT(CONFIG_QUEUE_PACKET_SEND_DBG_PROFILER, profile_point_start);
 
 	xQueueSend(xFramePacketQueueHandler, &ulFramePacketOffset, portMAX_DELAY);
-	ulFramePacketOffset = (ulFramePacketOffset + 1) & WIFI_TX_PACKETS_NUM_MASK;
+	ulFramePacketOffset = ((ulFramePacketOffset + 1) < WIFI_TX_PACKETS_NUM) ? (ulFramePacketOffset + 1) : 0;
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+	// Next slot is overwritten from now, it's set again only if image data block is queued there
+	ulSlotBlocks[ulFramePacketOffset] = 0;
+#endif
 
 	PROFILE_POINT(CONFIG_QUEUE_PACKET_SEND_DBG_PROFILER, profile_point_end);
 }
 
 
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+static void IRAM_ATTR
+wifi_fec_add_block(const uint8_t* pucData, size_t ulDataSize, uint32_t ulBlockId)
+{
+	uint32_t ulDataId = ulBlockId % CONFIG_WIRELESS_FEC_DATA_BLOCKS;
+
+	for(uint32_t i = 0; i < CONFIG_WIRELESS_FEC_PARITY_BLOCKS; i++)
+	{
+		vFecEncodeBlock(&ucFecParity[i][0], pucData, ulDataSize, i, ulDataId);
+	}
+}
+
+static void IRAM_ATTR
+wifi_fec_send_parity(const PacketHeader_t* pxHeader, uint32_t ulGroupEnd, BaseType_t xFinalGroup)
+{
+	for(uint32_t i = 0; i < CONFIG_WIRELESS_FEC_PARITY_BLOCKS; i++)
+	{
+		PacketImageData_t* pxPacket = (PacketImageData_t*)get_packet_from_queue();
+		// Segment id of data block shares bits with parity id, so nothing else is taken from it
+		pxPacket->xHeader.ulValue = 0;
+		pxPacket->xHeader.ucType = PACKET_TYPE_FRAME_PARITY;
+		pxPacket->xHeader.ucFrameId = pxHeader->ucFrameId;
+		pxPacket->xHeader.ucEncrypted = pxHeader->ucEncrypted;
+		pxPacket->xHeader.ucParityId = i;
+		pxPacket->xHeader.ucFinalBlock = xFinalGroup;
+		pxPacket->xHeader.ucDataSize = PACKET_IMAGE_DATA_MAX_SIZE + 1;
+		pxPacket->usBlockId = ulGroupEnd;
+
+		memcpy(&pxPacket->ucImageData[0], &ucFecParity[i][0], PACKET_IMAGE_DATA_MAX_SIZE);
+		set_packet_to_queue();
+	}
+
+	memset(&ucFecParity[0][0], 0, sizeof(ucFecParity));
+}
+#endif // CONFIG_WIRELESS_FEC_ENABLE
+
+
+static void IRAM_ATTR
+wifi_queue_image_block(PacketHeader_t xHeader, uint32_t ulBlockId, const uint8_t* pucData, size_t ulDataSize)
+{
+	// Reuse as it have blockId field.
+	PacketImageData_t* pxPacket = (PacketImageData_t*)get_packet_from_queue();
+	pxPacket->xHeader.ulValue = xHeader.ulValue;
+	pxPacket->xHeader.ucDataSize = ulDataSize + 1;
+	pxPacket->usBlockId = ulBlockId;
+
+	// Data could be already in place, see @ref ''pucWirelessGetFrameBlockBuffer''
+	if(pucData != &pxPacket->ucImageData[0])
+	{
+		memcpy(&pxPacket->ucImageData[0], pucData, ulDataSize);
+	}
+
+	if(xHeader.ucType == PACKET_TYPE_FRAME_DATA)
+	{
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+		wifi_fec_add_block(&pxPacket->ucImageData[0], ulDataSize, ulBlockId);
+#endif
+
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+		tx_frame_history_t* pxFrame = &xFrameHistory[ucTxFrameId & WIFI_TX_FRAME_HISTORY_MASK];
+
+		if(!ulBlockId)
+		{
+			// Frame sent two frames ago is forgotten
+			pxFrame->ulBlocks = 0;
+		}
+
+		// Block what Receiver can't store is never requested again
+		if(ulBlockId < WIFI_TX_FRAME_BLOCKS_MAX_NUM)
+		{
+			pxFrame->usSlots[ulBlockId] = (uint16_t)ulFramePacketOffset;
+			ulSlotBlocks[ulFramePacketOffset] = WIFI_TX_SLOT_BLOCK(xHeader.ucFrameId, ulBlockId);
+		}
+#endif
+	}
+
+	set_packet_to_queue();
+
+	if(xHeader.ucType == PACKET_TYPE_FRAME_DATA)
+	{
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+		// Shorter final group is protected as well
+		if(xHeader.ucFinalBlock || !((ulBlockId + 1) % CONFIG_WIRELESS_FEC_DATA_BLOCKS))
+		{
+			wifi_fec_send_parity(&xHeader, ulBlockId + 1, xHeader.ucFinalBlock);
+		}
+#endif
+
+		if(xHeader.ucFinalBlock)
+		{
+#if(CONFIG_WIRELESS_NAK_MAX_RETRIES > 0)
+			tx_frame_history_t* pxFrame = &xFrameHistory[ucTxFrameId & WIFI_TX_FRAME_HISTORY_MASK];
+			pxFrame->ucFrameId = ucTxFrameId;
+			pxFrame->ulRetries = 0;
+			pxFrame->llSentTime = esp_timer_get_time();
+			pxFrame->ulBlocks = (ulBlockId < WIFI_TX_FRAME_BLOCKS_MAX_NUM) ? (ulBlockId + 1) : WIFI_TX_FRAME_BLOCKS_MAX_NUM;
+#endif
+
+			// Header data belongs to the frame what will be sent next
+			++ucTxFrameId;
+		}
+	}
+}
+
+
 void IRAM_ATTR
 vWirelessSendArray(wifi_packet_type_t xType, uint8_t* pucData, size_t ulDataSize, BaseType_t xUseEncryption)
 {
@@ -487,35 +1135,22 @@ vWirelessSendArray(wifi_packet_type_t xType, uint8_t* pucData, size_t ulDataSize
 
 	uint32_t ulTotalPackets = 0;
 
-	// Reuse as it have blockId field.
-	PacketImageData_t* pxPacket = NULL;
 	PacketHeader_t xConfiguredHeader = {.ucType = (uint8_t)xType,
 	                                    .ucEncrypted = xUseEncryption,
 	                                    .ucFinalBlock = pdFALSE,
-	                                    .ucDataSize = PACKET_IMAGE_DATA_MAX_SIZE + 1};
+	                                    .ucFrameId = ucTxFrameId};
 
 	while(ulDataSize > PACKET_IMAGE_DATA_MAX_SIZE)
 	{
-		pxPacket = (PacketImageData_t*)get_packet_from_queue();
-		pxPacket->xHeader.ulValue = xConfiguredHeader.ulValue;
-		pxPacket->usBlockId = ulTotalPackets;
-
-		memcpy(&pxPacket->ucImageData[0], pucData, PACKET_IMAGE_DATA_MAX_SIZE);
-		set_packet_to_queue();
+		wifi_queue_image_block(xConfiguredHeader, ulTotalPackets, pucData, PACKET_IMAGE_DATA_MAX_SIZE);
 		++ulTotalPackets;
 
 		pucData += PACKET_IMAGE_DATA_MAX_SIZE;
 		ulDataSize -= PACKET_IMAGE_DATA_MAX_SIZE;
 	}
 
-	pxPacket = (PacketImageData_t*)get_packet_from_queue();
-	pxPacket->xHeader.ulValue = xConfiguredHeader.ulValue;
-	pxPacket->xHeader.ucFinalBlock = pdTRUE;
-	pxPacket->xHeader.ucDataSize = ulDataSize + 1;
-	pxPacket->usBlockId = ulTotalPackets;
-
-	memcpy(&pxPacket->ucImageData[0], pucData, ulDataSize);
-	set_packet_to_queue();
+	xConfiguredHeader.ucFinalBlock = pdTRUE;
+	wifi_queue_image_block(xConfiguredHeader, ulTotalPackets, pucData, ulDataSize);
 	++ulTotalPackets;
 
 #if (CONFIG_TOTAL_PACKETS_SEND_DBG_PRINTOUT == 1)
@@ -529,6 +1164,45 @@ vWirelessSendArray(wifi_packet_type_t xType, uint8_t* pucData, size_t ulDataSize
 }
 
 
+uint8_t* IRAM_ATTR
+pucWirelessGetFrameBlockBuffer(void)
+{
+	return &((PacketImageData_t*)get_packet_from_queue())->ucImageData[0];
+}
+
+
+BaseType_t IRAM_ATTR
+xWirelessSendFrameBlock(const uint8_t* pucData,
+                        size_t ulDataSize,
+                        BaseType_t xFinalBlock,
+                        BaseType_t xUseEncryption,
+                        uint8_t ucSegmentId,
+                        BaseType_t xSegmentEnd)
+{
+	// Receiver has no room for more blocks, so the frame ends here and it's decoded as truncated one
+	BaseType_t xFrameCut = ((xFinalBlock == pdFALSE) && ((ulStreamBlockId + 1) >= WIFI_TX_FRAME_BLOCKS_MAX_NUM));
+	if(xFrameCut == pdTRUE)
+	{
+		xFinalBlock = pdTRUE;
+		xSegmentEnd = pdTRUE;
+	}
+
+	PacketHeader_t xConfiguredHeader = {.ucType = PACKET_TYPE_FRAME_DATA,
+	                                    .ucEncrypted = xUseEncryption,
+	                                    .ucFinalBlock = xFinalBlock,
+	                                    .ucFrameId = ucTxFrameId};
+
+	xConfiguredHeader.ucSegmentId = ucSegmentId;
+	xConfiguredHeader.ucSegmentEnd = xSegmentEnd;
+
+	wifi_queue_image_block(xConfiguredHeader, ulStreamBlockId, pucData, ulDataSize);
+
+	ulStreamBlockId = (xFinalBlock == pdTRUE) ? 0 : (ulStreamBlockId + 1);
+
+	return (xFrameCut == pdTRUE) ? pdFALSE : pdTRUE;
+}
+
+
 // ----------------------------------------------------------------------
 // FreeRTOS functions
 
@@ -537,14 +1211,8 @@ vDataTransmitterTask(void* pvArg)
 {
 	(void)pvArg;
 	uint32_t ulFramePacketOffset = 0UL;
-	PacketFrame_t* pxPacket = NULL;
-
 	task_sync_get_bits(TASK_SYNC_EVENT_BIT_DATA_TX);
 
-#if(WIRELESS_USE_RAW_80211_PACKET == 0)
-	// xSemaphoreGive(xDataTransmitterTxLockHandler);
-#endif
-
 	ASYNC_PRINTF(CONFIG_ENABLE_TASK_START_EVENT_DBG_PRINTOUT, async_print_type_str, assigned_name_for_task_data_tx, 0);
 
 	for(;;)
@@ -552,8 +1220,7 @@ vDataTransmitterTask(void* pvArg)
 		// Wait for data as much as possible, but once anything appear - do not stop!
 		while(xQueueReceive(xFramePacketQueueHandler, &ulFramePacketOffset, portMAX_DELAY))
 		{
-			pxPacket = &xPackets[ulFramePacketOffset];
-			send_new_packet((const PacketFrame_t*)pxPacket);
+			send_new_packet(&xPackets[ulFramePacketOffset].xFrame, portMAX_DELAY);
 		}
 	}
 }
@@ -596,7 +1263,6 @@ init_wifi(void)
 
 	ESP_ERROR_CHECK(esp_wifi_set_country_code(DEFAULT_WIFI_COUNTRY_CODE, false));
 	ESP_ERROR_CHECK(esp_wifi_set_channel(DEFAULT_WIFI_CHANNEL, WIFI_SECOND_CHAN_NONE));
-	ESP_ERROR_CHECK(esp_wifi_internal_set_fix_rate(WIFI_IF_STA, true, DEFAULT_WIFI_DATA_RATE));
 
 	wifi_set_tx_power(DEFAULT_WIFI_TX_POWER);
 }
@@ -610,9 +1276,14 @@ init_espnow(void)
 #if(WIRELESS_USE_RAW_80211_PACKET == 0)
 	ESP_ERROR_CHECK(esp_now_init());
 	ESP_ERROR_CHECK(esp_wifi_config_espnow_rate(WIFI_IF_STA, DEFAULT_WIFI_DATA_RATE));
+
+#if(CONFIG_WIRELESS_RATE_CONTROL_ENABLE == 1)
+	// Same rate as DEFAULT_WIFI_DATA_RATE
+	vWirelessRateInit(&xTxRate, WIRELESS_RATE_1M_L);
+#endif
 	ESP_ERROR_CHECK(esp_now_set_pmk((const uint8_t*)&(xWifiEncryptionGetKeys())->ucPMK[0]));
 	ESP_ERROR_CHECK(esp_now_register_recv_cb(wifi_espnow_packet_rx_cb));
-	// ESP_ERROR_CHECK(esp_now_register_send_cb(wifi_espnow_packet_tx_cb));
+	ESP_ERROR_CHECK(esp_now_register_send_cb(wifi_espnow_packet_tx_cb));
 	ESP_ERROR_CHECK(esp_now_add_peer((const esp_now_peer_info_t*)&xPeerNode));
 #endif
 }
@@ -621,6 +1292,10 @@ init_espnow(void)
 void
 init_wireless(void)
 {
+#if(CONFIG_WIRELESS_FEC_ENABLE == 1)
+	vFecInit();
+#endif
+
 	init_wifi();
 	init_encryption();
 	init_espnow();
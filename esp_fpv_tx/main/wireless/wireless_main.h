@@ -29,9 +29,22 @@ typedef enum
 	PACKET_TYPE_PING,
 	PACKET_TYPE_SWITCH_CHANNEL,
 	PACKET_TYPE_TX_POWER_UPDATE,
-	PACKET_TYPE_ENABLE_LED
+	PACKET_TYPE_ENABLE_LED,
+	PACKET_TYPE_FRAME_PARITY,
+	PACKET_TYPE_LINK_STATS,
+	PACKET_TYPE_COLOR_MODE
 } wifi_packet_type_t;
 
+// ----------------------------
+typedef struct
+{
+	uint32_t ulPacketsSent;    // Packets confirmed by send callback
+	uint32_t ulPacketsFailed;  // Packets what were not acknowledged by the other node
+	uint32_t ulNoMemRetries;   // Times when driver had no free buffers and packet was sent again
+	uint32_t ulPacketsDropped; // Packets what were never passed to the driver
+	uint64_t ullAirtime;       // Time in us spent by confirmed packets in the air, including MAC retries
+} wireless_tx_stats_t;
+
 // ----------------------------
 // Common protocol type definitions
 #pragma pack(push, 1)
@@ -61,11 +74,18 @@ typedef struct
 				{
 					uint8_t ucEncrypted : 1;  // Received ucFrameData[] is encrypted
 					uint8_t ucFinalBlock : 1; // All previously splitted data is now fully transmitted and ready for process
-					uint8_t ucUnused : 6;
+					uint8_t ucParityId : 3;   // Index of parity block in FEC group, see @ref ''PACKET_TYPE_FRAME_PARITY''
+					uint8_t ucUnused : 3;
+				};
+				struct
+				{
+					uint8_t : 2;
+					uint8_t ucSegmentId : 5;  // Restart segment of @ref ''PACKET_TYPE_FRAME_DATA'' block
+					uint8_t ucSegmentEnd : 1; // The last data block of the restart segment
 				};
 			};
 			uint8_t ucDataSize; // Amount of bytes in ucFrameData[]
-			uint8_t ucReserved; // For padding and easy 32bit value copy via ulValue
+			uint8_t ucFrameId;  // Sequence number of the image frame this packet belongs to
 		};
 	};
 } PacketHeader_t; // 4 bytes total
@@ -87,6 +107,11 @@ typedef struct
 	uint8_t ucImageData[PACKET_FREE_DATA_SIZE - 1];
 } PacketImageData_t; // About 5~250 bytes
 
+// PACKET_TYPE_FRAME_PARITY reuses PacketImageData_t:
+//  - usBlockId is the index right after the last data block of protected group;
+//  - ucImageData[] is always PACKET_IMAGE_DATA_MAX_SIZE bytes,
+//    shorter final data block is treated as zero padded.
+
 #define PACKET_IMAGE_DATA_MAX_SIZE (PACKET_FREE_DATA_SIZE - 1)
 
 typedef struct
@@ -95,6 +120,26 @@ typedef struct
 	uint64_t ullTimestamp;
 } PacketPing_t; // About 8 bytes
 
+// Enougth to describe up to 128 blocks of single image frame
+#define PACKET_NAK_MAP_WORDS (4)
+
+typedef struct
+{
+	PacketHeader_t xHeader;                     // ucFrameId is the frame to retransmit blocks from
+	uint32_t ulMissingMap[PACKET_NAK_MAP_WORDS]; // Bit set for each block what need to be sent again
+} PacketNak_t; // About 20 bytes
+
+typedef struct
+{
+	PacketHeader_t xHeader;
+	uint32_t ulRxBytes;       // Amount of bytes received by Receiver during report period
+	uint16_t usPeriodMs;      // Duration of report period
+	uint16_t usFramesDecoded; // Frames shown by Receiver during report period
+	uint16_t usFramesDropped; // Frames abandoned by Receiver during report period
+	uint16_t usDecodeTimeMs;  // Average time used to decode single frame
+	int8_t icRssi;            // Signal level of Transmitter packets at Receiver, in dBm
+} PacketLinkStats_t; // About 17 bytes
+
 #pragma pack(pop)
 
 
@@ -143,6 +188,13 @@ typedef struct
 // ----------------------------------------------------------------------
 // Accessors functions
 
+/**
+ * @brief Get statistics of ESP-NOW Tx window
+ * 
+ * @param pxStats Where to store collected values
+ */
+void vWirelessGetTxStats(wireless_tx_stats_t* pxStats);
+
 /**
  * @brief Send blob of data if it's too huge to be send via regular way.
  * 
@@ -150,6 +202,38 @@ typedef struct
  */
 void vWirelessSendArray(wifi_packet_type_t xType, uint8_t* pucData, size_t ulDataSize, BaseType_t xUseEncryption);
 
+/**
+ * @brief Send single block of image frame as soon as it's ready.
+ *        Blocks are numbered automatically, numbering restarts after final block.
+ * 
+ * @param pucData Block data
+ * @param ulDataSize Amount of bytes in block, no more than @ref ''PACKET_IMAGE_DATA_MAX_SIZE''
+ * @param xFinalBlock pdTRUE for the last block of the frame
+ * @param xUseEncryption pdTRUE to encrypt the packet
+ * @param ucSegmentId Restart segment what block belongs to, 0 if image has no restart markers
+ * @param xSegmentEnd pdTRUE for the last block of the restart segment
+ * 
+ * @retval pdFALSE if frame is too huge and it was cut at this block, rest of it must not be sent
+ * 
+ * @attention Same as @ref ''vWirelessSendArray'' do not mix it with other calls while frame is not finished!
+ */
+BaseType_t xWirelessSendFrameBlock(const uint8_t* pucData,
+                                   size_t ulDataSize,
+                                   BaseType_t xFinalBlock,
+                                   BaseType_t xUseEncryption,
+                                   uint8_t ucSegmentId,
+                                   BaseType_t xSegmentEnd);
+
+/**
+ * @brief Get image data area of the next Tx packet, so block could be written there directly.
+ *        Pass returned pointer to @ref ''xWirelessSendFrameBlock'' to send it without any copy.
+ *
+ * @retval Pointer to @ref ''PACKET_IMAGE_DATA_MAX_SIZE'' bytes buffer
+ *
+ * @attention Buffer is valid only till the next call of @ref ''xWirelessSendFrameBlock'' or @ref ''vWirelessSendArray''!
+ */
+uint8_t* pucWirelessGetFrameBlockBuffer(void);
+
 /**
  * @brief Fill device MAC address which is required for Pairing
  * 
@@ -164,11 +248,14 @@ void vWirelessGetOwnMAC(uint8_t* pucMAC);
  */
 void vWirelessSetNodeKeys(pairing_data_t* pxKeysData);
 
+// Amount of bytes at the begining of ucFrameData[] what are changed by @ref ''wifi_crypt_packet''
+#define WIFI_CRYPT_BLOCK_SIZE (16)
+
 /**
  * @brief Encrypts first 16 bytes of input buffer
  * 
  * @param pucDataIn Input buffer with data to encrypt
- * @param pucDataOut Output buffer where encrypted data will be placed
+ * @param pucDataOut Output buffer where encrypted data will be placed, could be the same as pucDataIn
  * @param xInputSize Size of input buffer and amount of data in it
  * @param ucMode pass 1 for decrypt, pass 0 to encrypt. Check @ref ''AES_DECRYPT''
  * 
@@ -0,0 +1,257 @@
+/**
+ * @file wireless_rate.c
+ *
+ * Minstrel like PHY rate selection.
+ *
+ * Unlike Minstrel, lost ESP-NOW packet is lost for the application,
+ * there is no retry chain with slower rates. So the fastest rate is used
+ * only when it's reliable enougth, otherwise the most reliable one is used.
+ */
+
+#include "wireless_rate.h"
+
+#ifdef ESP_PLATFORM
+#include <esp_attr.h>
+#else
+#define IRAM_ATTR
+#define DRAM_ATTR
+#endif
+//
+#include <stdint.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Every Nth packet is used to probe neighbour rate
+#define WIRELESS_RATE_SAMPLE_INTERVAL (16)
+// How many rates above the best one are probed, one below is always probed
+#define WIRELESS_RATE_SAMPLE_SPAN (2)
+// Weight of the new period in averaged probability, in 1/4
+#define WIRELESS_RATE_EWMA_NEW_WEIGHT (1)
+// Rates with lower success probability are never chosen as the best one
+#define WIRELESS_RATE_PROB_GOOD ((WIRELESS_RATE_PROB_ONE * 90) / 100)
+// Averaged size of ESP-NOW packet in the air, with MAC header and vendor element
+#define WIRELESS_RATE_PACKET_BYTES (290)
+// Signal level above receiver sensitivity what rate needs to be used, in dB
+#define WIRELESS_RATE_RSSI_MARGIN (6)
+
+typedef struct
+{
+	uint16_t usKbps;       // Nominal bitrate
+	uint16_t usOverheadUs; // Preamble, Ack and interframe spaces
+	int8_t icSensitivity;  // Receiver sensitivity from ESP32 datasheet, in dBm
+} wireless_rate_info_t;
+
+// ----------------------------------------------------------------------
+// Variables
+
+// clang-format off
+DRAM_ATTR static const wireless_rate_info_t xRateInfo[WIRELESS_RATE_NUM] = {
+	{  250, 600, -105}, // LR
+	{  500, 600, -102},
+	{ 1000, 556,  -98}, // 11b, long preamble
+	{ 2000, 310,  -95}, // 11b, short preamble
+	{ 5500, 310,  -93},
+	{11000, 310,  -88},
+	{ 6500, 110,  -92}, // 11n HT20, long GI
+	{13000, 110,  -89},
+	{19500, 110,  -86},
+	{26000, 110,  -83},
+	{39000, 110,  -80},
+	{52000, 110,  -76},
+	{58500, 110,  -74},
+	{65000, 110,  -72},
+};
+// clang-format on
+
+// ----------------------------------------------------------------------
+// Static functions declaration
+
+/**
+ * @brief Time in us what single packet takes in the air with this rate
+ */
+static uint32_t wireless_rate_airtime(uint8_t ucRate);
+
+/**
+ * @brief Expected amount of delivered packets per second
+ */
+static uint32_t wireless_rate_throughput(const wireless_rate_t* pxRate, uint8_t ucRate);
+
+/**
+ * @brief Check if the other node could receive this rate with the last reported signal level
+ */
+static uint32_t wireless_rate_usable(const wireless_rate_t* pxRate, uint8_t ucRate);
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint32_t
+wireless_rate_airtime(uint8_t ucRate)
+{
+	return xRateInfo[ucRate].usOverheadUs + ((WIRELESS_RATE_PACKET_BYTES * 8UL * 1000UL) / xRateInfo[ucRate].usKbps);
+}
+
+static uint32_t
+wireless_rate_throughput(const wireless_rate_t* pxRate, uint8_t ucRate)
+{
+	return (pxRate->xStats[ucRate].usProb * (1000000UL / wireless_rate_airtime(ucRate))) / WIRELESS_RATE_PROB_ONE;
+}
+
+static uint32_t IRAM_ATTR
+wireless_rate_usable(const wireless_rate_t* pxRate, uint8_t ucRate)
+{
+	// The most robust rate is the last chance, it's always allowed
+	return !ucRate || !pxRate->icRssi ||
+	       (pxRate->icRssi >= (xRateInfo[ucRate].icSensitivity + WIRELESS_RATE_RSSI_MARGIN));
+}
+
+// ----------------------------------------------------------------------
+// Accessors functions
+
+uint32_t
+ulWirelessRateKbps(uint8_t ucRate)
+{
+	return (ucRate < WIRELESS_RATE_NUM) ? xRateInfo[ucRate].usKbps : 0;
+}
+
+uint8_t IRAM_ATTR
+ucWirelessRateGetBest(const wireless_rate_t* pxRate)
+{
+	return pxRate->ucBestRate;
+}
+
+void IRAM_ATTR
+vWirelessRateSetRssi(wireless_rate_t* pxRate, int8_t icRssi)
+{
+	pxRate->icRssi = icRssi;
+
+	while(!wireless_rate_usable(pxRate, pxRate->ucBestRate))
+	{
+		--pxRate->ucBestRate;
+	}
+}
+
+// ----------------------------------------------------------------------
+// Core functions
+
+void
+vWirelessRateInit(wireless_rate_t* pxRate, uint8_t ucStartRate)
+{
+	memset(pxRate, 0, sizeof(wireless_rate_t));
+
+	pxRate->ucBestRate = (ucStartRate < WIRELESS_RATE_NUM) ? ucStartRate : WIRELESS_RATE_1M_L;
+	pxRate->xStats[pxRate->ucBestRate].usProb = WIRELESS_RATE_PROB_ONE;
+	pxRate->xStats[pxRate->ucBestRate].ucValid = 1;
+}
+
+uint8_t IRAM_ATTR
+ucWirelessRateSelect(wireless_rate_t* pxRate)
+{
+	uint8_t ucBest = pxRate->ucBestRate;
+
+	if(++pxRate->ulPackets % WIRELESS_RATE_SAMPLE_INTERVAL)
+	{
+		return ucBest;
+	}
+
+	// Round robin over [best - 1 : best + span], the best one itself is skipped
+	for(uint32_t i = 0; i < (WIRELESS_RATE_SAMPLE_SPAN + 1); i++)
+	{
+		uint32_t ulOffset = pxRate->ucSampleOffset;
+		pxRate->ucSampleOffset = (uint8_t)((ulOffset + 1) % (WIRELESS_RATE_SAMPLE_SPAN + 1));
+
+		int32_t lRate = (ulOffset == 0) ? ((int32_t)ucBest - 1) : ((int32_t)ucBest + (int32_t)ulOffset);
+
+		if((lRate >= 0) && (lRate < WIRELESS_RATE_NUM) && wireless_rate_usable(pxRate, (uint8_t)lRate))
+		{
+			return (uint8_t)lRate;
+		}
+	}
+
+	return ucBest;
+}
+
+void IRAM_ATTR
+vWirelessRateReport(wireless_rate_t* pxRate, uint8_t ucRate, uint32_t ulSuccess)
+{
+	if(ucRate >= WIRELESS_RATE_NUM)
+	{
+		return;
+	}
+
+	++pxRate->xStats[ucRate].ulAttempts;
+
+	if(ulSuccess)
+	{
+		++pxRate->xStats[ucRate].ulSuccess;
+	}
+}
+
+uint8_t IRAM_ATTR
+ucWirelessRateUpdate(wireless_rate_t* pxRate)
+{
+	for(uint32_t i = 0; i < WIRELESS_RATE_NUM; i++)
+	{
+		wireless_rate_stats_t* pxStats = &pxRate->xStats[i];
+
+		if(!pxStats->ulAttempts)
+		{
+			continue;
+		}
+
+		uint32_t ulProb = (pxStats->ulSuccess * WIRELESS_RATE_PROB_ONE) / pxStats->ulAttempts;
+
+		if(pxStats->ucValid)
+		{
+			ulProb = ((pxStats->usProb * (4UL - WIRELESS_RATE_EWMA_NEW_WEIGHT)) +
+			          (ulProb * WIRELESS_RATE_EWMA_NEW_WEIGHT)) / 4UL;
+		}
+
+		pxStats->usProb = (uint16_t)ulProb;
+		pxStats->ucValid = 1;
+		pxStats->ulAttempts = 0;
+		pxStats->ulSuccess = 0;
+	}
+
+	uint32_t ulBestThroughput = 0;
+	int32_t lBest = -1;
+
+	// Statistics of rates what are not probed anymore could be too old
+	uint32_t ulLastRate = pxRate->ucBestRate + WIRELESS_RATE_SAMPLE_SPAN;
+	ulLastRate = (ulLastRate < WIRELESS_RATE_NUM) ? ulLastRate : (WIRELESS_RATE_NUM - 1);
+
+	for(uint32_t i = 0; i <= ulLastRate; i++)
+	{
+		if(!pxRate->xStats[i].ucValid || (pxRate->xStats[i].usProb < WIRELESS_RATE_PROB_GOOD) ||
+		   !wireless_rate_usable(pxRate, (uint8_t)i))
+		{
+			continue;
+		}
+
+		uint32_t ulThroughput = wireless_rate_throughput(pxRate, (uint8_t)i);
+
+		if(ulThroughput > ulBestThroughput)
+		{
+			ulBestThroughput = ulThroughput;
+			lBest = (int32_t)i;
+		}
+	}
+
+	if(lBest >= 0)
+	{
+		pxRate->ucBestRate = (uint8_t)lBest;
+	}
+	else if(pxRate->ucBestRate)
+	{
+		// Nothing is reliable, step down and let probes find the way back
+		--pxRate->ucBestRate;
+	}
+
+	while(!wireless_rate_usable(pxRate, pxRate->ucBestRate))
+	{
+		--pxRate->ucBestRate;
+	}
+
+	return pxRate->ucBestRate;
+}
@@ -0,0 +1,13 @@
+/**
+ * @file debug_tools_esp.h
+ *
+ * Host replacement of debug tools, profile points and printouts are compiled out.
+ */
+
+#ifndef _DEBUG_TOOLS_ESP_H
+#define _DEBUG_TOOLS_ESP_H
+
+#define PROFILE_POINT(name, type)
+#define ASYNC_PRINTF(name, type, fmt, val)
+
+#endif /* _DEBUG_TOOLS_ESP_H */
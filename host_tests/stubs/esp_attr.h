@@ -0,0 +1,13 @@
+/**
+ * @file esp_attr.h
+ *
+ * Host replacement of ESP-IDF memory placement attributes.
+ */
+
+#ifndef _ESP_ATTR_H
+#define _ESP_ATTR_H
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#endif /* _ESP_ATTR_H */
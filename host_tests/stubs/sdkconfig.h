@@ -0,0 +1,11 @@
+/**
+ * @file sdkconfig.h
+ *
+ * Host replacement of ESP-IDF generated configuration.
+ * Test targets define options what tested modules need, see CMakeLists.txt.
+ */
+
+#ifndef _SDKCONFIG_H
+#define _SDKCONFIG_H
+
+#endif /* _SDKCONFIG_H */
@@ -0,0 +1,87 @@
+/**
+ * @file test_common.h
+ *
+ * Helpers shared by host tests.
+ */
+
+#ifndef _TEST_COMMON_H
+#define _TEST_COMMON_H
+
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Check what is never compiled out, unlike assert()
+#define TEST_CHECK(xCond)                                                             \
+	do                                                                                \
+	{                                                                                 \
+		if(!(xCond))                                                                  \
+		{                                                                             \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #xCond); \
+			abort();                                                                  \
+		}                                                                             \
+	} while(0)
+
+// ----------------------------------------------------------------------
+// Helpers
+
+/**
+ * @brief Read whole file, test fails if it's not possible
+ *
+ * @param pcPath File path
+ * @param pxSize Where to store amount of bytes in the file
+ *
+ * @retval File content, must be freed by the caller
+ */
+static inline uint8_t*
+pucTestReadFile(const char* pcPath, size_t* pxSize)
+{
+	FILE* pxFile = fopen(pcPath, "rb");
+	TEST_CHECK(pxFile != NULL);
+	TEST_CHECK(fseek(pxFile, 0, SEEK_END) == 0);
+	long lSize = ftell(pxFile);
+	TEST_CHECK(lSize > 0);
+	TEST_CHECK(fseek(pxFile, 0, SEEK_SET) == 0);
+
+	uint8_t* pucData = (uint8_t*)malloc((size_t)lSize);
+	TEST_CHECK(pucData != NULL);
+	TEST_CHECK(fread(pucData, 1, (size_t)lSize, pxFile) == (size_t)lSize);
+	fclose(pxFile);
+
+	*pxSize = (size_t)lSize;
+	return pucData;
+}
+
+/**
+ * @brief Pseudo random numbers, the same sequence for the same seed on every host
+ *
+ * @param pulSeed State of the sequence, it's updated by each call
+ *
+ * @retval Next number, 24 bits
+ */
+static inline uint32_t
+ulTestRandNext(uint32_t* pulSeed)
+{
+	*pulSeed = *pulSeed * 1664525UL + 1013904223UL;
+	return *pulSeed >> 8;
+}
+
+/**
+ * @brief Monotonic time for benchmarks
+ *
+ * @retval Time in nanoseconds
+ */
+static inline uint64_t
+ullTestTimeNs(void)
+{
+	struct timespec xTime;
+	clock_gettime(CLOCK_MONOTONIC, &xTime);
+	return (uint64_t)xTime.tv_sec * 1000000000ULL + (uint64_t)xTime.tv_nsec;
+}
+
+#endif /* _TEST_COMMON_H */
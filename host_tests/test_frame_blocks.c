@@ -0,0 +1,545 @@
+/**
+ * @file test_frame_blocks.c
+ *
+ * Packet traces replayed through Rx frame assembly bookkeeping.
+ * Transmitter model splits every frame into blocks and restart segments, channel model loses,
+ * reorders, duplicates and delays packets, FEC restores some of lost blocks without their headers,
+ * and Jpg header is sometimes sent again, what starts new frame sequence.
+ * Receiver model handles every packet like the parser in wireless_main.c does.
+ * Frame ids are 8bit like in the packet header, so they wrap around many times during each trace.
+ *
+ * Checks:
+ * - delivered frames only grow, only packets of older frames are dropped as stale
+ * - blocks of different frames are never mixed in one slot
+ * - frame is delivered only with known total amount of blocks and enougth of them received
+ * - size of the frame ends with the final block, it's counted as full only if FEC restored it
+ * - every intact segment is really received completely and starts where it's told,
+ *   every segment what could be found is found
+ * - NAK map and blocks in order match the received blocks
+ * - without loss and reordering every frame is delivered with all segments intact
+ */
+
+#include "frame_blocks.h"
+#include "test_common.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_FRAMES_NUM  (4096)
+#define TEST_BLOCKS_MIN  (8)
+#define TEST_BLOCKS_MAX  (67) // 16k frame in 245 bytes blocks
+#define TEST_BLOCK_SIZE  (245)
+#define TEST_DATA_OFFSET (600) // Jpg header
+#define TEST_THRESHOLD   (90)
+#define TEST_NAK_WORDS   (4)
+#define TEST_EVENTS_MAX  (TEST_FRAMES_NUM * TEST_BLOCKS_MAX * 3)
+#define TEST_BENCH_RUNS  (20)
+
+// Packets are sent each TEST_TICKS, jitter and delays are in the same units
+#define TEST_TICKS (8)
+
+#define EVENT_DATA     (0) // Image data block
+#define EVENT_RESTORED (1) // Block restored by FEC, it's header is unknown
+#define EVENT_RESTART  (2) // Jpg header, new frame sequence starts from the frame
+
+typedef struct
+{
+	const char* pcName;
+	uint32_t ulLossPpm;      // Lost packets
+	uint32_t ulRestoredPpm;  // Lost packets what FEC restores
+	uint32_t ulDupPpm;       // Duplicated packets
+	uint32_t ulLatePpm;      // Packets what come much later, with packets of next frames
+	uint32_t ulJitter;       // Packets are reordered within this amount of packets
+	uint32_t ulRestartEvery; // New frame sequence each this amount of frames, 0 if never
+} test_channel_t;
+
+typedef struct
+{
+	uint64_t ullArrival;
+	uint32_t ulSent;
+	uint32_t ulFrame;
+	uint16_t usBlock;
+	uint8_t ucType;
+	uint8_t ucFinal;
+} test_event_t;
+
+typedef struct
+{
+	frame_blocks_t xBlocks;
+	uint32_t ulFrame;                               // Frame number of the slot, it's not wrapped
+	uint32_t ulBlockFrame[FRAME_BLOCKS_MAX_NUM];    // Frame what each block was written for
+	uint8_t ucRestored[FRAME_BLOCKS_MAX_NUM];       // Block was restored by FEC
+	frame_segments_t xSegments;
+} test_slot_t;
+
+typedef struct
+{
+	uint32_t ulPackets;
+	uint32_t ulDelivered;
+	uint32_t ulDropped;
+	uint32_t ulStale;
+	uint32_t ulDuplicates;
+	uint32_t ulSegments;
+	uint32_t ulIntact;
+} test_stats_t;
+
+// ----------------------------------------------------------------------
+// Variables
+
+static const test_channel_t xChannels[] = {
+    {"clean                      ", 0, 0, 0, 0, 0, 0},
+    {"new sequences              ", 0, 0, 0, 0, 0, 500},
+    {"reordered                  ", 0, 0, 0, 0, 12, 0},
+    {"lossy                      ", 30000, 0, 0, 0, 0, 0},
+    {"lossy, FEC                 ", 30000, 500000, 0, 0, 0, 0},
+    {"duplicates and late packets", 0, 0, 50000, 10000, 4, 300},
+    {"everything                 ", 50000, 500000, 20000, 10000, 12, 300},
+};
+
+// Frames what Transmitter sends
+static uint16_t usTotal[TEST_FRAMES_NUM];
+static uint8_t ucFinalSize[TEST_FRAMES_NUM];
+static uint8_t ucSegment[TEST_FRAMES_NUM][TEST_BLOCKS_MAX];
+static uint16_t usSegmentStart[TEST_FRAMES_NUM][FRAME_SEGMENTS_MAX_NUM];
+static uint8_t ucSegments[TEST_FRAMES_NUM];
+
+static test_event_t xEvents[TEST_EVENTS_MAX];
+static uint32_t ulEvents = 0;
+
+// Receiver
+static test_slot_t xSlots[2];
+static frame_sequence_t xSequence;
+static int32_t lLastDelivered; // Frame number, -1 before the first one
+static uint32_t ulRestartFrame;
+static test_stats_t xStats;
+static uint32_t ulChecks = 1;
+
+static uint32_t ulSeed = 1;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint32_t
+rand_ppm(uint32_t ulPpm)
+{
+	return (ulTestRandNext(&ulSeed) % 1000000UL) < ulPpm;
+}
+
+
+static void
+make_frames(void)
+{
+	for(uint32_t f = 0; f < TEST_FRAMES_NUM; f++)
+	{
+		uint32_t ulTotal = TEST_BLOCKS_MIN + ulTestRandNext(&ulSeed) % (TEST_BLOCKS_MAX - TEST_BLOCKS_MIN + 1);
+		uint32_t ulSeg = 0;
+		uint32_t b = 0;
+
+		usTotal[f] = (uint16_t)ulTotal;
+		ucFinalSize[f] = (uint8_t)(1 + ulTestRandNext(&ulSeed) % TEST_BLOCK_SIZE);
+
+		while(b < ulTotal)
+		{
+			// The last segment takes the rest of the frame
+			uint32_t ulLen = 1 + ulTestRandNext(&ulSeed) % 5;
+
+			if((ulSeg == (FRAME_SEGMENTS_MAX_NUM - 1)) || ((b + ulLen) > ulTotal))
+			{
+				ulLen = ulTotal - b;
+			}
+
+			usSegmentStart[f][ulSeg] = (uint16_t)b;
+			for(uint32_t i = 0; i < ulLen; i++, b++)
+			{
+				ucSegment[f][b] = (uint8_t)(ulSeg | ((i == (ulLen - 1)) ? FRAME_BLOCK_SEGMENT_END : 0));
+			}
+			++ulSeg;
+		}
+
+		ucSegments[f] = (uint8_t)ulSeg;
+	}
+}
+
+
+static void
+add_event(const test_channel_t* pxChannel, uint32_t ulSent, uint32_t ulFrame, uint32_t ulBlock, uint8_t ucType)
+{
+	test_event_t* pxEvent = &xEvents[ulEvents++];
+
+	TEST_CHECK(ulEvents <= TEST_EVENTS_MAX);
+
+	pxEvent->ullArrival = (uint64_t)ulSent * TEST_TICKS;
+	pxEvent->ulSent = ulEvents;
+	pxEvent->ulFrame = ulFrame;
+	pxEvent->usBlock = (uint16_t)ulBlock;
+	pxEvent->ucType = ucType;
+	pxEvent->ucFinal = (ucType == EVENT_DATA) && (ulBlock == (usTotal[ulFrame] - 1U));
+
+	if((ucType != EVENT_RESTART) && pxChannel->ulJitter)
+	{
+		pxEvent->ullArrival += ulTestRandNext(&ulSeed) % (pxChannel->ulJitter * TEST_TICKS);
+	}
+	// Much less than 128 frames, so 8bit frame id of late packet is never mistaken for newer frame
+	if((ucType == EVENT_DATA) && rand_ppm(pxChannel->ulLatePpm))
+	{
+		pxEvent->ullArrival += (uint64_t)(200 + ulTestRandNext(&ulSeed) % 1000) * TEST_TICKS;
+	}
+}
+
+
+static int
+compare_events(const void* pvA, const void* pvB)
+{
+	const test_event_t* pxA = (const test_event_t*)pvA;
+	const test_event_t* pxB = (const test_event_t*)pvB;
+
+	if(pxA->ullArrival != pxB->ullArrival)
+	{
+		return (pxA->ullArrival < pxB->ullArrival) ? -1 : 1;
+	}
+
+	return (pxA->ulSent < pxB->ulSent) ? -1 : 1;
+}
+
+
+static void
+make_trace(const test_channel_t* pxChannel)
+{
+	uint32_t ulSent = 0;
+
+	ulEvents = 0;
+	add_event(pxChannel, ulSent++, 0, 0, EVENT_RESTART);
+
+	for(uint32_t f = 0; f < TEST_FRAMES_NUM; f++)
+	{
+		uint32_t ulLost[TEST_BLOCKS_MAX];
+		uint32_t ulLostNum = 0;
+
+		if(f && pxChannel->ulRestartEvery && !(f % pxChannel->ulRestartEvery))
+		{
+			add_event(pxChannel, ulSent++, f, 0, EVENT_RESTART);
+		}
+
+		for(uint32_t b = 0; b < usTotal[f]; b++)
+		{
+			if(rand_ppm(pxChannel->ulLossPpm))
+			{
+				ulLost[ulLostNum++] = b;
+				++ulSent;
+				continue;
+			}
+
+			add_event(pxChannel, ulSent++, f, b, EVENT_DATA);
+
+			if(rand_ppm(pxChannel->ulDupPpm))
+			{
+				add_event(pxChannel, ulSent, f, b, EVENT_DATA);
+			}
+		}
+
+		// Parity comes after data blocks
+		for(uint32_t i = 0; i < ulLostNum; i++)
+		{
+			if(rand_ppm(pxChannel->ulRestoredPpm))
+			{
+				add_event(pxChannel, ulSent, f, ulLost[i], EVENT_RESTORED);
+			}
+		}
+	}
+
+	qsort(xEvents, ulEvents, sizeof(test_event_t), compare_events);
+}
+
+
+// Intact segments must be really intact, and everything what could be found must be found
+static void
+check_segments(const test_slot_t* pxSlot)
+{
+	const frame_segments_t* pxSegments = &pxSlot->xSegments;
+	uint32_t f = pxSlot->ulFrame;
+	uint32_t ulFirstMissing = usTotal[f];
+	uint32_t ulFinal = usTotal[f] - 1U;
+	uint32_t ulSize = ulFinal * TEST_BLOCK_SIZE + (pxSlot->ucRestored[ulFinal] ? TEST_BLOCK_SIZE : ucFinalSize[f]);
+
+	for(uint32_t b = 0; b < usTotal[f]; b++)
+	{
+		if(!ulFrameBlocksHas(&pxSlot->xBlocks, b))
+		{
+			ulFirstMissing = b;
+			break;
+		}
+	}
+	if(ulFirstMissing == usTotal[f])
+	{
+		TEST_CHECK(pxSegments->usIntactSize == (ulSize + TEST_DATA_OFFSET));
+	}
+	else
+	{
+		TEST_CHECK(pxSegments->usIntactSize == (ulFirstMissing * TEST_BLOCK_SIZE + TEST_DATA_OFFSET));
+	}
+
+	// Size of the frame passed to the decoder, see pucWirelessTakeCurrentRxBuffer()
+	if(ulFrameBlocksHas(&pxSlot->xBlocks, ulFinal))
+	{
+		TEST_CHECK(ulFrameBlocksSize(&pxSlot->xBlocks, usTotal[f], TEST_BLOCK_SIZE) == ulSize);
+	}
+
+	for(uint32_t s = 0; s < ucSegments[f]; s++)
+	{
+		uint32_t ulStart = usSegmentStart[f][s];
+		uint32_t ulEnd = ((s + 1) < ucSegments[f]) ? usSegmentStart[f][s + 1] : usTotal[f];
+		uint32_t ulReceived = 1;
+		uint32_t ulKnown = 1;
+
+		for(uint32_t b = ulStart; b < ulEnd; b++)
+		{
+			ulReceived &= ulFrameBlocksHas(&pxSlot->xBlocks, b);
+			ulKnown &= !pxSlot->ucRestored[b];
+		}
+
+		if(pxSegments->ulIntactMap & (1UL << s))
+		{
+			TEST_CHECK(ulReceived);
+			TEST_CHECK(pxSegments->usSegmentOffset[s] == (ulStart * TEST_BLOCK_SIZE + TEST_DATA_OFFSET));
+			++xStats.ulIntact;
+		}
+		// Start of the segment is known only after the end of previous one
+		else if(ulReceived && ulKnown &&
+		        (!ulStart || (ulFrameBlocksHas(&pxSlot->xBlocks, ulStart - 1) && !pxSlot->ucRestored[ulStart - 1])))
+		{
+			TEST_CHECK(0);
+		}
+	}
+
+	xStats.ulSegments += ucSegments[f];
+}
+
+
+static void
+check_missing(const test_slot_t* pxSlot)
+{
+	uint32_t ulMap[TEST_NAK_WORDS];
+	uint32_t ulTotal = pxSlot->xBlocks.usBlocksTotal ? pxSlot->xBlocks.usBlocksTotal : TEST_BLOCKS_MAX;
+	uint32_t ulInOrder = ulTotal;
+
+	vFrameBlocksMissing(&pxSlot->xBlocks, TEST_BLOCKS_MAX, ulMap, TEST_NAK_WORDS);
+
+	for(uint32_t b = 0; b < (TEST_NAK_WORDS * 32); b++)
+	{
+		uint32_t ulMissing = (ulMap[b >> 5] >> (b & 31)) & 1;
+		uint32_t ulExpected = (b < ulTotal) && !ulFrameBlocksHas(&pxSlot->xBlocks, b);
+
+		TEST_CHECK(ulMissing == ulExpected);
+		if(ulExpected && (b < ulInOrder))
+		{
+			ulInOrder = b;
+		}
+	}
+
+	TEST_CHECK(ulFrameBlocksInOrder(&pxSlot->xBlocks, 0, ulTotal) == ulInOrder);
+}
+
+
+static void
+deliver(test_slot_t* pxSlot)
+{
+	uint32_t f = pxSlot->ulFrame;
+
+	// See frame_assembly_is_ready()
+	pxSlot->xBlocks.ucDelivered = 1;
+
+	if(ulChecks)
+	{
+		TEST_CHECK(pxSlot->xBlocks.usBlocksTotal == usTotal[f]);
+		TEST_CHECK((pxSlot->xBlocks.usBlocksReceived * 100UL) >= (usTotal[f] * TEST_THRESHOLD));
+
+		for(uint32_t b = 0; b < usTotal[f]; b++)
+		{
+			TEST_CHECK(!ulFrameBlocksHas(&pxSlot->xBlocks, b) || (pxSlot->ulBlockFrame[b] == f));
+		}
+	}
+
+	vFrameBlocksFindSegments(&pxSlot->xBlocks, TEST_BLOCK_SIZE, TEST_DATA_OFFSET, &pxSlot->xSegments);
+
+	if(ulChecks)
+	{
+		check_segments(pxSlot);
+	}
+
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		test_slot_t* pxOther = &xSlots[i];
+
+		if(ulFrameBlocksIsOlder(&pxOther->xBlocks, pxSlot->xBlocks.ucFrameId))
+		{
+			TEST_CHECK(pxOther->ulFrame < f);
+			pxOther->xBlocks.ucDelivered = 1;
+			xStats.ulDropped += (pxOther->xBlocks.usBlocksReceived != 0);
+		}
+	}
+
+	TEST_CHECK((int32_t)f > lLastDelivered);
+	lLastDelivered = (int32_t)f;
+	vFrameSequenceDeliver(&xSequence, pxSlot->xBlocks.ucFrameId);
+	++xStats.ulDelivered;
+}
+
+
+// The same what wifi_espnow_parse_new_data() does
+static void
+receive(const test_event_t* pxEvent)
+{
+	uint8_t ucFrameId = (uint8_t)pxEvent->ulFrame;
+
+	++xStats.ulPackets;
+
+	if(pxEvent->ucType == EVENT_RESTART)
+	{
+		// See frame_assembly_restart()
+		xSlots[0].xBlocks.ucSynced = 0;
+		xSlots[1].xBlocks.ucSynced = 0;
+		vFrameSequenceRestart(&xSequence, ucFrameId);
+		ulRestartFrame = pxEvent->ulFrame;
+		lLastDelivered = (int32_t)pxEvent->ulFrame - 1;
+		return;
+	}
+
+	// See frame_assembly_check_frame()
+	test_slot_t* pxSlot = &xSlots[ucFrameId & 1];
+	uint8_t ucCheck = ucFrameBlocksCheck(&xSequence, &pxSlot->xBlocks, ucFrameId);
+
+	if(ucCheck == FRAME_BLOCKS_STALE)
+	{
+		TEST_CHECK(((int32_t)pxEvent->ulFrame <= lLastDelivered) || (pxEvent->ulFrame < pxSlot->ulFrame));
+		++xStats.ulStale;
+		return;
+	}
+
+	TEST_CHECK(((int32_t)pxEvent->ulFrame > lLastDelivered) && (pxEvent->ulFrame >= ulRestartFrame));
+
+	if(ucCheck == FRAME_BLOCKS_DROP)
+	{
+		++xStats.ulDropped;
+	}
+
+	if(ucCheck != FRAME_BLOCKS_CURRENT)
+	{
+		vFrameBlocksReset(&pxSlot->xBlocks, ucFrameId);
+		pxSlot->ulFrame = pxEvent->ulFrame;
+	}
+
+	// Blocks of another frame would be mixed with this one
+	TEST_CHECK(pxSlot->ulFrame == pxEvent->ulFrame);
+
+	uint8_t ucSeg = (pxEvent->ucType == EVENT_RESTORED) ? FRAME_BLOCK_SEGMENT_UNKNOWN
+	                                                    : ucSegment[pxEvent->ulFrame][pxEvent->usBlock];
+
+	uint8_t ucSize = pxEvent->ucFinal ? ucFinalSize[pxEvent->ulFrame] : TEST_BLOCK_SIZE;
+
+	// Final parity packet tells total amount of blocks even if final data block is lost
+	if((pxEvent->ucType == EVENT_RESTORED) && (pxEvent->usBlock == (usTotal[pxEvent->ulFrame] - 1U)))
+	{
+		pxSlot->xBlocks.usBlocksTotal = usTotal[pxEvent->ulFrame];
+	}
+
+	if(!ulFrameBlocksAdd(&pxSlot->xBlocks, pxEvent->usBlock, pxEvent->ucFinal, ucSeg, ucSize))
+	{
+		++xStats.ulDuplicates;
+		return;
+	}
+
+	pxSlot->ulBlockFrame[pxEvent->usBlock] = pxEvent->ulFrame;
+	pxSlot->ucRestored[pxEvent->usBlock] = (pxEvent->ucType == EVENT_RESTORED);
+
+	if(ulFrameBlocksIsComplete(&pxSlot->xBlocks, TEST_THRESHOLD))
+	{
+		deliver(pxSlot);
+	}
+	else if(pxEvent->ucFinal && ulChecks)
+	{
+		// NAK request, see frame_assembly_request_missing()
+		check_missing(pxSlot);
+	}
+}
+
+
+static void
+replay(void)
+{
+	memset(xSlots, 0, sizeof(xSlots));
+	memset(&xSequence, 0, sizeof(xSequence));
+	memset(&xStats, 0, sizeof(xStats));
+	lLastDelivered = -1;
+	ulRestartFrame = 0;
+
+	for(uint32_t i = 0; i < ulEvents; i++)
+	{
+		receive(&xEvents[i]);
+	}
+}
+
+
+static void
+test_channel(const test_channel_t* pxChannel)
+{
+	make_trace(pxChannel);
+	replay();
+
+	printf("%s: %u packets, delivered %u of %u frames, dropped %u, stale packets %u, duplicates %u, "
+	       "intact segments %.1f%%\n",
+	       pxChannel->pcName,
+	       (unsigned)xStats.ulPackets,
+	       (unsigned)xStats.ulDelivered,
+	       (unsigned)TEST_FRAMES_NUM,
+	       (unsigned)xStats.ulDropped,
+	       (unsigned)xStats.ulStale,
+	       (unsigned)xStats.ulDuplicates,
+	       100.0 * (double)xStats.ulIntact / (double)(xStats.ulSegments ? xStats.ulSegments : 1));
+
+	if(!pxChannel->ulLossPpm && !pxChannel->ulJitter && !pxChannel->ulDupPpm && !pxChannel->ulLatePpm)
+	{
+		TEST_CHECK(xStats.ulDelivered == TEST_FRAMES_NUM);
+		TEST_CHECK((xStats.ulDropped == 0) && (xStats.ulStale == 0));
+		TEST_CHECK(xStats.ulIntact == xStats.ulSegments);
+	}
+}
+
+
+// Whole packet path without checks, the last trace is replayed again
+static void
+bench(void)
+{
+	uint64_t ullStart = ullTestTimeNs();
+
+	ulChecks = 0;
+	for(uint32_t i = 0; i < TEST_BENCH_RUNS; i++)
+	{
+		replay();
+	}
+	ulChecks = 1;
+
+	printf("  %.1f ns per packet\n", (double)(ullTestTimeNs() - ullStart) / TEST_BENCH_RUNS / ulEvents);
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(void)
+{
+	make_frames();
+
+	for(uint32_t i = 0; i < (sizeof(xChannels) / sizeof(xChannels[0])); i++)
+	{
+		test_channel(&xChannels[i]);
+	}
+
+	bench();
+
+	return 0;
+}
@@ -0,0 +1,262 @@
+/**
+ * @file test_frame_mailbox.c
+ *
+ * Stress test of framebuffer handoff between Rx frame assembly and Jpg decoder.
+ * Producer thread works like WiFi task: it fills the framebuffer of assembly slot selected by frame id,
+ * publishes complete frames, leaves some of them incomplete and revokes ready ones on reset and restart.
+ * Decoder thread takes frames like @ref ''pucWirelessTakeCurrentRxBuffer'' and reads them
+ * outside of the lock. Mutex stands for portMUX, both of them give mutual exclusion between cores.
+ *
+ * Checks:
+ * - decoder never reads a framebuffer what is written at the same time (frame content is not torn)
+ * - decoder always takes the newest complete frame, frame ids only grow
+ * - every published frame is either taken or counted as skipped
+ */
+
+#include "frame_mailbox.h"
+#include "test_common.h"
+//
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_SLOTS_NUM   (2)
+#define TEST_BUFFERS_NUM (TEST_SLOTS_NUM + 1)
+#define TEST_BUF_SIZE    (1024)
+#define TEST_FRAMES_NUM  (200000)
+
+typedef struct
+{
+	uint8_t ucBuf;
+	uint32_t ulFrameId;
+} test_slot_t;
+
+// ----------------------------------------------------------------------
+// Variables
+
+static uint8_t ucTestBuf[TEST_BUFFERS_NUM][TEST_BUF_SIZE];
+static frame_mailbox_t xMailbox;
+static pthread_mutex_t xLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Everything below is guarded by xLock
+static test_slot_t xSlots[TEST_SLOTS_NUM] = {{.ucBuf = 0}, {.ucBuf = 1}};
+static test_slot_t* pxReady = NULL;
+static uint8_t ucDecodeBuf = TEST_SLOTS_NUM;
+static uint32_t ulLastPublished = 0;
+static uint32_t ulProducerDone = 0;
+
+static uint32_t ulDecodedFrames = 0;
+static uint32_t ulIncompleteFrames = 0;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint8_t
+frame_byte(uint32_t ulFrameId, uint32_t ulOffset)
+{
+	return (uint8_t)((ulFrameId * 31) ^ ulOffset ^ (ulFrameId >> 8));
+}
+
+
+static uint32_t
+rand_next(uint32_t* pulSeed)
+{
+	*pulSeed = *pulSeed * 1664525UL + 1013904223UL;
+	return *pulSeed >> 16;
+}
+
+
+// Called under the lock
+static void
+check_states(void)
+{
+	uint32_t ulDecoding = 0;
+	uint32_t ulReady = 0;
+
+	for(uint32_t i = 0; i < TEST_BUFFERS_NUM; i++)
+	{
+		ulDecoding += (xMailbox.ucState[i] == FRAME_BUF_DECODING);
+		ulReady += (xMailbox.ucState[i] == FRAME_BUF_READY);
+	}
+
+	TEST_CHECK(ulDecoding == 1);
+	TEST_CHECK(xMailbox.ucDecoding == ucDecodeBuf);
+	TEST_CHECK(ulReady == (pxReady ? 1 : 0));
+	TEST_CHECK(!pxReady || (xMailbox.ucReady == pxReady->ucBuf));
+	// Both assembly slots and decoder always own different framebuffers
+	TEST_CHECK(xSlots[0].ucBuf != xSlots[1].ucBuf);
+	TEST_CHECK((xSlots[0].ucBuf != ucDecodeBuf) && (xSlots[1].ucBuf != ucDecodeBuf));
+}
+
+
+static void*
+producer_task(void* pvArg)
+{
+	uint32_t ulSeed = 12345;
+
+	(void)pvArg;
+
+	for(uint32_t ulFrameId = 1; ulFrameId <= TEST_FRAMES_NUM; ulFrameId++)
+	{
+		test_slot_t* pxSlot = &xSlots[ulFrameId % TEST_SLOTS_NUM];
+		uint32_t ulRand = rand_next(&ulSeed);
+
+		// Reset of the slot for the next frame, see frame_assembly_reset()
+		pthread_mutex_lock(&xLock);
+		if(pxReady == pxSlot)
+		{
+			TEST_CHECK(ucFrameMailboxRevoke(&xMailbox, pxSlot->ucBuf) == pxSlot->ucBuf);
+			pxReady = NULL;
+		}
+		pxSlot->ulFrameId = ulFrameId;
+		uint8_t ucBuf = pxSlot->ucBuf;
+		TEST_CHECK(xMailbox.ucState[ucBuf] == FRAME_BUF_FILLING);
+		check_states();
+		pthread_mutex_unlock(&xLock);
+
+		// Packets are copied into the framebuffer without the lock
+		for(uint32_t i = 0; i < TEST_BUF_SIZE; i++)
+		{
+			ucTestBuf[ucBuf][i] = frame_byte(ulFrameId, i);
+
+			if((i == (TEST_BUF_SIZE / 2)) && ((ulRand & 3) == 0))
+			{
+				sched_yield();
+			}
+		}
+
+		// Some frames are never completed
+		if((ulRand % 11) == 0)
+		{
+			++ulIncompleteFrames;
+			continue;
+		}
+
+		pthread_mutex_lock(&xLock);
+		TEST_CHECK(pxSlot->ucBuf == ucBuf);
+		uint8_t ucSkipped = ucFrameMailboxPublish(&xMailbox, ucBuf);
+		TEST_CHECK((ucSkipped == FRAME_MAILBOX_NONE) == (pxReady == NULL));
+		TEST_CHECK(!pxReady || (ucSkipped == pxReady->ucBuf));
+		pxReady = pxSlot;
+		ulLastPublished = ulFrameId;
+		check_states();
+
+		// New Jpg header, nothing what is already received could be decoded, see frame_assembly_restart()
+		if((ulRand % 97) == 0)
+		{
+			TEST_CHECK(ucFrameMailboxRevoke(&xMailbox, FRAME_MAILBOX_NONE) == ucBuf);
+			pxReady = NULL;
+			check_states();
+		}
+		pthread_mutex_unlock(&xLock);
+
+		if((ulRand & 7) == 0)
+		{
+			sched_yield();
+		}
+	}
+
+	pthread_mutex_lock(&xLock);
+	ulProducerDone = 1;
+	pthread_mutex_unlock(&xLock);
+
+	return NULL;
+}
+
+
+static void*
+decoder_task(void* pvArg)
+{
+	uint32_t ulLastDecoded = 0;
+
+	(void)pvArg;
+
+	for(;;)
+	{
+		uint32_t ulFrameId = 0;
+		uint8_t ucBuf = FRAME_MAILBOX_NONE;
+
+		// See pucWirelessTakeCurrentRxBuffer()
+		pthread_mutex_lock(&xLock);
+		if(pxReady)
+		{
+			uint8_t ucReleased = FRAME_MAILBOX_NONE;
+
+			TEST_CHECK(pxReady->ulFrameId == ulLastPublished);
+			ucBuf = ucFrameMailboxTake(&xMailbox, &ucReleased);
+			TEST_CHECK(ucBuf == pxReady->ucBuf);
+			TEST_CHECK(ucReleased == ucDecodeBuf);
+			pxReady->ucBuf = ucReleased;
+			ucDecodeBuf = ucBuf;
+			ulFrameId = pxReady->ulFrameId;
+			pxReady = NULL;
+			check_states();
+		}
+		else if(ulProducerDone)
+		{
+			pthread_mutex_unlock(&xLock);
+			break;
+		}
+		pthread_mutex_unlock(&xLock);
+
+		if(ucBuf == FRAME_MAILBOX_NONE)
+		{
+			sched_yield();
+			continue;
+		}
+
+		TEST_CHECK(ulFrameId > ulLastDecoded);
+		ulLastDecoded = ulFrameId;
+
+		// Frame is read twice with a chance for producer to run in between, it must not change
+		for(uint32_t ulPass = 0; ulPass < 2; ulPass++)
+		{
+			for(uint32_t i = 0; i < TEST_BUF_SIZE; i++)
+			{
+				TEST_CHECK(ucTestBuf[ucBuf][i] == frame_byte(ulFrameId, i));
+			}
+			sched_yield();
+		}
+
+		++ulDecodedFrames;
+	}
+
+	return NULL;
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(void)
+{
+	pthread_t xProducer;
+	pthread_t xDecoder;
+
+	vFrameMailboxInit(&xMailbox, TEST_BUFFERS_NUM, ucDecodeBuf);
+
+	TEST_CHECK(pthread_create(&xDecoder, NULL, decoder_task, NULL) == 0);
+	TEST_CHECK(pthread_create(&xProducer, NULL, producer_task, NULL) == 0);
+	TEST_CHECK(pthread_join(xProducer, NULL) == 0);
+	TEST_CHECK(pthread_join(xDecoder, NULL) == 0);
+
+	TEST_CHECK(xMailbox.ucReady == FRAME_MAILBOX_NONE);
+	TEST_CHECK(xMailbox.ulTaken == ulDecodedFrames);
+	TEST_CHECK(xMailbox.ulPublished == (xMailbox.ulTaken + xMailbox.ulSkipped));
+	TEST_CHECK(xMailbox.ulPublished == (TEST_FRAMES_NUM - ulIncompleteFrames));
+	// Otherwise the test didn't run both threads at the same time
+	TEST_CHECK(xMailbox.ulSkipped && xMailbox.ulTaken);
+
+	printf("frames %u, incomplete %u, published %u, decoded %u, skipped %u\n",
+	       (unsigned)TEST_FRAMES_NUM,
+	       (unsigned)ulIncompleteFrames,
+	       (unsigned)xMailbox.ulPublished,
+	       (unsigned)xMailbox.ulTaken,
+	       (unsigned)xMailbox.ulSkipped);
+
+	return 0;
+}
@@ -0,0 +1,413 @@
+/**
+ * @file test_jpeg_restart.c
+ *
+ * Insertion of restart markers against the Jpg decoder.
+ * Every test frame is transcoded with several restart intervals and input chunk sizes,
+ * like camera passes it to @ref ''ulJpegRestartPush''. Transcoded image must be decoded to exactly
+ * the same pixels as the original one, as a whole and slice by slice on two decoders like Receiver does.
+ *
+ * Checks:
+ * - output doesn't depend on the size of input chunks
+ * - every block except the final one is full, segments start at block boundaries in order
+ * - lost slices spoil only own pixels, slices before cut image are still decoded
+ * - luma only output is a grayscale image with the same luma, 4:2:0 image stays in colour
+ * - broken entropy coded data always ends with a single final block
+ *
+ * Usage: test_jpeg_restart <file.jpg>...
+ */
+
+#include "jpeg_restart.h"
+#include "test_tjpgd_common.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Size of image block in ESP-NOW packet, see PACKET_IMAGE_DATA_MAX_SIZE
+#define TEST_BLOCK_SIZE (245)
+
+#define TEST_OUT_MAX_SIZE  (256 * 1024)
+#define TEST_BLOCKS_MAX    (TEST_OUT_MAX_SIZE / TEST_BLOCK_SIZE)
+#define TEST_NO_CUT        (0xFFFFFFFF)
+#define TEST_BENCH_RUNS    (200)
+
+// ----------------------------------------------------------------------
+// Static functions declaration
+
+static uint8_t* get_block(void);
+static uint8_t send_block(uint8_t* pucBlock, size_t xSize, uint8_t ucSegmentId, uint8_t ucSegmentEnd, uint8_t ucFinal);
+
+// ----------------------------------------------------------------------
+// Variables
+
+static jpeg_restart_config_t xConfig = {
+    .pucGetBlock = get_block,
+    .ucSendBlock = send_block,
+    .usBlockSize = TEST_BLOCK_SIZE,
+    .ucRowsPerSegment = 1,
+};
+
+static jpeg_restart_t xRestart;
+
+// Transcoded image, header first and then blocks one after another
+static uint8_t ucOut[TEST_OUT_MAX_SIZE];
+static uint8_t ucPrevOut[TEST_OUT_MAX_SIZE];
+static size_t xOutSize;
+static size_t xHeaderSize;
+
+static uint8_t ucBlockSegment[TEST_BLOCKS_MAX];
+static uint8_t ucBlockEnd[TEST_BLOCKS_MAX];
+static uint32_t ulBlocks;
+static uint32_t ulCutAt;
+static uint32_t ulFinals;
+
+static uint32_t ulSliceOffsets[JPEG_RESTART_SEGMENTS_MAX];
+
+static tjpgd_image_t xReference;
+static tjpgd_image_t xDecoded;
+static tjpgd_image_t xSliced;
+static tjpgd_image_t xSlicedInv;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint8_t*
+get_block(void)
+{
+	TEST_CHECK((xOutSize + TEST_BLOCK_SIZE) <= TEST_OUT_MAX_SIZE);
+	TEST_CHECK(ulBlocks < TEST_BLOCKS_MAX);
+	return &ucOut[xOutSize];
+}
+
+
+static uint8_t
+send_block(uint8_t* pucBlock, size_t xSize, uint8_t ucSegmentId, uint8_t ucSegmentEnd, uint8_t ucFinal)
+{
+	TEST_CHECK(pucBlock == &ucOut[xOutSize]);
+	TEST_CHECK(!ulFinals);
+	TEST_CHECK(ucFinal || (xSize == TEST_BLOCK_SIZE));
+	TEST_CHECK((xSize > 0) && (xSize <= TEST_BLOCK_SIZE));
+	TEST_CHECK(ucSegmentId < JPEG_RESTART_SEGMENTS_MAX);
+	TEST_CHECK((ulCutAt == TEST_NO_CUT) || (ulBlocks <= ulCutAt));
+
+	// The next segment starts right after the end of the previous one
+	if(ulBlocks)
+	{
+		uint8_t ucPrev = ucBlockSegment[ulBlocks - 1];
+		TEST_CHECK((ucSegmentId == ucPrev) || ((ucSegmentId == (ucPrev + 1)) && ucBlockEnd[ulBlocks - 1]));
+	}
+	else
+	{
+		TEST_CHECK(ucSegmentId == 0);
+	}
+
+	ucBlockSegment[ulBlocks] = ucSegmentId;
+	ucBlockEnd[ulBlocks] = ucSegmentEnd;
+	xOutSize += xSize;
+	ulFinals += (ucFinal != 0);
+
+	return (ulBlocks++ != ulCutAt);
+}
+
+
+// Header of baseline Jpg ends with SOS segment
+static size_t
+header_size(const uint8_t* pucJpg, size_t xSize)
+{
+	for(size_t i = 2; (i + 3) < xSize;)
+	{
+		TEST_CHECK(pucJpg[i] == 0xFF);
+		size_t xLen = ((size_t)pucJpg[i + 2] << 8) | pucJpg[i + 3];
+
+		if(pucJpg[i + 1] == 0xDA)
+		{
+			return i + 2 + xLen;
+		}
+
+		i += 2 + xLen;
+	}
+
+	TEST_CHECK(0);
+	return 0;
+}
+
+
+// Returns 0 if header is not supported
+static uint32_t
+transcode(const uint8_t* pucJpg,
+          size_t xSize,
+          uint8_t ucRows,
+          uint8_t ucLumaOnly,
+          size_t xChunk,
+          uint32_t ulCut)
+{
+	size_t xHeader = header_size(pucJpg, xSize);
+
+	xConfig.ucRowsPerSegment = ucRows;
+	xHeaderSize = xJpegRestartParseHeader(&xRestart, &xConfig, pucJpg, xHeader, ucOut, ucLumaOnly);
+	if(!xHeaderSize)
+	{
+		return 0;
+	}
+
+	// Luma only header drops chroma tables and components
+	TEST_CHECK(xRestart.ucLumaOnly ? (xHeaderSize < xHeader) : (xHeaderSize == (xHeader + JPEG_RESTART_DRI_SIZE)));
+	TEST_CHECK(xRestart.ucValid);
+
+	xOutSize = xHeaderSize;
+	ulBlocks = 0;
+	ulFinals = 0;
+	ulCutAt = ulCut;
+	vJpegRestartStartFrame(&xRestart);
+
+	for(size_t i = xHeader; i < xSize; i += xChunk)
+	{
+		size_t xLen = ((xSize - i) < xChunk) ? (xSize - i) : xChunk;
+
+		// Either the final block is sent or the image is cut
+		if(ulJpegRestartPush(&xRestart, &pucJpg[i], xLen))
+		{
+			TEST_CHECK((ulFinals == 1) || (ulBlocks == (ulCut + 1)));
+			break;
+		}
+	}
+
+	TEST_CHECK(ulJpegRestartFinish(&xRestart) == (xOutSize - xHeaderSize));
+	TEST_CHECK((ulCut != TEST_NO_CUT) || (ulFinals == 1));
+
+	// Offset of each slice is the first block of it's segment
+	memset(ulSliceOffsets, 0, sizeof(ulSliceOffsets));
+	for(uint32_t i = ulBlocks; i > 0; i--)
+	{
+		ulSliceOffsets[ucBlockSegment[i - 1]] = (uint32_t)(xHeaderSize + (i - 1) * TEST_BLOCK_SIZE);
+	}
+
+	return ucBlockSegment[ulBlocks - 1] + 1;
+}
+
+
+static void
+fill_image(tjpgd_image_t* pxImage, uint16_t usPixel)
+{
+	for(uint32_t i = 0; i < (sizeof(pxImage->usPixels) / sizeof(pxImage->usPixels[0])); i++)
+	{
+		pxImage->usPixels[i] = usPixel;
+	}
+}
+
+
+/**
+ * Decode slices twice over images filled with different values, any value could be a decoded pixel.
+ * Every pixel is either not decoded or it's the same as reference, returns amount of decoded ones
+ */
+static uint32_t
+decode_slices(uint32_t ulSlices)
+{
+	uint32_t ulPixels = (uint32_t)xReference.usWidth * xReference.usHeight;
+	uint32_t ulDecoded = 0;
+
+	fill_image(&xSliced, 0x0000);
+	fill_image(&xSlicedInv, 0xFFFF);
+	TEST_CHECK(lTjpgdDecodeSlices_ref(ucOut, xOutSize, 0, ulSliceOffsets, ulSlices, &xSliced) == 0);
+	TEST_CHECK(lTjpgdDecodeSlices_ref(ucOut, xOutSize, 0, ulSliceOffsets, ulSlices, &xSlicedInv) == 0);
+	TEST_CHECK((xSliced.usWidth == xReference.usWidth) && (xSliced.usHeight == xReference.usHeight));
+
+	for(uint32_t i = 0; i < ulPixels; i++)
+	{
+		if(xSliced.usPixels[i] == xSlicedInv.usPixels[i])
+		{
+			TEST_CHECK(xSliced.usPixels[i] == xReference.usPixels[i]);
+			++ulDecoded;
+		}
+		else
+		{
+			TEST_CHECK((xSliced.usPixels[i] == 0x0000) && (xSlicedInv.usPixels[i] == 0xFFFF));
+		}
+	}
+
+	return ulDecoded;
+}
+
+
+static void
+test_color(const char* pcPath, const uint8_t* pucJpg, size_t xSize)
+{
+	static const uint8_t ucRows[] = {1, 2, 3};
+	static const size_t xChunks[] = {1, 97, 4096};
+	uint32_t ulPixels;
+
+	TEST_CHECK(lTjpgdDecode_ref(pucJpg, xSize, 0, &xReference) == 0);
+	ulPixels = (uint32_t)xReference.usWidth * xReference.usHeight;
+
+	for(uint32_t r = 0; r < sizeof(ucRows); r++)
+	{
+		size_t xPrevSize = 0;
+		uint32_t ulSlices = 0;
+
+		for(uint32_t c = 0; c < (sizeof(xChunks) / sizeof(xChunks[0])); c++)
+		{
+			ulSlices = transcode(pucJpg, xSize, ucRows[r], 0, xChunks[c], TEST_NO_CUT);
+			TEST_CHECK(ulSlices);
+
+			TEST_CHECK(!c || ((xOutSize == xPrevSize) && (memcmp(ucOut, ucPrevOut, xOutSize) == 0)));
+			memcpy(ucPrevOut, ucOut, xOutSize);
+			xPrevSize = xOutSize;
+		}
+
+		// The last block of each segment is filled up
+		TEST_CHECK(ucBlockEnd[ulBlocks - 1]);
+
+		// Whole image at once
+		TEST_CHECK(lTjpgdDecode_ref(ucOut, xOutSize, 0, &xDecoded) == 0);
+		TEST_CHECK(memcmp(xDecoded.usPixels, xReference.usPixels, ulPixels * sizeof(uint16_t)) == 0);
+
+		// Slice by slice
+		TEST_CHECK(decode_slices(ulSlices) == ulPixels);
+		TEST_CHECK(xSliced.ulMcus == xReference.ulMcus);
+
+		// Every odd slice is lost
+		for(uint32_t i = 1; i < ulSlices; i += 2)
+		{
+			ulSliceOffsets[i] = 0;
+		}
+		uint32_t ulDecoded = decode_slices(ulSlices);
+		TEST_CHECK((ulSlices < 2) || ((ulDecoded > 0) && (ulDecoded < ulPixels)));
+
+		printf("%s: %u rows per slice, %u slices, %u bytes of %u blocks, %u bytes in original\n",
+		       pcPath,
+		       (unsigned)ucRows[r],
+		       (unsigned)ulSlices,
+		       (unsigned)(xOutSize - xHeaderSize),
+		       (unsigned)ulBlocks,
+		       (unsigned)(xSize - header_size(pucJpg, xSize)));
+
+		// Image is cut in the middle, slices what were sent completely are still good
+		uint32_t ulCut = ulBlocks / 2;
+		transcode(pucJpg, xSize, ucRows[r], 0, 97, ulCut);
+		TEST_CHECK(ulBlocks == (ulCut + 1));
+
+		uint32_t ulComplete = ucBlockSegment[ulCut];
+		TEST_CHECK(!ulComplete || ((decode_slices(ulComplete) > 0) && (decode_slices(ulComplete) < ulPixels)));
+	}
+}
+
+
+// Luma only image is grayscale with the same Y as color one
+static void
+test_luma(const char* pcPath, const uint8_t* pucJpg, size_t xSize)
+{
+	uint32_t ulSlices = transcode(pucJpg, xSize, 2, 1, 97, TEST_NO_CUT);
+	uint64_t ullError = 0;
+
+	TEST_CHECK(ulSlices);
+	TEST_CHECK(lTjpgdDecode_ref(pucJpg, xSize, 0, &xReference) == 0);
+
+	uint32_t ulPixels = (uint32_t)xReference.usWidth * xReference.usHeight;
+
+	// MCU of 4:2:0 image has two rows of Y blocks, colour image is sent then
+	if(xReference.ulMcus != (uint32_t)(((xReference.usWidth + 15) / 16) * ((xReference.usHeight + 7) / 8)))
+	{
+		TEST_CHECK(!xRestart.ucLumaOnly);
+		TEST_CHECK(lTjpgdDecode_ref(ucOut, xOutSize, 0, &xDecoded) == 0);
+		TEST_CHECK(memcmp(xDecoded.usPixels, xReference.usPixels, ulPixels * sizeof(uint16_t)) == 0);
+		printf("%s: luma only is not possible, colour image is sent\n", pcPath);
+		return;
+	}
+
+	TEST_CHECK(xRestart.ucLumaOnly);
+	TEST_CHECK(lTjpgdDecode_ref(ucOut, xOutSize, 0, &xDecoded) == 0);
+	TEST_CHECK((xDecoded.usWidth == xReference.usWidth) && (xDecoded.usHeight == xReference.usHeight));
+
+	for(uint32_t i = 0; i < ulPixels; i++)
+	{
+		uint16_t usGray = xDecoded.usPixels[i];
+		uint16_t usColor = xReference.usPixels[i];
+
+		TEST_CHECK((PIX_R(usGray) == PIX_B(usGray)) && ((PIX_G(usGray) >> 1) == PIX_R(usGray)));
+
+		// Y of color pixel in 5-bit units, with 1/64 fraction
+		uint32_t ulY = (PIX_R(usColor) * 2 * 299 + PIX_G(usColor) * 587 + PIX_B(usColor) * 2 * 114) * 32 / 1000;
+		ullError += ulTestChannelDiff(ulY, PIX_R(usGray) * 64 + 32);
+	}
+
+	memcpy(&xReference, &xDecoded, sizeof(tjpgd_image_t));
+	TEST_CHECK(decode_slices(ulSlices) == ulPixels);
+
+	printf("%s: luma only %u bytes, mean luma error %.2f of 31\n",
+	       pcPath,
+	       (unsigned)(xOutSize - xHeaderSize),
+	       (double)ullError / 64.0 / ulPixels);
+
+	// Chroma clipping of saturated colors makes most of the error
+	TEST_CHECK(ullError <= (uint64_t)ulPixels * 64);
+}
+
+
+// Random entropy coded data after a valid header
+static void
+test_broken(const uint8_t* pucJpg, size_t xSize)
+{
+	static uint8_t ucBroken[64 * 1024];
+	size_t xHeader = header_size(pucJpg, xSize);
+	uint32_t ulSeed = 1;
+
+	TEST_CHECK(xSize <= sizeof(ucBroken));
+	memcpy(ucBroken, pucJpg, xSize);
+
+	for(uint32_t n = 0; n < 200; n++)
+	{
+		for(size_t i = xHeader; i < xSize; i++)
+		{
+			ulSeed = ulSeed * 1664525UL + 1013904223UL;
+			// Partly valid data, the rest is random
+			ucBroken[i] = (i < (xHeader + n * 16)) ? pucJpg[i] : (uint8_t)(ulSeed >> 24);
+		}
+
+		transcode(ucBroken, xSize, 2, 0, 97, TEST_NO_CUT);
+		TEST_CHECK(ulFinals == 1);
+	}
+}
+
+
+static void
+bench(const uint8_t* pucJpg, size_t xSize)
+{
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t i = 0; i < TEST_BENCH_RUNS; i++)
+	{
+		transcode(pucJpg, xSize, 2, 0, TEST_BLOCK_SIZE, TEST_NO_CUT);
+	}
+
+	double dUs = (double)(ullTestTimeNs() - ullStart) / TEST_BENCH_RUNS / 1000.0;
+
+	printf("  transcoding: %.1f us per frame, %.1f MB/s\n", dUs, (double)xSize / dUs);
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(int argc, char** argv)
+{
+	TEST_CHECK(argc > 1);
+
+	for(int i = 1; i < argc; i++)
+	{
+		size_t xSize = 0;
+		uint8_t* pucJpg = pucTestReadFile(argv[i], &xSize);
+
+		test_color(argv[i], pucJpg, xSize);
+		test_luma(argv[i], pucJpg, xSize);
+		test_broken(pucJpg, xSize);
+		bench(pucJpg, xSize);
+
+		free(pucJpg);
+	}
+
+	return 0;
+}
@@ -0,0 +1,379 @@
+/**
+ * @file test_rate_control.c
+ *
+ * Closed loop of JPEG quality and frame size controller against synthetic link traces.
+ * Link model gives capacity of the radio in bytes per second of airtime. Everything what camera
+ * makes above it is lost, so Receiver reports dropped frames and radio busy all the time.
+ * Capacity of each trace segment is jittered, to see the dead zone keeping settings still.
+ *
+ * Checks:
+ * - controller is a pure function of its arguments, the same trace gives the same decisions
+ * - quality and frame size never leave configured limits
+ * - link is not overloaded at the end of every trace segment and it's not left mostly unused
+ * - settings don't flap on a steady link, failed upgrades back off up to @ref ''RATE_CONTROL_UPGRADE_WAIT_MAX''
+ * - reports right after a change are ignored, empty reports change nothing
+ */
+
+#include "rate_control.h"
+#include "test_common.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Same as camera.c with default Kconfig
+#define TEST_QUALITY_BEST  (12)
+#define TEST_QUALITY_WORST (40)
+#define TEST_CAMERA_FPS    (25)
+
+#define TEST_PERIOD_MS      (1000)
+#define TEST_SETTLE_PERIODS (30)
+#define TEST_TRACE_MAX_LEN  (1024)
+#define TEST_BENCH_UPDATES  (10000000)
+
+typedef struct
+{
+	uint32_t ulCapacity;     // Bytes per second of airtime
+	uint32_t ulDecodeTimeMs; // Time of Receiver to decode one frame
+	uint32_t ulPeriods;      // Length of the segment
+	uint32_t ulJitterPercent;
+} test_segment_t;
+
+typedef struct
+{
+	uint8_t ucQuality;
+	uint8_t ucFrameSize;
+	uint8_t ucAction;
+	uint32_t ulFrameBytes;
+	uint32_t ulDropped;
+} test_step_t;
+
+// ----------------------------------------------------------------------
+// Variables
+
+static const rate_control_config_t xConfig = {
+    .ucQualityBest = TEST_QUALITY_BEST,
+    .ucQualityWorst = TEST_QUALITY_WORST,
+    .ucQualityStep = 4,
+    .ucFrameSizeMax = 2,
+    .ucTargetFps = TEST_CAMERA_FPS,
+    .ucLinkLoadPercent = 80,
+    .ucLossHighPercent = 10,
+    .ucLossLowPercent = 2,
+    .ucHysteresisPercent = 15,
+    .ucUpgradeWaitMin = 3,
+    .ucHoldPeriods = 1,
+};
+
+// QQVGA, HQVGA and 240X240, see xFrameSizeLadder of camera.c
+static const uint32_t ulFramePixels[] = {160 * 120, 240 * 176, 240 * 240};
+
+static const test_segment_t xTrace[] = {
+    {200000, 20, 120, 5}, // Good link
+    {40000, 20, 120, 5},  // Drop of capacity
+    {120000, 20, 150, 10},
+    {32000, 20, 60, 5},   // Link what barely carries the smallest frames
+    {400000, 20, 200, 5}, // Plenty of capacity, everything must go to the maximum
+    {150000, 60, 120, 5}, // Slow Receiver
+};
+
+static test_step_t xSteps[TEST_TRACE_MAX_LEN];
+static uint32_t ulSeed;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+// Size of compressed frame is roughly proportional to the area and inverse to the quality value
+static uint32_t
+frame_bytes(const rate_control_state_t* pxState)
+{
+	return (ulFramePixels[pxState->ucFrameSize] * 12) / (pxState->ucQuality * 5);
+}
+
+
+// One report period of the link: camera sends frames, what doesn't fit into capacity is lost
+static void
+link_period(const rate_control_state_t* pxState,
+            uint32_t ulCapacity,
+            uint32_t ulDecodeTimeMs,
+            rate_control_input_t* pxInput)
+{
+	uint32_t ulFrameBytes = frame_bytes(pxState);
+	uint32_t ulFps = TEST_CAMERA_FPS;
+
+	// Receiver doesn't ask for frames what it can't show
+	if((1000 / ulDecodeTimeMs) < ulFps)
+	{
+		ulFps = 1000 / ulDecodeTimeMs;
+	}
+
+	uint64_t ullOffered = (uint64_t)ulFrameBytes * ulFps;
+
+	memset(pxInput, 0, sizeof(rate_control_input_t));
+	pxInput->ulPeriodMs = TEST_PERIOD_MS;
+	pxInput->ulDecodeTimeMs = ulDecodeTimeMs;
+	pxInput->ulFrameBytes = ulFrameBytes;
+
+	if(ullOffered <= ulCapacity)
+	{
+		pxInput->ulRxBytes = (uint32_t)ullOffered;
+		pxInput->ulFramesDecoded = ulFps;
+		pxInput->ulAirtimeUs = (uint32_t)((ullOffered * 1000000ULL) / ulCapacity);
+		return;
+	}
+
+	pxInput->ulRxBytes = ulCapacity;
+	pxInput->ulFramesDecoded = ulCapacity / ulFrameBytes;
+	pxInput->ulFramesDropped = ulFps - pxInput->ulFramesDecoded;
+	pxInput->ulAirtimeUs = TEST_PERIOD_MS * 1000;
+}
+
+
+static void
+check_limits(const rate_control_state_t* pxState)
+{
+	TEST_CHECK((pxState->ucQuality >= xConfig.ucQualityBest) && (pxState->ucQuality <= xConfig.ucQualityWorst));
+	TEST_CHECK(pxState->ucFrameSize <= xConfig.ucFrameSizeMax);
+	TEST_CHECK(pxState->ucUpgradeWait >= xConfig.ucUpgradeWaitMin);
+	TEST_CHECK(pxState->ucUpgradeWait <= RATE_CONTROL_UPGRADE_WAIT_MAX);
+}
+
+
+// Whole trace, every step is recorded
+static uint32_t
+run_trace(uint32_t ulTraceSeed)
+{
+	rate_control_state_t xState;
+	uint32_t ulStep = 0;
+
+	ulSeed = ulTraceSeed;
+	vRateControlInit(&xConfig, &xState, TEST_QUALITY_BEST, xConfig.ucFrameSizeMax);
+
+	for(uint32_t s = 0; s < (sizeof(xTrace) / sizeof(xTrace[0])); s++)
+	{
+		const test_segment_t* pxSegment = &xTrace[s];
+
+		for(uint32_t p = 0; p < pxSegment->ulPeriods; p++)
+		{
+			rate_control_input_t xInput;
+			uint32_t ulJitter = (pxSegment->ulCapacity * pxSegment->ulJitterPercent) / 100;
+			uint32_t ulCapacity = pxSegment->ulCapacity - ulJitter + (ulTestRandNext(&ulSeed) % (2 * ulJitter + 1));
+
+			TEST_CHECK(ulStep < TEST_TRACE_MAX_LEN);
+			link_period(&xState, ulCapacity, pxSegment->ulDecodeTimeMs, &xInput);
+
+			uint8_t ucHold = xState.ucHoldPeriods;
+			rate_control_action_t xAction = xRateControlUpdate(&xConfig, &xState, &xInput);
+
+			check_limits(&xState);
+			// Link is still settling after the previous change
+			TEST_CHECK(!ucHold || (xAction == RATE_CONTROL_KEEP));
+
+			xSteps[ulStep].ucQuality = xState.ucQuality;
+			xSteps[ulStep].ucFrameSize = xState.ucFrameSize;
+			xSteps[ulStep].ucAction = (uint8_t)xAction;
+			xSteps[ulStep].ulFrameBytes = xInput.ulFrameBytes;
+			xSteps[ulStep].ulDropped = xInput.ulFramesDropped;
+			++ulStep;
+		}
+	}
+
+	return ulStep;
+}
+
+
+static void
+test_trace(void)
+{
+	static test_step_t xFirst[TEST_TRACE_MAX_LEN];
+	uint32_t ulSteps = run_trace(1);
+	uint32_t ulStart = 0;
+
+	// Nothing but arguments affects decisions
+	memcpy(xFirst, xSteps, sizeof(xSteps));
+	TEST_CHECK(run_trace(1) == ulSteps);
+	TEST_CHECK(memcmp(xFirst, xSteps, ulSteps * sizeof(test_step_t)) == 0);
+
+	for(uint32_t s = 0; s < (sizeof(xTrace) / sizeof(xTrace[0])); s++)
+	{
+		const test_segment_t* pxSegment = &xTrace[s];
+		uint32_t ulEnd = ulStart + pxSegment->ulPeriods;
+		uint32_t ulFps = (1000 / pxSegment->ulDecodeTimeMs < TEST_CAMERA_FPS) ? (1000 / pxSegment->ulDecodeTimeMs) :
+		                                                                         TEST_CAMERA_FPS;
+		uint32_t ulChanges = 0;
+		uint32_t ulDropped = 0;
+		uint64_t ullOffered = 0;
+
+		for(uint32_t i = ulEnd - TEST_SETTLE_PERIODS; i < ulEnd; i++)
+		{
+			ulChanges += (xSteps[i].ucAction != RATE_CONTROL_KEEP);
+			ulDropped += xSteps[i].ulDropped;
+			ullOffered += (uint64_t)xSteps[i].ulFrameBytes * ulFps;
+		}
+
+		const test_step_t* pxLast = &xSteps[ulEnd - 1];
+		uint32_t ulLoad = (uint32_t)((ullOffered * 100) / ((uint64_t)pxSegment->ulCapacity * TEST_SETTLE_PERIODS));
+
+		printf("segment %u: capacity %6u B/s, fps %2u -> quality %2u, frame size %u, link load %3u%%, "
+		       "dropped %u, changes %u\n",
+		       (unsigned)s,
+		       (unsigned)pxSegment->ulCapacity,
+		       (unsigned)ulFps,
+		       (unsigned)pxLast->ucQuality,
+		       (unsigned)pxLast->ucFrameSize,
+		       (unsigned)ulLoad,
+		       (unsigned)ulDropped,
+		       (unsigned)ulChanges);
+
+		// Only rare probes of bigger frames on a steady link, each of them costs at most one period of loss
+		TEST_CHECK(ulChanges <= 2);
+		TEST_CHECK(ulDropped <= ulFps);
+		TEST_CHECK(ulLoad <= 100);
+
+		uint32_t ulAtMin = (pxLast->ucFrameSize == 0) && (pxLast->ucQuality == TEST_QUALITY_WORST);
+		uint32_t ulAtMax = (pxLast->ucFrameSize == xConfig.ucFrameSizeMax) && (pxLast->ucQuality == TEST_QUALITY_BEST);
+
+		// Link is used, unless it's out of reach of settings
+		TEST_CHECK(ulAtMin || ulAtMax || (ulLoad >= 40));
+		TEST_CHECK((pxSegment->ulCapacity != 32000) || ulAtMin);
+		TEST_CHECK((pxSegment->ulCapacity != 400000) || ulAtMax);
+
+		ulStart = ulEnd;
+	}
+}
+
+
+// Loss right after every upgrade doubles the wait before the next one
+static void
+test_backoff(void)
+{
+	rate_control_state_t xState;
+	rate_control_input_t xGood = {
+	    .ulPeriodMs = TEST_PERIOD_MS,
+	    .ulRxBytes = 10000,
+	    .ulFramesDecoded = 25,
+	    .ulFrameBytes = 400,
+	    .ulAirtimeUs = 500000,
+	};
+	rate_control_input_t xLossy = xGood;
+	uint32_t ulExpectedWait = xConfig.ucUpgradeWaitMin;
+
+	xLossy.ulFramesDecoded = 20;
+	xLossy.ulFramesDropped = 5;
+
+	vRateControlInit(&xConfig, &xState, TEST_QUALITY_WORST, 0);
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_KEEP);
+
+	for(uint32_t n = 0; n < 8; n++)
+	{
+		for(uint32_t i = 1; i < ulExpectedWait; i++)
+		{
+			TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_KEEP);
+		}
+
+		TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_UPGRADE);
+		TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xLossy) == RATE_CONTROL_KEEP);
+		TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xLossy) == RATE_CONTROL_DOWNGRADE);
+		TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_KEEP);
+
+		ulExpectedWait = (ulExpectedWait * 2 > RATE_CONTROL_UPGRADE_WAIT_MAX) ? RATE_CONTROL_UPGRADE_WAIT_MAX :
+		                                                                        (ulExpectedWait * 2);
+		TEST_CHECK(xState.ucUpgradeWait == ulExpectedWait);
+	}
+
+	// Upgrade what survived halves the wait
+	for(uint32_t i = 1; i < ulExpectedWait; i++)
+	{
+		TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_KEEP);
+	}
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_UPGRADE);
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_KEEP);
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xGood) == RATE_CONTROL_KEEP);
+	TEST_CHECK(xState.ucUpgradeWait == (RATE_CONTROL_UPGRADE_WAIT_MAX / 2));
+}
+
+
+// Frames inside of the dead zone around the budget never change anything
+static void
+test_hysteresis(void)
+{
+	rate_control_state_t xState;
+	rate_control_input_t xInput = {
+	    .ulPeriodMs = TEST_PERIOD_MS,
+	    .ulRxBytes = 100000,
+	    .ulFramesDecoded = 25,
+	    .ulAirtimeUs = 1000000,
+	};
+
+	vRateControlInit(&xConfig, &xState, 20, 1);
+
+	// Budget is 100000 * 80% / 25 = 3200 bytes, dead zone is 2720..3680
+	for(uint32_t ulBytes = 2721; ulBytes <= 3680; ulBytes += 7)
+	{
+		xInput.ulFrameBytes = ulBytes;
+		TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xInput) == RATE_CONTROL_KEEP);
+		TEST_CHECK(xState.ulFrameBudget == 3200);
+	}
+
+	TEST_CHECK((xState.ucQuality == 20) && (xState.ucFrameSize == 1));
+
+	xInput.ulFrameBytes = 3681;
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xInput) == RATE_CONTROL_DOWNGRADE);
+	TEST_CHECK(xState.ucQuality == 24);
+
+	// Empty reports and reports without airtime
+	memset(&xInput, 0, sizeof(xInput));
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xInput) == RATE_CONTROL_KEEP);
+	xInput.ulPeriodMs = TEST_PERIOD_MS;
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xInput) == RATE_CONTROL_KEEP);
+	TEST_CHECK(xState.ucHoldPeriods == xConfig.ucHoldPeriods);
+
+	xInput.ulRxBytes = 50000;
+	xInput.ulFramesDecoded = 25;
+	xInput.ulFrameBytes = 2000;
+	TEST_CHECK(xRateControlUpdate(&xConfig, &xState, &xInput) == RATE_CONTROL_KEEP);
+	TEST_CHECK(xState.ulFrameBudget == 1600);
+}
+
+
+static void
+bench(void)
+{
+	rate_control_state_t xState;
+	rate_control_input_t xInput;
+	uint32_t ulChanges = 0;
+
+	ulSeed = 7;
+	vRateControlInit(&xConfig, &xState, TEST_QUALITY_BEST, xConfig.ucFrameSizeMax);
+
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t n = 0; n < TEST_BENCH_UPDATES; n++)
+	{
+		link_period(&xState, 20000 + (ulTestRandNext(&ulSeed) % 200000), 20, &xInput);
+		ulChanges += (xRateControlUpdate(&xConfig, &xState, &xInput) != RATE_CONTROL_KEEP);
+	}
+
+	uint64_t ullTime = ullTestTimeNs() - ullStart;
+
+	printf("%.1f ns per report including link model, %u changes\n",
+	       (double)ullTime / TEST_BENCH_UPDATES,
+	       (unsigned)ulChanges);
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(void)
+{
+	test_trace();
+	test_backoff();
+	test_hysteresis();
+	bench();
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file test_tjpgd_common.h
+ *
+ * Helpers shared by tests what compare builds of Jpg decoder, see tjpgd_variant.h
+ */
+
+#ifndef _TEST_TJPGD_COMMON_H
+#define _TEST_TJPGD_COMMON_H
+
+#include "test_common.h"
+#include "tjpgd_variant.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_BAYER_NUM (8)
+
+// Byte swapped RGB565 to channels
+#define PIX_R(p) (((p) >> 3) & 0x1F)
+#define PIX_G(p) ((((p) & 0x07) << 3) | ((p) >> 13))
+#define PIX_B(p) (((p) >> 8) & 0x1F)
+
+// ----------------------------------------------------------------------
+// Helpers
+
+static inline uint32_t
+ulTestChannelDiff(uint32_t ulA, uint32_t ulB)
+{
+	return (ulA > ulB) ? (ulA - ulB) : (ulB - ulA);
+}
+
+/**
+ * @brief Compare two decoded images of the same size
+ *
+ * @param pxA The first image
+ * @param pxB The second image
+ * @param pulSame Where to add amount of equal pixels
+ *
+ * @retval The biggest difference of R, G or B channel of RGB565
+ */
+static inline uint32_t
+ulTestImageDiff(const tjpgd_image_t* pxA, const tjpgd_image_t* pxB, uint32_t* pulSame)
+{
+	uint32_t ulPixels = (uint32_t)pxA->usWidth * pxA->usHeight;
+	uint32_t ulMaxDiff = 0;
+
+	TEST_CHECK((pxA->usWidth == pxB->usWidth) && (pxA->usHeight == pxB->usHeight));
+	TEST_CHECK(pxA->ulMcus == pxB->ulMcus);
+
+	for(uint32_t i = 0; i < ulPixels; i++)
+	{
+		uint16_t usA = pxA->usPixels[i];
+		uint16_t usB = pxB->usPixels[i];
+		uint32_t ulDiff = ulTestChannelDiff(PIX_R(usA), PIX_R(usB));
+
+		if(ulTestChannelDiff(PIX_G(usA), PIX_G(usB)) > ulDiff)
+		{
+			ulDiff = ulTestChannelDiff(PIX_G(usA), PIX_G(usB));
+		}
+		if(ulTestChannelDiff(PIX_B(usA), PIX_B(usB)) > ulDiff)
+		{
+			ulDiff = ulTestChannelDiff(PIX_B(usA), PIX_B(usB));
+		}
+
+		ulMaxDiff = (ulDiff > ulMaxDiff) ? ulDiff : ulMaxDiff;
+		*pulSame += (usA == usB);
+	}
+
+	return ulMaxDiff;
+}
+
+/**
+ * @brief Print time of whole frame decoding with one build, all bayer patterns are used in turn
+ *
+ * @param pucJpg Jpg file
+ * @param xSize Amount of bytes in pucJpg
+ * @param ulRuns Amount of decoded frames
+ * @param pcName Name of the build
+ * @param pxDecode Decoder of the build
+ * @param pxImage Image buffer for decoding
+ */
+static inline void
+vTestBenchDecode(const uint8_t* pucJpg,
+                 size_t xSize,
+                 uint32_t ulRuns,
+                 const char* pcName,
+                 tjpgd_variant_decode_t pxDecode,
+                 tjpgd_image_t* pxImage)
+{
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t i = 0; i < ulRuns; i++)
+	{
+		TEST_CHECK(pxDecode(pucJpg, xSize, (uint8_t)(i % TEST_BAYER_NUM), pxImage) == 0);
+	}
+
+	uint64_t ullTime = ullTestTimeNs() - ullStart;
+
+	printf("  %s: %.1f us per frame, %.0f ns per MCU\n",
+	       pcName,
+	       (double)ullTime / ulRuns / 1000.0,
+	       (double)ullTime / ulRuns / pxImage->ulMcus);
+}
+
+#endif /* _TEST_TJPGD_COMMON_H */
@@ -0,0 +1,86 @@
+/**
+ * @file test_tjpgd_float.c
+ *
+ * Fixed point conversion of YCbCr straight to RGB565 (JD_FORMAT 1) against the float conversion
+ * to RGB888 (JD_FORMAT 0) what firmware used before, with RGB888 packed to RGB565 afterwards.
+ * 20-bit coefficients are truncated like float products were, so only rare G values may differ by 1
+ * before they are cut to 6 bits. Every test frame is decoded with all bayer patterns, then both builds are timed.
+ *
+ * Usage: test_tjpgd_float <file.jpg>...
+ */
+
+#include "test_tjpgd_common.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_BENCH_RUNS (200)
+
+// Pixels what differ from the float conversion, in 1/1000000
+#define TEST_DIFF_PPM_MAX (100)
+
+// ----------------------------------------------------------------------
+// Variables
+
+static tjpgd_image_t xFixed;
+static tjpgd_image_t xFloat;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static void
+compare_frame(const char* pcPath, const uint8_t* pucJpg, size_t xSize)
+{
+	uint32_t ulPixels = 0;
+	uint32_t ulSame = 0;
+	uint32_t ulMaxDiff = 0;
+
+	for(uint8_t ucBayer = 0; ucBayer < TEST_BAYER_NUM; ucBayer++)
+	{
+		TEST_CHECK(lTjpgdDecode_ref(pucJpg, xSize, ucBayer, &xFixed) == 0);
+		TEST_CHECK(lTjpgdDecode_float(pucJpg, xSize, ucBayer, &xFloat) == 0);
+
+		uint32_t ulDiff = ulTestImageDiff(&xFixed, &xFloat, &ulSame);
+		ulMaxDiff = (ulDiff > ulMaxDiff) ? ulDiff : ulMaxDiff;
+		ulPixels += (uint32_t)xFixed.usWidth * xFixed.usHeight;
+	}
+
+	printf("%s: %ux%u, %u MCUs, max channel diff %u, different pixels %u of %u\n",
+	       pcPath,
+	       (unsigned)xFixed.usWidth,
+	       (unsigned)xFixed.usHeight,
+	       (unsigned)xFixed.ulMcus,
+	       (unsigned)ulMaxDiff,
+	       (unsigned)(ulPixels - ulSame),
+	       (unsigned)ulPixels);
+
+	TEST_CHECK(ulMaxDiff <= 1);
+	TEST_CHECK(((uint64_t)(ulPixels - ulSame) * 1000000ULL) <= ((uint64_t)ulPixels * TEST_DIFF_PPM_MAX));
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(int argc, char** argv)
+{
+	TEST_CHECK(argc > 1);
+
+	for(int i = 1; i < argc; i++)
+	{
+		size_t xSize = 0;
+		uint8_t* pucJpg = pucTestReadFile(argv[i], &xSize);
+
+		compare_frame(argv[i], pucJpg, xSize);
+		vTestBenchDecode(pucJpg, xSize, TEST_BENCH_RUNS, "fixed point RGB565    ", lTjpgdDecode_ref, &xFixed);
+		vTestBenchDecode(pucJpg, xSize, TEST_BENCH_RUNS, "float RGB888 + packing", lTjpgdDecode_float, &xFloat);
+
+		free(pucJpg);
+	}
+
+	return 0;
+}
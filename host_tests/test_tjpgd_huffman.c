@@ -0,0 +1,174 @@
+/**
+ * @file test_tjpgd_huffman.c
+ *
+ * Huffman decoding with lookup tables (JD_FASTDECODE 2) against bit by bit decoding (JD_FASTDECODE 1).
+ * Both builds must output exactly the same pixels and return the same result, also for broken and
+ * truncated data. Images are decoded from the input buffer and in place from the memory like Receiver does,
+ * lookup tables peek bytes right from there. Every test frame is decoded with all bayer patterns,
+ * then both builds are timed.
+ *
+ * Usage: test_tjpgd_huffman <file.jpg>...
+ */
+
+#include "test_tjpgd_common.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_BENCH_RUNS  (200)
+#define TEST_BROKEN_RUNS (300)
+#define TEST_RESULTS_NUM (9)
+
+typedef struct
+{
+	const char* pcName;
+	tjpgd_variant_decode_t pxTables;
+	tjpgd_variant_decode_t pxBits;
+} test_input_t;
+
+// ----------------------------------------------------------------------
+// Variables
+
+static const test_input_t xInputs[] = {
+    {"input buffer", lTjpgdDecode_ref, lTjpgdDecode_fast1},
+    {"in place    ", lTjpgdDecodeMem_ref, lTjpgdDecodeMem_fast1},
+};
+
+static tjpgd_image_t xTables;
+static tjpgd_image_t xBits;
+
+static uint8_t ucBroken[64 * 1024];
+static uint32_t ulSeed = 1;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+// Both builds return the same and decode the same pixels, even if data is broken
+static int32_t
+compare_decode(const test_input_t* pxInput, const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer)
+{
+	memset(&xTables, 0, sizeof(xTables));
+	memset(&xBits, 0, sizeof(xBits));
+
+	int32_t lTables = pxInput->pxTables(pucJpg, xSize, ucBayer, &xTables);
+	int32_t lBits = pxInput->pxBits(pucJpg, xSize, ucBayer, &xBits);
+
+	TEST_CHECK(lTables == lBits);
+	TEST_CHECK(memcmp(&xTables, &xBits, sizeof(xTables)) == 0);
+
+	return lTables;
+}
+
+
+static void
+compare_frame(const char* pcPath, const uint8_t* pucJpg, size_t xSize)
+{
+	for(uint32_t i = 0; i < (sizeof(xInputs) / sizeof(xInputs[0])); i++)
+	{
+		for(uint8_t ucBayer = 0; ucBayer < TEST_BAYER_NUM; ucBayer++)
+		{
+			TEST_CHECK(compare_decode(&xInputs[i], pucJpg, xSize, ucBayer) == 0);
+		}
+	}
+
+	printf("%s: %ux%u, %u MCUs, the same pixels\n",
+	       pcPath,
+	       (unsigned)xTables.usWidth,
+	       (unsigned)xTables.usHeight,
+	       (unsigned)xTables.ulMcus);
+}
+
+
+// Random bytes are changed and the end of data is cut, header is kept
+static void
+test_broken(const uint8_t* pucJpg, size_t xSize)
+{
+	uint32_t ulResults[TEST_RESULTS_NUM] = {0};
+	// Start of entropy coded data is somewhere after quantizer and Huffman tables
+	size_t xKept = xSize / 8;
+
+	TEST_CHECK(xSize <= sizeof(ucBroken));
+
+	for(uint32_t n = 0; n < TEST_BROKEN_RUNS; n++)
+	{
+		size_t xLen = xSize;
+
+		memcpy(ucBroken, pucJpg, xSize);
+
+		if(n & 1)
+		{
+			for(uint32_t b = 1 + (ulTestRandNext(&ulSeed) % 8); b; b--)
+			{
+				ucBroken[xKept + ulTestRandNext(&ulSeed) % (xSize - xKept)] = (uint8_t)ulTestRandNext(&ulSeed);
+			}
+		}
+		if(n & 2)
+		{
+			xLen = xKept + ulTestRandNext(&ulSeed) % (xSize - xKept);
+		}
+		if(!(n & 3))
+		{
+			// Markers and stuffed bytes are where bit by bit path is taken
+			for(uint32_t b = 1 + (ulTestRandNext(&ulSeed) % 4); b; b--)
+			{
+				size_t xPos = xKept + ulTestRandNext(&ulSeed) % (xSize - xKept);
+				ucBroken[xPos] = (ulTestRandNext(&ulSeed) & 1) ? 0xFF : 0x00;
+			}
+		}
+
+		for(uint32_t i = 0; i < (sizeof(xInputs) / sizeof(xInputs[0])); i++)
+		{
+			int32_t lRes = compare_decode(&xInputs[i], ucBroken, xLen, (uint8_t)(n % TEST_BAYER_NUM));
+
+			TEST_CHECK((lRes >= 0) && (lRes < TEST_RESULTS_NUM));
+			++ulResults[lRes];
+		}
+	}
+
+	printf("  broken data, results of %u decodes:", (unsigned)(TEST_BROKEN_RUNS * 2));
+	for(uint32_t i = 0; i < TEST_RESULTS_NUM; i++)
+	{
+		if(ulResults[i])
+		{
+			printf(" %u: %u", (unsigned)i, (unsigned)ulResults[i]);
+		}
+	}
+	printf("\n");
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(int argc, char** argv)
+{
+	TEST_CHECK(argc > 1);
+
+	for(int i = 1; i < argc; i++)
+	{
+		size_t xSize = 0;
+		uint8_t* pucJpg = pucTestReadFile(argv[i], &xSize);
+
+		compare_frame(argv[i], pucJpg, xSize);
+		test_broken(pucJpg, xSize);
+
+		for(uint32_t n = 0; n < (sizeof(xInputs) / sizeof(xInputs[0])); n++)
+		{
+			char cName[64];
+
+			snprintf(cName, sizeof(cName), "%s, lookup tables", xInputs[n].pcName);
+			vTestBenchDecode(pucJpg, xSize, TEST_BENCH_RUNS, cName, xInputs[n].pxTables, &xTables);
+			snprintf(cName, sizeof(cName), "%s, bit by bit   ", xInputs[n].pcName);
+			vTestBenchDecode(pucJpg, xSize, TEST_BENCH_RUNS, cName, xInputs[n].pxBits, &xBits);
+		}
+
+		free(pucJpg);
+	}
+
+	return 0;
+}
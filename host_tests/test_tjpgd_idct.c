@@ -0,0 +1,140 @@
+/**
+ * @file test_tjpgd_idct.c
+ *
+ * IDCT of only non zero corner of the block (JD_USE_SPARSE_IDCT 1) against full IDCT of every block
+ * (JD_USE_SPARSE_IDCT 0). Zero elements add nothing to the transform, so both builds must output exactly
+ * the same pixels. Every test frame is decoded with all bayer patterns, then amount of blocks of
+ * each IDCT size is printed and both builds are timed. Entropy decoding alone is timed too,
+ * so the time of IDCT and output stage is the rest of the whole decoding.
+ *
+ * Usage: test_tjpgd_idct <file.jpg>...
+ */
+
+#include "test_tjpgd_common.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_BENCH_RUNS   (200)
+#define TEST_IDCT_CLASSES (4)
+
+// ----------------------------------------------------------------------
+// Variables
+
+static const char* pcClassNames[TEST_IDCT_CLASSES] = {"DC only", "2x2", "4x4", "full"};
+
+static tjpgd_image_t xSparse;
+static tjpgd_image_t xFull;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static void
+compare_frame(const char* pcPath, const uint8_t* pucJpg, size_t xSize)
+{
+	uint32_t ulPixels = (uint32_t)sizeof(xSparse.usPixels) / sizeof(xSparse.usPixels[0]);
+
+	for(uint8_t ucBayer = 0; ucBayer < TEST_BAYER_NUM; ucBayer++)
+	{
+		// Pixels out of the image must be the same too
+		memset(xSparse.usPixels, 0, sizeof(xSparse.usPixels));
+		memset(xFull.usPixels, 0, sizeof(xFull.usPixels));
+
+		TEST_CHECK(lTjpgdDecode_ref(pucJpg, xSize, ucBayer, &xSparse) == 0);
+		TEST_CHECK(lTjpgdDecode_fullidct(pucJpg, xSize, ucBayer, &xFull) == 0);
+		TEST_CHECK((xSparse.usWidth == xFull.usWidth) && (xSparse.usHeight == xFull.usHeight));
+		TEST_CHECK(xSparse.ulMcus == xFull.ulMcus);
+		TEST_CHECK(memcmp(xSparse.usPixels, xFull.usPixels, ulPixels * sizeof(uint16_t)) == 0);
+	}
+
+	uint32_t ulClasses[TEST_IDCT_CLASSES] = {0};
+	uint32_t ulBlocks = 0;
+
+	TEST_CHECK(lTjpgdCountIdct_ref(pucJpg, xSize, ulClasses) == 0);
+
+	printf("%s: %ux%u, %u MCUs, the same pixels, blocks:",
+	       pcPath,
+	       (unsigned)xSparse.usWidth,
+	       (unsigned)xSparse.usHeight,
+	       (unsigned)xSparse.ulMcus);
+
+	for(uint32_t i = 0; i < TEST_IDCT_CLASSES; i++)
+	{
+		ulBlocks += ulClasses[i];
+	}
+	for(uint32_t i = 0; i < TEST_IDCT_CLASSES; i++)
+	{
+		printf(" %s %.1f%%", pcClassNames[i], 100.0 * (double)ulClasses[i] / (double)ulBlocks);
+	}
+	printf("\n");
+
+	TEST_CHECK(ulBlocks > 0);
+}
+
+
+// Returns time of a frame in ns
+static double
+bench_decode(const uint8_t* pucJpg, size_t xSize, tjpgd_variant_decode_t pxDecode, tjpgd_image_t* pxImage)
+{
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t i = 0; i < TEST_BENCH_RUNS; i++)
+	{
+		TEST_CHECK(pxDecode(pucJpg, xSize, (uint8_t)(i % TEST_BAYER_NUM), pxImage) == 0);
+	}
+
+	return (double)(ullTestTimeNs() - ullStart) / TEST_BENCH_RUNS;
+}
+
+
+static void
+bench(const uint8_t* pucJpg, size_t xSize)
+{
+	uint32_t ulClasses[TEST_IDCT_CLASSES] = {0};
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t i = 0; i < TEST_BENCH_RUNS; i++)
+	{
+		TEST_CHECK(lTjpgdCountIdct_ref(pucJpg, xSize, ulClasses) == 0);
+	}
+
+	double dEntropy = (double)(ullTestTimeNs() - ullStart) / TEST_BENCH_RUNS;
+	double dSparse = bench_decode(pucJpg, xSize, lTjpgdDecode_ref, &xSparse);
+	double dFull = bench_decode(pucJpg, xSize, lTjpgdDecode_fullidct, &xFull);
+
+	printf("  entropy decoding %.1f us, whole frame with full IDCT %.1f us, with sparse IDCT %.1f us\n",
+	       dEntropy / 1000.0,
+	       dFull / 1000.0,
+	       dSparse / 1000.0);
+	printf("  IDCT and output stage %.1f us -> %.1f us, %.2fx\n",
+	       (dFull - dEntropy) / 1000.0,
+	       (dSparse - dEntropy) / 1000.0,
+	       (dFull - dEntropy) / (dSparse - dEntropy));
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(int argc, char** argv)
+{
+	TEST_CHECK(argc > 1);
+
+	for(int i = 1; i < argc; i++)
+	{
+		size_t xSize = 0;
+		uint8_t* pucJpg = pucTestReadFile(argv[i], &xSize);
+
+		compare_frame(argv[i], pucJpg, xSize);
+		bench(pucJpg, xSize);
+
+		free(pucJpg);
+	}
+
+	return 0;
+}
@@ -0,0 +1,132 @@
+/**
+ * @file test_tjpgd_prepare.c
+ *
+ * Decoder prepared once and reused for every next frame with the same Jpg header (jd_rewind_mem())
+ * against decoder prepared for every frame with jd_prepare(), like Receiver did before.
+ * Both must output exactly the same pixels, also when frames with different headers come in turn.
+ * Then whole frame decoding both ways and jd_prepare() alone are timed, what is the saving per frame.
+ *
+ * Usage: test_tjpgd_prepare <file.jpg>...
+ */
+
+#include "test_tjpgd_common.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_BENCH_RUNS (200)
+#define TEST_FILES_MAX  (8)
+
+// ----------------------------------------------------------------------
+// Variables
+
+static tjpgd_image_t xReused;
+static tjpgd_image_t xPrepared;
+
+static uint8_t* pucFiles[TEST_FILES_MAX];
+static size_t xSizes[TEST_FILES_MAX];
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static void
+compare_decode(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer)
+{
+	TEST_CHECK(lTjpgdDecodeReuse_ref(pucJpg, xSize, ucBayer, &xReused) == 0);
+	TEST_CHECK(lTjpgdDecodeMem_ref(pucJpg, xSize, ucBayer, &xPrepared) == 0);
+	TEST_CHECK(memcmp(&xReused, &xPrepared, sizeof(xReused)) == 0);
+}
+
+
+// Returns time of a call in ns
+static double
+bench_prepare(const uint8_t* pucJpg, size_t xSize)
+{
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t i = 0; i < TEST_BENCH_RUNS; i++)
+	{
+		TEST_CHECK(lTjpgdPrepare_ref(pucJpg, xSize) == 0);
+	}
+
+	return (double)(ullTestTimeNs() - ullStart) / TEST_BENCH_RUNS;
+}
+
+
+// Returns time of a frame in ns
+static double
+bench_decode(const uint8_t* pucJpg, size_t xSize, tjpgd_variant_decode_t pxDecode, tjpgd_image_t* pxImage)
+{
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t i = 0; i < TEST_BENCH_RUNS; i++)
+	{
+		TEST_CHECK(pxDecode(pucJpg, xSize, (uint8_t)(i % TEST_BAYER_NUM), pxImage) == 0);
+	}
+
+	return (double)(ullTestTimeNs() - ullStart) / TEST_BENCH_RUNS;
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(int argc, char** argv)
+{
+	uint32_t ulFiles = (uint32_t)(argc - 1);
+
+	TEST_CHECK((ulFiles > 0) && (ulFiles <= TEST_FILES_MAX));
+
+	for(uint32_t i = 0; i < ulFiles; i++)
+	{
+		pucFiles[i] = pucTestReadFile(argv[i + 1], &xSizes[i]);
+	}
+
+	// Steady header, then header changes with every frame
+	for(uint32_t i = 0; i < ulFiles; i++)
+	{
+		for(uint8_t ucBayer = 0; ucBayer < TEST_BAYER_NUM; ucBayer++)
+		{
+			compare_decode(pucFiles[i], xSizes[i], ucBayer);
+		}
+	}
+	for(uint32_t n = 0; n < (ulFiles * TEST_BAYER_NUM); n++)
+	{
+		compare_decode(pucFiles[n % ulFiles], xSizes[n % ulFiles], (uint8_t)(n % TEST_BAYER_NUM));
+	}
+
+	for(uint32_t i = 0; i < ulFiles; i++)
+	{
+		// The first call prepares decoder for this image
+		TEST_CHECK(lTjpgdDecodeReuse_ref(pucFiles[i], xSizes[i], 0, &xReused) == 0);
+
+		double dPrepare = bench_prepare(pucFiles[i], xSizes[i]);
+		double dReused = bench_decode(pucFiles[i], xSizes[i], lTjpgdDecodeReuse_ref, &xReused);
+		double dPrepared = bench_decode(pucFiles[i], xSizes[i], lTjpgdDecodeMem_ref, &xPrepared);
+
+		printf("%s: %ux%u, %u MCUs, the same pixels\n",
+		       argv[i + 1],
+		       (unsigned)xReused.usWidth,
+		       (unsigned)xReused.usHeight,
+		       (unsigned)xReused.ulMcus);
+		// Difference of whole frame times is within noise, so the saving is the time of jd_prepare alone
+		printf("  frame with jd_prepare %.1f us, with reused tables %.1f us, "
+		       "saved jd_prepare %.1f us, %.2f%% of the frame\n",
+		       dPrepared / 1000.0,
+		       dReused / 1000.0,
+		       dPrepare / 1000.0,
+		       100.0 * dPrepare / dPrepared);
+	}
+
+	for(uint32_t i = 0; i < ulFiles; i++)
+	{
+		free(pucFiles[i]);
+	}
+
+	return 0;
+}
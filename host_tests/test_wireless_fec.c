@@ -0,0 +1,238 @@
+/**
+ * @file test_wireless_fec.c
+ *
+ * Round trip of FEC parity blocks: every group size and parity amount, every way to lose blocks
+ * what parity could cover, short final block and groups what can't be restored.
+ * Then encoder and recovery throughput is printed, to compare with time budget of a packet.
+ */
+
+#include "test_common.h"
+#include "wireless_fec.h"
+//
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+// Size of image block in ESP-NOW packet, see PACKET_IMAGE_DATA_MAX_SIZE
+#define TEST_BLOCK_SIZE (245)
+
+#define TEST_RANDOM_GROUPS (20000)
+#define TEST_BENCH_GROUPS  (100000)
+#define TEST_BENCH_DATA    (8)
+
+// ----------------------------------------------------------------------
+// Variables
+
+static uint8_t ucData[FEC_DATA_BLOCKS_MAX_NUM][TEST_BLOCK_SIZE];
+static uint8_t ucOrigin[FEC_DATA_BLOCKS_MAX_NUM][TEST_BLOCK_SIZE];
+static uint8_t ucParity[FEC_PARITY_BLOCKS_MAX_NUM][TEST_BLOCK_SIZE];
+static uint32_t ulSeed = 1;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint32_t
+bits_count(uint32_t ulMap)
+{
+	return (uint32_t)__builtin_popcount(ulMap);
+}
+
+
+// Fill data blocks, the last one is ulLastSize bytes long with zero tail, and make parity of them
+static void
+encode_group(uint32_t ulDataNum, uint32_t ulParityNum, uint32_t ulLastSize)
+{
+	memset(ucParity, 0, sizeof(ucParity));
+
+	for(uint32_t i = 0; i < ulDataNum; i++)
+	{
+		size_t xSize = (i == (ulDataNum - 1)) ? ulLastSize : TEST_BLOCK_SIZE;
+
+		memset(&ucOrigin[i][0], 0, TEST_BLOCK_SIZE);
+		for(size_t b = 0; b < xSize; b++)
+		{
+			ucOrigin[i][b] = (uint8_t)ulTestRandNext(&ulSeed);
+		}
+
+		for(uint32_t j = 0; j < ulParityNum; j++)
+		{
+			vFecEncodeBlock(&ucParity[j][0], &ucOrigin[i][0], xSize, j, i);
+		}
+	}
+
+	memcpy(ucData, ucOrigin, sizeof(ucData));
+}
+
+
+// Lose data blocks of ulMissingMap and restore them with parity blocks of ulParityMap
+static int32_t
+recover_group(uint32_t ulDataNum, uint32_t ulMissingMap, uint32_t ulParityMap)
+{
+	uint8_t* pucData[FEC_DATA_BLOCKS_MAX_NUM];
+	uint8_t* pucParity[FEC_PARITY_BLOCKS_MAX_NUM];
+
+	for(uint32_t i = 0; i < FEC_DATA_BLOCKS_MAX_NUM; i++)
+	{
+		pucData[i] = &ucData[i][0];
+		if(ulMissingMap & (1UL << i))
+		{
+			memset(&ucData[i][0], 0xA5, TEST_BLOCK_SIZE);
+		}
+	}
+
+	for(uint32_t j = 0; j < FEC_PARITY_BLOCKS_MAX_NUM; j++)
+	{
+		pucParity[j] = &ucParity[j][0];
+	}
+
+	return lFecRecover(pucData, ulDataNum, ulMissingMap, pucParity, ulParityMap, TEST_BLOCK_SIZE);
+}
+
+
+// Random set of ulNum bits out of ulWidth
+static uint32_t
+random_map(uint32_t ulWidth, uint32_t ulNum)
+{
+	uint32_t ulMap = 0;
+
+	while(bits_count(ulMap) < ulNum)
+	{
+		ulMap |= 1UL << (ulTestRandNext(&ulSeed) % ulWidth);
+	}
+
+	return ulMap;
+}
+
+
+// Every loss pattern of small groups with all parity blocks received
+static void
+test_exhaustive(void)
+{
+	uint32_t ulGroups = 0;
+
+	for(uint32_t ulDataNum = 1; ulDataNum <= 10; ulDataNum++)
+	{
+		for(uint32_t ulParityNum = 1; ulParityNum <= FEC_PARITY_BLOCKS_MAX_NUM; ulParityNum++)
+		{
+			for(uint32_t ulMissingMap = 0; ulMissingMap < (1UL << ulDataNum); ulMissingMap++)
+			{
+				uint32_t ulLost = bits_count(ulMissingMap);
+
+				encode_group(ulDataNum, ulParityNum, TEST_BLOCK_SIZE);
+				int32_t lRestored = recover_group(ulDataNum, ulMissingMap, (1UL << ulParityNum) - 1);
+
+				if(ulLost > ulParityNum)
+				{
+					TEST_CHECK(lRestored == -1);
+					continue;
+				}
+
+				TEST_CHECK(lRestored == (int32_t)ulLost);
+				TEST_CHECK(memcmp(ucData, ucOrigin, ulDataNum * TEST_BLOCK_SIZE) == 0);
+				++ulGroups;
+			}
+		}
+	}
+
+	printf("exhaustive: %u groups restored\n", (unsigned)ulGroups);
+}
+
+
+// Random groups up to the maximum size, any subset of parity blocks, short final block
+static void
+test_random(void)
+{
+	for(uint32_t n = 0; n < TEST_RANDOM_GROUPS; n++)
+	{
+		uint32_t ulDataNum = 1 + ulTestRandNext(&ulSeed) % FEC_DATA_BLOCKS_MAX_NUM;
+		uint32_t ulParityNum = 1 + ulTestRandNext(&ulSeed) % FEC_PARITY_BLOCKS_MAX_NUM;
+		uint32_t ulLastSize = 1 + ulTestRandNext(&ulSeed) % TEST_BLOCK_SIZE;
+		uint32_t ulReceived = ulTestRandNext(&ulSeed) % (ulParityNum + 1);
+		uint32_t ulLost = ulTestRandNext(&ulSeed) % (ulParityNum + 2);
+
+		ulLost = (ulLost > ulDataNum) ? ulDataNum : ulLost;
+		encode_group(ulDataNum, ulParityNum, ulLastSize);
+
+		uint32_t ulMissingMap = random_map(ulDataNum, ulLost);
+		uint32_t ulParityMap = random_map(ulParityNum, ulReceived);
+		int32_t lRestored = recover_group(ulDataNum, ulMissingMap, ulParityMap);
+
+		if(ulLost > ulReceived)
+		{
+			TEST_CHECK(lRestored == -1);
+			continue;
+		}
+
+		// Missing tail of the final block comes back as zeros
+		TEST_CHECK(lRestored == (int32_t)ulLost);
+		TEST_CHECK(memcmp(ucData, ucOrigin, ulDataNum * TEST_BLOCK_SIZE) == 0);
+	}
+
+	printf("random: %u groups\n", (unsigned)TEST_RANDOM_GROUPS);
+}
+
+
+static void
+bench(void)
+{
+	for(uint32_t ulParityNum = 1; ulParityNum <= 2; ulParityNum++)
+	{
+		uint64_t ullStart = ullTestTimeNs();
+
+		for(uint32_t n = 0; n < TEST_BENCH_GROUPS; n++)
+		{
+			for(uint32_t i = 0; i < TEST_BENCH_DATA; i++)
+			{
+				for(uint32_t j = 0; j < ulParityNum; j++)
+				{
+					vFecEncodeBlock(&ucParity[j][0], &ucOrigin[i][0], TEST_BLOCK_SIZE, j, i);
+				}
+			}
+		}
+
+		double dSec = (double)(ullTestTimeNs() - ullStart) / 1e9;
+		double dBytes = (double)TEST_BENCH_GROUPS * TEST_BENCH_DATA * TEST_BLOCK_SIZE;
+		printf("encode %u+%u: %.1f MB/s of data, %.2f us per data block\n",
+		       (unsigned)TEST_BENCH_DATA,
+		       (unsigned)ulParityNum,
+		       dBytes / dSec / 1e6,
+		       dSec * 1e6 / ((double)TEST_BENCH_GROUPS * TEST_BENCH_DATA));
+	}
+
+	for(uint32_t ulLost = 1; ulLost <= 2; ulLost++)
+	{
+		encode_group(TEST_BENCH_DATA, ulLost, TEST_BLOCK_SIZE);
+		uint64_t ullStart = ullTestTimeNs();
+
+		for(uint32_t n = 0; n < TEST_BENCH_GROUPS; n++)
+		{
+			// Parity blocks are spoiled by recovery, content doesn't matter for timing
+			TEST_CHECK(recover_group(TEST_BENCH_DATA, (1UL << ulLost) - 1, (1UL << ulLost) - 1) == (int32_t)ulLost);
+		}
+
+		double dSec = (double)(ullTestTimeNs() - ullStart) / 1e9;
+		printf("recover %u lost of %u: %.1f MB/s of group data, %.2f us per group\n",
+		       (unsigned)ulLost,
+		       (unsigned)TEST_BENCH_DATA,
+		       (double)TEST_BENCH_GROUPS * TEST_BENCH_DATA * TEST_BLOCK_SIZE / dSec / 1e6,
+		       dSec * 1e6 / TEST_BENCH_GROUPS);
+	}
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(void)
+{
+	vFecInit();
+
+	test_exhaustive();
+	test_random();
+	bench();
+
+	return 0;
+}
@@ -0,0 +1,278 @@
+/**
+ * @file test_wireless_rate.c
+ *
+ * PHY rate selection against synthetic loss curves.
+ * Success probability of every rate is a logistic curve of signal level above receiver sensitivity,
+ * packets are sent back to back during each 100ms update period, so faster rates send more of them.
+ * Throughput of selected rates is compared with the best rate what the loss curves allow.
+ *
+ * Checks:
+ * - selection converges to nearly the best throughput after signal level changes, with and without RSSI reports
+ * - best rate doesn't flap on a steady link
+ * - rates what need better signal than reported one are never sent, not even as probes
+ * - about one packet of @ref ''WIRELESS_RATE_SAMPLE_INTERVAL'' is a probe
+ */
+
+#include "test_common.h"
+#include "wireless_rate.h"
+//
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TEST_PERIOD_US      (100000)
+#define TEST_SETTLE_PERIODS (30)
+#define TEST_CHECK_PERIODS  (40)
+#define TEST_PACKET_BYTES   (290)
+#define TEST_BENCH_PACKETS  (20000000)
+
+typedef struct
+{
+	int8_t icRssi;         // Signal level at the other node
+	uint8_t ucReported;    // Other node reports signal level, otherwise the last report is used
+	uint8_t ucExpectedMin; // The best rate must end at least this fast
+} test_segment_t;
+
+// ----------------------------------------------------------------------
+// Variables
+
+// Copy of xRateInfo of wireless_rate.c, test must not depend on its internals
+static const uint16_t usOverheadUs[WIRELESS_RATE_NUM] = {600, 600, 556, 310, 310, 310, 110, 110,
+                                                         110, 110, 110, 110, 110, 110};
+static const int8_t icSensitivity[WIRELESS_RATE_NUM] = {-105, -102, -98, -95, -93, -88, -92,
+                                                        -89,  -86,  -83, -80, -76, -74, -72};
+
+static const test_segment_t xTrace[] = {
+    {-50, 0, WIRELESS_RATE_MCS7},
+    {-78, 0, WIRELESS_RATE_MCS2},
+    {-60, 0, WIRELESS_RATE_MCS7},
+    {-78, 1, WIRELESS_RATE_MCS2},
+    {-96, 1, WIRELESS_RATE_LORA_250K},
+    {-85, 1, WIRELESS_RATE_MCS0},
+};
+
+static uint32_t ulSeed = 1;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint32_t
+airtime_us(uint8_t ucRate)
+{
+	return usOverheadUs[ucRate] + (TEST_PACKET_BYTES * 8UL * 1000UL) / ulWirelessRateKbps(ucRate);
+}
+
+
+// Loss curve, about 97% of packets get through at the edge of usable signal level
+static double
+success_prob(uint8_t ucRate, int8_t icRssi)
+{
+	return 1.0 / (1.0 + exp(-1.2 * (double)(icRssi - icSensitivity[ucRate] - 3)));
+}
+
+
+// Delivered packets per second of the best rate what loss curves allow
+static double
+best_throughput(int8_t icRssi)
+{
+	double dBest = 0.0;
+
+	for(uint8_t r = 0; r < WIRELESS_RATE_NUM; r++)
+	{
+		double dThroughput = success_prob(r, icRssi) * 1e6 / airtime_us(r);
+		dBest = (dThroughput > dBest) ? dThroughput : dBest;
+	}
+
+	return dBest;
+}
+
+
+static uint32_t
+rate_usable(uint8_t ucRate, int8_t icRssi)
+{
+	// Copy of RSSI margin of wireless_rate.c
+	return !ucRate || (icRssi >= (icSensitivity[ucRate] + 6));
+}
+
+
+// Some of probed rates around the best one could be used, see ucWirelessRateSelect()
+static uint32_t
+neighbour_usable(uint8_t ucBest, int8_t icRssi)
+{
+	for(int32_t r = (int32_t)ucBest - 1; r <= ((int32_t)ucBest + 2); r++)
+	{
+		if((r >= 0) && (r < WIRELESS_RATE_NUM) && (r != ucBest) && (!icRssi || rate_usable((uint8_t)r, icRssi)))
+		{
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static void
+test_trace(void)
+{
+	wireless_rate_t xRate;
+	uint32_t ulThreshold = 1 << 24;
+
+	vWirelessRateInit(&xRate, WIRELESS_RATE_1M_L);
+
+	for(uint32_t s = 0; s < (sizeof(xTrace) / sizeof(xTrace[0])); s++)
+	{
+		const test_segment_t* pxSegment = &xTrace[s];
+		uint32_t ulChanges = 0;
+		uint32_t ulPackets = 0;
+		uint32_t ulDelivered = 0;
+		uint32_t ulProbes = 0;
+		uint8_t ucLastBest = ucWirelessRateGetBest(&xRate);
+
+		if(pxSegment->ucReported)
+		{
+			vWirelessRateSetRssi(&xRate, pxSegment->icRssi);
+			TEST_CHECK(rate_usable(ucWirelessRateGetBest(&xRate), pxSegment->icRssi));
+		}
+
+		for(uint32_t p = 0; p < (TEST_SETTLE_PERIODS + TEST_CHECK_PERIODS); p++)
+		{
+			uint32_t ulTimeUs = 0;
+
+			while(ulTimeUs < TEST_PERIOD_US)
+			{
+				uint8_t ucBest = ucWirelessRateGetBest(&xRate);
+				uint8_t ucRate = ucWirelessRateSelect(&xRate);
+				uint32_t ulChance = (uint32_t)(success_prob(ucRate, pxSegment->icRssi) * ulThreshold);
+				uint32_t ulSuccess = (ulTestRandNext(&ulSeed) & (ulThreshold - 1)) < ulChance;
+
+				TEST_CHECK(ucRate < WIRELESS_RATE_NUM);
+				TEST_CHECK(!xRate.icRssi || rate_usable(ucRate, xRate.icRssi));
+
+				vWirelessRateReport(&xRate, ucRate, ulSuccess);
+				ulTimeUs += airtime_us(ucRate);
+
+				if(p >= TEST_SETTLE_PERIODS)
+				{
+					++ulPackets;
+					ulDelivered += ulSuccess;
+					ulProbes += (ucRate != ucBest);
+				}
+			}
+
+			uint8_t ucBest = ucWirelessRateUpdate(&xRate);
+
+			if(p >= TEST_SETTLE_PERIODS)
+			{
+				ulChanges += (ucBest != ucLastBest);
+			}
+			ucLastBest = ucBest;
+		}
+
+		double dThroughput = (double)ulDelivered * 1e6 / ((double)TEST_CHECK_PERIODS * TEST_PERIOD_US);
+		double dBest = best_throughput(pxSegment->icRssi);
+
+		printf("rssi %4d%s: best rate %2u (%5u kbps), %6.0f of %6.0f packets/s, loss %4.1f%%, probes %4.1f%%, "
+		       "changes %u\n",
+		       (int)pxSegment->icRssi,
+		       pxSegment->ucReported ? " reported" : "         ",
+		       (unsigned)ucLastBest,
+		       (unsigned)ulWirelessRateKbps(ucLastBest),
+		       dThroughput,
+		       dBest,
+		       100.0 * (double)(ulPackets - ulDelivered) / (double)ulPackets,
+		       100.0 * (double)ulProbes / (double)ulPackets,
+		       (unsigned)ulChanges);
+
+		TEST_CHECK(ucLastBest >= pxSegment->ucExpectedMin);
+		TEST_CHECK(dThroughput >= (0.75 * dBest));
+		TEST_CHECK(ulChanges <= 4);
+		// Probes are every 16th packet, except when neighbour rates are out of reach of the signal level
+		TEST_CHECK((ulProbes * 16) <= (ulPackets + 16));
+		TEST_CHECK(!neighbour_usable(ucLastBest, xRate.icRssi) || ((ulProbes * 20) >= ulPackets));
+	}
+}
+
+
+// Reported signal level alone limits the rates
+static void
+test_rssi(void)
+{
+	wireless_rate_t xRate;
+
+	TEST_CHECK(ulWirelessRateKbps(WIRELESS_RATE_NUM) == 0);
+
+	for(int32_t lRssi = -40; lRssi >= -110; lRssi--)
+	{
+		uint8_t ucMaxUsable = 0;
+
+		for(uint8_t r = 0; r < WIRELESS_RATE_NUM; r++)
+		{
+			ucMaxUsable = rate_usable(r, (int8_t)lRssi) ? r : ucMaxUsable;
+		}
+
+		vWirelessRateInit(&xRate, WIRELESS_RATE_MCS7);
+		vWirelessRateSetRssi(&xRate, (int8_t)lRssi);
+
+		// Best rate goes down to the first usable one at once
+		TEST_CHECK(ucWirelessRateGetBest(&xRate) == ucMaxUsable);
+
+		for(uint32_t n = 0; n < 1000; n++)
+		{
+			uint8_t ucRate = ucWirelessRateSelect(&xRate);
+			TEST_CHECK(rate_usable(ucRate, (int8_t)lRssi));
+			vWirelessRateReport(&xRate, ucRate, 1);
+
+			if((n % 100) == 99)
+			{
+				TEST_CHECK(rate_usable(ucWirelessRateUpdate(&xRate), (int8_t)lRssi));
+			}
+		}
+	}
+}
+
+
+static void
+bench(void)
+{
+	wireless_rate_t xRate;
+	uint32_t ulSum = 0;
+
+	vWirelessRateInit(&xRate, WIRELESS_RATE_MCS3);
+	vWirelessRateSetRssi(&xRate, -70);
+
+	uint64_t ullStart = ullTestTimeNs();
+
+	for(uint32_t n = 0; n < TEST_BENCH_PACKETS; n++)
+	{
+		uint8_t ucRate = ucWirelessRateSelect(&xRate);
+		vWirelessRateReport(&xRate, ucRate, (n & 15) != 0);
+		ulSum += ucRate;
+
+		if((n & 1023) == 1023)
+		{
+			ulSum += ucWirelessRateUpdate(&xRate);
+		}
+	}
+
+	uint64_t ullTime = ullTestTimeNs() - ullStart;
+
+	printf("%.2f ns per packet select and report, update every 1024 packets included (%u)\n",
+	       (double)ullTime / TEST_BENCH_PACKETS,
+	       (unsigned)(ulSum & 1));
+}
+
+// ----------------------------------------------------------------------
+// Test
+
+int
+main(void)
+{
+	test_trace();
+	test_rssi();
+	bench();
+
+	return 0;
+}
@@ -0,0 +1,299 @@
+/**
+ * @file tjpgd_variant.c
+ *
+ * Decode from the memory with one build of tjpgd.c, see tjpgd_variant.h
+ */
+
+#include "tjpgd_variant.h"
+#include "tjpg_decoder/tjpgd.h"
+//
+#include <stdint.h>
+#include <string.h>
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+typedef struct
+{
+	const uint8_t* pucJpg;
+	size_t xSize;
+	size_t xOffset;
+	tjpgd_image_t* pxImage;
+} tjpgd_variant_src_t;
+
+// ----------------------------------------------------------------------
+// Variables
+
+static uint8_t ucPool[TJPGD_WORKSPACE_SIZE] __attribute__((aligned(4)));
+static uint8_t ucClonePool[JD_CLONE_POOL_SIZE] __attribute__((aligned(4)));
+// Copy of image what is decoded in place, see jd_rewind_mem()
+static uint8_t ucMemData[256 * 1024];
+static JMCU xMcu;
+static uint32_t* pulIdctClasses;
+
+// Decoder what is prepared only for new image, like Receiver does only for new Jpg header
+static uint8_t ucReusePool[TJPGD_WORKSPACE_SIZE] __attribute__((aligned(4)));
+static JDEC xReuseJdec;
+static const uint8_t* pucReuseJpg;
+static size_t xReuseSize;
+static size_t xReuseOffset;
+
+// ----------------------------------------------------------------------
+// Static functions
+
+static uint32_t
+jpg_input(JDEC* jdec, uint8_t* pucBuf, uint32_t ulLen)
+{
+	tjpgd_variant_src_t* pxSrc = (tjpgd_variant_src_t*)jdec->device;
+	size_t xLeft = pxSrc->xSize - pxSrc->xOffset;
+
+	if(ulLen > xLeft)
+	{
+		ulLen = (uint32_t)xLeft;
+	}
+
+	if(pucBuf)
+	{
+		memcpy(pucBuf, &pxSrc->pucJpg[pxSrc->xOffset], ulLen);
+	}
+
+	pxSrc->xOffset += ulLen;
+	return ulLen;
+}
+
+
+static uint32_t
+jpg_output(JDEC* jdec, void* pvBitmap, JRECT* pxRect)
+{
+	tjpgd_variant_src_t* pxSrc = (tjpgd_variant_src_t*)jdec->device;
+	tjpgd_image_t* pxImage = pxSrc->pxImage;
+	// Clipped MCU at right/bottom edge keeps full MCU stride
+	uint32_t ulStride = jdec->msx * 8;
+
+	for(uint32_t y = pxRect->top; y <= pxRect->bottom; y++)
+	{
+		uint16_t* pusDst = &pxImage->usPixels[y * pxImage->usWidth + pxRect->left];
+
+#if JD_FORMAT == 0
+		// RGB888 is packed like firmware did before RGB565 was made by the decoder
+		const uint8_t* pucRgb = (const uint8_t*)pvBitmap + (y - pxRect->top) * ulStride * 3;
+
+		for(uint32_t x = pxRect->left; x <= pxRect->right; x++, pucRgb += 3)
+		{
+			uint16_t usPixel = (uint16_t)(((pucRgb[0] & 0xF8) << 8) | ((pucRgb[1] & 0xFC) << 3) | (pucRgb[2] >> 3));
+			*pusDst++ = (uint16_t)((usPixel << 8) | (usPixel >> 8));
+		}
+#else
+		memcpy(pusDst,
+		       (const uint16_t*)pvBitmap + (y - pxRect->top) * ulStride,
+		       (pxRect->right - pxRect->left + 1) * sizeof(uint16_t));
+#endif
+	}
+
+	++pxImage->ulMcus;
+	return 1;
+}
+
+
+static JMCU*
+mcu_count(JDEC* jdec, JMCU* pxMcu)
+{
+	if(pxMcu)
+	{
+		uint32_t ulBlocks = jdec->msx * jdec->msy + ((jdec->ncomp == 3) ? 2 : 0);
+
+		for(uint32_t i = 0; i < ulBlocks; i++)
+		{
+			++pulIdctClasses[(pxMcu->idctmap >> (i * 2)) & 3];
+		}
+	}
+
+	return &xMcu;
+}
+
+// ----------------------------------------------------------------------
+// Core functions
+
+int32_t
+TJPGD_VARIANT_NAME(lTjpgdDecode)(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage)
+{
+	tjpgd_variant_src_t xSrc = {.pucJpg = pucJpg, .xSize = xSize, .xOffset = 0, .pxImage = pxImage};
+	JDEC xJdec;
+	JRESULT xRes = jd_prepare(&xJdec, jpg_input, ucPool, sizeof(ucPool), &xSrc);
+
+	if(xRes != JDR_OK)
+	{
+		return xRes;
+	}
+
+	if((xJdec.width > TJPGD_IMAGE_WIDTH_MAX) || (xJdec.height > TJPGD_IMAGE_HEIGHT_MAX))
+	{
+		return JDR_PAR;
+	}
+
+	pxImage->usWidth = (uint16_t)xJdec.width;
+	pxImage->usHeight = (uint16_t)xJdec.height;
+	pxImage->ulMcus = 0;
+	xJdec.bayer = ucBayer;
+	xJdec.scale = 0;
+
+	return jd_decomp(&xJdec, jpg_output);
+}
+
+
+int32_t
+TJPGD_VARIANT_NAME(lTjpgdDecodeMem)(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage)
+{
+	tjpgd_variant_src_t xSrc = {.pucJpg = pucJpg, .xSize = xSize, .xOffset = 0, .pxImage = pxImage};
+	JDEC xJdec;
+	JRESULT xRes = jd_prepare(&xJdec, jpg_input, ucPool, sizeof(ucPool), &xSrc);
+
+	if(xRes != JDR_OK)
+	{
+		return xRes;
+	}
+
+	if((xJdec.width > TJPGD_IMAGE_WIDTH_MAX) || (xJdec.height > TJPGD_IMAGE_HEIGHT_MAX) || (xSize > sizeof(ucMemData)))
+	{
+		return JDR_PAR;
+	}
+
+	pxImage->usWidth = (uint16_t)xJdec.width;
+	pxImage->usHeight = (uint16_t)xJdec.height;
+	pxImage->ulMcus = 0;
+	xJdec.bayer = ucBayer;
+	xJdec.scale = 0;
+
+	// Data after SOS what was read together with the header is dropped, like Receiver does
+	size_t xOffset = xSrc.xOffset - (size_t)(xJdec.dpend - xJdec.dptr - 1);
+
+	memcpy(ucMemData, pucJpg, xSize);
+	jd_rewind_mem(&xJdec, &ucMemData[xOffset], xSize - xOffset);
+
+	return jd_decomp(&xJdec, jpg_output);
+}
+
+
+int32_t
+TJPGD_VARIANT_NAME(lTjpgdDecodeReuse)(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage)
+{
+	tjpgd_variant_src_t xSrc = {.pucJpg = pucJpg, .xSize = xSize, .xOffset = 0, .pxImage = pxImage};
+
+	if((pucJpg != pucReuseJpg) || (xSize != xReuseSize))
+	{
+		JRESULT xRes = jd_prepare(&xReuseJdec, jpg_input, ucReusePool, sizeof(ucReusePool), &xSrc);
+
+		pucReuseJpg = NULL;
+		if(xRes != JDR_OK)
+		{
+			return xRes;
+		}
+
+		if((xReuseJdec.width > TJPGD_IMAGE_WIDTH_MAX) || (xReuseJdec.height > TJPGD_IMAGE_HEIGHT_MAX) ||
+		   (xSize > sizeof(ucMemData)))
+		{
+			return JDR_PAR;
+		}
+
+		pucReuseJpg = pucJpg;
+		xReuseSize = xSize;
+		xReuseOffset = xSrc.xOffset - (size_t)(xReuseJdec.dpend - xReuseJdec.dptr - 1);
+	}
+
+	pxImage->usWidth = (uint16_t)xReuseJdec.width;
+	pxImage->usHeight = (uint16_t)xReuseJdec.height;
+	pxImage->ulMcus = 0;
+	xReuseJdec.device = &xSrc;
+	xReuseJdec.bayer = ucBayer;
+	xReuseJdec.scale = 0;
+
+	memcpy(ucMemData, pucJpg, xSize);
+	jd_rewind_mem(&xReuseJdec, &ucMemData[xReuseOffset], xSize - xReuseOffset);
+
+	return jd_decomp(&xReuseJdec, jpg_output);
+}
+
+
+int32_t
+TJPGD_VARIANT_NAME(lTjpgdPrepare)(const uint8_t* pucJpg, size_t xSize)
+{
+	tjpgd_variant_src_t xSrc = {.pucJpg = pucJpg, .xSize = xSize, .xOffset = 0, .pxImage = NULL};
+	JDEC xJdec;
+
+	return jd_prepare(&xJdec, jpg_input, ucPool, sizeof(ucPool), &xSrc);
+}
+
+
+int32_t
+TJPGD_VARIANT_NAME(lTjpgdDecodeSlices)(const uint8_t* pucJpg,
+                                       size_t xSize,
+                                       uint8_t ucBayer,
+                                       const uint32_t* pulOffsets,
+                                       uint32_t ulSlices,
+                                       tjpgd_image_t* pxImage)
+{
+	tjpgd_variant_src_t xSrc = {.pucJpg = pucJpg, .xSize = xSize, .xOffset = 0, .pxImage = pxImage};
+	tjpgd_variant_src_t xCloneSrc = xSrc;
+	JDEC xJdec;
+	JDEC xClone;
+	JRESULT xRes = jd_prepare(&xJdec, jpg_input, ucPool, sizeof(ucPool), &xSrc);
+
+	if(xRes != JDR_OK)
+	{
+		return xRes;
+	}
+
+	if((xJdec.width > TJPGD_IMAGE_WIDTH_MAX) || (xJdec.height > TJPGD_IMAGE_HEIGHT_MAX))
+	{
+		return JDR_PAR;
+	}
+
+	pxImage->usWidth = (uint16_t)xJdec.width;
+	pxImage->usHeight = (uint16_t)xJdec.height;
+	pxImage->ulMcus = 0;
+	// jd_decomp() moves to the next pattern before the image, slices are output with the same one
+	xJdec.bayer = (ucBayer + 1) & 7;
+	xJdec.scale = 0;
+
+	// Decoding in place rewrites stuffed bytes, so the caller's image is kept as it is
+	if(xSize > sizeof(ucMemData))
+	{
+		return JDR_PAR;
+	}
+	memcpy(ucMemData, pucJpg, xSize);
+
+	// Slices go to both decoders in turn, like to both cores of Receiver
+	xRes = jd_clone(&xClone, &xJdec, ucClonePool, sizeof(ucClonePool), &xCloneSrc);
+
+	for(uint32_t i = 0; (i < ulSlices) && (xRes == JDR_OK); i++)
+	{
+		JDEC* pxJdec = (i & 1) ? &xClone : &xJdec;
+
+		if(!pulOffsets[i])
+		{
+			continue;
+		}
+
+		jd_rewind_mem(pxJdec, &ucMemData[pulOffsets[i]], xSize - pulOffsets[i]);
+		xRes = jd_decomp_slice(pxJdec, jpg_output, (uint16_t)i);
+	}
+
+	return xRes;
+}
+
+
+int32_t
+TJPGD_VARIANT_NAME(lTjpgdCountIdct)(const uint8_t* pucJpg, size_t xSize, uint32_t* pulClasses)
+{
+	tjpgd_variant_src_t xSrc = {.pucJpg = pucJpg, .xSize = xSize, .xOffset = 0, .pxImage = NULL};
+	JDEC xJdec;
+	JRESULT xRes = jd_prepare(&xJdec, jpg_input, ucPool, sizeof(ucPool), &xSrc);
+
+	if(xRes != JDR_OK)
+	{
+		return xRes;
+	}
+
+	pulIdctClasses = pulClasses;
+	return jd_decomp_mcus(&xJdec, mcu_count);
+}
@@ -0,0 +1,126 @@
+/**
+ * @file tjpgd_variant.h
+ *
+ * Jpg decoder built several times with different configuration into the same test binary.
+ * Public symbols of tjpgd.c get suffix of the build, so builds are linked together and compared.
+ * Included into tjpgd.c of each build by the compiler, see fpv_tjpgd_variant() in CMakeLists.txt.
+ */
+
+#ifndef _TJPGD_VARIANT_H
+#define _TJPGD_VARIANT_H
+
+//
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ----------------------------------------------------------------------
+// Definitions, type & enum declaration
+
+#define TJPGD_VARIANT_CAT2(name, variant) name##_##variant
+#define TJPGD_VARIANT_CAT(name, variant)  TJPGD_VARIANT_CAT2(name, variant)
+
+#ifdef TJPGD_VARIANT
+#define TJPGD_VARIANT_NAME(name) TJPGD_VARIANT_CAT(name, TJPGD_VARIANT)
+
+#define jd_prepare      TJPGD_VARIANT_NAME(jd_prepare)
+#define jd_rewind       TJPGD_VARIANT_NAME(jd_rewind)
+#define jd_rewind_mem   TJPGD_VARIANT_NAME(jd_rewind_mem)
+#define jd_decomp       TJPGD_VARIANT_NAME(jd_decomp)
+#define jd_decomp_mcus  TJPGD_VARIANT_NAME(jd_decomp_mcus)
+#define jd_output_mcu   TJPGD_VARIANT_NAME(jd_output_mcu)
+#define jd_clone        TJPGD_VARIANT_NAME(jd_clone)
+#define jd_decomp_slice TJPGD_VARIANT_NAME(jd_decomp_slice)
+#endif
+
+// Biggest image what tests decode
+#define TJPGD_IMAGE_WIDTH_MAX  (320)
+#define TJPGD_IMAGE_HEIGHT_MAX (240)
+
+typedef struct
+{
+	uint16_t usWidth;
+	uint16_t usHeight;
+	uint32_t ulMcus;                                                  // Amount of decoded MCUs
+	uint16_t usPixels[TJPGD_IMAGE_WIDTH_MAX * TJPGD_IMAGE_HEIGHT_MAX]; // Byte swapped RGB565, as decoder makes it
+} tjpgd_image_t;
+
+/**
+ * @brief Decode whole Jpg image from the memory
+ *
+ * @param pucJpg Jpg file
+ * @param xSize Amount of bytes in pucJpg
+ * @param ucBayer Output bayer pattern, see JDEC.bayer
+ * @param pxImage Where to store decoded image
+ *
+ * @retval JRESULT of the decoder, 0 on success
+ */
+typedef int32_t (*tjpgd_variant_decode_t)(const uint8_t* pucJpg,
+                                          size_t xSize,
+                                          uint8_t ucBayer,
+                                          tjpgd_image_t* pxImage);
+
+// Builds of tjpgd.c, see CMakeLists.txt
+int32_t lTjpgdDecode_ref(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage);
+int32_t lTjpgdDecode_float(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage);
+int32_t lTjpgdDecode_fullidct(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage);
+int32_t lTjpgdDecode_fast1(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage);
+
+// The same, but entropy coded data is decoded in place like Receiver does, see jd_rewind_mem()
+int32_t lTjpgdDecodeMem_ref(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage);
+int32_t lTjpgdDecodeMem_fast1(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage);
+
+/**
+ * @brief The same as lTjpgdDecodeMem_ref(), but decoder is prepared only when another image is passed,
+ *        like Receiver does only for new Jpg header. Otherwise tables are reused, see jd_rewind_mem().
+ */
+int32_t lTjpgdDecodeReuse_ref(const uint8_t* pucJpg, size_t xSize, uint8_t ucBayer, tjpgd_image_t* pxImage);
+
+/**
+ * @brief Parse Jpg header and build Huffman and quantizer tables only, see jd_prepare()
+ *
+ * @param pucJpg Jpg file
+ * @param xSize Amount of bytes in pucJpg
+ *
+ * @retval JRESULT of the decoder, 0 on success
+ */
+int32_t lTjpgdPrepare_ref(const uint8_t* pucJpg, size_t xSize);
+
+/**
+ * @brief Decode restart intervals of Jpg image from the memory, each of them on it's own
+ *
+ * @param pucJpg Jpg file with restart interval
+ * @param xSize Amount of bytes in pucJpg
+ * @param ucBayer Output bayer pattern, the same as @ref ''tjpgd_variant_decode_t'' uses
+ * @param pulOffsets Offset of each interval in pucJpg, 0 if interval is lost and it's not decoded
+ * @param ulSlices Amount of intervals in pulOffsets
+ * @param pxImage Where to store decoded image, pixels of lost intervals are not changed
+ *
+ * @retval JRESULT of the decoder, 0 on success
+ */
+int32_t lTjpgdDecodeSlices_ref(const uint8_t* pucJpg,
+                               size_t xSize,
+                               uint8_t ucBayer,
+                               const uint32_t* pulOffsets,
+                               uint32_t ulSlices,
+                               tjpgd_image_t* pxImage);
+
+/**
+ * @brief Decode entropy coded data only and count blocks of each IDCT size, see JMCU.idctmap
+ *
+ * @param pucJpg Jpg file
+ * @param xSize Amount of bytes in pucJpg
+ * @param pulClasses Where to add amount of DC only, 2x2, 4x4 and full blocks
+ *
+ * @retval JRESULT of the decoder, 0 on success
+ */
+int32_t lTjpgdCountIdct_ref(const uint8_t* pucJpg, size_t xSize, uint32_t* pulClasses);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _TJPGD_VARIANT_H */